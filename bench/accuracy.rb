@@ -0,0 +1,351 @@
+#! /usr/bin/env ruby
+# coding: utf-8
+
+#
+# Spectrum analyzer for WAV file
+#
+#   Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+#
+
+require 'optparse'
+require 'json'
+require 'tmpdir'
+
+$LOAD_PATH.unshift(File.expand_path("../lib", __dir__))
+$LOAD_PATH.unshift(__dir__)
+
+require 'wavspa/version'
+require 'wavspa/wavfft/preset'
+require 'wavspa/wavlet/preset'
+require 'wavspa/fft'
+require 'wavspa/wavelet'
+require 'wavspa/fb'
+require 'wavspa/wavmap'
+require 'wavspa/cache'
+require 'synth'
+
+module WavSpectrumAnalyzer
+  module Bench
+    #
+    # 近似モードの精度評価
+    #   現行の倍精度の fft_calc_* / walet_calc_* の出力を基準とし、各モード
+    #   の出力との dB 誤差と、FrameBuffer で量子化した画素値の差を求める
+    #
+    module Accuracy
+      RATE    = 44100
+      LENGTHS = {:fft => 1, :wavelet => 0.5}
+      KINDS   = %i[power amplitude]
+
+      #
+      # 評価対象のモード
+      #   :run には評価条件(基準出力を含む)を受け取り、基準出力と同じ形式
+      #   ({:power => カラム列, :amplitude => カラム列}、各カラムはdoubleの
+      #   String)を返すブロックを指定する。:tolerance は許容誤差
+      #   (dB誤差の最大値とRMS、画素値の差の最大値)で、超えた場合は失敗と
+      #   する。新しい近似モードはここに追加すること。
+      #
+      MODES = {
+        "float32-output" => {
+          :tolerance => {:max_db => 0.001, :rms_db => 0.0001, :pixel => 1},
+          :run       => ->(ctx) {
+            columns(ctx, :float32)
+          },
+        },
+
+        "cache-float32" => {
+          :tolerance => {:max_db => 0.001, :rms_db => 0.0001, :pixel => 1},
+          :run       => ->(ctx) {
+            through_cache(ctx, :FLOAT32)
+          },
+        },
+
+        "cache-float16" => {
+          :tolerance => {:max_db => 0.5, :rms_db => 0.05, :pixel => 1},
+          :run       => ->(ctx) {
+            through_cache(ctx, :FLOAT16)
+          },
+        },
+      }
+
+      #
+      # 評価条件
+      #
+      Context = Struct.new(:analyzer, :param, :wav, :usize, :nblk,
+                           :reference, :dir)
+
+      class << self
+        def unit_size(analyzer, param, rate)
+          if analyzer == :fft
+            return (rate / 100) * param[:unit_time]
+          else
+            return (rate * param[:unit_time]) / 1000
+          end
+        end
+
+        #
+        # 現行の経路で全カラムを計算する (変換1回につき power と amplitude
+        # の両方を取り出す。typeに :float32 を指定した場合は単精度で受け取って
+        # doubleに戻す)
+        #
+        def columns(ctx, type = nil)
+          param = ctx.param
+
+          if ctx.analyzer == :fft
+            an = FFT.new(ctx.wav.format, param[:fft_size])
+            an.window     = param[:window_function]
+            an.width      = param[:output_width]
+            an.scale_mode = param[:scale_mode]
+            an.frequency  = [ctx.wav.sample_rate, *param[:range]]
+
+          else
+            an = Wavelet.new
+            an.frequency       = ctx.wav.sample_rate
+            an.sigma           = param[:sigma]
+            an.gabor_threshold = param[:threshold]
+            an.range           = (param[:range][0] .. param[:range][1])
+            an.scale_mode      = param[:scale_mode]
+            an.width           = param[:output_width]
+            an.put_in(ctx.wav, 0)
+          end
+
+          ret = KINDS.map { |kind| [kind, []] }.to_h
+
+          ctx.nblk.times { |col|
+            if ctx.analyzer == :fft
+              an.enqueue(ctx.wav, col * ctx.usize, ctx.usize, 0)
+            else
+              an.transform(col * ctx.usize)
+            end
+
+            KINDS.each { |kind|
+              dat = an.send(kind, nil, type || :float64)
+              dat = dat.unpack("e*").pack("d*") if type == :float32
+              ret[kind] << dat
+            }
+          }
+
+          return ret
+        end
+
+        #
+        # 基準出力をスペクトラムキャッシュに書き出して読み戻す
+        #
+        def through_cache(ctx, type)
+          return KINDS.map { |kind|
+            [kind, through_cache1(ctx, kind, type)]
+          }.to_h
+        end
+
+        def through_cache1(ctx, kind, type)
+          path = File.join(ctx.dir, "accuracy.spc")
+
+          writer = CacheWriter.new(path, ctx.param[:output_width],
+                                   :sample_type => type,
+                                   :plot_mode => kind.upcase,
+                                   :scale_mode => ctx.param[:scale_mode],
+                                   :sample_rate => ctx.wav.sample_rate,
+                                   :unit_size => ctx.usize,
+                                   :range => ctx.param[:range])
+
+          ctx.reference[kind].each { |dat| writer << dat }
+          writer.close
+
+          reader = CacheReader.new(path)
+          ret    = Array.new(reader.columns) { |col| reader.read(col) }
+          reader.close
+
+          return ret
+
+        ensure
+          File.unlink(path) if File.exist?(path)
+        end
+
+        #
+        # 値をdBに揃える (powerは振幅値なので20log10を取る)
+        #   floor未満(無音や単精度の下限を下回った値)はfloorに丸める
+        #
+        def to_db(kind, vals, floor)
+          return vals.map { |v|
+            if kind == :power
+              v = (v > 0.0)? 20.0 * Math.log10(v): floor
+            end
+
+            (v.nan? or v < floor)? floor: v
+          }
+        end
+
+        def db_error(ctx, kind, cols, floor)
+          max = 0.0
+          sum = 0.0
+          n   = 0
+
+          ctx.reference[kind].zip(cols) { |ref, dat|
+            a = to_db(kind, ref.unpack("d*"), floor)
+            b = to_db(kind, dat.unpack("d*"), floor)
+
+            a.zip(b) { |x, y|
+              d    = (x - y).abs
+              max  = d if d > max
+              sum += d * d
+              n   += 1
+            }
+          }
+
+          return max, Math.sqrt(sum / n)
+        end
+
+        def render(ctx, kind, cols)
+          param = ctx.param
+          fb    = FrameBuffer.new(ctx.nblk, param[:output_width],
+                                  :column_step => param[:col_step],
+                                  :ceil => param[:ceil],
+                                  :floor => param[:floor],
+                                  :luminance => param[:luminance])
+
+          cols.each_with_index { |dat, col|
+            if kind == :power
+              fb.draw_power(col, dat)
+            else
+              fb.draw_amplitude(col, dat)
+            end
+          }
+
+          return fb.to_s.unpack("C*")
+        end
+
+        #
+        # 量子化後の画素値の差 (最大値と、値が変わった画素の割合)
+        #
+        def pixel_error(ctx, kind, cols)
+          a    = render(ctx, kind, ctx.reference[kind])
+          b    = render(ctx, kind, cols)
+          max  = 0
+          diff = 0
+
+          a.each_slice(3).zip(b.each_slice(3)) { |p, q|
+            d    = p.zip(q).map { |x, y| (x - y).abs }.max
+            max  = d if d > max
+            diff += 1 if d > 0
+          }
+
+          return max, diff.to_f / (a.size / 3)
+        end
+
+        def check(stat, tol)
+          return (stat["max_db"] <= tol[:max_db] and
+                  stat["rms_db"] <= tol[:rms_db] and
+                  stat["pixel_max"] <= tol[:pixel])
+        end
+
+        def run(opts)
+          presets = {
+            :fft     => FFTApp::PRESET_TABLE,
+            :wavelet => WaveLetApp::PRESET_TABLE,
+          }
+
+          results = []
+          nfail   = 0
+
+          Dir.mktmpdir("wavspa-accuracy") { |dir|
+            opts[:signals].each { |sig|
+              opts[:analyzers].each { |analyzer|
+                sec  = LENGTHS[analyzer]
+                path = File.join(dir, "#{sig}.wav")
+                Synth.write(path, sig, RATE, sec)
+
+                wav   = WavMap.new(path)
+                param = presets[analyzer][opts[:preset]]
+                raise ArgumentError, "unknown preset #{opts[:preset]}" if not param
+
+                usize = unit_size(analyzer, param, RATE)
+
+                ctx   = Context.new(analyzer, param, wav, usize,
+                                    wav.frames / usize, nil, dir)
+                ctx.reference = columns(ctx)
+
+                MODES.each { |name, mode|
+                  next if opts[:modes] and not opts[:modes].include?(name)
+
+                  out = mode[:run].(ctx)
+
+                  KINDS.each { |kind|
+                    max_db, rms_db  = db_error(ctx, kind, out[kind], opts[:floor])
+                    pix_max, pix_rt = pixel_error(ctx, kind, out[kind])
+
+                    ent = {
+                      "analyzer"     => analyzer.to_s,
+                      "preset"       => opts[:preset],
+                      "signal"       => sig.to_s,
+                      "kind"         => kind.to_s,
+                      "mode"         => name,
+                      "max_db"       => max_db,
+                      "rms_db"       => rms_db,
+                      "pixel_max"    => pix_max,
+                      "pixel_ratio"  => pix_rt,
+                    }
+                    ent["pass"] = check(ent, mode[:tolerance])
+                    nfail += 1 if not ent["pass"]
+                    results << ent
+
+                    printf("%-8s %-8s %-10s %-16s %10.6f %10.6f %4d %8.4f%% %s\n",
+                           analyzer, sig, kind, name, max_db, rms_db,
+                           pix_max, pix_rt * 100, (ent["pass"])? "": "FAIL")
+                  }
+                }
+
+                wav.close
+                File.unlink(path)
+              }
+            }
+          }
+
+          ret = {
+            "version"   => VERSION,
+            "rate"      => RATE,
+            "floor_db"  => opts[:floor],
+            "tolerance" => MODES.map { |name, mode|
+              [name, mode[:tolerance].transform_keys(&:to_s)]
+            }.to_h,
+            "results"   => results,
+          }
+
+          return ret, nfail
+        end
+      end
+    end
+  end
+end
+
+if $0 == __FILE__
+  opts = {
+    :signals   => WavSpectrumAnalyzer::Bench::Synth::SIGNALS,
+    :analyzers => [:fft, :wavelet],
+    :preset    => "default",
+    :modes     => nil,
+    :floor     => -120.0,
+    :output    => nil,
+  }
+
+  OptionParser.new { |opt|
+    opt.on("-o", "--output=FILE", String) { |v| opts[:output] = v }
+    opt.on("--signals=LIST", Array) { |v| opts[:signals] = v.map(&:to_sym) }
+    opt.on("--analyzers=LIST", Array) { |v| opts[:analyzers] = v.map(&:to_sym) }
+    opt.on("--preset=NAME", String) { |v| opts[:preset] = v }
+    opt.on("--modes=LIST", Array) { |v| opts[:modes] = v }
+    opt.on("--floor=DB", Float) { |v| opts[:floor] = v }
+
+    opt.parse!(ARGV)
+  }
+
+  printf("%-8s %-8s %-10s %-16s %10s %10s %4s %9s\n",
+         "analyzer", "signal", "kind", "mode", "max dB", "rms dB",
+         "pix", "changed")
+
+  result, nfail = WavSpectrumAnalyzer::Bench::Accuracy.run(opts)
+
+  if opts[:output]
+    File.write(opts[:output], JSON.pretty_generate(result) + "\n")
+  end
+
+  exit(1) if nfail > 0
+end
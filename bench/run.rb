@@ -0,0 +1,396 @@
+#! /usr/bin/env ruby
+# coding: utf-8
+
+#
+# Spectrum analyzer for WAV file
+#
+#   Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+#
+
+require 'optparse'
+require 'json'
+require 'tmpdir'
+require 'etc'
+
+$LOAD_PATH.unshift(File.expand_path("../lib", __dir__))
+$LOAD_PATH.unshift(__dir__)
+
+require 'wavspa/version'
+require 'wavspa/wavfft/preset'
+require 'wavspa/wavlet/preset'
+require 'wavspa/fft'
+require 'wavspa/wavelet'
+require 'wavspa/fb'
+require 'wavspa/wavmap'
+require 'wavspa/render'
+require 'synth'
+
+module WavSpectrumAnalyzer
+  module Bench
+    RATES   = [44100, 96000, 192000]
+
+    #
+    # 入力の長さ(秒)
+    #   Waveletは1カラムあたりの計算量が大きい(窓長がサンプリング周波数に
+    #   比例する)ので、FFTより短い入力で計測する
+    #
+    LENGTHS = {
+      :fft     => [1, 4],
+      :wavelet => [0.1, 0.5],
+    }
+
+    class << self
+      def now
+        return Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      #
+      # ハードウェアカウンタの準備 (使えない環境ではnilのまま)
+      #
+      def setup_perf
+        require 'wavspa/perf'
+
+        perf = PerfCounter.new
+        if perf.available?
+          @perf = perf
+        else
+          STDERR.print("warning: perf events are unavailable, " \
+                       "counters are not collected.\n")
+        end
+
+      rescue LoadError
+        STDERR.print("warning: wavspa/perf is not built, " \
+                     "counters are not collected.\n")
+      end
+
+      def perf_events
+        return (@perf)? @perf.events.map(&:to_s): []
+      end
+
+      #
+      # ブロックの実行時間を stage に積算する
+      #   (カウンタが有効なら、その値も @counters に積算する)
+      #
+      def measure(tbl, stage)
+        @perf.start if @perf
+
+        t0  = now
+        ret = yield
+        tbl[stage] = (tbl[stage] || 0.0) + (now - t0)
+
+        if @perf
+          acc = (@counters[stage] ||= {})
+          @perf.stop.each { |name, val|
+            acc[name] = (acc[name] || 0) + val if val
+          }
+        end
+
+        return ret
+      end
+
+      #
+      # カウンタ値から IPC と1単位(サンプルまたは画素)あたりの値を求める
+      #
+      def counter_report(acc, unit, units)
+        ret = acc.transform_keys(&:to_s)
+
+        if acc[:cycles] and acc[:instructions] and acc[:cycles] > 0
+          ret["ipc"] = acc[:instructions].to_f / acc[:cycles]
+        end
+
+        ret["unit"]     = unit.to_s
+        ret["units"]    = units
+        ret["per_unit"] = acc.map { |name, val|
+          [name.to_s, val.to_f / units]
+        }.to_h
+
+        return ret
+      end
+
+      def create_fb(param, nblk)
+        return FrameBuffer.new(nblk, param[:output_width],
+                               :column_step => param[:col_step],
+                               :ceil => param[:ceil],
+                               :floor => param[:floor],
+                               :luminance => param[:luminance])
+      end
+
+      def run_fft(wav, param, png)
+        ret   = {}
+        usize = (wav.sample_rate / 100) * param[:unit_time]
+        nblk  = wav.frames / usize
+        fb    = create_fb(param, nblk)
+        dat   = String.new
+
+        fft = FFT.new(wav.format, param[:fft_size])
+        fft.window     = param[:window_function]
+        fft.width      = param[:output_width]
+        fft.scale_mode = param[:scale_mode]
+        fft.frequency  = [wav.sample_rate, *param[:range]]
+
+        nblk.times { |col|
+          measure(ret, :transform) { fft.enqueue(wav, col * usize, usize, 0) }
+          measure(ret, :reduce) { fft.power(dat) }
+          measure(ret, :draw) { fb.draw_power(col, dat) }
+        }
+
+        measure(ret, :png) { fb.write_png(png) }
+
+        units = {
+          :transform => [:sample, nblk * usize],
+          :reduce    => [:pixel, nblk * param[:output_width]],
+          :draw      => [:pixel, nblk * param[:output_width] * param[:col_step]],
+          :png       => [:pixel, fb.width * fb.height],
+        }
+
+        return ret, nblk, units
+      end
+
+      def run_wavelet(wav, param, png)
+        ret   = {}
+        usize = (wav.sample_rate * param[:unit_time]) / 1000
+        nblk  = wav.frames / usize
+        fb    = create_fb(param, nblk)
+        dat   = String.new
+
+        wl = Wavelet.new
+        wl.frequency       = wav.sample_rate
+        wl.sigma           = param[:sigma]
+        wl.gabor_threshold = param[:threshold]
+        wl.range           = (param[:range][0] .. param[:range][1])
+        wl.scale_mode      = param[:scale_mode]
+        wl.width           = param[:output_width]
+
+        measure(ret, :import) { wl.put_in(wav, 0) }
+
+        nblk.times { |col|
+          measure(ret, :transform) { wl.transform(col * usize) }
+          measure(ret, :reduce) { wl.power(dat) }
+          measure(ret, :draw) { fb.draw_power(col, dat) }
+        }
+
+        measure(ret, :png) { fb.write_png(png) }
+
+        units = {
+          :import    => [:sample, wav.frames],
+          :transform => [:sample, nblk * usize],
+          :reduce    => [:pixel, nblk * param[:output_width]],
+          :draw      => [:pixel, nblk * param[:output_width] * param[:col_step]],
+          :png       => [:pixel, fb.width * fb.height],
+        }
+
+        return ret, nblk, units
+      end
+
+      #
+      # 1ケース分の計測 (各ステージについてrepeat回中の最小値を採る。
+      # カウンタの値は最小値となった回のものを採る)
+      #
+      def run_case(analyzer, param, path, png, repeat)
+        best = {}
+        ctrs = {}
+        cols = nil
+
+        repeat.times {
+          wav       = WavMap.new(path)
+          @counters = {}
+
+          if analyzer == :fft
+            tbl, cols, units = run_fft(wav, param, png)
+          else
+            tbl, cols, units = run_wavelet(wav, param, png)
+          end
+
+          measure(tbl, :render) {
+            WavSpectrumAnalyzer.render(wav, png, param.merge(:analyzer => analyzer.upcase))
+          }
+
+          units[:render] = [:sample, wav.frames]
+
+          wav.close
+
+          tbl.each { |stage, sec|
+            next if best[stage] and sec >= best[stage]
+
+            best[stage] = sec
+            if @counters[stage]
+              ctrs[stage] = counter_report(@counters[stage], *units[stage])
+            end
+          }
+        }
+
+        return best, cols, ctrs
+      end
+
+      def nyquist_ok?(param, rate)
+        return param[:range][1] <= rate / 2.0
+      end
+
+      def run(opts)
+        setup_perf if opts[:perf]
+
+        presets = {
+          :fft     => FFTApp::PRESET_TABLE,
+          :wavelet => WaveLetApp::PRESET_TABLE,
+        }
+
+        results = []
+
+        Dir.mktmpdir("wavspa-bench") { |dir|
+          png = File.join(dir, "out.png")
+
+          opts[:rates].product(opts[:signals]) { |rate, sig|
+            presets.each { |analyzer, table|
+              next if not opts[:analyzers].include?(analyzer)
+
+              opts[:lengths][analyzer].each { |sec|
+                path = File.join(dir, "#{sig}-#{rate}-#{sec}.wav")
+                Synth.write(path, sig, rate, sec) if not File.exist?(path)
+
+                table.each { |name, param|
+                  next if opts[:presets] and not opts[:presets].include?(name)
+
+                  ent = {
+                    "analyzer" => analyzer.to_s,
+                    "preset"   => name,
+                    "signal"   => sig.to_s,
+                    "rate"     => rate,
+                    "seconds"  => sec,
+                  }
+
+                  if not nyquist_ok?(param, rate)
+                    ent["skipped"] = "frequency range exceeds Nyquist frequency"
+                    results << ent
+                    next
+                  end
+
+                  STDERR.printf("%-40s", case_key(ent).join("/") + "s")
+
+                  best, cols, ctrs = run_case(analyzer, param, path, png,
+                                              opts[:repeat])
+
+                  ent["columns"]         = cols
+                  ent["stages"]          = best.transform_keys(&:to_s)
+                  ent["samples_per_sec"] = (rate * sec) / best[:render]
+                  ent["counters"]        = ctrs.transform_keys(&:to_s) if @perf
+                  results << ent
+
+                  STDERR.printf(" render %10.3f ms", best[:render] * 1000)
+                  if ctrs.dig(:transform, "ipc")
+                    STDERR.printf("  transform IPC %5.2f", ctrs[:transform]["ipc"])
+                  end
+                  STDERR.printf("\n")
+                }
+              }
+            }
+
+            Dir.glob(File.join(dir, "*.wav")).each { |f| File.unlink(f) }
+          }
+        }
+
+        return {
+          "version"   => VERSION,
+          "ruby"      => RUBY_DESCRIPTION,
+          "host"      => {
+            "nproc"   => Etc.nprocessors,
+            "uname"   => Etc.uname.values_at(:sysname, :release, :machine).join(" "),
+          },
+          "timestamp" => Time.now.utc.strftime("%Y-%m-%dT%H:%M:%SZ"),
+          "repeat"    => opts[:repeat],
+          "perf"      => perf_events,
+          "results"   => results,
+        }
+      end
+
+      def case_key(ent)
+        return ent.values_at("analyzer", "preset", "signal", "rate", "seconds")
+      end
+
+      #
+      # ベースラインとの比較 (閾値を超えて遅くなったステージの数を返す)
+      #
+      def compare(cur, base, threshold)
+        ret = 0
+        tbl = base["results"].map { |ent| [case_key(ent), ent] }.to_h
+
+        cur["results"].each { |ent|
+          next if ent["skipped"]
+
+          ref = tbl[case_key(ent)]
+          next if not ref or ref["skipped"]
+
+          ent["stages"].each { |stage, sec|
+            prev = ref["stages"][stage]
+            next if not prev or prev <= 0.0
+
+            diff = (sec - prev) / prev * 100.0
+            mark = (diff > threshold)? "REGRESSION": ""
+            ret += 1 if diff > threshold
+
+            printf("%-40s %-10s %10.3f ms -> %10.3f ms %+7.1f%% %s\n",
+                   case_key(ent).join("/") + "s", stage,
+                   prev * 1000, sec * 1000, diff, mark)
+          }
+        }
+
+        return ret
+      end
+    end
+  end
+end
+
+if $0 == __FILE__
+  opts = {
+    :rates     => WavSpectrumAnalyzer::Bench::RATES,
+    :lengths   => WavSpectrumAnalyzer::Bench::LENGTHS.dup,
+    :signals   => WavSpectrumAnalyzer::Bench::Synth::SIGNALS,
+    :analyzers => [:fft, :wavelet],
+    :presets   => nil,
+    :repeat    => 3,
+    :output    => nil,
+    :baseline  => nil,
+    :threshold => 10.0,
+    :perf      => false,
+  }
+
+  OptionParser.new { |opt|
+    opt.on("-o", "--output=FILE", String) { |v| opts[:output] = v }
+    opt.on("-b", "--baseline=FILE", String) { |v| opts[:baseline] = v }
+    opt.on("--threshold=PERCENT", Float) { |v| opts[:threshold] = v }
+    opt.on("-n", "--repeat=N", Integer) { |v| opts[:repeat] = v }
+    opt.on("--rates=LIST", Array) { |v| opts[:rates] = v.map(&:to_i) }
+    opt.on("--fft-lengths=LIST", Array) { |v|
+      opts[:lengths][:fft] = v.map(&:to_f)
+    }
+    opt.on("--wavelet-lengths=LIST", Array) { |v|
+      opts[:lengths][:wavelet] = v.map(&:to_f)
+    }
+    opt.on("--signals=LIST", Array) { |v| opts[:signals] = v.map(&:to_sym) }
+    opt.on("--analyzers=LIST", Array) { |v| opts[:analyzers] = v.map(&:to_sym) }
+    opt.on("--presets=LIST", Array) { |v| opts[:presets] = v }
+    opt.on("--perf") { opts[:perf] = true }
+
+    opt.on("--quick") {
+      opts[:rates]   = [44100]
+      opts[:lengths] = {:fft => [1], :wavelet => [0.1]}
+      opts[:repeat]  = 1
+    }
+
+    opt.parse!(ARGV)
+  }
+
+  result = WavSpectrumAnalyzer::Bench.run(opts)
+  json   = JSON.pretty_generate(result)
+
+  if opts[:output]
+    File.write(opts[:output], json + "\n")
+  else
+    puts json
+  end
+
+  if opts[:baseline]
+    base = JSON.parse(File.read(opts[:baseline]))
+    nreg = WavSpectrumAnalyzer::Bench.compare(result, base, opts[:threshold])
+    exit(1) if nreg > 0
+  end
+end
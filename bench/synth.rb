@@ -0,0 +1,82 @@
+#! /usr/bin/env ruby
+# coding: utf-8
+
+#
+# Spectrum analyzer for WAV file
+#
+#   Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+#
+
+module WavSpectrumAnalyzer
+  module Bench
+    #
+    # ベンチマーク用の合成信号 (16bit PCM, モノラル)
+    #   乱数も含めて毎回同じ内容になるので、結果を比較してよい
+    #
+    module Synth
+      SIGNALS   = %i[sweep noise chirp silence]
+      AMPLITUDE = 0.5
+
+      class << self
+        def samples(signal, rate, sec)
+          n = (rate * sec).to_i
+
+          case signal
+          when :sweep
+            # 20Hzから0.45fsまでの指数スイープ
+            f0 = 20.0
+            f1 = rate * 0.45
+            k  = Math.log(f1 / f0)
+            t1 = sec.to_f
+            ret = Array.new(n) { |i|
+              t = i.to_f / rate
+              AMPLITUDE * Math.sin(2 * Math::PI * f0 * t1 / k *
+                                   (Math.exp(t / t1 * k) - 1.0))
+            }
+
+          when :chirp
+            # 100Hzから0.4fsまで1秒周期で繰り返す線形チャープ
+            f0 = 100.0
+            f1 = rate * 0.4
+            ret = Array.new(n) { |i|
+              t = (i % rate).to_f / rate
+              AMPLITUDE * Math.sin(2 * Math::PI * (f0 * t + (f1 - f0) * t * t / 2))
+            }
+
+          when :noise
+            # xorshift32による一様乱数
+            x   = 2463534242
+            ret = Array.new(n) {
+              x ^= (x << 13) & 0xffffffff
+              x ^= x >> 17
+              x ^= (x << 5) & 0xffffffff
+              AMPLITUDE * ((x.to_f / 0xffffffff) * 2.0 - 1.0)
+            }
+
+          when :silence
+            ret = Array.new(n, 0.0)
+
+          else
+            raise ArgumentError, "unknown signal #{signal}"
+          end
+
+          return ret
+        end
+
+        def write(path, signal, rate, sec)
+          data = samples(signal, rate, sec).map { |v| (v * 32767).round }
+          data = data.pack("s<*")
+
+          File.open(path, "wb") { |f|
+            f.write(["RIFF", 36 + data.bytesize, "WAVE"].pack("a4Va4"))
+            f.write(["fmt ", 16, 1, 1, rate, rate * 2, 2, 16].pack("a4VvvVVvv"))
+            f.write(["data", data.bytesize].pack("a4V"))
+            f.write(data)
+          }
+
+          return path
+        end
+      end
+    end
+  end
+end
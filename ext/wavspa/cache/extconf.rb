@@ -0,0 +1,8 @@
+require 'mkmf'
+
+$INCFLAGS << " -I$(srcdir)/../common"
+
+have_library( "m")
+have_header("ruby/memory_view.h")
+
+create_makefile( "wavspa/cache")
@@ -0,0 +1,668 @@
+﻿/*
+ * Spectrum cache file interface for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "ruby.h"
+#include "spc.h"
+#include "rb_column.h"
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+#include "ruby/memory_view.h"
+#endif /* defined(HAVE_RUBY_MEMORY_VIEW_H) */
+
+#include <stdint.h>
+#include <string.h>
+
+#define N(x)                        (sizeof((x))/sizeof(*(x)))
+#define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
+#define ARGUMENT_ERROR(...)         rb_raise(rb_eArgError, __VA_ARGS__)
+#define EQ_STR(val,str)             (rb_to_id(val) == rb_intern(str))
+
+typedef struct {
+  spc_writer_t* wr;
+} rb_cache_writer_t;
+
+typedef struct {
+  spc_reader_t* rd;
+  int exported;     // as "number of exported memory views"
+  int orphaned;     // ビューを残したままオブジェクトが解放された
+
+  ssize_t shape[2];
+  ssize_t strides[2];
+} rb_cache_reader_t;
+
+static const char* opts_keys[] = {
+  "sample_type",      // {sym}
+  "plot_mode",        // {sym}
+  "scale_mode",       // {sym}
+  "sample_rate",      // {num}
+  "unit_size",        // {int}
+  "range",            // {Array}
+};
+
+static ID opts_ids[N(opts_keys)];
+
+static void
+rb_cache_writer_free(void* _ptr)
+{
+  rb_cache_writer_t* ptr;
+
+  ptr = (rb_cache_writer_t*)_ptr;
+
+  if (ptr->wr != NULL) spc_writer_destroy(ptr->wr);
+
+  free(ptr);
+}
+
+static size_t
+rb_cache_writer_size(const void* _ptr)
+{
+  size_t ret;
+  rb_cache_writer_t* ptr;
+
+  ptr = (rb_cache_writer_t*)_ptr;
+  ret = sizeof(*ptr);
+
+  if (ptr->wr != NULL) {
+    ret += sizeof(*ptr->wr) + (sizeof(float) * ptr->wr->hdr.height);
+  }
+
+  return ret;
+}
+
+static const struct rb_data_type_struct cache_writer_data_type = {
+  .wrap_struct_name = "Spectrum cache writer for WAV file spectrum analyzer",
+  .function = {
+    .dfree = rb_cache_writer_free,
+    .dsize = rb_cache_writer_size,
+  },
+};
+
+static void
+rb_cache_reader_free(void* _ptr)
+{
+  rb_cache_reader_t* ptr;
+
+  ptr = (rb_cache_reader_t*)_ptr;
+
+  /*
+   * 終了処理ではビューより先にオブジェクトが解放されることがあるので、
+   * その場合は最後のビューの解放時に後始末する
+   */
+  if (ptr->exported) {
+    ptr->orphaned = !0;
+
+  } else {
+    if (ptr->rd != NULL) spc_reader_destroy(ptr->rd);
+    free(ptr);
+  }
+}
+
+static size_t
+rb_cache_reader_size(const void* _ptr)
+{
+  return sizeof(rb_cache_reader_t) + sizeof(spc_reader_t);
+}
+
+static const struct rb_data_type_struct cache_reader_data_type = {
+  .wrap_struct_name = "Spectrum cache reader for WAV file spectrum analyzer",
+  .function = {
+    .dfree = rb_cache_reader_free,
+    .dsize = rb_cache_reader_size,
+  },
+};
+
+static VALUE
+rb_cache_writer_alloc(VALUE self)
+{
+  rb_cache_writer_t* ptr;
+
+  ptr = ALLOC(rb_cache_writer_t);
+  memset(ptr, 0, sizeof(*ptr));
+
+  return TypedData_Wrap_Struct(self, &cache_writer_data_type, ptr);
+}
+
+static VALUE
+rb_cache_writer_initialize(int argc, VALUE* argv, VALUE self)
+{
+  rb_cache_writer_t* ptr;
+  VALUE path;
+  VALUE height;
+  VALUE opt;
+  VALUE opts[N(opts_ids)];
+  spc_header_t hdr;
+  int err;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_cache_writer_t, &cache_writer_data_type, ptr);
+
+  if (ptr->wr != NULL) {
+    RUNTIME_ERROR("already initialized");
+  }
+
+  /*
+   * parse argument
+   */
+  rb_scan_args(argc, argv, "21", &path, &height, &opt);
+
+  ExportStringValue(path);
+  Check_Type(height, T_FIXNUM);
+
+  if (FIX2INT(height) < 1) {
+    ARGUMENT_ERROR("too small");
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+
+  hdr.type   = SPC_TYPE_FLOAT32;
+  hdr.mode   = SPC_MODE_POWER;
+  hdr.height = FIX2INT(height);
+  hdr.scale  = SPC_LOGSCALE_MODE;
+
+  if (opt != Qnil) {
+    Check_Type(opt, T_HASH);
+    rb_get_kwargs(opt, opts_ids, 0, N(opts_ids), opts);
+
+    // :sample_type
+    if (opts[0] != Qundef) {
+      if (EQ_STR(opts[0], "FLOAT32")) {
+        hdr.type = SPC_TYPE_FLOAT32;
+
+      } else if (EQ_STR(opts[0], "FLOAT16")) {
+        hdr.type = SPC_TYPE_FLOAT16;
+
+      } else {
+        ARGUMENT_ERROR("unsupported sample type");
+      }
+    }
+
+    // :plot_mode
+    if (opts[1] != Qundef) {
+      if (EQ_STR(opts[1], "POWER")) {
+        hdr.mode = SPC_MODE_POWER;
+
+      } else if (EQ_STR(opts[1], "AMPLITUDE")) {
+        hdr.mode = SPC_MODE_AMPLITUDE;
+
+      } else {
+        ARGUMENT_ERROR("unsupported plot mode");
+      }
+    }
+
+    // :scale_mode
+    if (opts[2] != Qundef) {
+      if (EQ_STR(opts[2], "LOGSCALE") || EQ_STR(opts[2], "LOG")) {
+        hdr.scale = SPC_LOGSCALE_MODE;
+
+      } else if (EQ_STR(opts[2], "LINEARSCALE") || EQ_STR(opts[2], "LINEAR")) {
+        hdr.scale = SPC_LINEARSCALE_MODE;
+
+      } else {
+        ARGUMENT_ERROR("unsupported scale mode");
+      }
+    }
+
+    // :sample_rate
+    if (opts[3] != Qundef) hdr.fq_s = NUM2DBL(opts[3]);
+
+    // :unit_size
+    if (opts[4] != Qundef) hdr.unit = NUM2UINT(opts[4]);
+
+    // :range
+    if (opts[5] != Qundef) {
+      Check_Type(opts[5], T_ARRAY);
+      if (RARRAY_LEN(opts[5]) != 2) {
+        ARGUMENT_ERROR("range shall be 2 entries contain.");
+      }
+
+      hdr.fq_l = NUM2DBL(RARRAY_AREF(opts[5], 0));
+      hdr.fq_h = NUM2DBL(RARRAY_AREF(opts[5], 1));
+    }
+  }
+
+  /*
+   * create writer context
+   */
+  err = spc_writer_new(StringValueCStr(path), &hdr, &ptr->wr);
+  if (err) {
+    RUNTIME_ERROR("spc_writer_new() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
+
+static VALUE
+rb_cache_writer_put(VALUE self, VALUE dat)
+{
+  rb_cache_writer_t* ptr;
+  int err;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_cache_writer_t, &cache_writer_data_type, ptr);
+
+  /*
+   * check argument
+   */
+  Check_Type(dat, T_STRING);
+
+  if (ptr->wr == NULL) {
+    RUNTIME_ERROR("already closed");
+  }
+
+  if (RSTRING_LEN(dat) != (long)(sizeof(double) * ptr->wr->hdr.height)) {
+    ARGUMENT_ERROR("invalid data length");
+  }
+
+  /*
+   * call cache library
+   */
+  err = spc_writer_put(ptr->wr, (double*)RSTRING_PTR(dat));
+  if (err) {
+    RUNTIME_ERROR("spc_writer_put() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
+
+static VALUE
+rb_cache_writer_columns(VALUE self)
+{
+  rb_cache_writer_t* ptr;
+
+  TypedData_Get_Struct(self, rb_cache_writer_t, &cache_writer_data_type, ptr);
+
+  if (ptr->wr == NULL) {
+    RUNTIME_ERROR("already closed");
+  }
+
+  return ULL2NUM(ptr->wr->hdr.columns);
+}
+
+static VALUE
+rb_cache_writer_close(VALUE self)
+{
+  rb_cache_writer_t* ptr;
+  int err;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_cache_writer_t, &cache_writer_data_type, ptr);
+
+  /*
+   * call cache library
+   */
+  if (ptr->wr != NULL) {
+    err = spc_writer_close(ptr->wr);
+    spc_writer_destroy(ptr->wr);
+    ptr->wr = NULL;
+
+    if (err) {
+      RUNTIME_ERROR("spc_writer_close() failed. [err = %d]\n", err);
+    }
+  }
+
+  return Qnil;
+}
+
+static VALUE
+rb_cache_reader_alloc(VALUE self)
+{
+  rb_cache_reader_t* ptr;
+
+  ptr = ALLOC(rb_cache_reader_t);
+  memset(ptr, 0, sizeof(*ptr));
+
+  return TypedData_Wrap_Struct(self, &cache_reader_data_type, ptr);
+}
+
+static VALUE
+rb_cache_reader_initialize(VALUE self, VALUE path)
+{
+  rb_cache_reader_t* ptr;
+  int err;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_cache_reader_t, &cache_reader_data_type, ptr);
+
+  if (ptr->rd != NULL) {
+    RUNTIME_ERROR("already initialized");
+  }
+
+  /*
+   * check argument
+   */
+  ExportStringValue(path);
+
+  /*
+   * create reader context
+   */
+  err = spc_reader_new(StringValueCStr(path), &ptr->rd);
+  if (err) {
+    RUNTIME_ERROR("spc_reader_new() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
+
+static spc_reader_t*
+get_reader(VALUE self)
+{
+  rb_cache_reader_t* ptr;
+
+  TypedData_Get_Struct(self, rb_cache_reader_t, &cache_reader_data_type, ptr);
+
+  if (ptr->rd == NULL) {
+    RUNTIME_ERROR("already closed");
+  }
+
+  return ptr->rd;
+}
+
+static VALUE
+rb_cache_reader_height(VALUE self)
+{
+  return UINT2NUM(get_reader(self)->hdr.height);
+}
+
+static VALUE
+rb_cache_reader_columns(VALUE self)
+{
+  return ULL2NUM(get_reader(self)->hdr.columns);
+}
+
+static VALUE
+rb_cache_reader_sample_rate(VALUE self)
+{
+  return DBL2NUM(get_reader(self)->hdr.fq_s);
+}
+
+static VALUE
+rb_cache_reader_unit_size(VALUE self)
+{
+  return UINT2NUM(get_reader(self)->hdr.unit);
+}
+
+static VALUE
+rb_cache_reader_range(VALUE self)
+{
+  spc_reader_t* rd;
+
+  rd = get_reader(self);
+
+  return rb_assoc_new(DBL2NUM(rd->hdr.fq_l), DBL2NUM(rd->hdr.fq_h));
+}
+
+static VALUE
+rb_cache_reader_sample_type(VALUE self)
+{
+  VALUE ret;
+
+  switch (get_reader(self)->hdr.type) {
+  case SPC_TYPE_FLOAT32:
+    ret = ID2SYM(rb_intern("FLOAT32"));
+    break;
+
+  case SPC_TYPE_FLOAT16:
+    ret = ID2SYM(rb_intern("FLOAT16"));
+    break;
+
+  default:
+    RUNTIME_ERROR("Really?");
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_cache_reader_plot_mode(VALUE self)
+{
+  VALUE ret;
+
+  switch (get_reader(self)->hdr.mode) {
+  case SPC_MODE_POWER:
+    ret = ID2SYM(rb_intern("POWER"));
+    break;
+
+  case SPC_MODE_AMPLITUDE:
+    ret = ID2SYM(rb_intern("AMPLITUDE"));
+    break;
+
+  default:
+    RUNTIME_ERROR("Really?");
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_cache_reader_scale_mode(VALUE self)
+{
+  VALUE ret;
+
+  switch (get_reader(self)->hdr.scale) {
+  case SPC_LOGSCALE_MODE:
+    ret = ID2SYM(rb_intern("LOGSCALE"));
+    break;
+
+  case SPC_LINEARSCALE_MODE:
+    ret = ID2SYM(rb_intern("LINEARSCALE"));
+    break;
+
+  default:
+    RUNTIME_ERROR("Really?");
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_cache_reader_read(int argc, VALUE* argv, VALUE self)
+{
+  spc_reader_t* rd;
+  VALUE col;
+  VALUE into;
+  VALUE ret;
+  int err;
+
+  /*
+   * extract context data
+   */
+  rd = get_reader(self);
+
+  /*
+   * check argument
+   */
+  rb_scan_args(argc, argv, "11", &col, &into);
+
+  if (NUM2ULL(col) >= rd->hdr.columns) {
+    ARGUMENT_ERROR("invalid column number");
+  }
+
+  if (into != Qnil) {
+    Check_Type(into, T_STRING);
+  }
+
+  /*
+   * alloc return object
+   *   (intoが指定されている場合はそのバッファに読み込む)
+   */
+  ret = column_buffer(into, rd->hdr.height);
+  rb_str_set_len(ret, sizeof(double) * rd->hdr.height);
+
+  /*
+   * call cache library
+   */
+  err = spc_reader_read(rd, NUM2ULL(col), (double*)RSTRING_PTR(ret));
+  if (err) {
+    RUNTIME_ERROR("spc_reader_read() failed. [err = %d]\n", err);
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_cache_reader_close(VALUE self)
+{
+  rb_cache_reader_t* ptr;
+
+  TypedData_Get_Struct(self, rb_cache_reader_t, &cache_reader_data_type, ptr);
+
+  if (ptr->exported) {
+    RUNTIME_ERROR("memory view is exported");
+  }
+
+  if (ptr->rd != NULL) {
+    spc_reader_destroy(ptr->rd);
+    ptr->rd = NULL;
+  }
+
+  return Qnil;
+}
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+/*
+ * MemoryViewとしての公開
+ *
+ *   マップしたキャッシュファイルのデータ部を、columns×heightの2次元配列
+ *   ("f")として読み出し専用で直接参照させる。ビューを解放するまでは
+ *   closeできない。
+ *   MemoryViewの書式には半精度浮動小数点数が無いので、float16形式の
+ *   キャッシュは公開しない(#readで読み出すこと)。
+ */
+static bool
+cache_reader_get_memory_view(VALUE self, rb_memory_view_t* view, int flags)
+{
+  rb_cache_reader_t* ptr;
+  spc_reader_t* rd;
+  ssize_t size;
+
+  TypedData_Get_Struct(self, rb_cache_reader_t, &cache_reader_data_type, ptr);
+
+  rd   = ptr->rd;
+
+  if (rd == NULL || rd->hdr.type != SPC_TYPE_FLOAT32) {
+    return false;
+  }
+
+  if (flags & RUBY_MEMORY_VIEW_WRITABLE) {
+    return false;
+  }
+
+  size = sizeof(float);
+
+  ptr->shape[0]   = rd->hdr.columns;
+  ptr->shape[1]   = rd->hdr.height;
+  ptr->strides[0] = rd->stride;
+  ptr->strides[1] = size;
+
+  view->obj          = self;
+  view->data         = rd->data;
+  view->byte_size    = rd->stride * rd->hdr.columns;
+  view->readonly     = true;
+  view->format       = "f";
+  view->item_size    = size;
+  view->ndim         = 2;
+  view->shape        = ptr->shape;
+  view->strides      = ptr->strides;
+  view->sub_offsets  = NULL;
+  view->private_data = ptr;
+
+  ptr->exported++;
+
+  return true;
+}
+
+static bool
+cache_reader_release_memory_view(VALUE self, rb_memory_view_t* view)
+{
+  rb_cache_reader_t* ptr;
+
+  /*
+   * selfは解放済みの場合があるので参照しない
+   */
+  ptr = (rb_cache_reader_t*)view->private_data;
+
+  ptr->exported--;
+
+  if (ptr->orphaned && !ptr->exported) {
+    rb_cache_reader_free(ptr);
+  }
+
+  return true;
+}
+
+static bool
+cache_reader_memory_view_available_p(VALUE self)
+{
+  rb_cache_reader_t* ptr;
+
+  TypedData_Get_Struct(self, rb_cache_reader_t, &cache_reader_data_type, ptr);
+
+  return (ptr->rd != NULL && ptr->rd->hdr.type == SPC_TYPE_FLOAT32);
+}
+
+static const rb_memory_view_entry_t cache_reader_memory_view_entry = {
+  cache_reader_get_memory_view,
+  cache_reader_release_memory_view,
+  cache_reader_memory_view_available_p,
+};
+#endif /* defined(HAVE_RUBY_MEMORY_VIEW_H) */
+
+void
+Init_cache(void)
+{
+  VALUE wavspa_module;
+  VALUE writer_klass;
+  VALUE reader_klass;
+  int i;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
+  wavspa_module = rb_define_module("WavSpectrumAnalyzer");
+  writer_klass  = rb_define_class_under(wavspa_module,
+                                        "CacheWriter", rb_cObject);
+  reader_klass  = rb_define_class_under(wavspa_module,
+                                        "CacheReader", rb_cObject);
+
+  rb_define_alloc_func(writer_klass, rb_cache_writer_alloc);
+  rb_define_method(writer_klass, "initialize", rb_cache_writer_initialize, -1);
+  rb_define_method(writer_klass, "put", rb_cache_writer_put, 1);
+  rb_define_method(writer_klass, "<<", rb_cache_writer_put, 1);
+  rb_define_method(writer_klass, "columns", rb_cache_writer_columns, 0);
+  rb_define_method(writer_klass, "close", rb_cache_writer_close, 0);
+
+  rb_define_alloc_func(reader_klass, rb_cache_reader_alloc);
+  rb_define_method(reader_klass, "initialize", rb_cache_reader_initialize, 1);
+  rb_define_method(reader_klass, "height", rb_cache_reader_height, 0);
+  rb_define_method(reader_klass, "columns", rb_cache_reader_columns, 0);
+  rb_define_method(reader_klass, "sample_rate",
+                                 rb_cache_reader_sample_rate, 0);
+  rb_define_method(reader_klass, "unit_size", rb_cache_reader_unit_size, 0);
+  rb_define_method(reader_klass, "range", rb_cache_reader_range, 0);
+  rb_define_method(reader_klass, "sample_type",
+                                 rb_cache_reader_sample_type, 0);
+  rb_define_method(reader_klass, "plot_mode", rb_cache_reader_plot_mode, 0);
+  rb_define_method(reader_klass, "scale_mode", rb_cache_reader_scale_mode, 0);
+  rb_define_method(reader_klass, "read", rb_cache_reader_read, -1);
+  rb_define_method(reader_klass, "close", rb_cache_reader_close, 0);
+
+  for (i = 0; i < (int)N(opts_keys); i++) {
+    opts_ids[i] = rb_intern_const(opts_keys[i]);
+  }
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  rb_memory_view_register(reader_klass, &cache_reader_memory_view_entry);
+#endif /* defined(HAVE_RUBY_MEMORY_VIEW_H) */
+}
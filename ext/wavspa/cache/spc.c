@@ -0,0 +1,556 @@
+﻿/*
+ * Spectrum cache file library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "spc.h"
+
+#define ALLOC(t)                ((t*)malloc(sizeof(t)))
+#define NALLOC(t,n)             ((t*)malloc(sizeof(t) * (n)))
+
+#define ERR                     __LINE__
+
+#define SPC_MAGIC               "WSPC"
+#define SPC_VERSION             1
+
+typedef char spc_header_size_check[
+                   (sizeof(spc_header_t) == SPC_HEADER_SIZE)? 1: -1];
+
+static size_t
+sample_size(int type)
+{
+  size_t ret;
+
+  switch (type) {
+  case SPC_TYPE_FLOAT32:
+    ret = sizeof(float);
+    break;
+
+  case SPC_TYPE_FLOAT16:
+    ret = sizeof(uint16_t);
+    break;
+
+  default:
+    ret = 0;
+    break;
+  }
+
+  return ret;
+}
+
+/*
+ * IEEE754 binary16 <-> binary32 の変換
+ *   (丸めは最近接偶数、範囲外は無限大に飽和させる)
+ */
+static uint16_t
+float_to_half(float f)
+{
+  uint32_t x;
+  uint32_t sign;
+  uint32_t mant;
+  uint32_t rem;
+  int exp;
+  int sft;
+  uint16_t ret;
+
+  memcpy(&x, &f, sizeof(x));
+
+  sign = (x >> 16) & 0x8000;
+  exp  = (int)((x >> 23) & 0xff) - 127 + 15;
+  mant = x & 0x007fffff;
+
+  if (((x >> 23) & 0xff) == 0xff) {
+    // Inf or NaN
+    ret = sign | 0x7c00 | ((mant)? 0x0200: 0);
+
+  } else if (exp >= 31) {
+    ret = sign | 0x7c00;
+
+  } else if (exp <= 0) {
+    if (exp < -10) {
+      ret = sign;
+
+    } else {
+      // subnormal
+      mant |= 0x00800000;
+      sft   = 14 - exp;
+      rem   = mant & ((1 << sft) - 1);
+      ret   = sign | (mant >> sft);
+
+      if (rem > (1u << (sft - 1)) ||
+          (rem == (1u << (sft - 1)) && (ret & 1))) {
+        ret++;
+      }
+    }
+
+  } else {
+    ret  = sign | (exp << 10) | (mant >> 13);
+    mant = mant & 0x1fff;
+
+    if (mant > 0x1000 || (mant == 0x1000 && (ret & 1))) {
+      ret++;
+    }
+  }
+
+  return ret;
+}
+
+static float
+half_to_float(uint16_t h)
+{
+  uint32_t sign;
+  uint32_t exp;
+  uint32_t mant;
+  uint32_t x;
+  float ret;
+
+  sign = ((uint32_t)h & 0x8000) << 16;
+  exp  = (h >> 10) & 0x1f;
+  mant = h & 0x03ff;
+
+  if (exp == 0x1f) {
+    x = sign | 0x7f800000 | (mant << 13);
+
+  } else if (exp != 0) {
+    x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+
+  } else if (mant == 0) {
+    x = sign;
+
+  } else {
+    // subnormal
+    exp = 127 - 15 + 1;
+    while (!(mant & 0x0400)) {
+      mant <<= 1;
+      exp--;
+    }
+
+    x = sign | (exp << 23) | ((mant & 0x03ff) << 13);
+  }
+
+  memcpy(&ret, &x, sizeof(ret));
+
+  return ret;
+}
+
+int
+spc_writer_new(char* path, spc_header_t* hdr, spc_writer_t** _obj)
+{
+  int ret;
+  spc_writer_t* obj;
+  FILE* fp;
+  void* buf;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  obj = NULL;
+  fp  = NULL;
+  buf = NULL;
+
+  do {
+    /*
+     * argument check
+     */
+    if (path == NULL || hdr == NULL || _obj == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (!sample_size(hdr->type) || hdr->height == 0) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * alloc object
+     */
+    obj = ALLOC(spc_writer_t);
+    if (obj == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    buf = malloc(sample_size(hdr->type) * hdr->height);
+    if (buf == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * write header
+     */
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    memcpy(obj->hdr.magic, SPC_MAGIC, sizeof(obj->hdr.magic));
+    obj->hdr.version  = SPC_VERSION;
+    obj->hdr.type     = hdr->type;
+    obj->hdr.mode     = hdr->mode;
+    obj->hdr.height   = hdr->height;
+    obj->hdr.scale    = hdr->scale;
+    obj->hdr.columns  = 0;
+    obj->hdr.unit     = hdr->unit;
+    obj->hdr.reserve0 = 0;
+    obj->hdr.fq_s     = hdr->fq_s;
+    obj->hdr.fq_l     = hdr->fq_l;
+    obj->hdr.fq_h     = hdr->fq_h;
+    obj->hdr.reserve1 = 0;
+
+    if (fwrite(&obj->hdr, sizeof(obj->hdr), 1, fp) != 1) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * set return parameter
+     */
+    obj->fp  = fp;
+    obj->buf = buf;
+
+    *_obj = obj;
+  } while (0);
+
+  /*
+   * post process
+   */
+  if (ret) {
+    if (fp != NULL) fclose(fp);
+    if (buf != NULL) free(buf);
+    if (obj != NULL) free(obj);
+  }
+
+  return ret;
+}
+
+int
+spc_writer_put(spc_writer_t* ptr, double* src)
+{
+  int ret;
+  uint32_t i;
+  float* f32;
+  uint16_t* f16;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    /*
+     * argument check
+     */
+    if (ptr == NULL || src == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (ptr->fp == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * convert sample type
+     */
+    switch (ptr->hdr.type) {
+    case SPC_TYPE_FLOAT32:
+      f32 = (float*)ptr->buf;
+      for (i = 0; i < ptr->hdr.height; i++) {
+        f32[i] = (float)src[i];
+      }
+      break;
+
+    case SPC_TYPE_FLOAT16:
+      f16 = (uint16_t*)ptr->buf;
+      for (i = 0; i < ptr->hdr.height; i++) {
+        f16[i] = float_to_half((float)src[i]);
+      }
+      break;
+    }
+
+    /*
+     * write column
+     */
+    if (fwrite(ptr->buf,
+               sample_size(ptr->hdr.type), ptr->hdr.height, ptr->fp) !=
+                                                        ptr->hdr.height) {
+      ret = ERR;
+      break;
+    }
+
+    ptr->hdr.columns++;
+  } while (0);
+
+  return ret;
+}
+
+int
+spc_writer_close(spc_writer_t* ptr)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    /*
+     * argument check
+     */
+    if (ptr == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (ptr->fp == NULL) {
+      break;
+    }
+
+    /*
+     * update column count
+     */
+    if (fseek(ptr->fp, 0, SEEK_SET)) {
+      ret = ERR;
+    }
+
+    if (!ret) {
+      if (fwrite(&ptr->hdr, sizeof(ptr->hdr), 1, ptr->fp) != 1) ret = ERR;
+    }
+
+    if (fclose(ptr->fp)) {
+      if (!ret) ret = ERR;
+    }
+
+    ptr->fp = NULL;
+  } while (0);
+
+  return ret;
+}
+
+int
+spc_writer_destroy(spc_writer_t* ptr)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+
+  /*
+   * release object
+   */
+  if (!ret) {
+    if (ptr->fp != NULL) spc_writer_close(ptr);
+    if (ptr->buf != NULL) free(ptr->buf);
+    free(ptr);
+  }
+
+  return ret;
+}
+
+int
+spc_reader_new(char* path, spc_reader_t** _obj)
+{
+  int ret;
+  spc_reader_t* obj;
+  int fd;
+  struct stat st;
+  void* map;
+  spc_header_t* hdr;
+  size_t stride;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  obj = NULL;
+  fd  = -1;
+  map = MAP_FAILED;
+
+  do {
+    /*
+     * argument check
+     */
+    if (path == NULL || _obj == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * map file
+     */
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      ret = ERR;
+      break;
+    }
+
+    if (fstat(fd, &st) || st.st_size < SPC_HEADER_SIZE) {
+      ret = ERR;
+      break;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * check header
+     */
+    hdr = (spc_header_t*)map;
+
+    if (memcmp(hdr->magic, SPC_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != SPC_VERSION) {
+      ret = ERR;
+      break;
+    }
+
+    stride = sample_size(hdr->type) * hdr->height;
+    if (stride == 0) {
+      ret = ERR;
+      break;
+    }
+
+    if (hdr->columns > ((st.st_size - SPC_HEADER_SIZE) / stride)) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * alloc object
+     */
+    obj = ALLOC(spc_reader_t);
+    if (obj == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * set return parameter
+     */
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    memcpy(&obj->hdr, hdr, sizeof(obj->hdr));
+    obj->map    = map;
+    obj->size   = st.st_size;
+    obj->data   = (uint8_t*)map + SPC_HEADER_SIZE;
+    obj->stride = stride;
+
+    *_obj = obj;
+  } while (0);
+
+  /*
+   * post process
+   */
+  if (fd >= 0) close(fd);
+
+  if (ret) {
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+    if (obj != NULL) free(obj);
+  }
+
+  return ret;
+}
+
+int
+spc_reader_read(spc_reader_t* ptr, uint64_t col, double* dst)
+{
+  int ret;
+  uint32_t i;
+  float* f32;
+  uint16_t* f16;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    /*
+     * argument check
+     */
+    if (ptr == NULL || dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (col >= ptr->hdr.columns) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * convert sample type
+     */
+    switch (ptr->hdr.type) {
+    case SPC_TYPE_FLOAT32:
+      f32 = (float*)(ptr->data + (ptr->stride * col));
+      for (i = 0; i < ptr->hdr.height; i++) {
+        dst[i] = f32[i];
+      }
+      break;
+
+    case SPC_TYPE_FLOAT16:
+      f16 = (uint16_t*)(ptr->data + (ptr->stride * col));
+      for (i = 0; i < ptr->hdr.height; i++) {
+        dst[i] = half_to_float(f16[i]);
+      }
+      break;
+    }
+  } while (0);
+
+  return ret;
+}
+
+int
+spc_reader_destroy(spc_reader_t* ptr)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+
+  /*
+   * release object
+   */
+  if (!ret) {
+    munmap(ptr->map, ptr->size);
+    free(ptr);
+  }
+
+  return ret;
+}
@@ -0,0 +1,70 @@
+﻿/*
+ * Spectrum cache file library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __SPC_H__
+#define __SPC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SPC_TYPE_FLOAT32          1
+#define SPC_TYPE_FLOAT16          2
+
+#define SPC_MODE_POWER            1
+#define SPC_MODE_AMPLITUDE        2
+
+#define SPC_LINEARSCALE_MODE      1
+#define SPC_LOGSCALE_MODE         2
+
+#define SPC_HEADER_SIZE           64
+
+/*
+ * ファイルヘッダ (64 bytes, ホストのバイトオーダで格納)
+ *
+ * ヘッダの直後から、1カラム(height個のサンプル)を1行として
+ * columns行分のデータが並ぶ。行内のサンプルは低周波側から順に
+ * 格納する(fft_calc_*()/walet_calc_*()の出力と同じ並び)。
+ */
+typedef struct {
+  char magic[4];      // "WSPC"
+  uint16_t version;
+  uint8_t type;       // as SPC_TYPE_*
+  uint8_t mode;       // as SPC_MODE_*
+  uint32_t height;    // as "samples per column"
+  uint32_t scale;     // as SPC_*SCALE_MODE
+  uint64_t columns;
+  uint32_t unit;      // as "input samples per column"
+  uint32_t reserve0;
+  double fq_s;        // as "sampling frequency"
+  double fq_l;        // as "low side frequency"
+  double fq_h;        // as "high side frequency"
+  uint64_t reserve1;
+} spc_header_t;
+
+typedef struct {
+  FILE* fp;
+  spc_header_t hdr;
+  void* buf;
+} spc_writer_t;
+
+typedef struct {
+  spc_header_t hdr;
+  void* map;
+  size_t size;
+  uint8_t* data;
+  size_t stride;
+} spc_reader_t;
+
+int spc_writer_new(char* path, spc_header_t* hdr, spc_writer_t** obj);
+int spc_writer_put(spc_writer_t* ptr, double* src);
+int spc_writer_close(spc_writer_t* ptr);
+int spc_writer_destroy(spc_writer_t* ptr);
+
+int spc_reader_new(char* path, spc_reader_t** obj);
+int spc_reader_read(spc_reader_t* ptr, uint64_t col, double* dst);
+int spc_reader_destroy(spc_reader_t* ptr);
+
+#endif /* !defined(__SPC_H__) */
@@ -0,0 +1,7 @@
+require 'mkmf'
+
+$INCFLAGS << " -I$(srcdir)/../common"
+
+have_header("ruby/memory_view.h")
+
+create_makefile( "wavspa/colbuf")
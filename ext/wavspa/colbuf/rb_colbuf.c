@@ -0,0 +1,265 @@
+﻿/*
+ * Column buffer with MemoryView export for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "ruby.h"
+#include "rb_column.h"
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+#include "ruby/memory_view.h"
+#endif /* defined(HAVE_RUBY_MEMORY_VIEW_H) */
+
+#include <stdint.h>
+#include <string.h>
+
+#define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
+#define ARGUMENT_ERROR(...)         rb_raise(rb_eArgError, __VA_ARGS__)
+
+static void
+rb_colbuf_free(void* _ptr)
+{
+  rb_column_t* ptr;
+
+  ptr = (rb_column_t*)_ptr;
+
+  if (ptr->buf != NULL) free(ptr->buf);
+
+  free(ptr);
+}
+
+static size_t
+rb_colbuf_size(const void* _ptr)
+{
+  rb_column_t* ptr;
+
+  ptr = (rb_column_t*)_ptr;
+
+  return sizeof(*ptr) + (sizeof(double) * ptr->size);
+}
+
+static const struct rb_data_type_struct colbuf_data_type = {
+  .wrap_struct_name = COLUMN_DATA_TYPE_NAME,
+  .function = {
+    .dfree = rb_colbuf_free,
+    .dsize = rb_colbuf_size,
+  },
+};
+
+static VALUE
+rb_colbuf_alloc(VALUE self)
+{
+  rb_column_t* ptr;
+
+  ptr = ALLOC(rb_column_t);
+  memset(ptr, 0, sizeof(*ptr));
+
+  return TypedData_Wrap_Struct(self, &colbuf_data_type, ptr);
+}
+
+static rb_column_t*
+get_column(VALUE self)
+{
+  rb_column_t* ret;
+
+  TypedData_Get_Struct(self, rb_column_t, &colbuf_data_type, ret);
+
+  if (ret->buf == NULL) {
+    RUNTIME_ERROR("not initialized");
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_colbuf_initialize(int argc, VALUE* argv, VALUE self)
+{
+  rb_column_t* ptr;
+  VALUE size;
+  VALUE type;
+  double* buf;
+
+  /*
+   * strip object
+   */
+  TypedData_Get_Struct(self, rb_column_t, &colbuf_data_type, ptr);
+
+  if (ptr->buf != NULL) {
+    RUNTIME_ERROR("already initialized");
+  }
+
+  /*
+   * check argument
+   */
+  rb_scan_args(argc, argv, "11", &size, &type);
+
+  if (NUM2INT(size) <= 0) {
+    ARGUMENT_ERROR("invalid size");
+  }
+
+  /*
+   * alloc buffer
+   *   (float32の場合もdoubleで計算してから詰め直すのでdouble分確保する)
+   */
+  buf = (double*)malloc(sizeof(double) * NUM2INT(size));
+  if (buf == NULL) {
+    rb_raise(rb_eNoMemError, "buffer allocation failed");
+  }
+
+  memset(buf, 0, sizeof(double) * NUM2INT(size));
+
+  ptr->size = NUM2INT(size);
+  ptr->type = column_parse_type(type);
+  ptr->buf  = buf;
+
+  return Qnil;
+}
+
+static VALUE
+rb_colbuf_get_size(VALUE self)
+{
+  return INT2FIX(get_column(self)->size);
+}
+
+static VALUE
+rb_colbuf_get_type(VALUE self)
+{
+  VALUE ret;
+
+  switch (get_column(self)->type) {
+  case COLUMN_TYPE_FLOAT32:
+    ret = ID2SYM(rb_intern("float32"));
+    break;
+
+  default:
+    ret = ID2SYM(rb_intern("float64"));
+    break;
+  }
+
+  return ret;
+}
+
+static size_t
+item_size(rb_column_t* ptr)
+{
+  return (ptr->type == COLUMN_TYPE_FLOAT32)? sizeof(float): sizeof(double);
+}
+
+static VALUE
+rb_colbuf_to_s(VALUE self)
+{
+  rb_column_t* ptr;
+
+  ptr = get_column(self);
+
+  return rb_str_new((char*)ptr->buf, item_size(ptr) * ptr->size);
+}
+
+static VALUE
+rb_colbuf_to_a(VALUE self)
+{
+  VALUE ret;
+  rb_column_t* ptr;
+  int i;
+
+  ptr = get_column(self);
+  ret = rb_ary_new_capa(ptr->size);
+
+  for (i = 0; i < ptr->size; i++) {
+    if (ptr->type == COLUMN_TYPE_FLOAT32) {
+      rb_ary_push(ret, DBL2NUM(((float*)ptr->buf)[i]));
+    } else {
+      rb_ary_push(ret, DBL2NUM(ptr->buf[i]));
+    }
+  }
+
+  return ret;
+}
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+/*
+ * MemoryViewとしての公開
+ *
+ *   形式は1次元("d" または "f")で、バッファを直接参照させる。ビューは
+ *   書き込み可能で、FFT#power等で同じバッファへ出力すれば取得済みの
+ *   ビューからもその内容が見える。ビューを保持している間はRuby側で
+ *   オブジェクトが保持されるので、バッファが解放されることはない。
+ */
+static bool
+colbuf_get_memory_view(VALUE self, rb_memory_view_t* view, int flags)
+{
+  rb_column_t* ptr;
+
+  TypedData_Get_Struct(self, rb_column_t, &colbuf_data_type, ptr);
+
+  if (ptr->buf == NULL) {
+    return false;
+  }
+
+  ptr->shape[0]   = ptr->size;
+  ptr->strides[0] = item_size(ptr);
+
+  view->obj          = self;
+  view->data         = ptr->buf;
+  view->byte_size    = item_size(ptr) * ptr->size;
+  view->readonly     = false;
+  view->format       = (ptr->type == COLUMN_TYPE_FLOAT32)? "f": "d";
+  view->item_size    = item_size(ptr);
+  view->ndim         = 1;
+  view->shape        = ptr->shape;
+  view->strides      = ptr->strides;
+  view->sub_offsets  = NULL;
+  view->private_data = NULL;
+
+  return true;
+}
+
+static bool
+colbuf_release_memory_view(VALUE self, rb_memory_view_t* view)
+{
+  return true;
+}
+
+static bool
+colbuf_memory_view_available_p(VALUE self)
+{
+  rb_column_t* ptr;
+
+  TypedData_Get_Struct(self, rb_column_t, &colbuf_data_type, ptr);
+
+  return (ptr->buf != NULL);
+}
+
+static const rb_memory_view_entry_t colbuf_memory_view_entry = {
+  colbuf_get_memory_view,
+  colbuf_release_memory_view,
+  colbuf_memory_view_available_p,
+};
+#endif /* defined(HAVE_RUBY_MEMORY_VIEW_H) */
+
+void
+Init_colbuf(void)
+{
+  VALUE wavspa_module;
+  VALUE colbuf_klass;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
+  wavspa_module = rb_define_module("WavSpectrumAnalyzer");
+  colbuf_klass  = rb_define_class_under(wavspa_module,
+                                        "ColumnBuffer", rb_cObject);
+
+  rb_define_alloc_func(colbuf_klass, rb_colbuf_alloc);
+  rb_define_method(colbuf_klass, "initialize", rb_colbuf_initialize, -1);
+  rb_define_method(colbuf_klass, "size", rb_colbuf_get_size, 0);
+  rb_define_method(colbuf_klass, "type", rb_colbuf_get_type, 0);
+  rb_define_method(colbuf_klass, "to_s", rb_colbuf_to_s, 0);
+  rb_define_method(colbuf_klass, "to_a", rb_colbuf_to_a, 0);
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  rb_memory_view_register(colbuf_klass, &colbuf_memory_view_entry);
+#endif /* defined(HAVE_RUBY_MEMORY_VIEW_H) */
+}
@@ -0,0 +1,35 @@
+﻿/*
+ * Clock helper
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * 指定したクロックの現在値(ナノ秒)
+ */
+static inline uint64_t
+clock_ns(clockid_t id)
+{
+  struct timespec ts;
+
+  clock_gettime(id, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/*
+ * 処理時間の計測に使う単調増加の時刻(ナノ秒)
+ */
+static inline uint64_t
+now_ns(void)
+{
+  return clock_ns(CLOCK_MONOTONIC);
+}
+
+#endif /* !defined(__CLOCK_H__) */
@@ -0,0 +1,231 @@
+﻿/*
+ * Column output buffer helper for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __RB_COLUMN_H__
+#define __RB_COLUMN_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ruby.h"
+#include "ruby/encoding.h"
+
+#define COLUMN_DATA_TYPE_NAME   "Column buffer for spectrum analyzer"
+
+#define COLUMN_TYPE_FLOAT64     1
+#define COLUMN_TYPE_FLOAT32     2
+
+/*
+ * WavSpectrumAnalyzer::ColumnBufferの実体
+ *   bufは常にsize個のdoubleを格納できる大きさで確保する(float32の場合も
+ *   doubleで計算した後に先頭へ詰め直すため)
+ */
+typedef struct {
+  int size;
+  int type;         // as COLUMN_TYPE_*
+  double* buf;
+
+  ssize_t shape[1];
+  ssize_t strides[1];
+} rb_column_t;
+
+/*
+ * ColumnBufferであればその実体を返す(それ以外はNULL)
+ *   fb.hと同様に、別の拡張ライブラリで定義されたデータ型を名前で照合する
+ */
+static inline rb_column_t*
+column_get_struct(VALUE obj)
+{
+  if (!RB_TYPE_P(obj, T_DATA) || !RTYPEDDATA_P(obj) ||
+      strcmp(RTYPEDDATA_TYPE(obj)->wrap_struct_name, COLUMN_DATA_TYPE_NAME)) {
+    return NULL;
+  }
+
+  return (rb_column_t*)RTYPEDDATA_DATA(obj);
+}
+
+static inline int
+column_parse_type(VALUE type)
+{
+  int ret;
+
+  if (type == Qnil) {
+    ret = COLUMN_TYPE_FLOAT64;
+
+  } else if (!SYMBOL_P(type) && !RB_TYPE_P(type, T_STRING)) {
+    rb_raise(rb_eTypeError, "output type shall be Symbol or String");
+
+  } else if (rb_to_id(type) == rb_intern("float64") ||
+             rb_to_id(type) == rb_intern("double")) {
+    ret = COLUMN_TYPE_FLOAT64;
+
+  } else if (rb_to_id(type) == rb_intern("float32") ||
+             rb_to_id(type) == rb_intern("float")) {
+    ret = COLUMN_TYPE_FLOAT32;
+
+  } else {
+    rb_raise(rb_eArgError, "unknown output type");
+  }
+
+  return ret;
+}
+
+/*
+ * power/amplitude/absolute系メソッドの引数を評価する
+ *
+ *   meth([into[, type]]) または meth(into: buf, type: :float32)
+ *
+ * intoにはStringかColumnBufferを指定できる。ColumnBufferの場合、出力
+ * 形式はColumnBuffer側の指定に従う。
+ *
+ * キーワード引数はC関数の呼び出し毎にHashが生成されるので、カラム
+ * 毎に呼び出す場合は位置引数で渡すこと。
+ */
+static inline void
+column_parse_args(int argc, VALUE* argv, VALUE* into, int* type)
+{
+  VALUE opt;
+  VALUE _type;
+  ID ids[2];
+  VALUE opts[2];
+
+  rb_scan_args(argc, argv, "02:", into, &_type, &opt);
+
+  if (opt != Qnil) {
+    ids[0] = rb_intern("into");
+    ids[1] = rb_intern("type");
+
+    rb_get_kwargs(opt, ids, 0, 2, opts);
+
+    if (opts[0] != Qundef) *into = opts[0];
+    if (opts[1] != Qundef) _type = opts[1];
+  }
+
+  if (*into != Qnil && column_get_struct(*into) != NULL) {
+    *type = column_get_struct(*into)->type;
+
+    if (_type != Qnil && column_parse_type(_type) != *type) {
+      rb_raise(rb_eArgError, "output type is not match with the buffer");
+    }
+
+  } else {
+    if (*into != Qnil) {
+      Check_Type(*into, T_STRING);
+    }
+
+    *type = column_parse_type(_type);
+  }
+}
+
+/*
+ * n個のdoubleを書き込める出力バッファ(ASCII-8BIT)を用意する
+ *   (intoが指定されている場合は容量が足りる限り再確保しない)
+ */
+static inline VALUE
+column_buffer(VALUE into, int n)
+{
+  VALUE ret;
+  rb_column_t* col;
+
+  col = (into != Qnil)? column_get_struct(into): NULL;
+
+  if (col != NULL) {
+    if (col->size != n) {
+      rb_raise(rb_eArgError, "buffer size is not match");
+    }
+
+    ret = into;
+
+  } else if (into == Qnil) {
+    ret = rb_str_buf_new(sizeof(double) * n);
+
+  } else {
+    ret = into;
+
+    rb_str_modify(ret);
+    rb_str_set_len(ret, 0);
+    rb_str_modify_expand(ret, sizeof(double) * n);
+
+    if (ENCODING_GET(ret) != rb_ascii8bit_encindex()) {
+      rb_enc_associate_index(ret, rb_ascii8bit_encindex());
+    }
+  }
+
+  return ret;
+}
+
+/*
+ * float32指定の場合はバッファ先頭に詰め直す(GVL無しで呼び出し可)
+ *   前から順に変換するので、未変換の値を上書きすることはない
+ */
+static inline void
+column_pack(double* buf, int type, int n)
+{
+  uint8_t* p;
+  double d;
+  float f;
+  int i;
+
+  if (type == COLUMN_TYPE_FLOAT32) {
+    p = (uint8_t*)buf;
+
+    for (i = 0; i < n; i++) {
+      memcpy(&d, p + (sizeof(double) * i), sizeof(d));
+      f = (float)d;
+      memcpy(p + (sizeof(float) * i), &f, sizeof(f));
+    }
+  }
+}
+
+/*
+ * column_buffer()で用意したバッファの書き込み先
+ */
+static inline double*
+column_ptr(VALUE buf)
+{
+  rb_column_t* col;
+
+  col = column_get_struct(buf);
+
+  return (col != NULL)? col->buf: (double*)RSTRING_PTR(buf);
+}
+
+static inline VALUE
+column_unlock(VALUE buf)
+{
+  if (column_get_struct(buf) == NULL) rb_str_unlocktmp(buf);
+
+  return Qnil;
+}
+
+/*
+ * column_ptr()の指す領域へGVL無しで書き込む処理(func)を呼び出す
+ *   Stringの場合は書き込みが終わるまでロックし、他のスレッドからの変更
+ *   (再確保や共有)をそのスレッド側の例外にする。ColumnBufferは領域が
+ *   固定なのでロックしない。
+ */
+static inline void
+column_call_locked(VALUE buf, VALUE (*func)(VALUE), VALUE arg)
+{
+  if (column_get_struct(buf) == NULL) rb_str_locktmp(buf);
+
+  rb_ensure(func, arg, column_unlock, buf);
+}
+
+static inline void
+column_set_len(VALUE str, int type, int n)
+{
+  if (column_get_struct(str) != NULL) {
+    // ColumnBufferは長さ固定
+
+  } else if (type == COLUMN_TYPE_FLOAT32) {
+    rb_str_set_len(str, sizeof(float) * n);
+  } else {
+    rb_str_set_len(str, sizeof(double) * n);
+  }
+}
+
+#endif /* !defined(__RB_COLUMN_H__) */
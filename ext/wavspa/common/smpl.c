@@ -0,0 +1,591 @@
+﻿/*
+ * Sample format import library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "smpl.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SMPL_X86
+#include <immintrin.h>
+#endif /* defined(__x86_64__) || ... */
+
+#define N(x)                    (sizeof(x)/sizeof(*x))
+
+#define SIMD_NONE               0
+#define SIMD_SSE41              1
+#define SIMD_AVX2               2
+
+#define S8_SCALE                (1.0 / 128.0)
+#define S16_SCALE               (1.0 / 32768.0)
+#define S32_SCALE               (1.0 / 2147483648.0)
+
+#define DOWNMIX_CHUNK           256
+
+static const struct {
+  const char* name;
+  int fmt;
+} fmt_table[] = {
+  {"u8",    SMPL_FMT_U8},
+  {"s8",    SMPL_FMT_S8},
+  {"u16le", SMPL_FMT_U16LE},
+  {"u16be", SMPL_FMT_U16BE},
+  {"s16le", SMPL_FMT_S16LE},
+  {"s16be", SMPL_FMT_S16BE},
+  {"s24le", SMPL_FMT_S24LE},
+  {"s24be", SMPL_FMT_S24BE},
+  {"s32le", SMPL_FMT_S32LE},
+  {"s32be", SMPL_FMT_S32BE},
+  {"f32le", SMPL_FMT_F32LE},
+  {"f32be", SMPL_FMT_F32BE},
+  {"f64le", SMPL_FMT_F64LE},
+  {"f64be", SMPL_FMT_F64BE},
+};
+
+/*
+ * スカラー版
+ *   (SIMD版で処理しきれなかった端数の処理にも用いる)
+ *   strideはサンプル間のバイト数で、インタリーブされたブロックから
+ *   1チャネル分を取り出す場合はブロックサイズを指定する。
+ */
+static void
+import_u8(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++, src += stride) {
+    dst[i] = ((double)src[0] - 128.0) / 128.0;
+  }
+}
+
+static void
+import_s8(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++, src += stride) {
+    dst[i] = (double)(int8_t)src[0] / 128.0;
+  }
+}
+
+static void
+import_u16le(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  uint16_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = ((((uint16_t)src[0] << 0) & 0x00ff)|
+              (((uint16_t)src[1] << 8) & 0xff00));
+    
+    dst[i] = ((double)smpl - 32768.0) / 32768.0;
+  }
+}
+
+static void
+import_u16be(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  uint16_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = ((((uint16_t)src[1] << 0) & 0x00ff)|
+              (((uint16_t)src[0] << 8) & 0xff00));
+
+    dst[i] = ((double)smpl - 32768.0) / 32768.0;
+  }
+}
+
+static void
+import_s16le(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  int16_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = ((((int16_t)src[0] << 0) & 0x00ff)|
+              (((int16_t)src[1] << 8) & 0xff00));
+    
+    dst[i] = (double)smpl  / 32768.0;
+  }
+}
+
+static void
+import_s16be(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  int16_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = ((((int16_t)src[1] << 0) & 0x00ff)|
+              (((int16_t)src[0] << 8) & 0xff00));
+    
+    dst[i] = (double)smpl  / 32768.0;
+  }
+}
+
+static void
+import_s24le(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  int32_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = ((((int32_t)src[0] <<  8) & 0x0000ff00)|
+              (((int32_t)src[1] << 16) & 0x00ff0000)|
+              (((int32_t)src[2] << 24) & 0xff000000));
+    
+    dst[i] = (double)smpl  / 2147483648.0;
+  }
+}
+
+static void
+import_s24be(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  int32_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = ((((int32_t)src[2] <<  8) & 0x0000ff00)|
+              (((int32_t)src[1] << 16) & 0x00ff0000)|
+              (((int32_t)src[0] << 24) & 0xff000000));
+    
+    dst[i] = (double)smpl  / 2147483648.0;
+  }
+}
+
+static void
+import_s32le(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  int32_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = (int32_t)(((uint32_t)src[0] <<  0)|
+                       ((uint32_t)src[1] <<  8)|
+                       ((uint32_t)src[2] << 16)|
+                       ((uint32_t)src[3] << 24));
+    
+    dst[i] = (double)smpl  / 2147483648.0;
+  }
+}
+
+static void
+import_s32be(double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  size_t i;
+  int32_t smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    smpl   = (int32_t)(((uint32_t)src[3] <<  0)|
+                       ((uint32_t)src[2] <<  8)|
+                       ((uint32_t)src[1] << 16)|
+                       ((uint32_t)src[0] << 24));
+    
+    dst[i] = (double)smpl  / 2147483648.0;
+  }
+}
+
+static void
+import_f32(double* dst, uint8_t* src, size_t n, size_t stride, int be)
+{
+  size_t i;
+  uint32_t x;
+  float smpl;
+
+  for (i = 0; i < n; i++, src += stride) {
+    if (be) {
+      x = ((uint32_t)src[3] <<  0)| ((uint32_t)src[2] <<  8)|
+          ((uint32_t)src[1] << 16)| ((uint32_t)src[0] << 24);
+    } else {
+      x = ((uint32_t)src[0] <<  0)| ((uint32_t)src[1] <<  8)|
+          ((uint32_t)src[2] << 16)| ((uint32_t)src[3] << 24);
+    }
+
+    memcpy(&smpl, &x, sizeof(smpl));
+    dst[i] = smpl;
+  }
+}
+
+static void
+import_f64(double* dst, uint8_t* src, size_t n, size_t stride, int be)
+{
+  size_t i;
+  int j;
+  uint64_t x;
+
+  for (i = 0; i < n; i++, src += stride) {
+    x = 0;
+
+    for (j = 0; j < 8; j++) {
+      x |= (uint64_t)src[(be)? j: 7 - j] << (8 * (7 - j));
+    }
+
+    memcpy(dst + i, &x, sizeof(x));
+  }
+}
+
+#ifdef SMPL_X86
+/*
+ * SSE4.1/AVX2版 (リトルエンディアンの形式のみ)
+ *   いずれもスカラー版と同じ値(2のべき乗でのスケーリングなので誤差は
+ *   生じない)を返し、処理できたサンプル数を返す。
+ */
+static const int8_t s24_shuffle[16] = {
+  -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+};
+
+__attribute__((target("sse4.1")))
+static inline void
+store_epi32_sse41(double* dst, __m128i v, __m128d k)
+{
+  _mm_storeu_pd(dst + 0, _mm_mul_pd(_mm_cvtepi32_pd(v), k));
+  _mm_storeu_pd(dst + 2,
+                _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)), k));
+}
+
+__attribute__((target("sse4.1")))
+static size_t
+import_sse41(int fmt, double* dst, uint8_t* src, size_t n)
+{
+  size_t i;
+  int32_t w;
+  __m128i v;
+  __m128i msk;
+  __m128 f;
+
+  i = 0;
+
+  switch (fmt) {
+  case SMPL_FMT_U8:
+  case SMPL_FMT_S8:
+    for (; i + 4 <= n; i += 4, src += 4) {
+      memcpy(&w, src, sizeof(w));
+
+      if (fmt == SMPL_FMT_U8) {
+        v = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(w)),
+                          _mm_set1_epi32(128));
+      } else {
+        v = _mm_cvtepi8_epi32(_mm_cvtsi32_si128(w));
+      }
+
+      store_epi32_sse41(dst + i, v, _mm_set1_pd(S8_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_S16LE:
+    for (; i + 4 <= n; i += 4, src += 8) {
+      v = _mm_cvtepi16_epi32(_mm_loadl_epi64((__m128i*)src));
+      store_epi32_sse41(dst + i, v, _mm_set1_pd(S16_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_S24LE:
+    /*
+     * 16バイト読んで先頭12バイト(4サンプル)を上位3バイトに寄せる
+     */
+    msk = _mm_loadu_si128((__m128i*)s24_shuffle);
+
+    for (; i + 6 <= n; i += 4, src += 12) {
+      v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)src), msk);
+      store_epi32_sse41(dst + i, v, _mm_set1_pd(S32_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_S32LE:
+    for (; i + 4 <= n; i += 4, src += 16) {
+      v = _mm_loadu_si128((__m128i*)src);
+      store_epi32_sse41(dst + i, v, _mm_set1_pd(S32_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_F32LE:
+    for (; i + 4 <= n; i += 4, src += 16) {
+      f = _mm_loadu_ps((float*)src);
+      _mm_storeu_pd(dst + i + 0, _mm_cvtps_pd(f));
+      _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+    }
+    break;
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2")))
+static inline void
+store_epi32_avx2(double* dst, __m256i v, __m256d k)
+{
+  _mm256_storeu_pd(dst + 0,
+                   _mm256_mul_pd(_mm256_cvtepi32_pd(
+                                 _mm256_castsi256_si128(v)), k));
+  _mm256_storeu_pd(dst + 4,
+                   _mm256_mul_pd(_mm256_cvtepi32_pd(
+                                 _mm256_extracti128_si256(v, 1)), k));
+}
+
+__attribute__((target("avx2")))
+static size_t
+import_avx2(int fmt, double* dst, uint8_t* src, size_t n)
+{
+  size_t i;
+  __m256i v;
+  __m256i msk;
+
+  i = 0;
+
+  switch (fmt) {
+  case SMPL_FMT_U8:
+  case SMPL_FMT_S8:
+    for (; i + 8 <= n; i += 8, src += 8) {
+      if (fmt == SMPL_FMT_U8) {
+        v = _mm256_sub_epi32(
+                  _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)src)),
+                  _mm256_set1_epi32(128));
+      } else {
+        v = _mm256_cvtepi8_epi32(_mm_loadl_epi64((__m128i*)src));
+      }
+
+      store_epi32_avx2(dst + i, v, _mm256_set1_pd(S8_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_S16LE:
+    for (; i + 8 <= n; i += 8, src += 16) {
+      v = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i*)src));
+      store_epi32_avx2(dst + i, v, _mm256_set1_pd(S16_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_S24LE:
+    /*
+     * 各レーンに12バイト(4サンプル)ずつ読み込んでレーン内でシャッフル
+     * する(上位レーンの読み込みが28バイト目まで及ぶので余裕を見る)
+     */
+    msk = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i*)s24_shuffle));
+
+    for (; i + 10 <= n; i += 8, src += 24) {
+      v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((__m128i*)src)),
+                _mm_loadu_si128((__m128i*)(src + 12)), 1);
+      v = _mm256_shuffle_epi8(v, msk);
+
+      store_epi32_avx2(dst + i, v, _mm256_set1_pd(S32_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_S32LE:
+    for (; i + 8 <= n; i += 8, src += 32) {
+      v = _mm256_loadu_si256((__m256i*)src);
+      store_epi32_avx2(dst + i, v, _mm256_set1_pd(S32_SCALE));
+    }
+    break;
+
+  case SMPL_FMT_F32LE:
+    for (; i + 8 <= n; i += 8, src += 32) {
+      _mm256_storeu_pd(dst + i + 0,
+                       _mm256_cvtps_pd(_mm_loadu_ps((float*)src + 0)));
+      _mm256_storeu_pd(dst + i + 4,
+                       _mm256_cvtps_pd(_mm_loadu_ps((float*)src + 4)));
+    }
+    break;
+  }
+
+  return i;
+}
+
+static int
+simd_level(void)
+{
+  static int level = -1;
+
+  /*
+   * 判定結果は常に同じなので、複数スレッドから同時に呼ばれても問題ない
+   */
+  if (level < 0) {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+      level = SIMD_AVX2;
+
+    } else if (__builtin_cpu_supports("sse4.1")) {
+      level = SIMD_SSE41;
+
+    } else {
+      level = SIMD_NONE;
+    }
+  }
+
+  return level;
+}
+#endif /* defined(SMPL_X86) */
+
+int
+smpl_parse_format(const char* str)
+{
+  int ret;
+  int i;
+
+  ret = 0;
+
+  if (str != NULL) {
+    for (i = 0; i < (int)N(fmt_table); i++) {
+      if (strcasecmp(fmt_table[i].name, str) == 0) {
+        ret = fmt_table[i].fmt;
+        break;
+      }
+    }
+  }
+
+  return ret;
+}
+
+static void
+import_scalar(int fmt, double* dst, uint8_t* src, size_t n, size_t stride)
+{
+  switch (fmt) {
+  case SMPL_FMT_U8:
+    import_u8(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S8:
+    import_s8(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_U16LE:
+    import_u16le(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_U16BE:
+    import_u16be(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S16LE:
+    import_s16le(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S16BE:
+    import_s16be(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S24LE:
+    import_s24le(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S24BE:
+    import_s24be(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S32LE:
+    import_s32le(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_S32BE:
+    import_s32be(dst, src, n, stride);
+    break;
+
+  case SMPL_FMT_F32LE:
+    import_f32(dst, src, n, stride, 0);
+    break;
+
+  case SMPL_FMT_F32BE:
+    import_f32(dst, src, n, stride, !0);
+    break;
+
+  case SMPL_FMT_F64LE:
+    import_f64(dst, src, n, stride, 0);
+    break;
+
+  case SMPL_FMT_F64BE:
+    import_f64(dst, src, n, stride, !0);
+    break;
+  }
+}
+
+/*
+ * 全チャネルの平均を取り込む
+ *   (チャネル毎に一旦作業領域に取り込んでから加算する)
+ */
+static void
+import_downmix(int fmt, double* dst, uint8_t* src, size_t n, int nch)
+{
+  double tmp[DOWNMIX_CHUNK];
+  size_t size;
+  size_t stride;
+  size_t m;
+  size_t i;
+  int ch;
+
+  size   = SMPL_SIZE(fmt);
+  stride = size * nch;
+
+  while (n > 0) {
+    m = (n < DOWNMIX_CHUNK)? n: DOWNMIX_CHUNK;
+
+    import_scalar(fmt, dst, src, m, stride);
+
+    for (ch = 1; ch < nch; ch++) {
+      import_scalar(fmt, tmp, src + (ch * size), m, stride);
+
+      for (i = 0; i < m; i++) {
+        dst[i] += tmp[i];
+      }
+    }
+
+    for (i = 0; i < m; i++) {
+      dst[i] /= nch;
+    }
+
+    dst += m;
+    src += m * stride;
+    n   -= m;
+  }
+}
+
+void
+smpl_import(int fmt, double* dst, void* src, size_t n)
+{
+  smpl_import_channel(fmt, dst, src, n, 1, 0);
+}
+
+void
+smpl_import_channel(int fmt, double* dst, void* _src, size_t n, int nch, int ch)
+{
+  uint8_t* src;
+  size_t size;
+  size_t i;
+
+  src  = (uint8_t*)_src;
+  size = SMPL_SIZE(fmt);
+  i    = 0;
+
+  if (ch == SMPL_DOWNMIX) {
+    import_downmix(fmt, dst, src, n, nch);
+
+  } else {
+    src += ch * size;
+
+#ifdef SMPL_X86
+    // SIMD版は連続したサンプル列のみ
+    if (nch == 1) {
+      switch (simd_level()) {
+      case SIMD_AVX2:
+        i = import_avx2(fmt, dst, src, n);
+        break;
+
+      case SIMD_SSE41:
+        i = import_sse41(fmt, dst, src, n);
+        break;
+      }
+    }
+#endif /* defined(SMPL_X86) */
+
+    import_scalar(fmt, dst + i, src + (i * size), n - i, size * nch);
+  }
+}
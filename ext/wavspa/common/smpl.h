@@ -0,0 +1,43 @@
+﻿/*
+ * Sample format import library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __SMPL_H__
+#define __SMPL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * フォーマットコード
+ *   bit 0-3  : 1サンプルあたりのバイト数
+ *   bit 4    : ビッグエンディアン
+ *   bit 8-11 : 種別
+ */
+#define SMPL_FMT_U8               0x0001
+#define SMPL_FMT_S8               0x0101
+#define SMPL_FMT_U16LE            0x0002
+#define SMPL_FMT_U16BE            0x0012
+#define SMPL_FMT_S16LE            0x0102
+#define SMPL_FMT_S16BE            0x0112
+#define SMPL_FMT_S24LE            0x0203
+#define SMPL_FMT_S24BE            0x0213
+#define SMPL_FMT_S32LE            0x0304
+#define SMPL_FMT_S32BE            0x0314
+#define SMPL_FMT_F32LE            0x0404
+#define SMPL_FMT_F32BE            0x0414
+#define SMPL_FMT_F64LE            0x0508
+#define SMPL_FMT_F64BE            0x0518
+
+#define SMPL_SIZE(fmt)            ((fmt) & 0x000f)
+
+#define SMPL_DOWNMIX              (-1)
+
+int smpl_parse_format(const char* str);
+void smpl_import(int fmt, double* dst, void* src, size_t n);
+void smpl_import_channel(int fmt, double* dst, void* src,
+                         size_t n, int nch, int ch);
+
+#endif /* !defined(__SMPL_H__) */
@@ -0,0 +1,326 @@
+﻿/*
+ * Chrome trace event recorder
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#ifndef WAVSPA_TRACE
+#define WAVSPA_TRACE
+#endif /* !defined(WAVSPA_TRACE) */
+
+#include "trace.h"
+#include "clock.h"
+
+#define ALLOC(t)                ((t*)malloc(sizeof(t)))
+
+#define CHUNK_EVENTS            8192
+#define DEFAULT_LIMIT           (1024 * 1024)
+
+typedef struct {
+  uint64_t ts;
+  uint64_t dur;
+  const char* name;
+  const char* cat;
+  const char* key;
+  int64_t val;
+  int tid;
+  char ph;
+} event_t;
+
+typedef struct __chunk__ {
+  struct __chunk__* next;
+  size_t used;
+  event_t ev[CHUNK_EVENTS];
+} chunk_t;
+
+/*
+ * スレッド毎のバッファ
+ *   (一度登録したバッファは解放しない。スレッドの終了時に空き状態に
+ *    戻し、後から生成されたスレッドが引き継いで使う。引き継いだスレッド
+ *    には新しいtidを割り当て、件数も数え直すので、記録はスレッド毎に
+ *    分かれる)
+ */
+typedef struct __buffer__ {
+  struct __buffer__* next;
+  int tid;          // as "tid of the current owner"
+  int owner;
+
+  chunk_t* head;
+  chunk_t* tail;
+  size_t count;     // as "events recorded by the current owner"
+  size_t dropped;
+} buffer_t;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static int enabled = 0;
+static char* path = NULL;
+static size_t limit = DEFAULT_LIMIT;
+static uint64_t origin = 0;
+
+static buffer_t* buffers = NULL;
+static int last_tid = 0;
+
+static __thread buffer_t* current = NULL;
+
+uint64_t
+trace_now(void)
+{
+  return now_ns();
+}
+
+static void
+release(void* data)
+{
+  __atomic_store_n(&((buffer_t*)data)->owner, 0, __ATOMIC_RELEASE);
+}
+
+static buffer_t*
+acquire(void)
+{
+  buffer_t* ret;
+  int free;
+
+  /*
+   * 空いているバッファがあれば引き継ぐ
+   */
+  for (ret = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+       ret != NULL; ret = ret->next) {
+    free = 0;
+    if (__atomic_compare_exchange_n(&ret->owner, &free, 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      ret->tid   = __atomic_add_fetch(&last_tid, 1, __ATOMIC_RELAXED);
+      ret->count = 0;
+      break;
+    }
+  }
+
+  /*
+   * 無ければ新たに確保してリストの先頭に繋ぐ
+   */
+  if (ret == NULL) {
+    ret = ALLOC(buffer_t);
+    if (ret == NULL) return NULL;
+
+    memset(ret, 0, sizeof(*ret));
+
+    ret->tid   = __atomic_add_fetch(&last_tid, 1, __ATOMIC_RELAXED);
+    ret->owner = 1;
+    ret->next  = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&buffers, &ret->next, ret, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+
+  pthread_setspecific(key, ret);
+
+  return ret;
+}
+
+static void
+put_event(FILE* fp, event_t* ev, int pid, int* first)
+{
+  fprintf(fp, "%s\n    {\"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d",
+          (*first)? "": ",", ev->ph, (ev->ts - origin) / 1e3, pid, ev->tid);
+
+  if (ev->ph != 'E') {
+    fprintf(fp, ", \"name\": \"%s\", \"cat\": \"%s\"", ev->name, ev->cat);
+  }
+
+  if (ev->ph == 'X') {
+    fprintf(fp, ", \"dur\": %.3f", ev->dur / 1e3);
+  }
+
+  if (ev->key != NULL) {
+    fprintf(fp, ", \"args\": {\"%s\": %" PRId64 "}", ev->key, ev->val);
+  }
+
+  fprintf(fp, "}");
+
+  *first = 0;
+}
+
+static void
+dump(void)
+{
+  FILE* fp;
+  buffer_t* buf;
+  chunk_t* chk;
+  size_t dropped;
+  size_t i;
+  int pid;
+  int first;
+
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    fprintf(stderr, "wavspa: can't write trace to %s\n", path);
+    return;
+  }
+
+  pid     = (int)getpid();
+  first   = !0;
+  dropped = 0;
+
+  fprintf(fp, "{\n  \"traceEvents\": [");
+
+  for (buf = buffers; buf != NULL; buf = buf->next) {
+    for (chk = buf->head; chk != NULL; chk = chk->next) {
+      for (i = 0; i < chk->used; i++) {
+        put_event(fp, chk->ev + i, pid, &first);
+      }
+    }
+
+    dropped += buf->dropped;
+  }
+
+  fprintf(fp, "\n  ],\n");
+  fprintf(fp, "  \"displayTimeUnit\": \"ms\",\n");
+  fprintf(fp, "  \"otherData\": {\"dropped_events\": %zu}\n", dropped);
+  fprintf(fp, "}\n");
+
+  fclose(fp);
+}
+
+static void
+setup(void)
+{
+  char* s;
+
+  s = getenv("WAVSPA_TRACE");
+  if (s == NULL || *s == '\0') return;
+
+  path = strdup(s);
+  if (path == NULL) return;
+
+  s = getenv("WAVSPA_TRACE_LIMIT");
+  if (s != NULL && atol(s) > 0) limit = (size_t)atol(s);
+
+  if (pthread_key_create(&key, release)) return;
+
+  origin  = trace_now();
+  enabled = !0;
+
+  atexit(dump);
+}
+
+int
+trace_enabled(void)
+{
+  pthread_once(&once, setup);
+
+  return enabled;
+}
+
+/*
+ * スレッド毎の上限(WAVSPA_TRACE_LIMIT, 既定は1M件)を超えた分は捨てて
+ * 件数だけを数える
+ */
+static event_t*
+alloc_event(void)
+{
+  buffer_t* buf;
+  chunk_t* chk;
+
+  if (!trace_enabled()) return NULL;
+
+  if (current == NULL) current = acquire();
+
+  buf = current;
+  if (buf == NULL) return NULL;
+
+  if (buf->count >= limit) {
+    buf->dropped++;
+    return NULL;
+  }
+
+  chk = buf->tail;
+
+  if (chk == NULL || chk->used == CHUNK_EVENTS) {
+    chk = ALLOC(chunk_t);
+    if (chk == NULL) {
+      buf->dropped++;
+      return NULL;
+    }
+
+    chk->next = NULL;
+    chk->used = 0;
+
+    if (buf->tail != NULL) {
+      buf->tail->next = chk;
+    } else {
+      buf->head = chk;
+    }
+
+    buf->tail = chk;
+  }
+
+  buf->count++;
+  chk->ev[chk->used].tid = buf->tid;
+
+  return chk->ev + chk->used++;
+}
+
+void
+trace_begin(const char* name, const char* cat, const char* key, int64_t val)
+{
+  event_t* ev;
+
+  ev = alloc_event();
+
+  if (ev != NULL) {
+    ev->ph   = 'B';
+    ev->ts   = trace_now();
+    ev->dur  = 0;
+    ev->name = name;
+    ev->cat  = cat;
+    ev->key  = key;
+    ev->val  = val;
+  }
+}
+
+void
+trace_end(void)
+{
+  event_t* ev;
+
+  ev = alloc_event();
+
+  if (ev != NULL) {
+    ev->ph   = 'E';
+    ev->ts   = trace_now();
+    ev->dur  = 0;
+    ev->name = NULL;
+    ev->cat  = NULL;
+    ev->key  = NULL;
+    ev->val  = 0;
+  }
+}
+
+void
+trace_complete(const char* name, const char* cat,
+               uint64_t start, uint64_t end, const char* key, int64_t val)
+{
+  event_t* ev;
+
+  ev = alloc_event();
+
+  if (ev != NULL) {
+    ev->ph   = 'X';
+    ev->ts   = start;
+    ev->dur  = end - start;
+    ev->name = name;
+    ev->cat  = cat;
+    ev->key  = key;
+    ev->val  = val;
+  }
+}
@@ -0,0 +1,45 @@
+﻿/*
+ * Chrome trace event recorder
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * 環境変数WAVSPA_TRACEに出力ファイル名を設定して実行すると記録を有効にし、
+ * プロセスの終了時にChromeのtrace event形式(JSON)で書き出す。出力は
+ * Perfetto(ui.perfetto.dev)やchrome://tracingで表示できる。
+ *
+ * 記録はスレッド毎のバッファに対して行うのでロックは取らない。イベント
+ * 名などの文字列はポインタのまま保持するので、静的な文字列を渡すこと。
+ *
+ * WAVSPA_TRACEを定義せずにビルドした場合、以下のマクロは何もしない。
+ */
+#ifdef WAVSPA_TRACE
+int trace_enabled(void);
+uint64_t trace_now(void);
+
+void trace_begin(const char* name, const char* cat, const char* key, int64_t val);
+void trace_end(void);
+void trace_complete(const char* name, const char* cat,
+                    uint64_t start, uint64_t end, const char* key, int64_t val);
+
+#define TRACE_ENABLED()                 trace_enabled()
+#define TRACE_BEGIN(name,cat,key,val)   trace_begin(name, cat, key, val)
+#define TRACE_END()                     trace_end()
+#define TRACE_COMPLETE(name,cat,st,ed,key,val) \
+                                 trace_complete(name, cat, st, ed, key, val)
+
+#else /* defined(WAVSPA_TRACE) */
+#define TRACE_ENABLED()                 (0)
+#define TRACE_BEGIN(name,cat,key,val)
+#define TRACE_END()
+#define TRACE_COMPLETE(name,cat,st,ed,key,val)
+#endif /* defined(WAVSPA_TRACE) */
+
+#endif /* !defined(__TRACE_H__) */
@@ -1,3 +1,11 @@
 require 'mkmf'
 
+if not have_header("zlib.h") or not have_library("z", "deflate")
+  abort("zlib is not found.")
+end
+
+have_library("pthread")
+
+$INCFLAGS << " -I$(srcdir)/../common"
+
 create_makefile( "wavspa/fb")
@@ -0,0 +1,89 @@
+﻿/*
+ * Simple Frame buffer
+ *
+ *  Copyright (C) 2016 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __FB_H__
+#define __FB_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ruby.h"
+#include "fbdraw.h"
+
+#define FB_DATA_TYPE_NAME   "Simple frame buffer for WAV file spectrum analyzer"
+
+typedef struct {
+  int width;
+  int height;       // as "height of one band"
+  int bands;        // as "number of stacked bands"
+  int step;
+  int margin_x;
+  int margin_y;
+
+  int stride;
+  size_t size;
+
+  double ceil;
+  double floor;
+  double range;
+  double lumi;
+
+  int cmap;
+  double pscale;    // as "scale factor for power"
+  double ascale;    // as "scale factor for amplitude"
+  uint8_t lut[LUT_SIZE * 3];
+  uint8_t* qbuf;    // as "quantized column" (per band)
+
+  uint8_t* pix;     // as "pixel store" (heap or map)
+  void* map;        // as "mapped pixel store"
+} rb_fb_t;
+
+/*
+ * 他の拡張ライブラリ(FFT/Wavelet)からフレームバッファへ直接描画する
+ * ためのインタフェース。各拡張ライブラリは個別の共有オブジェクトとして
+ * ロードされるので、データ型は名前で照合する。
+ */
+static inline rb_fb_t*
+fb_get_struct(VALUE obj)
+{
+  rb_fb_t* ret;
+
+  if (!RB_TYPE_P(obj, T_DATA) || !RTYPEDDATA_P(obj) ||
+      strcmp(RTYPEDDATA_TYPE(obj)->wrap_struct_name, FB_DATA_TYPE_NAME)) {
+    rb_raise(rb_eTypeError, "not a frame buffer object");
+  }
+
+  ret = (rb_fb_t*)RTYPEDDATA_DATA(obj);
+  if (ret->pix == NULL) {
+    rb_raise(rb_eRuntimeError, "frame buffer is not initialized");
+  }
+
+  return ret;
+}
+
+/*
+ * 指定バンド用の量子化バッファ
+ *   (バンド毎に分けてあるので、バンドが異なれば並行して描画できる)
+ */
+static inline uint8_t*
+fb_qbuf(rb_fb_t* ptr, int band)
+{
+  return ptr->qbuf + ((size_t)band * ptr->height);
+}
+
+/*
+ * qbufに格納されたLUTインデックス(低周波側から順)を指定カラムに展開する
+ */
+static inline void
+fb_put_column(rb_fb_t* ptr, int col, int band)
+{
+  fbdraw_put_column(ptr->pix + ((ptr->margin_x + (col * ptr->step)) * 3) +
+                               ((size_t)band * ptr->height * ptr->stride),
+                    ptr->stride, ptr->height, ptr->step,
+                    ptr->lut, fb_qbuf(ptr, band));
+}
+
+#endif /* !defined(__FB_H__) */
@@ -0,0 +1,448 @@
+﻿/*
+ * Drawing primitives for the spectrum frame buffer
+ *
+ *  Copyright (C) 2016 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "fbdraw.h"
+
+#define N(x)                        (sizeof((x))/sizeof(*(x)))
+
+/*
+ * from M+ font (M+ gothic 10r)
+ */
+static const uint8_t font[] = {
+  0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x00, /* 0x00 */
+  0x00, 0x00, 0x00, 0x60, 0xf0, 0x60, 0x00, 0x00, 0x00, 0x00, /* 0x01 */
+  0x50, 0xa8, 0x50, 0xa8, 0x50, 0xa8, 0x50, 0xa8, 0x50, 0xa8, /* 0x02 */
+  0x90, 0xf0, 0x90, 0x90, 0x00, 0xf8, 0x20, 0x20, 0x20, 0x00, /* 0x03 */
+  0xf0, 0x80, 0xf0, 0x80, 0x00, 0xf0, 0x80, 0xf0, 0x80, 0x00, /* 0x04 */
+  0xf0, 0x90, 0x80, 0xf0, 0x00, 0xf0, 0x90, 0xe0, 0x90, 0x00, /* 0x05 */
+  0x80, 0x80, 0x80, 0xf0, 0x00, 0xf0, 0x80, 0xf0, 0x80, 0x00, /* 0x06 */
+  0x60, 0x90, 0x90, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x07 */
+  0x00, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x00, 0xf0, 0x00, 0x00, /* 0x08 */
+  0x90, 0xd0, 0xb0, 0x90, 0x00, 0x80, 0x80, 0x80, 0xf0, 0x00, /* 0x09 */
+  0x90, 0x90, 0xa0, 0xc0, 0x00, 0xf8, 0x20, 0x20, 0x20, 0x00, /* 0x0a */
+  0x20, 0x20, 0x20, 0x20, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x0b */
+  0x00, 0x00, 0x00, 0x00, 0xe0, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x0c */
+  0x00, 0x00, 0x00, 0x00, 0x38, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x0d */
+  0x20, 0x20, 0x20, 0x20, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x0e */
+  0x20, 0x20, 0x20, 0x20, 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x0f */
+  0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x10 */
+  0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x11 */
+  0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x12 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, /* 0x13 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, /* 0x14 */
+  0x20, 0x20, 0x20, 0x20, 0x38, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x15 */
+  0x20, 0x20, 0x20, 0x20, 0xe0, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x16 */
+  0x20, 0x20, 0x20, 0x20, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x17 */
+  0x00, 0x00, 0x00, 0x00, 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x18 */
+  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x19 */
+  0x00, 0x20, 0x40, 0x80, 0x40, 0x20, 0x00, 0xf0, 0x00, 0x00, /* 0x1a */
+  0x00, 0x40, 0x20, 0x10, 0x20, 0x40, 0x00, 0xf0, 0x00, 0x00, /* 0x1b */
+  0x00, 0x00, 0x00, 0xf0, 0x50, 0x50, 0x90, 0x90, 0x00, 0x00, /* 0x1c */
+  0x00, 0x20, 0x20, 0xf0, 0x40, 0xf0, 0x40, 0x40, 0x00, 0x00, /* 0x1d */
+  0x00, 0x30, 0x40, 0x40, 0xf0, 0x40, 0x40, 0xb0, 0x00, 0x00, /* 0x1e */
+  0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x1f */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x20 */
+  0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x20, 0x00, 0x00, /* 0x21 */
+  0x50, 0x50, 0x50, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x22 */
+  0x00, 0x50, 0x50, 0xf0, 0x50, 0xf0, 0x50, 0x50, 0x00, 0x00, /* 0x23 */
+  0x00, 0x20, 0x70, 0xa0, 0xe0, 0x70, 0x50, 0xe0, 0x40, 0x00, /* 0x24 */
+  0x00, 0xc0, 0xc0, 0x10, 0x60, 0x80, 0x30, 0x30, 0x00, 0x00, /* 0x25 */
+  0x00, 0x40, 0xa0, 0xa0, 0x40, 0xb0, 0xa0, 0x50, 0x00, 0x00, /* 0x26 */
+  0x20, 0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x27 */
+  0x10, 0x20, 0x20, 0x40, 0x40, 0x40, 0x20, 0x20, 0x10, 0x00, /* 0x28 */
+  0x80, 0x40, 0x40, 0x20, 0x20, 0x20, 0x40, 0x40, 0x80, 0x00, /* 0x29 */
+  0x00, 0x00, 0x50, 0x20, 0xf0, 0x20, 0x50, 0x00, 0x00, 0x00, /* 0x2a */
+  0x00, 0x00, 0x20, 0x20, 0xf0, 0x20, 0x20, 0x00, 0x00, 0x00, /* 0x2b */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x40, 0x00, /* 0x2c */
+  0x00, 0x00, 0x00, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x2d */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, /* 0x2e */
+  0x00, 0x10, 0x10, 0x20, 0x20, 0x40, 0x40, 0x80, 0x80, 0x00, /* 0x2f */
+  0x00, 0x60, 0x90, 0xb0, 0xd0, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x30 */
+  0x00, 0x20, 0x60, 0xa0, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00, /* 0x31 */
+  0x00, 0x60, 0x90, 0x10, 0x20, 0x40, 0x80, 0xf0, 0x00, 0x00, /* 0x32 */
+  0x00, 0xf0, 0x10, 0x20, 0x60, 0x10, 0x90, 0x60, 0x00, 0x00, /* 0x33 */
+  0x00, 0x20, 0x60, 0xa0, 0xa0, 0xf0, 0x20, 0x20, 0x00, 0x00, /* 0x34 */
+  0x00, 0xf0, 0x80, 0xe0, 0x10, 0x10, 0x90, 0x60, 0x00, 0x00, /* 0x35 */
+  0x00, 0x60, 0x80, 0xe0, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x36 */
+  0x00, 0xf0, 0x10, 0x20, 0x20, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0x37 */
+  0x00, 0x60, 0x90, 0x90, 0x60, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x38 */
+  0x00, 0x60, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, 0x00, 0x00, /* 0x39 */
+  0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, /* 0x3a */
+  0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x40, 0x00, 0x00, /* 0x3b */
+  0x00, 0x10, 0x20, 0x40, 0x80, 0x40, 0x20, 0x10, 0x00, 0x00, /* 0x3c */
+  0x00, 0x00, 0x00, 0xf0, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00, /* 0x3d */
+  0x00, 0x80, 0x40, 0x20, 0x10, 0x20, 0x40, 0x80, 0x00, 0x00, /* 0x3e */
+  0x00, 0xe0, 0x10, 0x10, 0x20, 0x40, 0x00, 0x40, 0x00, 0x00, /* 0x3f */
+  0x00, 0x60, 0x90, 0xb0, 0xa0, 0xb0, 0x80, 0x70, 0x00, 0x00, /* 0x40 */
+  0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x41 */
+  0x00, 0xe0, 0x90, 0x90, 0xe0, 0x90, 0x90, 0xe0, 0x00, 0x00, /* 0x42 */
+  0x00, 0x60, 0x90, 0x80, 0x80, 0x80, 0x80, 0x70, 0x00, 0x00, /* 0x43 */
+  0x00, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x90, 0xe0, 0x00, 0x00, /* 0x44 */
+  0x00, 0xf0, 0x80, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0x45 */
+  0x00, 0xf0, 0x80, 0x80, 0xe0, 0x80, 0x80, 0x80, 0x00, 0x00, /* 0x46 */
+  0x00, 0x70, 0x80, 0x80, 0xb0, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0x47 */
+  0x00, 0x90, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x48 */
+  0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0x49 */
+  0x00, 0x10, 0x10, 0x10, 0x10, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x4a */
+  0x00, 0x90, 0xa0, 0xc0, 0xc0, 0xa0, 0x90, 0x90, 0x00, 0x00, /* 0x4b */
+  0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0x4c */
+  0x00, 0x90, 0xb0, 0xd0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x4d */
+  0x00, 0x90, 0xd0, 0xb0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x4e */
+  0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x4f */
+  0x00, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, 0x00, 0x00, /* 0x50 */
+  0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x40, 0x30, /* 0x51 */
+  0x00, 0xe0, 0x90, 0x90, 0xe0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x52 */
+  0x00, 0x70, 0x80, 0x80, 0x60, 0x10, 0x10, 0xe0, 0x00, 0x00, /* 0x53 */
+  0x00, 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00, /* 0x54 */
+  0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x55 */
+  0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0xa0, 0xc0, 0x00, 0x00, /* 0x56 */
+  0x00, 0x90, 0x90, 0x90, 0x90, 0xd0, 0xb0, 0x90, 0x00, 0x00, /* 0x57 */
+  0x00, 0x90, 0x90, 0x90, 0x60, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x58 */
+  0x00, 0x90, 0x90, 0x90, 0xa0, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0x59 */
+  0x00, 0xf0, 0x10, 0x20, 0x40, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0x5a */
+  0x70, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x70, 0x00, /* 0x5b */
+  0x00, 0x80, 0x80, 0x40, 0x40, 0x20, 0x20, 0x10, 0x10, 0x00, /* 0x5c */
+  0xe0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xe0, 0x00, /* 0x5d */
+  0x20, 0x50, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x5e */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x00, /* 0x5f */
+  0x40, 0x40, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x60 */
+  0x00, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0x61 */
+  0x00, 0x80, 0x80, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x00, 0x00, /* 0x62 */
+  0x00, 0x00, 0x00, 0x60, 0x90, 0x80, 0x80, 0x70, 0x00, 0x00, /* 0x63 */
+  0x00, 0x10, 0x10, 0x70, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0x64 */
+  0x00, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0x65 */
+  0x00, 0x30, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0x66 */
+  0x00, 0x00, 0x00, 0x70, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0x67 */
+  0x00, 0x80, 0x80, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x68 */
+  0x20, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0x69 */
+  0x20, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0xc0, /* 0x6a */
+  0x00, 0x80, 0x80, 0x90, 0xa0, 0xc0, 0xa0, 0x90, 0x00, 0x00, /* 0x6b */
+  0x00, 0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0x30, 0x00, 0x00, /* 0x6c */
+  0x00, 0x00, 0x00, 0xf0, 0xa8, 0xa8, 0xa8, 0xa8, 0x00, 0x00, /* 0x6d */
+  0x00, 0x00, 0x00, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x6e */
+  0x00, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x6f */
+  0x00, 0x00, 0x00, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, /* 0x70 */
+  0x00, 0x00, 0x00, 0x70, 0x90, 0x90, 0x90, 0x70, 0x10, 0x10, /* 0x71 */
+  0x00, 0x00, 0x00, 0xb0, 0xc0, 0x80, 0x80, 0x80, 0x00, 0x00, /* 0x72 */
+  0x00, 0x00, 0x00, 0x70, 0x80, 0x60, 0x10, 0xe0, 0x00, 0x00, /* 0x73 */
+  0x00, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x40, 0x30, 0x00, 0x00, /* 0x74 */
+  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0x75 */
+  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0xa0, 0xc0, 0x00, 0x00, /* 0x76 */
+  0x00, 0x00, 0x00, 0x90, 0x90, 0xd0, 0xb0, 0x90, 0x00, 0x00, /* 0x77 */
+  0x00, 0x00, 0x00, 0x90, 0x90, 0x60, 0x90, 0x90, 0x00, 0x00, /* 0x78 */
+  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0x79 */
+  0x00, 0x00, 0x00, 0xf0, 0x20, 0x40, 0x80, 0xf0, 0x00, 0x00, /* 0x7a */
+  0x30, 0x40, 0x40, 0x40, 0x80, 0x40, 0x40, 0x40, 0x30, 0x00, /* 0x7b */
+  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, /* 0x7c */
+  0xc0, 0x20, 0x20, 0x20, 0x10, 0x20, 0x20, 0x20, 0xc0, 0x00, /* 0x7d */
+  0x00, 0x50, 0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x7e */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x7f */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x80 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x81 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x82 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x83 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x84 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x85 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x86 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x87 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x88 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x89 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8a */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8b */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8c */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8d */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8e */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8f */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x90 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x91 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x92 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x93 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x94 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x95 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x96 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x97 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x98 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x99 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9a */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9b */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9c */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9d */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9e */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9f */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xa0 */
+  0x00, 0x20, 0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00, /* 0xa1 */
+  0x00, 0x20, 0x20, 0x70, 0xa0, 0xa0, 0xa0, 0x70, 0x20, 0x00, /* 0xa2 */
+  0x00, 0x30, 0x40, 0x40, 0xf0, 0x40, 0x40, 0xb0, 0x00, 0x00, /* 0xa3 */
+  0x00, 0x00, 0x90, 0x60, 0x60, 0x60, 0x90, 0x00, 0x00, 0x00, /* 0xa4 */
+  0x00, 0x90, 0xa0, 0x40, 0xf0, 0x40, 0xf0, 0x40, 0x00, 0x00, /* 0xa5 */
+  0x20, 0x20, 0x20, 0x20, 0x00, 0x20, 0x20, 0x20, 0x20, 0x00, /* 0xa6 */
+  0x60, 0x90, 0x80, 0x60, 0x90, 0x60, 0x10, 0x90, 0x60, 0x00, /* 0xa7 */
+  0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xa8 */
+  0x00, 0xf0, 0x90, 0x60, 0x40, 0x60, 0x90, 0xf0, 0x00, 0x00, /* 0xa9 */
+  0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0xf0, 0x00, 0x00, /* 0xaa */
+  0x00, 0x10, 0x20, 0x50, 0xa0, 0x50, 0x20, 0x10, 0x00, 0x00, /* 0xab */
+  0x00, 0x00, 0x00, 0x00, 0xf0, 0x10, 0x10, 0x00, 0x00, 0x00, /* 0xac */
+  0x00, 0x00, 0x00, 0x00, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xad */
+  0x00, 0xf0, 0x90, 0x60, 0x40, 0x40, 0x90, 0xf0, 0x00, 0x00, /* 0xae */
+  0x00, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xaf */
+  0x60, 0x90, 0x90, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb0 */
+  0x00, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x00, 0xf0, 0x00, 0x00, /* 0xb1 */
+  0xc0, 0x20, 0x40, 0x80, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb2 */
+  0xe0, 0x20, 0x40, 0x20, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb3 */
+  0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb4 */
+  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0xb0, 0xd0, 0x80, 0x80, /* 0xb5 */
+  0x00, 0xf0, 0xd0, 0xd0, 0xd0, 0x50, 0x50, 0x50, 0x00, 0x00, /* 0xb6 */
+  0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb7 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x20, 0x40, /* 0xb8 */
+  0x40, 0xc0, 0x40, 0x40, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb9 */
+  0x60, 0x90, 0x90, 0x60, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00, /* 0xba */
+  0x00, 0x80, 0x40, 0xa0, 0x50, 0xa0, 0x40, 0x80, 0x00, 0x00, /* 0xbb */
+  0x40, 0xc0, 0x40, 0x40, 0x30, 0x50, 0x70, 0x10, 0x00, 0x00, /* 0xbc */
+  0x40, 0xc0, 0x40, 0x40, 0x70, 0x10, 0x20, 0x70, 0x00, 0x00, /* 0xbd */
+  0xe0, 0x40, 0x20, 0xc0, 0x30, 0x50, 0x70, 0x10, 0x00, 0x00, /* 0xbe */
+  0x00, 0x20, 0x00, 0x20, 0x40, 0x80, 0x80, 0x70, 0x00, 0x00, /* 0xbf */
+  0x20, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc0 */
+  0x40, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc1 */
+  0x90, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc2 */
+  0xa0, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc3 */
+  0x50, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc4 */
+  0x90, 0x90, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc5 */
+  0x00, 0xf0, 0xa0, 0xa0, 0xf0, 0xa0, 0xa0, 0xb0, 0x00, 0x00, /* 0xc6 */
+  0x00, 0x60, 0x90, 0x80, 0x80, 0x80, 0x80, 0x70, 0x20, 0x40, /* 0xc7 */
+  0x20, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xc8 */
+  0x40, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xc9 */
+  0x90, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xca */
+  0x50, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xcb */
+  0x10, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xcc */
+  0x20, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xcd */
+  0x90, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xce */
+  0x50, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xcf */
+  0x00, 0xe0, 0x50, 0x50, 0xf0, 0x50, 0x50, 0xe0, 0x00, 0x00, /* 0xd0 */
+  0xa0, 0x00, 0x90, 0xd0, 0xb0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0xd1 */
+  0x20, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd2 */
+  0x40, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd3 */
+  0x90, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd4 */
+  0xa0, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd5 */
+  0x50, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd6 */
+  0x00, 0x00, 0x90, 0x90, 0x60, 0x90, 0x90, 0x00, 0x00, 0x00, /* 0xd7 */
+  0x10, 0x60, 0x90, 0xb0, 0xd0, 0x90, 0x90, 0x60, 0x80, 0x00, /* 0xd8 */
+  0x20, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd9 */
+  0x40, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xda */
+  0x90, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xdb */
+  0x50, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xdc */
+  0x40, 0x00, 0x90, 0x90, 0xa0, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0xdd */
+  0x80, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, 0x00, 0x00, /* 0xde */
+  0x00, 0x60, 0x90, 0x90, 0xe0, 0x90, 0x90, 0xe0, 0x80, 0x80, /* 0xdf */
+  0x20, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe0 */
+  0x40, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe1 */
+  0x90, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe2 */
+  0xa0, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe3 */
+  0x50, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe4 */
+  0x90, 0x60, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe5 */
+  0x00, 0x00, 0x00, 0xf0, 0x20, 0x70, 0xa0, 0xf0, 0x00, 0x00, /* 0xe6 */
+  0x00, 0x00, 0x00, 0x60, 0x90, 0x80, 0x80, 0x70, 0x20, 0x40, /* 0xe7 */
+  0x20, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xe8 */
+  0x40, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xe9 */
+  0x90, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xea */
+  0x50, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xeb */
+  0x10, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xec */
+  0x20, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xed */
+  0x90, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xee */
+  0x50, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xef */
+  0x70, 0xc0, 0x20, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf0 */
+  0xa0, 0x00, 0x00, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0xf1 */
+  0x20, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf2 */
+  0x40, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf3 */
+  0x90, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf4 */
+  0xa0, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf5 */
+  0x50, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf6 */
+  0x00, 0x40, 0x40, 0x00, 0xf0, 0x00, 0x40, 0x40, 0x00, 0x00, /* 0xf7 */
+  0x00, 0x00, 0x10, 0x60, 0x90, 0xf0, 0x90, 0x60, 0x80, 0x00, /* 0xf8 */
+  0x20, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xf9 */
+  0x40, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xfa */
+  0x90, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xfb */
+  0x50, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xfc */
+  0x40, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0xfd */
+  0x00, 0x80, 0x80, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, /* 0xfe */
+  0x50, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0xff */
+};
+
+/*
+ * colormap anchors (evenly spaced, linear interpolated to LUT)
+ */
+static const uint8_t viridis_anchor[][3] = {
+  {0x44, 0x01, 0x54}, {0x48, 0x28, 0x78}, {0x3e, 0x4a, 0x89},
+  {0x31, 0x68, 0x8e}, {0x26, 0x82, 0x8e}, {0x1f, 0x9e, 0x89},
+  {0x35, 0xb7, 0x79}, {0x6d, 0xcd, 0x59}, {0xb4, 0xde, 0x2c},
+  {0xfd, 0xe7, 0x25},
+};
+
+static const uint8_t magma_anchor[][3] = {
+  {0x00, 0x00, 0x04}, {0x18, 0x0f, 0x3e}, {0x45, 0x10, 0x77},
+  {0x72, 0x1f, 0x81}, {0x9f, 0x2f, 0x7f}, {0xcd, 0x40, 0x71},
+  {0xf1, 0x60, 0x5d}, {0xfd, 0x95, 0x67}, {0xfe, 0xc9, 0x8d},
+  {0xfc, 0xfd, 0xbf},
+};
+
+static void
+interp_lut(uint8_t* lut, const uint8_t (*anc)[3], int n)
+{
+  int i;
+  int k;
+  double x;
+  double t;
+
+  for (i = 0; i < LUT_SIZE; i++, lut += 3) {
+    x = ((double)i * (n - 1)) / (LUT_SIZE - 1);
+    k = (int)x;
+    if (k >= n - 1) k = n - 2;
+    t = x - k;
+
+    lut[0] = round(anc[k][0] + ((anc[k + 1][0] - anc[k][0]) * t));
+    lut[1] = round(anc[k][1] + ((anc[k + 1][1] - anc[k][1]) * t));
+    lut[2] = round(anc[k][2] + ((anc[k + 1][2] - anc[k][2]) * t));
+  }
+}
+
+void
+fbdraw_make_lut(uint8_t* lut, int cmap)
+{
+  int v;
+
+  switch (cmap) {
+  case CMAP_GREEN:
+    for (v = 0; v < LUT_SIZE; v++, lut += 3) {
+      lut[0] = v / 3;
+      lut[1] = v;
+      lut[2] = v / 2;
+    }
+    break;
+
+  case CMAP_GRAYSCALE:
+    for (v = 0; v < LUT_SIZE; v++, lut += 3) {
+      lut[0] = v;
+      lut[1] = v;
+      lut[2] = v;
+    }
+    break;
+
+  case CMAP_VIRIDIS:
+    interp_lut(lut, viridis_anchor, N(viridis_anchor));
+    break;
+
+  case CMAP_MAGMA:
+    interp_lut(lut, magma_anchor, N(magma_anchor));
+    break;
+  }
+}
+
+/*
+ * カラム単位で量子化(スケーリング+クランプ)を行ってLUTのインデックスに
+ * 変換する。分岐を含まないのでコンパイラによるベクトル化が効く。
+ */
+void
+fbdraw_quantize(uint8_t* dst, uint8_t* src, int n, double scale, double bias)
+{
+  int i;
+  double x;
+
+  for (i = 0; i < n; i++, src += sizeof(double)) {
+    memcpy(&x, src, sizeof(double));
+
+    x = (x * scale) + bias;
+    x = (x > 0.0)? x: 0.0;
+    x = (x < 255.0)? x: 255.0;
+
+    dst[i] = (uint8_t)x;
+  }
+}
+
+void
+fbdraw_put_string(uint8_t* pix, int stride, int w, int h,
+                  int row, int col, const char* str, int len,
+                  uint8_t r, uint8_t g, uint8_t b)
+{
+  uint8_t* p0;
+  uint8_t* p;
+  const uint8_t* gl; // as Glyph
+  int i;
+  int j;
+  int k;
+
+  p0 = pix + (((ptrdiff_t)row * stride) + (col * 3));
+
+  for (i = 0; i < len; i++) {
+    p  = p0 + (i * 6 * 3);
+    gl = font + ((uint8_t)str[i] * 10);
+
+    for (j = 0; j < 10; j++) {
+      for (k = 0; k < 5; k++) {
+        do {
+          if ((col + k <  0) || (row + j <  0)) break;
+          if ((col + k >= w) || (row + j >= h)) break;
+          if (!(gl[j] & (0x80 >> k))) break;
+
+          p[0] = r;
+          p[1] = g;
+          p[2] = b;
+        } while (0);
+
+        p += 3;
+      }
+
+      p += (stride - (5 * 3));
+    }
+
+    col += 6;
+  }
+}
+
+/*
+ * 周波数線 (赤を加算)
+ */
+void
+fbdraw_hline(uint8_t* pix, int stride, int w, int row)
+{
+  uint8_t* p;
+  int i;
+
+  p = pix + ((size_t)row * stride);
+
+  for (i = 0; i < w; i++) {
+    p[0] = 0xff;
+    p += 3;
+  }
+}
+
+/*
+ * 時間線 (青寄りの色を飽和加算)
+ */
+void
+fbdraw_vline(uint8_t* pix, int stride, int h, int x)
+{
+  uint8_t* p;
+  int i;
+  int v;
+
+  p = pix + ((size_t)x * 3);
+
+  for (i = 0; i < h; i++) {
+    v = p[0] + 0x40;
+    p[0] = (v <= 0xff)? v: 0xff;
+
+    v = p[1] + 0x40;
+    p[1] = (v <= 0xff)? v: 0xff;
+
+    v = p[2] + 0xff;
+    p[2] = (v <= 0xff)? v: 0xff;
+
+    p += stride;
+  }
+}
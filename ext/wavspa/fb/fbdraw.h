@@ -0,0 +1,63 @@
+﻿/*
+ * Drawing primitives for the spectrum frame buffer
+ *
+ *  Copyright (C) 2016 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __FBDRAW_H__
+#define __FBDRAW_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CMAP_GREEN                  0
+#define CMAP_GRAYSCALE              1
+#define CMAP_VIRIDIS                2
+#define CMAP_MAGMA                  3
+
+#define LUT_SIZE                    256
+
+/*
+ * Rubyに依存しない描画処理
+ *   (rb_fb.cとネイティブのレンダリングパイプラインで共有する)
+ */
+void fbdraw_make_lut(uint8_t* lut, int cmap);
+void fbdraw_quantize(uint8_t* dst, uint8_t* src, int n,
+                     double scale, double bias);
+void fbdraw_put_string(uint8_t* pix, int stride, int w, int h,
+                       int row, int col, const char* str, int len,
+                       uint8_t r, uint8_t g, uint8_t b);
+void fbdraw_hline(uint8_t* pix, int stride, int w, int row);
+void fbdraw_vline(uint8_t* pix, int stride, int h, int x);
+
+/*
+ * LUTインデックス(低周波側から順)を1カラム分展開する
+ *   pはカラム左上の画素を指すこと
+ */
+static inline void
+fbdraw_put_column(uint8_t* p, int stride, int height, int step,
+                  const uint8_t* lut, const uint8_t* qbuf)
+{
+  const uint8_t* q;
+  const uint8_t* c;
+  int i;
+  int j;
+
+  q = qbuf + (height - 1);
+
+  for (i = 0; i < height; i++) {
+    c = lut + (*q-- * 3);
+
+    for (j = 0; j < step; j++) {
+      p[0] = c[0];
+      p[1] = c[1];
+      p[2] = c[2];
+
+      p += 3;
+    }
+
+    p += (stride - (j * 3));
+  }
+}
+
+#endif /* !defined(__FBDRAW_H__) */
@@ -0,0 +1,557 @@
+﻿/*
+ * Parallel PNG encoder
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+/*
+ * 画像を水平方向のバンドに分割し、各バンドを別スレッドで独立した
+ * raw deflateストリームとして圧縮する(pigzと同じ方式)。最終バンド
+ * 以外はZ_SYNC_FLUSHでバイト境界に揃えて終端させるので、出力を
+ * そのまま連結すれば一つの有効なdeflateストリームになる。zlibの
+ * ヘッダとadler32(adler32_combine()で合成)を付加してIDATチャンクと
+ * して書き出す。
+ *
+ * メモリ使用量を抑えるため、バンドはスレッド数単位で処理して
+ * 順次ファイルに書き出す。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "pngenc.h"
+#include "trace.h"
+
+#define NALLOC(t,n)             ((t*)malloc(sizeof(t) * (n)))
+#define MAX(m,n)                (((m) > (n))? (m): (n))
+#define MIN(m,n)                (((m) < (n))? (m): (n))
+
+#define ERR                     __LINE__
+
+#define BPP                     3
+#define MAX_BAND_BYTES          (32 * 1024 * 1024)
+#define MAX_THREADS             64
+
+/*
+ * deflateInit2(windowBits=15, memLevel=8)の作業領域 (zconf.hの式による)
+ */
+#define DEFLATE_STATE_BYTES     ((1 << (15 + 2)) + (1 << (8 + 9)) + 6144)
+
+typedef struct {
+  uint8_t* pix;
+  int stride;
+  int rowbytes;
+  int top;
+  int rows;
+  int level;
+  int last;
+
+  uint8_t* out;
+  size_t used;
+  uLong adler;
+  uLong crc;
+
+  int err;
+} band_t;
+
+static const uint8_t signature[] = {
+  0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a
+};
+
+static void
+put_be32(uint8_t* dst, uint32_t val)
+{
+  dst[0] = (val >> 24) & 0xff;
+  dst[1] = (val >> 16) & 0xff;
+  dst[2] = (val >>  8) & 0xff;
+  dst[3] = (val >>  0) & 0xff;
+}
+
+static int
+paeth(int a, int b, int c)
+{
+  int p;
+  int pa;
+  int pb;
+  int pc;
+
+  p  = a + b - c;
+  pa = abs(p - a);
+  pb = abs(p - b);
+  pc = abs(p - c);
+
+  return (pa <= pb && pa <= pc)? a: (pb <= pc)? b: c;
+}
+
+/*
+ * 5種類のフィルタを全て試し、符号付き差分の絶対値和が最小のものを
+ * 選択する(libpngのデフォルトと同じヒューリスティック)。
+ */
+static uint8_t*
+filter_row(uint8_t** fbuf, uint8_t* cur, uint8_t* prv, int n)
+{
+  uint8_t* ret;
+  unsigned long sum[5];
+  unsigned long best;
+  int a;
+  int b;
+  int c;
+  int i;
+  int k;
+  uint8_t v;
+
+  memset(sum, 0, sizeof(sum));
+
+  fbuf[0][0] = 0;
+  fbuf[1][0] = 1;
+  fbuf[2][0] = 2;
+  fbuf[3][0] = 3;
+  fbuf[4][0] = 4;
+
+  for (i = 0; i < n; i++) {
+    a = (i >= BPP)? cur[i - BPP]: 0;
+    b = (prv != NULL)? prv[i]: 0;
+    c = (prv != NULL && i >= BPP)? prv[i - BPP]: 0;
+
+    v = cur[i];
+    fbuf[0][i + 1] = v;
+    sum[0] += (v < 128)? v: 256 - v;
+
+    v = cur[i] - a;
+    fbuf[1][i + 1] = v;
+    sum[1] += (v < 128)? v: 256 - v;
+
+    v = cur[i] - b;
+    fbuf[2][i + 1] = v;
+    sum[2] += (v < 128)? v: 256 - v;
+
+    v = cur[i] - ((a + b) >> 1);
+    fbuf[3][i + 1] = v;
+    sum[3] += (v < 128)? v: 256 - v;
+
+    v = cur[i] - paeth(a, b, c);
+    fbuf[4][i + 1] = v;
+    sum[4] += (v < 128)? v: 256 - v;
+  }
+
+  ret  = fbuf[0];
+  best = sum[0];
+
+  for (k = 1; k < 5; k++) {
+    if (sum[k] < best) {
+      ret  = fbuf[k];
+      best = sum[k];
+    }
+  }
+
+  return ret;
+}
+
+static void*
+encode_band(void* data)
+{
+  band_t* band;
+  z_stream zs;
+  int zinit;
+  uint8_t* fbuf[5];
+  uint8_t* cur;
+  uint8_t* prv;
+  uint8_t* row;
+  size_t capa;
+  int flush;
+  int err;
+  int i;
+
+  /*
+   * initialize
+   */
+  band  = (band_t*)data;
+  zinit = 0;
+
+  TRACE_BEGIN("deflate", "png", "top", band->top);
+
+  memset(&zs, 0, sizeof(zs));
+  memset(fbuf, 0, sizeof(fbuf));
+
+  band->err   = 0;
+  band->out   = NULL;
+  band->used  = 0;
+  band->adler = adler32(0, NULL, 0);
+  band->crc   = crc32(0, NULL, 0);
+
+  do {
+    /*
+     * setup deflate stream
+     */
+    if (deflateInit2(&zs, band->level,
+                     Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      band->err = ERR;
+      break;
+    }
+
+    zinit = !0;
+
+    /*
+     * alloc buffers
+     */
+    for (i = 0; i < 5; i++) {
+      fbuf[i] = NALLOC(uint8_t, band->rowbytes + 1);
+      if (fbuf[i] == NULL) {
+        band->err = ERR;
+        break;
+      }
+    }
+
+    if (band->err) break;
+
+    // 同期フラッシュの空ブロック分を含めて余裕を持たせておく
+    capa      = deflateBound(&zs,
+                             (uLong)(band->rowbytes + 1) * band->rows) + 64;
+    band->out = NALLOC(uint8_t, capa);
+    if (band->out == NULL) {
+      band->err = ERR;
+      break;
+    }
+
+    zs.next_out  = band->out;
+    zs.avail_out = capa;
+
+    /*
+     * filter and deflate rows
+     */
+    for (i = 0; i < band->rows; i++) {
+      cur = band->pix + ((size_t)(band->top + i) * band->stride);
+      prv = ((band->top + i) > 0)? cur - band->stride: NULL;
+      row = filter_row(fbuf, cur, prv, band->rowbytes);
+
+      band->adler = adler32(band->adler, row, band->rowbytes + 1);
+
+      if (i < band->rows - 1) {
+        flush = Z_NO_FLUSH;
+      } else {
+        flush = (band->last)? Z_FINISH: Z_SYNC_FLUSH;
+      }
+
+      zs.next_in  = row;
+      zs.avail_in = band->rowbytes + 1;
+
+      err = deflate(&zs, flush);
+      if (err == Z_STREAM_ERROR || zs.avail_in != 0) {
+        band->err = ERR;
+        break;
+      }
+
+      if (flush == Z_FINISH && err != Z_STREAM_END) {
+        band->err = ERR;
+        break;
+      }
+    }
+
+    if (band->err) break;
+
+    band->used = capa - zs.avail_out;
+    band->crc  = crc32(band->crc, band->out, band->used);
+  } while (0);
+
+  /*
+   * post process
+   */
+  if (zinit) deflateEnd(&zs);
+
+  for (i = 0; i < 5; i++) {
+    if (fbuf[i] != NULL) free(fbuf[i]);
+  }
+
+  if (band->err) {
+    if (band->out != NULL) free(band->out);
+    band->out = NULL;
+  }
+
+  TRACE_END();
+
+  return NULL;
+}
+
+static int
+write_chunk(FILE* fp, const char* type, uint8_t* data, size_t size)
+{
+  int ret;
+  uint8_t tmp[4];
+  uLong crc;
+
+  ret = 0;
+
+  put_be32(tmp, size);
+  if (fwrite(tmp, 4, 1, fp) != 1) ret = ERR;
+
+  if (!ret) {
+    if (fwrite(type, 4, 1, fp) != 1) ret = ERR;
+  }
+
+  if (!ret && size > 0) {
+    if (fwrite(data, size, 1, fp) != 1) ret = ERR;
+  }
+
+  if (!ret) {
+    crc = crc32(0, (const Bytef*)type, 4);
+    if (size > 0) crc = crc32(crc, data, size);
+
+    put_be32(tmp, crc);
+    if (fwrite(tmp, 4, 1, fp) != 1) ret = ERR;
+  }
+
+  return ret;
+}
+
+/*
+ * バンドの圧縮データをIDATチャンクとして書き出す。zlibヘッダ(先頭
+ * バンド)とadler32(最終バンド)はバンドの前後に付加し、CRCはスレッド
+ * 側で求めた値をcrc32_combine()で合成する。
+ */
+static int
+write_band(FILE* fp, band_t* band, int first, uLong adler)
+{
+  int ret;
+  uint8_t head[8];
+  uint8_t tail[8];
+  size_t size;
+  uLong crc;
+
+  ret  = 0;
+  size = band->used + ((first)? 2: 0) + ((band->last)? 4: 0);
+
+  put_be32(head + 0, size);
+  memcpy(head + 4, "IDAT", 4);
+
+  crc = crc32(0, head + 4, 4);
+
+  if (fwrite(head, 8, 1, fp) != 1) ret = ERR;
+
+  if (!ret && first) {
+    head[0] = 0x78;
+    head[1] = 0x9c;
+    crc     = crc32(crc, head, 2);
+
+    if (fwrite(head, 2, 1, fp) != 1) ret = ERR;
+  }
+
+  if (!ret && band->used > 0) {
+    crc = crc32_combine(crc, band->crc, band->used);
+    if (fwrite(band->out, band->used, 1, fp) != 1) ret = ERR;
+  }
+
+  if (!ret && band->last) {
+    put_be32(tail, adler);
+    crc = crc32(crc, tail, 4);
+
+    if (fwrite(tail, 4, 1, fp) != 1) ret = ERR;
+  }
+
+  if (!ret) {
+    put_be32(tail, crc);
+    if (fwrite(tail, 4, 1, fp) != 1) ret = ERR;
+  }
+
+  return ret;
+}
+
+/*
+ * 同時に処理するバンドの数と、1バンドの行数を決める
+ */
+static void
+decide_bands(int width, int height, int* nthreads, int* brows)
+{
+  int rowbytes;
+  int n;
+
+  n = *nthreads;
+  if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  n = MAX(1, MIN(n, MAX_THREADS));
+
+  rowbytes  = width * BPP;
+  *nthreads = n;
+  *brows    = MIN((height + n - 1) / n, MAX(1, MAX_BAND_BYTES / (rowbytes + 1)));
+}
+
+int
+pngenc_write(char* path, uint8_t* pix, int width, int height,
+             int stride, int nthreads, int level)
+{
+  int ret;
+  FILE* fp;
+  band_t* band;
+  pthread_t thr[MAX_THREADS];
+  int started[MAX_THREADS];
+  uint8_t ihdr[13];
+  int rowbytes;
+  int brows;
+  int nband;
+  int head;
+  int n;
+  int i;
+  uLong adler;
+
+  /*
+   * initialize
+   */
+  ret  = 0;
+  fp   = NULL;
+  band = NULL;
+
+  do {
+    /*
+     * argument check
+     */
+    if (path == NULL || pix == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (width < 1 || height < 1 || stride < (width * BPP)) {
+      ret = ERR;
+      break;
+    }
+
+    if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * decide band size
+     */
+    decide_bands(width, height, &nthreads, &brows);
+
+    rowbytes = width * BPP;
+    nband    = (height + brows - 1) / brows;
+
+    band = NALLOC(band_t, nthreads);
+    if (band == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * write header
+     */
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (fwrite(signature, sizeof(signature), 1, fp) != 1) {
+      ret = ERR;
+      break;
+    }
+
+    put_be32(ihdr + 0, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8]  = 8;       // bit depth
+    ihdr[9]  = 2;       // color type (RGB)
+    ihdr[10] = 0;       // compression method
+    ihdr[11] = 0;       // filter method
+    ihdr[12] = 0;       // interlace method
+
+    ret = write_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    if (ret) break;
+
+    /*
+     * encode bands
+     */
+    adler = adler32(0, NULL, 0);
+
+    for (head = 0; head < nband && !ret; head += nthreads) {
+      n = MIN(nthreads, nband - head);
+
+      for (i = 0; i < n; i++) {
+        band[i].pix      = pix;
+        band[i].stride   = stride;
+        band[i].rowbytes = rowbytes;
+        band[i].top      = (head + i) * brows;
+        band[i].rows     = MIN(brows, height - band[i].top);
+        band[i].level    = level;
+        band[i].last     = ((head + i) == (nband - 1));
+        band[i].out      = NULL;
+      }
+
+      if (n == 1) {
+        encode_band(band);
+
+      } else {
+        for (i = 0; i < n; i++) {
+          started[i] = !pthread_create(thr + i, NULL, encode_band, band + i);
+          if (!started[i]) encode_band(band + i);
+        }
+
+        for (i = 0; i < n; i++) {
+          if (started[i]) pthread_join(thr[i], NULL);
+        }
+      }
+
+      for (i = 0; i < n; i++) {
+        if (!ret && band[i].err) ret = band[i].err;
+
+        if (!ret) {
+          adler = adler32_combine(adler, band[i].adler,
+                                  (z_off_t)(rowbytes + 1) * band[i].rows);
+          ret   = write_band(fp, band + i, (head + i) == 0, adler);
+        }
+
+        if (band[i].out != NULL) free(band[i].out);
+      }
+    }
+
+    if (ret) break;
+
+    ret = write_chunk(fp, "IEND", NULL, 0);
+    if (ret) break;
+
+    if (fclose(fp)) {
+      fp  = NULL;
+      ret = ERR;
+      break;
+    }
+
+    fp = NULL;
+  } while (0);
+
+  /*
+   * post process
+   */
+  if (fp != NULL) fclose(fp);
+  if (band != NULL) free(band);
+
+  return ret;
+}
+
+/*
+ * pngenc_write()が確保する作業メモリの見積もり (バイト数)
+ *   同時に処理するバンド毎の圧縮出力バッファ、フィルタ用の行バッファ
+ *   およびdeflateの作業領域の合計。画素は呼び出し元のものを参照する
+ *   だけなので含まない。
+ */
+size_t
+pngenc_estimate(int width, int height, int nthreads)
+{
+  int brows;
+  int nband;
+  size_t row;
+
+  if (width < 1 || height < 1) return 0;
+
+  decide_bands(width, height, &nthreads, &brows);
+
+  nband = (height + brows - 1) / brows;
+  row   = (size_t)width * BPP + 1;
+
+  return (size_t)MIN(nthreads, nband) *
+         (compressBound((uLong)(row * brows)) + 64 +
+          (row * 5) + DEFLATE_STATE_BYTES);
+}
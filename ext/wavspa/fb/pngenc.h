@@ -0,0 +1,17 @@
+﻿/*
+ * Parallel PNG encoder
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __PNGENC_H__
+#define __PNGENC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+int pngenc_write(char* path, uint8_t* pix, int width, int height,
+                 int stride, int nthreads, int level);
+size_t pngenc_estimate(int width, int height, int nthreads);
+
+#endif /* !defined(__PNGENC_H__) */
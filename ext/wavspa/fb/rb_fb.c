@@ -5,299 +5,26 @@
  */
 
 #include "ruby.h"
+#include "ruby/thread.h"
 
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "fb.h"
+#include "fbdraw.h"
+#include "pngenc.h"
+
 #define N(x)                        (sizeof((x))/sizeof(*(x)))
 #define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
 #define ARGUMENT_ERROR(...)         rb_raise(rb_eArgError, __VA_ARGS__)
 #define RB_FFT(p)                   ((rb_fft_t*)(p))
 #define EQ_STR(val,str)             (rb_to_id(val) == rb_intern(str))
 
-typedef struct {
-  int width;
-  int height;
-  int step;
-  int margin_x;
-  int margin_y;
-
-  int stride;
-  int size;
-
-  double ceil;
-  double floor;
-  double range;
-  double lumi;
-
-  VALUE buf;
-} rb_fb_t;
-
-/*
- * from M+ font (M+ gothic 10r)
- */
-const uint8_t font[] = {
-  0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x70, 0x00, /* 0x00 */
-  0x00, 0x00, 0x00, 0x60, 0xf0, 0x60, 0x00, 0x00, 0x00, 0x00, /* 0x01 */
-  0x50, 0xa8, 0x50, 0xa8, 0x50, 0xa8, 0x50, 0xa8, 0x50, 0xa8, /* 0x02 */
-  0x90, 0xf0, 0x90, 0x90, 0x00, 0xf8, 0x20, 0x20, 0x20, 0x00, /* 0x03 */
-  0xf0, 0x80, 0xf0, 0x80, 0x00, 0xf0, 0x80, 0xf0, 0x80, 0x00, /* 0x04 */
-  0xf0, 0x90, 0x80, 0xf0, 0x00, 0xf0, 0x90, 0xe0, 0x90, 0x00, /* 0x05 */
-  0x80, 0x80, 0x80, 0xf0, 0x00, 0xf0, 0x80, 0xf0, 0x80, 0x00, /* 0x06 */
-  0x60, 0x90, 0x90, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x07 */
-  0x00, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x00, 0xf0, 0x00, 0x00, /* 0x08 */
-  0x90, 0xd0, 0xb0, 0x90, 0x00, 0x80, 0x80, 0x80, 0xf0, 0x00, /* 0x09 */
-  0x90, 0x90, 0xa0, 0xc0, 0x00, 0xf8, 0x20, 0x20, 0x20, 0x00, /* 0x0a */
-  0x20, 0x20, 0x20, 0x20, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x0b */
-  0x00, 0x00, 0x00, 0x00, 0xe0, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x0c */
-  0x00, 0x00, 0x00, 0x00, 0x38, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x0d */
-  0x20, 0x20, 0x20, 0x20, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x0e */
-  0x20, 0x20, 0x20, 0x20, 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x0f */
-  0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x10 */
-  0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x11 */
-  0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x12 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, 0x00, 0x00, /* 0x13 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x00, /* 0x14 */
-  0x20, 0x20, 0x20, 0x20, 0x38, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x15 */
-  0x20, 0x20, 0x20, 0x20, 0xe0, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x16 */
-  0x20, 0x20, 0x20, 0x20, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x17 */
-  0x00, 0x00, 0x00, 0x00, 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x18 */
-  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, /* 0x19 */
-  0x00, 0x20, 0x40, 0x80, 0x40, 0x20, 0x00, 0xf0, 0x00, 0x00, /* 0x1a */
-  0x00, 0x40, 0x20, 0x10, 0x20, 0x40, 0x00, 0xf0, 0x00, 0x00, /* 0x1b */
-  0x00, 0x00, 0x00, 0xf0, 0x50, 0x50, 0x90, 0x90, 0x00, 0x00, /* 0x1c */
-  0x00, 0x20, 0x20, 0xf0, 0x40, 0xf0, 0x40, 0x40, 0x00, 0x00, /* 0x1d */
-  0x00, 0x30, 0x40, 0x40, 0xf0, 0x40, 0x40, 0xb0, 0x00, 0x00, /* 0x1e */
-  0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x1f */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x20 */
-  0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x20, 0x00, 0x00, /* 0x21 */
-  0x50, 0x50, 0x50, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x22 */
-  0x00, 0x50, 0x50, 0xf0, 0x50, 0xf0, 0x50, 0x50, 0x00, 0x00, /* 0x23 */
-  0x00, 0x20, 0x70, 0xa0, 0xe0, 0x70, 0x50, 0xe0, 0x40, 0x00, /* 0x24 */
-  0x00, 0xc0, 0xc0, 0x10, 0x60, 0x80, 0x30, 0x30, 0x00, 0x00, /* 0x25 */
-  0x00, 0x40, 0xa0, 0xa0, 0x40, 0xb0, 0xa0, 0x50, 0x00, 0x00, /* 0x26 */
-  0x20, 0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x27 */
-  0x10, 0x20, 0x20, 0x40, 0x40, 0x40, 0x20, 0x20, 0x10, 0x00, /* 0x28 */
-  0x80, 0x40, 0x40, 0x20, 0x20, 0x20, 0x40, 0x40, 0x80, 0x00, /* 0x29 */
-  0x00, 0x00, 0x50, 0x20, 0xf0, 0x20, 0x50, 0x00, 0x00, 0x00, /* 0x2a */
-  0x00, 0x00, 0x20, 0x20, 0xf0, 0x20, 0x20, 0x00, 0x00, 0x00, /* 0x2b */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x40, 0x00, /* 0x2c */
-  0x00, 0x00, 0x00, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x2d */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, /* 0x2e */
-  0x00, 0x10, 0x10, 0x20, 0x20, 0x40, 0x40, 0x80, 0x80, 0x00, /* 0x2f */
-  0x00, 0x60, 0x90, 0xb0, 0xd0, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x30 */
-  0x00, 0x20, 0x60, 0xa0, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00, /* 0x31 */
-  0x00, 0x60, 0x90, 0x10, 0x20, 0x40, 0x80, 0xf0, 0x00, 0x00, /* 0x32 */
-  0x00, 0xf0, 0x10, 0x20, 0x60, 0x10, 0x90, 0x60, 0x00, 0x00, /* 0x33 */
-  0x00, 0x20, 0x60, 0xa0, 0xa0, 0xf0, 0x20, 0x20, 0x00, 0x00, /* 0x34 */
-  0x00, 0xf0, 0x80, 0xe0, 0x10, 0x10, 0x90, 0x60, 0x00, 0x00, /* 0x35 */
-  0x00, 0x60, 0x80, 0xe0, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x36 */
-  0x00, 0xf0, 0x10, 0x20, 0x20, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0x37 */
-  0x00, 0x60, 0x90, 0x90, 0x60, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x38 */
-  0x00, 0x60, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, 0x00, 0x00, /* 0x39 */
-  0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, /* 0x3a */
-  0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x40, 0x00, 0x00, /* 0x3b */
-  0x00, 0x10, 0x20, 0x40, 0x80, 0x40, 0x20, 0x10, 0x00, 0x00, /* 0x3c */
-  0x00, 0x00, 0x00, 0xf0, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00, /* 0x3d */
-  0x00, 0x80, 0x40, 0x20, 0x10, 0x20, 0x40, 0x80, 0x00, 0x00, /* 0x3e */
-  0x00, 0xe0, 0x10, 0x10, 0x20, 0x40, 0x00, 0x40, 0x00, 0x00, /* 0x3f */
-  0x00, 0x60, 0x90, 0xb0, 0xa0, 0xb0, 0x80, 0x70, 0x00, 0x00, /* 0x40 */
-  0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x41 */
-  0x00, 0xe0, 0x90, 0x90, 0xe0, 0x90, 0x90, 0xe0, 0x00, 0x00, /* 0x42 */
-  0x00, 0x60, 0x90, 0x80, 0x80, 0x80, 0x80, 0x70, 0x00, 0x00, /* 0x43 */
-  0x00, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x90, 0xe0, 0x00, 0x00, /* 0x44 */
-  0x00, 0xf0, 0x80, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0x45 */
-  0x00, 0xf0, 0x80, 0x80, 0xe0, 0x80, 0x80, 0x80, 0x00, 0x00, /* 0x46 */
-  0x00, 0x70, 0x80, 0x80, 0xb0, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0x47 */
-  0x00, 0x90, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x48 */
-  0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0x49 */
-  0x00, 0x10, 0x10, 0x10, 0x10, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x4a */
-  0x00, 0x90, 0xa0, 0xc0, 0xc0, 0xa0, 0x90, 0x90, 0x00, 0x00, /* 0x4b */
-  0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0x4c */
-  0x00, 0x90, 0xb0, 0xd0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x4d */
-  0x00, 0x90, 0xd0, 0xb0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x4e */
-  0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x4f */
-  0x00, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, 0x00, 0x00, /* 0x50 */
-  0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x40, 0x30, /* 0x51 */
-  0x00, 0xe0, 0x90, 0x90, 0xe0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x52 */
-  0x00, 0x70, 0x80, 0x80, 0x60, 0x10, 0x10, 0xe0, 0x00, 0x00, /* 0x53 */
-  0x00, 0xf8, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00, /* 0x54 */
-  0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x55 */
-  0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0xa0, 0xc0, 0x00, 0x00, /* 0x56 */
-  0x00, 0x90, 0x90, 0x90, 0x90, 0xd0, 0xb0, 0x90, 0x00, 0x00, /* 0x57 */
-  0x00, 0x90, 0x90, 0x90, 0x60, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x58 */
-  0x00, 0x90, 0x90, 0x90, 0xa0, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0x59 */
-  0x00, 0xf0, 0x10, 0x20, 0x40, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0x5a */
-  0x70, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x70, 0x00, /* 0x5b */
-  0x00, 0x80, 0x80, 0x40, 0x40, 0x20, 0x20, 0x10, 0x10, 0x00, /* 0x5c */
-  0xe0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xe0, 0x00, /* 0x5d */
-  0x20, 0x50, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x5e */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x00, /* 0x5f */
-  0x40, 0x40, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x60 */
-  0x00, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0x61 */
-  0x00, 0x80, 0x80, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x00, 0x00, /* 0x62 */
-  0x00, 0x00, 0x00, 0x60, 0x90, 0x80, 0x80, 0x70, 0x00, 0x00, /* 0x63 */
-  0x00, 0x10, 0x10, 0x70, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0x64 */
-  0x00, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0x65 */
-  0x00, 0x30, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0x66 */
-  0x00, 0x00, 0x00, 0x70, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0x67 */
-  0x00, 0x80, 0x80, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x68 */
-  0x20, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0x69 */
-  0x20, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0xc0, /* 0x6a */
-  0x00, 0x80, 0x80, 0x90, 0xa0, 0xc0, 0xa0, 0x90, 0x00, 0x00, /* 0x6b */
-  0x00, 0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0x30, 0x00, 0x00, /* 0x6c */
-  0x00, 0x00, 0x00, 0xf0, 0xa8, 0xa8, 0xa8, 0xa8, 0x00, 0x00, /* 0x6d */
-  0x00, 0x00, 0x00, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0x6e */
-  0x00, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0x6f */
-  0x00, 0x00, 0x00, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, /* 0x70 */
-  0x00, 0x00, 0x00, 0x70, 0x90, 0x90, 0x90, 0x70, 0x10, 0x10, /* 0x71 */
-  0x00, 0x00, 0x00, 0xb0, 0xc0, 0x80, 0x80, 0x80, 0x00, 0x00, /* 0x72 */
-  0x00, 0x00, 0x00, 0x70, 0x80, 0x60, 0x10, 0xe0, 0x00, 0x00, /* 0x73 */
-  0x00, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x40, 0x30, 0x00, 0x00, /* 0x74 */
-  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0x75 */
-  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0xa0, 0xc0, 0x00, 0x00, /* 0x76 */
-  0x00, 0x00, 0x00, 0x90, 0x90, 0xd0, 0xb0, 0x90, 0x00, 0x00, /* 0x77 */
-  0x00, 0x00, 0x00, 0x90, 0x90, 0x60, 0x90, 0x90, 0x00, 0x00, /* 0x78 */
-  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0x79 */
-  0x00, 0x00, 0x00, 0xf0, 0x20, 0x40, 0x80, 0xf0, 0x00, 0x00, /* 0x7a */
-  0x30, 0x40, 0x40, 0x40, 0x80, 0x40, 0x40, 0x40, 0x30, 0x00, /* 0x7b */
-  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, /* 0x7c */
-  0xc0, 0x20, 0x20, 0x20, 0x10, 0x20, 0x20, 0x20, 0xc0, 0x00, /* 0x7d */
-  0x00, 0x50, 0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x7e */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x7f */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x80 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x81 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x82 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x83 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x84 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x85 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x86 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x87 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x88 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x89 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8a */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8b */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8c */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8d */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8e */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x8f */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x90 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x91 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x92 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x93 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x94 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x95 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x96 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x97 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x98 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x99 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9a */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9b */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9c */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9d */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9e */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x9f */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xa0 */
-  0x00, 0x20, 0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00, /* 0xa1 */
-  0x00, 0x20, 0x20, 0x70, 0xa0, 0xa0, 0xa0, 0x70, 0x20, 0x00, /* 0xa2 */
-  0x00, 0x30, 0x40, 0x40, 0xf0, 0x40, 0x40, 0xb0, 0x00, 0x00, /* 0xa3 */
-  0x00, 0x00, 0x90, 0x60, 0x60, 0x60, 0x90, 0x00, 0x00, 0x00, /* 0xa4 */
-  0x00, 0x90, 0xa0, 0x40, 0xf0, 0x40, 0xf0, 0x40, 0x00, 0x00, /* 0xa5 */
-  0x20, 0x20, 0x20, 0x20, 0x00, 0x20, 0x20, 0x20, 0x20, 0x00, /* 0xa6 */
-  0x60, 0x90, 0x80, 0x60, 0x90, 0x60, 0x10, 0x90, 0x60, 0x00, /* 0xa7 */
-  0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xa8 */
-  0x00, 0xf0, 0x90, 0x60, 0x40, 0x60, 0x90, 0xf0, 0x00, 0x00, /* 0xa9 */
-  0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0xf0, 0x00, 0x00, /* 0xaa */
-  0x00, 0x10, 0x20, 0x50, 0xa0, 0x50, 0x20, 0x10, 0x00, 0x00, /* 0xab */
-  0x00, 0x00, 0x00, 0x00, 0xf0, 0x10, 0x10, 0x00, 0x00, 0x00, /* 0xac */
-  0x00, 0x00, 0x00, 0x00, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xad */
-  0x00, 0xf0, 0x90, 0x60, 0x40, 0x40, 0x90, 0xf0, 0x00, 0x00, /* 0xae */
-  0x00, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xaf */
-  0x60, 0x90, 0x90, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb0 */
-  0x00, 0x40, 0x40, 0xf0, 0x40, 0x40, 0x00, 0xf0, 0x00, 0x00, /* 0xb1 */
-  0xc0, 0x20, 0x40, 0x80, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb2 */
-  0xe0, 0x20, 0x40, 0x20, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb3 */
-  0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb4 */
-  0x00, 0x00, 0x00, 0x90, 0x90, 0x90, 0xb0, 0xd0, 0x80, 0x80, /* 0xb5 */
-  0x00, 0xf0, 0xd0, 0xd0, 0xd0, 0x50, 0x50, 0x50, 0x00, 0x00, /* 0xb6 */
-  0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb7 */
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x20, 0x40, /* 0xb8 */
-  0x40, 0xc0, 0x40, 0x40, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0xb9 */
-  0x60, 0x90, 0x90, 0x60, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x00, /* 0xba */
-  0x00, 0x80, 0x40, 0xa0, 0x50, 0xa0, 0x40, 0x80, 0x00, 0x00, /* 0xbb */
-  0x40, 0xc0, 0x40, 0x40, 0x30, 0x50, 0x70, 0x10, 0x00, 0x00, /* 0xbc */
-  0x40, 0xc0, 0x40, 0x40, 0x70, 0x10, 0x20, 0x70, 0x00, 0x00, /* 0xbd */
-  0xe0, 0x40, 0x20, 0xc0, 0x30, 0x50, 0x70, 0x10, 0x00, 0x00, /* 0xbe */
-  0x00, 0x20, 0x00, 0x20, 0x40, 0x80, 0x80, 0x70, 0x00, 0x00, /* 0xbf */
-  0x20, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc0 */
-  0x40, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc1 */
-  0x90, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc2 */
-  0xa0, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc3 */
-  0x50, 0x00, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc4 */
-  0x90, 0x90, 0x60, 0x90, 0x90, 0xf0, 0x90, 0x90, 0x00, 0x00, /* 0xc5 */
-  0x00, 0xf0, 0xa0, 0xa0, 0xf0, 0xa0, 0xa0, 0xb0, 0x00, 0x00, /* 0xc6 */
-  0x00, 0x60, 0x90, 0x80, 0x80, 0x80, 0x80, 0x70, 0x20, 0x40, /* 0xc7 */
-  0x20, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xc8 */
-  0x40, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xc9 */
-  0x90, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xca */
-  0x50, 0x00, 0xf0, 0x80, 0xe0, 0x80, 0x80, 0xf0, 0x00, 0x00, /* 0xcb */
-  0x10, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xcc */
-  0x20, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xcd */
-  0x90, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xce */
-  0x50, 0x00, 0x70, 0x20, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xcf */
-  0x00, 0xe0, 0x50, 0x50, 0xf0, 0x50, 0x50, 0xe0, 0x00, 0x00, /* 0xd0 */
-  0xa0, 0x00, 0x90, 0xd0, 0xb0, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0xd1 */
-  0x20, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd2 */
-  0x40, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd3 */
-  0x90, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd4 */
-  0xa0, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd5 */
-  0x50, 0x00, 0x60, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd6 */
-  0x00, 0x00, 0x90, 0x90, 0x60, 0x90, 0x90, 0x00, 0x00, 0x00, /* 0xd7 */
-  0x10, 0x60, 0x90, 0xb0, 0xd0, 0x90, 0x90, 0x60, 0x80, 0x00, /* 0xd8 */
-  0x20, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xd9 */
-  0x40, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xda */
-  0x90, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xdb */
-  0x50, 0x00, 0x90, 0x90, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xdc */
-  0x40, 0x00, 0x90, 0x90, 0xa0, 0x40, 0x40, 0x40, 0x00, 0x00, /* 0xdd */
-  0x80, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, 0x00, 0x00, /* 0xde */
-  0x00, 0x60, 0x90, 0x90, 0xe0, 0x90, 0x90, 0xe0, 0x80, 0x80, /* 0xdf */
-  0x20, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe0 */
-  0x40, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe1 */
-  0x90, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe2 */
-  0xa0, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe3 */
-  0x50, 0x00, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe4 */
-  0x90, 0x60, 0x00, 0x60, 0x10, 0x70, 0x90, 0x70, 0x00, 0x00, /* 0xe5 */
-  0x00, 0x00, 0x00, 0xf0, 0x20, 0x70, 0xa0, 0xf0, 0x00, 0x00, /* 0xe6 */
-  0x00, 0x00, 0x00, 0x60, 0x90, 0x80, 0x80, 0x70, 0x20, 0x40, /* 0xe7 */
-  0x20, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xe8 */
-  0x40, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xe9 */
-  0x90, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xea */
-  0x50, 0x00, 0x00, 0x60, 0x90, 0xf0, 0x80, 0x70, 0x00, 0x00, /* 0xeb */
-  0x10, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xec */
-  0x20, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xed */
-  0x90, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xee */
-  0x50, 0x00, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, 0x00, 0x00, /* 0xef */
-  0x70, 0xc0, 0x20, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf0 */
-  0xa0, 0x00, 0x00, 0xe0, 0x90, 0x90, 0x90, 0x90, 0x00, 0x00, /* 0xf1 */
-  0x20, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf2 */
-  0x40, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf3 */
-  0x90, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf4 */
-  0xa0, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf5 */
-  0x50, 0x00, 0x00, 0x60, 0x90, 0x90, 0x90, 0x60, 0x00, 0x00, /* 0xf6 */
-  0x00, 0x40, 0x40, 0x00, 0xf0, 0x00, 0x40, 0x40, 0x00, 0x00, /* 0xf7 */
-  0x00, 0x00, 0x10, 0x60, 0x90, 0xf0, 0x90, 0x60, 0x80, 0x00, /* 0xf8 */
-  0x20, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xf9 */
-  0x40, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xfa */
-  0x90, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xfb */
-  0x50, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x00, 0x00, /* 0xfc */
-  0x40, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0xfd */
-  0x00, 0x80, 0x80, 0xe0, 0x90, 0x90, 0x90, 0xe0, 0x80, 0x80, /* 0xfe */
-  0x50, 0x00, 0x00, 0x90, 0x90, 0x90, 0x90, 0x70, 0x10, 0x60, /* 0xff */
-};
-
-static VALUE wavspa_module;
-static VALUE fb_klass;
-
 static const char* opts_keys[] = {
   "column_step",
   "margin_x",
@@ -305,26 +32,36 @@ static const char* opts_keys[] = {
   "ceil",
   "floor",
   "luminance",
+  "colormap",
+  "mmap",
+  "bands",
 };
 
 static ID opts_ids[N(opts_keys)];
 
+static const char* png_opts_keys[] = {
+  "threads",          // {int}
+  "level",            // {int}
+};
+
+static ID png_opts_ids[N(png_opts_keys)];
+
 static void
-rb_fb_mark(void* _ptr)
+rb_fb_free(void* _ptr)
 {
   rb_fb_t* ptr;
 
   ptr = (rb_fb_t*)_ptr;
 
-  if (ptr->buf != Qnil) {
-    rb_gc_mark(ptr->buf);
+  if (ptr->qbuf != NULL) xfree(ptr->qbuf);
+
+  if (ptr->map != NULL) {
+    munmap(ptr->map, ptr->size);
+  } else if (ptr->pix != NULL) {
+    xfree(ptr->pix);
   }
-}
 
-static void
-rb_fb_free(void* _ptr)
-{
-  ((rb_fb_t*)_ptr)->buf = Qnil;
+  xfree(ptr);
 }
 
 static size_t
@@ -334,16 +71,17 @@ rb_fb_size(const void* _ptr)
   rb_fb_t* ptr;
 
   ptr = (rb_fb_t*)_ptr;
-  ret = sizeof(*ptr) + ((ptr->buf != Qnil)? RSTRING_LEN(ptr->buf): 0);
+  ret = sizeof(*ptr) + ((ptr->map == NULL)? ptr->size: 0);
 
   return ret;
 }
 
 static const struct rb_data_type_struct fb_data_type = {
-  "Simple frame buffer for WAV file spectrum analyzer",
-  {rb_fb_mark, rb_fb_free, rb_fb_size, {NULL, NULL}},
-  NULL,
-  NULL,
+  .wrap_struct_name = FB_DATA_TYPE_NAME,
+  .function = {
+    .dfree = rb_fb_free,
+    .dsize = rb_fb_size,
+  },
 };
 
 static VALUE
@@ -356,6 +94,7 @@ rb_fb_alloc(VALUE self)
 
   ptr->width    = -1;
   ptr->height   = -1;
+  ptr->bands    = 1;
   ptr->step     = 1;
   ptr->margin_x = 0;
   ptr->margin_y = 0;
@@ -363,10 +102,71 @@ rb_fb_alloc(VALUE self)
   ptr->floor    = -90.0;
   ptr->range    = ptr->ceil - ptr->floor;
   ptr->lumi     = 3.5;
-  ptr->size     = -1;
-  ptr->buf      = Qnil;
+  ptr->cmap     = CMAP_GREEN;
+  ptr->qbuf     = NULL;
+  ptr->size     = 0;
+  ptr->pix      = NULL;
+  ptr->map      = NULL;
+
+  return TypedData_Wrap_Struct(self, &fb_data_type, ptr);
+}
+
+static void
+set_colormap(rb_fb_t* ptr)
+{
+  fbdraw_make_lut(ptr->lut, ptr->cmap);
+}
+
+/*
+ * 画素データをファイルにマップする(物理メモリを超える画像向け)。
+ * pathにnilを指定した場合は一時ファイルを作成し、直ちにunlinkする。
+ */
+static void
+map_store(rb_fb_t* ptr, VALUE path)
+{
+  int fd;
+  int err;
+  char tmpl[1024];
+  const char* dir;
+  void* map;
+
+  if (path == Qnil) {
+    dir = getenv("TMPDIR");
+    if (dir == NULL) dir = "/tmp";
+
+    snprintf(tmpl, sizeof(tmpl), "%s/wavspa-fb-XXXXXX", dir);
+
+    fd = mkstemp(tmpl);
+    if (fd >= 0) unlink(tmpl);
+
+  } else {
+    fd = open(StringValueCStr(path), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  }
+
+  if (fd < 0) {
+    rb_sys_fail("open backing file");
+  }
+
+  /*
+   * ftruncate()で広げただけの疎なファイルでは、ディスクが溢れた時点で
+   * 描画中にSIGBUSとなるので、先に全領域を確保しておく
+   */
+  err = posix_fallocate(fd, 0, ptr->size);
+  if (err) {
+    close(fd);
+    rb_syserr_fail(err, "allocate backing file");
+  }
+
+  map = mmap(NULL, ptr->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    rb_sys_fail("mmap backing file");
+  }
 
-  return TypedData_Wrap_Struct(fb_klass, &fb_data_type, ptr);
+  // 確保した領域はゼロで埋まっているのでクリアは不要
+  ptr->map = map;
+  ptr->pix = (uint8_t*)map;
 }
 
 static VALUE
@@ -377,6 +177,7 @@ rb_fb_initialize(int argc, VALUE* argv, VALUE self)
   VALUE height;
   VALUE opt;
   VALUE opts[N(opts_ids)];
+  VALUE mmap_opt;
 
   /*
    * extract context data
@@ -388,6 +189,8 @@ rb_fb_initialize(int argc, VALUE* argv, VALUE self)
    */
   rb_scan_args(argc, argv, "21", &width, &height, &opt);
 
+  mmap_opt = Qfalse;
+
   /*
    * eval argument
    */
@@ -419,22 +222,67 @@ rb_fb_initialize(int argc, VALUE* argv, VALUE self)
 
     // :numinance
     if (opts[5] != Qundef) ptr->lumi = NUM2DBL(opts[5]);
+
+    // :colormap
+    if (opts[6] != Qundef) {
+      if (EQ_STR(opts[6], "GREEN")) {
+        ptr->cmap = CMAP_GREEN;
+
+      } else if (EQ_STR(opts[6], "GRAYSCALE") || EQ_STR(opts[6], "GRAY")) {
+        ptr->cmap = CMAP_GRAYSCALE;
+
+      } else if (EQ_STR(opts[6], "VIRIDIS")) {
+        ptr->cmap = CMAP_VIRIDIS;
+
+      } else if (EQ_STR(opts[6], "MAGMA")) {
+        ptr->cmap = CMAP_MAGMA;
+
+      } else {
+        ARGUMENT_ERROR("unknown colormap");
+      }
+    }
+
+    // :mmap
+    if (opts[7] != Qundef && RTEST(opts[7])) {
+      if (opts[7] != Qtrue) ExportStringValue(opts[7]);
+      mmap_opt = opts[7];
+    }
+
+    // :bands
+    if (opts[8] != Qundef) {
+      ptr->bands = FIX2INT(opts[8]);
+      if (ptr->bands < 1) ARGUMENT_ERROR("invalid band number");
+    }
+  }
+
+  if (ptr->pix != NULL) {
+    RUNTIME_ERROR("already initialized");
   }
 
   ptr->width  = FIX2INT(width);
   ptr->height = FIX2INT(height);
 
   ptr->stride = (ptr->margin_x + (ptr->width * ptr->step)) * 3;
-  ptr->size   = ptr->stride * (ptr->height + ptr->margin_y);
-  ptr->buf    = rb_str_buf_new(ptr->size);
+  ptr->size   = (size_t)ptr->stride *
+                        ((ptr->height * ptr->bands) + ptr->margin_y);
 
   ptr->range  = ptr->ceil - ptr->floor;
+  ptr->pscale = 1024 * ptr->lumi;
+  ptr->ascale = 255.0 / ptr->range;
+  if (ptr->qbuf != NULL) xfree(ptr->qbuf);
+  ptr->qbuf   = ALLOC_N(uint8_t, ptr->height * ptr->bands);
+
+  set_colormap(ptr);
 
   /*
-   * clear buffer
+   * alloc and clear buffer
    */
-  rb_str_set_len(ptr->buf, ptr->size);
-  memset(RSTRING_PTR(ptr->buf), 0, RSTRING_LEN(ptr->buf));
+  if (mmap_opt != Qfalse) {
+    map_store(ptr, (mmap_opt == Qtrue)? Qnil: mmap_opt);
+
+  } else {
+    ptr->pix = ZALLOC_N(uint8_t, ptr->size);
+  }
 
   return self;
 }
@@ -462,7 +310,20 @@ rb_fb_height(VALUE self)
    */
   TypedData_Get_Struct(self, rb_fb_t, &fb_data_type, ptr);
 
-  return INT2FIX(ptr->height + ptr->margin_y);
+  return INT2FIX((ptr->height * ptr->bands) + ptr->margin_y);
+}
+
+static VALUE
+rb_fb_bands(VALUE self)
+{
+  rb_fb_t* ptr;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_fb_t, &fb_data_type, ptr);
+
+  return INT2FIX(ptr->bands);
 }
 
 static VALUE
@@ -475,19 +336,42 @@ rb_fb_to_s(VALUE self)
    */
   TypedData_Get_Struct(self, rb_fb_t, &fb_data_type, ptr);
 
-  return ptr->buf;
+  if (ptr->pix == NULL) {
+    RUNTIME_ERROR("frame buffer is not initialized");
+  }
+
+  /*
+   * 画素データはコピーして返す
+   *   (返したStringへの変更で描画先が再確保されないように)
+   */
+  return rb_str_new((char*)ptr->pix, ptr->size);
+}
+
+static int
+get_band(rb_fb_t* ptr, int argc, VALUE* argv, VALUE* col, VALUE* dat)
+{
+  VALUE band;
+
+  rb_scan_args(argc, argv, "21", col, dat, &band);
+
+  if (band == Qnil) return 0;
+
+  Check_Type(band, T_FIXNUM);
+
+  if (FIX2INT(band) < 0 || FIX2INT(band) >= ptr->bands) {
+    ARGUMENT_ERROR("invalid band number");
+  }
+
+  return FIX2INT(band);
 }
 
 static VALUE
-rb_fb_draw_power(VALUE self, VALUE col, VALUE dat)
+rb_fb_draw_power(int argc, VALUE* argv, VALUE self)
 {
   rb_fb_t* ptr;
-  uint8_t* p;
-  uint8_t* src;
-  double x;
-  int v;
-  int i;
-  int j;
+  VALUE col;
+  VALUE dat;
+  int band;
 
   /*
    * extract context data
@@ -497,6 +381,8 @@ rb_fb_draw_power(VALUE self, VALUE col, VALUE dat)
   /*
    * check argument
    */
+  band = get_band(ptr, argc, argv, &col, &dat);
+
   Check_Type(col, T_FIXNUM);
   Check_Type(dat, T_STRING);
 
@@ -511,47 +397,21 @@ rb_fb_draw_power(VALUE self, VALUE col, VALUE dat)
   /*
    * put pixel data
    */
-  p   = (uint8_t*)RSTRING_PTR(ptr->buf) +
-              ((ptr->margin_x + (FIX2INT(col) * ptr->step)) * 3);
-  src = (uint8_t*)RSTRING_PTR(dat) + (sizeof(double) * (ptr->height - 1));
-
-  for (i = 0; i < ptr->height; i++) {
-    memcpy(&x, src, sizeof(double));
-
-    v = round(x * 1024 * ptr->lumi);
-
-    if (v < 0) {
-      v = 0;
-
-    } else if (v > 255.0) {
-      v = 255;
-    }
-
-    for (j = 0; j < ptr->step; j++) {
-      p[0] = v / 3;
-      p[1] = v;
-      p[2] = v / 2;
-
-      p += 3;
-    }
+  fbdraw_quantize(fb_qbuf(ptr, band),
+           (uint8_t*)RSTRING_PTR(dat), ptr->height, ptr->pscale, 0.5);
 
-    p   += (ptr->stride - (j * 3));
-    src -= sizeof(double);
-  }
+  fb_put_column(ptr, FIX2INT(col), band);
 
   return self;
 }
 
 static VALUE
-rb_fb_draw_amplitude(VALUE self, VALUE col, VALUE dat)
+rb_fb_draw_amplitude(int argc, VALUE* argv, VALUE self)
 {
   rb_fb_t* ptr;
-  uint8_t* p;
-  uint8_t* src;
-  double x;
-  int v;
-  int i;
-  int j;
+  VALUE col;
+  VALUE dat;
+  int band;
 
   /*
    * extract context data
@@ -561,6 +421,8 @@ rb_fb_draw_amplitude(VALUE self, VALUE col, VALUE dat)
   /*
    * check argument
    */
+  band = get_band(ptr, argc, argv, &col, &dat);
+
   Check_Type(col, T_FIXNUM);
   Check_Type(dat, T_STRING);
 
@@ -575,34 +437,11 @@ rb_fb_draw_amplitude(VALUE self, VALUE col, VALUE dat)
   /*
    * put pixel data
    */
-  p   = (uint8_t*)RSTRING_PTR(ptr->buf) +
-              ((ptr->margin_x + (FIX2INT(col) * ptr->step)) * 3);
-  src = (uint8_t*)RSTRING_PTR(dat) + (sizeof(double) * (ptr->height - 1));
-
-  for (i = 0; i < ptr->height; i++) {
-    memcpy(&x, src, sizeof(double));
-
-    if (x >= ptr->ceil) {
-      v = 255;
-
-    } else if (x <= ptr->floor) {
-      v = 0;
-
-    } else {
-      v = (uint8_t)((255.0 * (x - ptr->floor)) / ptr->range);
-    }
+  fbdraw_quantize(fb_qbuf(ptr, band),
+           (uint8_t*)RSTRING_PTR(dat),
+           ptr->height, ptr->ascale, -ptr->floor * ptr->ascale);
 
-    for (j = 0; j < ptr->step; j++) {
-      p[0] = v / 3;
-      p[1] = v;
-      p[2] = v / 2;
-
-      p += 3;
-    }
-
-    p   += (ptr->stride - (j * 3));
-    src -= sizeof(double);
-  }
+  fb_put_column(ptr, FIX2INT(col), band);
 
   return self;
 }
@@ -611,63 +450,16 @@ static void
 put_string(rb_fb_t* ptr, int row, int col,
            VALUE rstr, uint8_t r, uint8_t g, uint8_t b)
 {
-  uint8_t* head;
-  uint8_t* tail;
-  uint8_t* p0;
-  char* str;
-  int len;
-  int w;
-  int h;
-
-  uint8_t* p;
-  const uint8_t* gl; // as Glyph
-  int i;
-  int j;
-  int k;
-  uint8_t m;
-
-  head = (uint8_t*)RSTRING_PTR(ptr->buf);
-  tail = head + RSTRING_LEN(ptr->buf);
-  p0   = head + ((row * ptr->stride) + (col * 3));
-  str  = RSTRING_PTR(rstr);
-  len  = RSTRING_LEN(rstr);
-  w    = ptr->width + ptr->margin_x;
-  h    = ptr->height + ptr->margin_y;
-
-  for (i = 0; i < len; i++) {
-    p  = p0 + (i * 6 * 3);
-    gl = font + (str[i] * 10);
-
-    for (j = 0; j < 10; j++) {
-      for (k = 0; k < 5; k++) {
-        do {
-          if ((col + k <  0) || (row + j <  0)) break;
-          if ((col + k >= w) || (row + j >= h)) break;
-          if (!(gl[j] & (0x80 >> k))) break;
-
-          p[0] = r;
-          p[1] = g;
-          p[2] = b;
-        } while (0);
-
-        p += 3;
-      }
-
-      p += (ptr->stride - (5 * 3));
-    }
-
-    col += 6;
-  }
+  fbdraw_put_string(ptr->pix, ptr->stride,
+                    ptr->width + ptr->margin_x,
+                    (ptr->height * ptr->bands) + ptr->margin_y,
+                    row, col, RSTRING_PTR(rstr), RSTRING_LEN(rstr), r, g, b);
 }
 
 static VALUE
 rb_fb_hline(VALUE self, VALUE row, VALUE label)
 {
   rb_fb_t* ptr;
-  uint8_t* p;
-  int i;
-  int j;
-  int w;
 
   /*
    * extract context data
@@ -680,31 +472,15 @@ rb_fb_hline(VALUE self, VALUE row, VALUE label)
   Check_Type(row, T_FIXNUM);
   Check_Type(label, T_STRING);
 
-  if (FIX2INT(row) < 0 || FIX2INT(row) >= ptr->height) {
+  if (FIX2INT(row) < 0 || FIX2INT(row) >= (ptr->height * ptr->bands)) {
     ARGUMENT_ERROR("invalid column number");
   }
 
   /*
    * put line
    */
-  p = (uint8_t*)RSTRING_PTR(ptr->buf) + (FIX2INT(row) * ptr->stride);
-  w = ptr->margin_x + (ptr->width * ptr->step);
-
-  for (i = 0; i < w; i++) {
-    for (j = 0; j < ptr->step; j++) {
-      int v;
-      v = p[0] + 0xff;
-      p[0] = (v <= 0xff)? v: 0xff;
-
-      v = p[1] + 0x00;
-      p[1] = (v <= 0xff)? v: 0xff;
-
-      v = p[2] + 0x00;
-      p[2] = (v <= 0xff)? v: 0xff;
-    }
-
-    p += 3;
-  }
+  fbdraw_hline(ptr->pix, ptr->stride,
+               ptr->margin_x + (ptr->width * ptr->step), FIX2INT(row));
 
   /*
    * put label
@@ -718,9 +494,6 @@ static VALUE
 rb_fb_vline(VALUE self, VALUE col, VALUE label)
 {
   rb_fb_t* ptr;
-  uint8_t* p;
-  int i;
-  int h;
 
   /*
    * extract context data
@@ -740,29 +513,15 @@ rb_fb_vline(VALUE self, VALUE col, VALUE label)
   /*
    * put line
    */
-  p = (uint8_t*)RSTRING_PTR(ptr->buf) +
-          ((ptr->margin_x + (FIX2INT(col) * ptr->step)) * 3);
-  h = ptr->margin_y + ptr->height;
-
-  for (i = 0; i < h; i++) {
-    int v;
-    v = p[0] + 0x40;
-    p[0] = (v <= 0xff)? v: 0xff;
-
-    v = p[1] + 0x40;
-    p[1] = (v <= 0xff)? v: 0xff;
-
-    v = p[2] + 0xff;
-    p[2] = (v <= 0xff)? v: 0xff;
-
-    p += ptr->stride;
-  }
+  fbdraw_vline(ptr->pix, ptr->stride,
+               ptr->margin_y + (ptr->height * ptr->bands),
+               ptr->margin_x + (FIX2INT(col) * ptr->step));
 
   /*
    * put label
    */
   put_string(ptr,
-             ptr->height + 14,
+             (ptr->height * ptr->bands) + 14,
              ptr->margin_x + (FIX2INT(col) * ptr->step) + 4,
              label,
              0x80,
@@ -772,11 +531,107 @@ rb_fb_vline(VALUE self, VALUE col, VALUE label)
   return self;
 }
 
+typedef struct {
+  int err;
+  char* path;
+  uint8_t* pix;
+  int width;
+  int height;
+  int stride;
+  int threads;
+  int level;
+} write_png_arg_t;
+
+static void*
+_write_png(void* data)
+{
+  write_png_arg_t* arg;
+
+  arg = (write_png_arg_t*)data;
+
+  arg->err = pngenc_write(arg->path,
+                          arg->pix,
+                          arg->width,
+                          arg->height,
+                          arg->stride,
+                          arg->threads,
+                          arg->level);
+
+  return NULL;
+}
+
+static VALUE
+rb_fb_write_png(int argc, VALUE* argv, VALUE self)
+{
+  rb_fb_t* ptr;
+  VALUE path;
+  VALUE opt;
+  VALUE opts[N(png_opts_ids)];
+  write_png_arg_t arg;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_fb_t, &fb_data_type, ptr);
+
+  /*
+   * parse argument
+   */
+  rb_scan_args(argc, argv, "11", &path, &opt);
+
+  ExportStringValue(path);
+
+  arg.threads = 0;
+  arg.level   = 6;
+
+  if (opt != Qnil) {
+    Check_Type(opt, T_HASH);
+    rb_get_kwargs(opt, png_opts_ids, 0, N(png_opts_ids), opts);
+
+    // :threads
+    if (opts[0] != Qundef) arg.threads = NUM2INT(opts[0]);
+
+    // :level
+    if (opts[1] != Qundef) arg.level = NUM2INT(opts[1]);
+  }
+
+  if (ptr->pix == NULL) {
+    RUNTIME_ERROR("not initialized");
+  }
+
+  /*
+   * call encoder
+   */
+  arg.path   = StringValueCStr(path);
+  arg.pix    = ptr->pix;
+  arg.width  = ptr->margin_x + (ptr->width * ptr->step);
+  arg.height = (ptr->height * ptr->bands) + ptr->margin_y;
+  arg.stride = ptr->stride;
+
+  rb_thread_call_without_gvl(_write_png, &arg, RUBY_UBF_PROCESS, NULL);
+
+  if (arg.err) {
+    RUNTIME_ERROR("pngenc_write() failed. [err = %d]\n", arg.err);
+  }
+
+  return self;
+}
+
 void
 Init_fb()
 {
+  VALUE wavspa_module;
+  VALUE fb_klass;
   int i;
 
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  /*
+   * フォントやカラーマップの表、opts_idsは読み出し専用なのでRactor間で
+   * 共有しても問題ない
+   */
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
   wavspa_module = rb_define_module("WavSpectrumAnalyzer");
   fb_klass      = rb_define_class_under(wavspa_module,
                                         "FrameBuffer", rb_cObject);
@@ -785,13 +640,19 @@ Init_fb()
   rb_define_method(fb_klass, "initialize", rb_fb_initialize, -1);
   rb_define_method(fb_klass, "width", rb_fb_width, 0);
   rb_define_method(fb_klass, "height", rb_fb_height, 0);
+  rb_define_method(fb_klass, "bands", rb_fb_bands, 0);
   rb_define_method(fb_klass, "to_s", rb_fb_to_s, 0);
-  rb_define_method(fb_klass, "draw_power", rb_fb_draw_power, 2);
-  rb_define_method(fb_klass, "draw_amplitude", rb_fb_draw_amplitude, 2);
+  rb_define_method(fb_klass, "draw_power", rb_fb_draw_power, -1);
+  rb_define_method(fb_klass, "draw_amplitude", rb_fb_draw_amplitude, -1);
   rb_define_method(fb_klass, "hline", rb_fb_hline, 2);
   rb_define_method(fb_klass, "vline", rb_fb_vline, 2);
+  rb_define_method(fb_klass, "write_png", rb_fb_write_png, -1);
 
   for (i = 0; i < (int)N(opts_keys); i++) {
     opts_ids[i] = rb_intern_const(opts_keys[i]);
   }
+
+  for (i = 0; i < (int)N(png_opts_keys); i++) {
+    png_opts_ids[i] = rb_intern_const(png_opts_keys[i]);
+  }
 }
@@ -1,6 +1,13 @@
 require 'mkmf'
 
+# 閾値はWAVSPA_FFT_PLAN=estimateの場合の既定値。通常は初回にサイズ毎の
+# 実行方法を計測して選ぶ(fftplan.h)
 $CFLAGS="-DUSE_CDFT_PTHREADS -DCDFT_THREADS_BEGIN_N=512 -DCDFT_4THREADS_BEGIN_N=1024"
+$INCFLAGS << " -I$(srcdir)/../fb -I$(srcdir)/../wavmap -I$(srcdir)/../common"
+
+# 共通のサンプル取り込み処理(../common/smpl.c)も合わせてビルドする
+$VPATH << "$(srcdir)/../common"
+$srcs = Dir.glob("#{$srcdir}/*.c").map {|f| File.basename(f)} << "smpl.c"
 
 have_library( "m")
 create_makefile( "wavspa/fft")
@@ -13,8 +13,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include "fft.h"
+#include "smpl.h"
+#include "clock.h"
 
 #define N(x)            (sizeof(x)/sizeof(*x))
 #define IS_POW2(n)      (!((n) & ((n) - 1)))
@@ -24,20 +27,20 @@
 
 #define ERR             __LINE__
 
-#define FMT_U8          0x0001
-#define FMT_U16LE       0x0002
-#define FMT_U16BE       0x0012
-#define FMT_S16LE       0x0102
-#define FMT_S16BE       0x0112
-#define FMT_S24LE       0x0203
-#define FMT_S24BE       0x0213
-
 typedef struct {
   int pos;
   int n;
 } lc_t;
 
-extern void rdft(int, int, double *, int *, double *);
+static inline uint8_t
+quantize(double x, double scale, double bias)
+{
+  x = (x * scale) + bias;
+  x = (x > 0.0)? x: 0.0;
+  x = (x < 255.0)? x: 255.0;
+
+  return (uint8_t)x;
+}
 
 int
 fft_new(char* _fmt, int capa, fft_t** _obj)
@@ -54,6 +57,7 @@ fft_new(char* _fmt, int capa, fft_t** _obj)
   double* a;
   int* ip;
   double* w;
+  int plan;
 
   /*
    * initialize
@@ -74,29 +78,9 @@ fft_new(char* _fmt, int capa, fft_t** _obj)
   if (!capa || !IS_POW2(capa)) ret = ERR;
   if (_obj == NULL) ret = ERR;
 
-  if (strcasecmp("u8", _fmt) == 0) {
-    fmt = FMT_U8;
-
-  } else if (strcasecmp("u16be", _fmt) == 0) {
-    fmt = FMT_U16BE;
-
-  } else if (strcasecmp("u16le", _fmt) == 0) {
-    fmt = FMT_U16LE;
-
-  } else if (strcasecmp("s16be", _fmt) == 0) {
-    fmt = FMT_S16BE;
-
-  } else if (strcasecmp("s16le", _fmt) == 0) {
-    fmt = FMT_S16LE;
-
-  } else if (strcasecmp("s24be", _fmt) == 0) {
-    fmt = FMT_S24BE;
-
-  } else if (strcasecmp("s24le", _fmt) == 0) {
-    fmt = FMT_S24LE;
-
-  } else {
-    ret = ERR;
+  if (!ret) {
+    fmt = smpl_parse_format(_fmt);
+    if (!fmt) ret = ERR;
   }
 
   /*
@@ -141,8 +125,13 @@ fft_new(char* _fmt, int capa, fft_t** _obj)
    * set return parameter
    */
   if (!ret) {
+    /*
+     * rdft()の実行方法はサイズ毎に決める (未計測のサイズは初回に計測する)
+     */
+    if (fftplan_lookup(capa, &plan)) plan = FFTPLAN_ESTIMATE;
+
     ip[0] = 0;
-    rdft(capa, 1, a, ip, w);
+    fftplan_rdft(capa, plan, a, ip, w);
 
     memset(data, 0, sizeof(double) * capa);
 
@@ -167,6 +156,10 @@ fft_new(char* _fmt, int capa, fft_t** _obj)
     obj->a        = a;
     obj->ip       = ip;
     obj->w        = w;
+    obj->plan     = plan;
+
+    memset(&obj->stats, 0, sizeof(obj->stats));
+    obj->stats.allocs = 7;   // obj, data, wtbl, line, a, ip, w
 
     fft_set_window(obj, FFT_WINDOW_BLACKMAN);
     fft_set_width(obj, 480);
@@ -222,104 +215,18 @@ fft_destroy(fft_t* fft)
   return ret;
 }
 
-static void
-import_u8(double* dst, uint8_t* src, int n)
-{
-  int i;
-
-  for (i = 0; i < n; i++) {
-    dst[i] = ((double)src[i] - 128.0) / 128.0;
-  }
-}
-
-static void
-import_u16le(double* dst, uint8_t* src, int n)
-{
-  int i;
-  uint16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((uint16_t)src[0] << 0) & 0x00ff)|
-              (((uint16_t)src[1] << 8) & 0xff00));
-    
-    dst[i] = ((double)smpl - 32768.0) / 32768.0;
-  }
-}
-
-static void
-import_u16be(double* dst, uint8_t* src, int n)
-{
-  int i;
-  uint16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((uint16_t)src[1] << 0) & 0x00ff)|
-              (((uint16_t)src[0] << 8) & 0xff00));
-
-    dst[i] = ((double)smpl - 32768.0) / 32768.0;
-  }
-}
-
-static void
-import_s16le(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((int16_t)src[0] << 0) & 0x00ff)|
-              (((int16_t)src[1] << 8) & 0xff00));
-    
-    dst[i] = (double)smpl  / 32768.0;
-  }
-}
-
-static void
-import_s16be(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((int16_t)src[1] << 0) & 0x00ff)|
-              (((int16_t)src[0] << 8) & 0xff00));
-    
-    dst[i] = (double)smpl  / 32768.0;
-  }
-}
-
-static void
-import_s24le(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int32_t smpl;
-
-  for (i = 0; i < n; i++, src += 3) {
-    smpl   = ((((int32_t)src[0] <<  8) & 0x0000ff00)|
-              (((int32_t)src[1] << 16) & 0x00ff0000)|
-              (((int32_t)src[2] << 24) & 0xff000000));
-    
-    dst[i] = (double)smpl  / 2147483648.0;
-  }
-}
-
-static void
-import_s24be(double* dst, uint8_t* src, int n)
+int
+fft_shift_in(fft_t* fft, void* src, int n)
 {
-  int i;
-  int32_t smpl;
-
-  for (i = 0; i < n; i++, src += 3) {
-    smpl   = ((((int32_t)src[2] <<  8) & 0x0000ff00)|
-              (((int32_t)src[1] << 16) & 0x00ff0000)|
-              (((int32_t)src[0] << 24) & 0xff000000));
-    
-    dst[i] = (double)smpl  / 2147483648.0;
-  }
+  return fft_shift_in_channel(fft, src, n, 1, 0);
 }
 
+/*
+ * インタリーブされたnch チャネルのブロック列からch番目のチャネルを取り込む
+ * (chにSMPL_DOWNMIXを指定した場合は全チャネルの平均を取り込む)
+ */
 int
-fft_shift_in(fft_t* fft, void* src, int n)
+fft_shift_in_channel(fft_t* fft, void* src, int n, int nch, int ch)
 {
   int ret;
   double* dst;
@@ -335,6 +242,8 @@ fft_shift_in(fft_t* fft, void* src, int n)
   if (fft == NULL) ret = ERR;
   if (src == NULL) ret = ERR;
   if (n < 0) ret = ERR;
+  if (nch < 1) ret = ERR;
+  if (ch >= nch || (ch < 0 && ch != SMPL_DOWNMIX)) ret = ERR;
 
   if (!ret) {
     if (n > fft->capa) ret = ERR;
@@ -347,37 +256,10 @@ fft_shift_in(fft_t* fft, void* src, int n)
     memmove(fft->data, fft->data + n, sizeof(double) * (fft->capa - n));
 
     dst = fft->data + (fft->capa - n);
-    switch (fft->fmt) {
-    case FMT_U8:
-      import_u8(dst, src, n);
-      break;
-
-    case FMT_U16BE:
-      import_u16be(dst, src, n);
-      break;
-
-    case FMT_U16LE:
-      import_u16le(dst, src, n);
-      break;
-
-    case FMT_S16BE:
-      import_s16be(dst, src, n);
-      break;
-
-    case FMT_S16LE:
-      import_s16le(dst, src, n);
-      break;
-
-    case FMT_S24BE:
-      import_s24be(dst, src, n);
-      break;
-
-    case FMT_S24LE:
-      import_s24le(dst, src, n);
-      break;
-    }
+    smpl_import_channel(fft->fmt, dst, src, n, nch, ch);
 
     fft->used += n;
+    fft->stats.samples += n;
 
     if (fft->used > fft->capa) {
       fft->used = fft->capa;
@@ -659,6 +541,8 @@ fft_set_width(fft_t* fft, int width)
     fft->line  = line;
     fft->width = width;
 
+    fft->stats.allocs++;
+
     set_line_mapping(fft);
   }
 
@@ -700,6 +584,61 @@ fft_set_scale_mode(fft_t* fft, int mode)
   return ret;
 }
 
+/*
+ * rdft()の実行方法を明示的に指定する (fft_new()で選んだものを上書きする)
+ */
+int
+fft_set_plan(fft_t* fft, int plan)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (fft == NULL) ret = ERR;
+  if (plan < 0 || plan >= FFTPLAN_NUM) ret = ERR;
+
+  /*
+   * modify FFT context
+   */
+  if (!ret) {
+    fft->plan = plan;
+  }
+
+  return ret;
+}
+
+int
+fft_get_plan(fft_t* fft, int* dst)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (fft == NULL) ret = ERR;
+  if (dst == NULL) ret = ERR;
+
+  /*
+   * set return parameter
+   */
+  if (!ret) {
+    *dst = fft->plan;
+  }
+
+  return ret;
+}
+
 int
 fft_set_frequency(fft_t* fft, double s, double l, double h)
 {
@@ -747,6 +686,7 @@ fft_transform(fft_t* fft)
 {
   int ret;
   int i;
+  uint64_t t0;
 
   /*
    * initialize
@@ -762,11 +702,16 @@ fft_transform(fft_t* fft)
    * do transform
    */
   if (!ret) {
+    t0 = now_ns();
+
     for (i = 0; i < fft->capa; i++) {
       fft->a[i] = fft->data[i] * fft->wtbl[i];
     }
 
-    rdft(fft->capa, 1, fft->a, fft->ip, fft->w);
+    fftplan_rdft(fft->capa, fft->plan, fft->a, fft->ip, fft->w);
+
+    fft->stats.frames++;
+    fft->stats.transform_ns += now_ns() - t0;
   }
 
   return ret;
@@ -782,6 +727,9 @@ fft_calc_power(fft_t* fft, double* dst)
   lc_t* lc;
   double v;
   double fq;
+  uint64_t t0;
+
+  t0 = now_ns();
 
   do {
     /*
@@ -823,6 +771,8 @@ fft_calc_power(fft_t* fft, double* dst)
     }
   } while(0);
 
+  if (!ret) fft->stats.reduce_ns += now_ns() - t0;
+
   return ret;
 }
 
@@ -841,6 +791,9 @@ fft_calc_amplitude(fft_t* fft, double* dst)
   double v;
   double base;
   lc_t* lc;
+  uint64_t t0;
+
+  t0 = now_ns();
 
   do {
     /*
@@ -877,6 +830,8 @@ fft_calc_amplitude(fft_t* fft, double* dst)
     ret = 0;
   } while(0);
 
+  if (!ret) fft->stats.reduce_ns += now_ns() - t0;
+
   return ret;
 }
 
@@ -890,6 +845,9 @@ fft_calc_absolute(fft_t* fft, double* dst)
   double v;
   double base;
   lc_t* lc;
+  uint64_t t0;
+
+  t0 = now_ns();
 
   do {
     /*
@@ -926,5 +884,182 @@ fft_calc_absolute(fft_t* fft, double* dst)
     ret = 0;
   } while(0);
 
+  if (!ret) fft->stats.reduce_ns += now_ns() - t0;
+
+  return ret;
+}
+
+/*
+ * 以下の二つはfft_calc_power()/fft_calc_amplitude()と同じ値を求め、
+ * doubleの配列を経由せずに直接 (x * scale) + bias で量子化した
+ * 8bitの値(フレームバッファのLUTインデックス)を書き出す。
+ */
+int
+fft_plot_power(fft_t* fft, uint8_t* dst, double scale, double bias)
+{
+  int ret;
+  int i;
+  int j;
+  double* a;
+  lc_t* lc;
+  double v;
+  double fq;
+  uint64_t t0;
+
+  t0 = now_ns();
+
+  do {
+    /*
+     * initialize
+     */
+    ret = 0;
+
+    /*
+     * argument check
+     */
+    if (fft == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * calc power spectrum and quantize
+     */
+    for (i = 0, lc = (lc_t*)fft->line; i < fft->width; i++, lc++) {
+      v = 0.0;
+
+      if (fft->mode == FFT_LINEARSCALE_MODE) {
+        fq = fft->fq_l + (fft->step * i);
+      } else {
+        fq = fft->fq_l * pow(fft->step, i);
+      } 
+
+      for(j = 0, a = fft->a + (lc->pos * 2); j < lc->n; j++, a += 2) {
+        v += sqrt((a[0] * a[0]) + (a[1] * a[1]));
+      }
+
+      dst[i] = quantize(v / (j * fq), scale, bias);
+    }
+  } while(0);
+
+  if (!ret) fft->stats.reduce_ns += now_ns() - t0;
+
+  return ret;
+}
+
+int
+fft_plot_amplitude(fft_t* fft, uint8_t* dst, double scale, double bias)
+{
+  int ret;
+  int i;
+  int j;
+  double* a;
+  double v;
+  double base;
+  lc_t* lc;
+  uint64_t t0;
+
+  t0 = now_ns();
+
+  do {
+    /*
+     * argument check
+     */
+    if (fft == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * calc amplitude spectrum and quantize
+     */
+    base = (double)fft->used;
+
+    for (i = 0, lc = (lc_t*)fft->line; i < fft->width; i++, lc++) {
+      v = 0;
+
+      for(j = 0, a = fft->a + (lc->pos * 2); j < lc->n; j++, a += 2) {
+        v += 20.0 * log10(sqrt((a[0] * a[0]) + (a[1] * a[1])) / base);
+      }
+
+      dst[i] = quantize(v / j, scale, bias);
+    }
+
+    /*
+     * mark success
+     */
+    ret = 0;
+  } while(0);
+
+  if (!ret) fft->stats.reduce_ns += now_ns() - t0;
+
+  return ret;
+}
+
+int
+fft_get_stats(fft_t* fft, fft_stats_t* dst)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (fft == NULL) ret = ERR;
+  if (dst == NULL) ret = ERR;
+
+  /*
+   * copy counters and eval current configuration
+   */
+  if (!ret) {
+    *dst = fft->stats;
+
+    dst->table_bytes  = (sizeof(double) * fft->capa) +
+                        (sizeof(lc_t) * fft->width) +
+                        (sizeof(int) * (2 + (int)sqrt(fft->capa / 2))) +
+                        (sizeof(double) * (fft->capa / 2));
+    dst->buffer_bytes = sizeof(double) * fft->capa * 2;
+    dst->threads      = fftplan_threads(fft->capa, fft->plan);
+  }
+
+  return ret;
+}
+
+int
+fft_reset_stats(fft_t* fft)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (fft == NULL) ret = ERR;
+
+  /*
+   * clear counters
+   */
+  if (!ret) {
+    memset(&fft->stats, 0, sizeof(fft->stats));
+  }
+
   return ret;
 }
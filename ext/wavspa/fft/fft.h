@@ -11,6 +11,11 @@
 #ifndef __FFT_H__
 #define __FFT_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fftplan.h"
+
 #define FFT_WINDOW_RECTANGULAR        0
 #define FFT_WINDOW_HAMMING            1
 #define FFT_WINDOW_HANN               2
@@ -21,6 +26,23 @@
 #define FFT_LINEARSCALE_MODE          1
 #define FFT_LOGSCALE_MODE             2
 
+/*
+ * 実行統計 (fft_get_stats()で取得、fft_reset_stats()で0に戻す)
+ *   カウンタはオブジェクト毎に非アトミックに更新するので、fft_t自体と
+ *   同じく一つのオブジェクトを複数のスレッドから同時に操作しないこと。
+ *   table_bytes/buffer_bytes/threadsは取得時点の構成から求める。
+ */
+typedef struct {
+  uint64_t frames;        // as "number of fft_transform() calls"
+  uint64_t samples;       // as "number of imported samples"
+  uint64_t transform_ns;
+  uint64_t reduce_ns;     // as "time spent in fft_calc_*()/fft_plot_*()"
+  uint64_t allocs;        // as "number of memory allocations"
+  size_t table_bytes;     // 窓関数・ビン対応表・rdft()の作業表
+  size_t buffer_bytes;    // サンプルと変換結果のバッファ
+  int threads;            // as "number of threads used by rdft()"
+} fft_stats_t;
+
 typedef struct {
   double* data;
   double* wtbl; 
@@ -44,6 +66,9 @@ typedef struct {
   double* a;
   int* ip;
   double* w;
+  int plan;     // as "FFTPLAN_* used by rdft()"
+
+  fft_stats_t stats;
 } fft_t;
 
 int fft_new(char* fmt, int capa, fft_t** obj);
@@ -53,12 +78,20 @@ int fft_set_window(fft_t* fft, int type);
 int fft_set_width(fft_t* fft, int width);
 int fft_set_scale_mode(fft_t* fft, int mode);
 int fft_set_frequency(fft_t* fft, double s, double l, double h);
+int fft_set_plan(fft_t* fft, int plan);
+int fft_get_plan(fft_t* fft, int* dst);
 
 int fft_shift_in(fft_t* fft, void* data, int n);
+int fft_shift_in_channel(fft_t* fft, void* data, int n, int nch, int ch);
 int fft_reset(fft_t* fft);
 int fft_transform(fft_t* fft);
 int fft_calc_power(fft_t* fft, double* dst);
 int fft_calc_amplitude(fft_t* fft, double* dst);
 int fft_calc_absolute(fft_t* fft, double* dst);
+int fft_plot_power(fft_t* fft, uint8_t* dst, double scale, double bias);
+int fft_plot_amplitude(fft_t* fft, uint8_t* dst, double scale, double bias);
+
+int fft_get_stats(fft_t* fft, fft_stats_t* dst);
+int fft_reset_stats(fft_t* fft);
 
 #endif /* !defined(__FFT_H__) */
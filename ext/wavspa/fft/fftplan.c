@@ -0,0 +1,729 @@
+﻿/*
+ * rdft() execution planner
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "fftplan.h"
+#include "clock.h"
+
+#define N(x)            (sizeof(x)/sizeof(*x))
+#define IS_POW2(n)      (!((n) & ((n) - 1)))
+#define NALLOC(t,n)     ((t*)malloc(sizeof(t) * (n)))
+#define MAX(m,n)        (((m) > (n))? (m): (n))
+
+#define ERR             __LINE__
+
+/*
+ * 計測条件
+ *   各実行方法をMIN_REPEAT回からMAX_REPEAT回まで繰り返して最小値を取る。
+ *   繰り返しはサイズ毎の計測時間の合計がMEASURE_NSに収まるところで打ち
+ *   切る(初回のfft_new()を待たせる時間を抑えるため)。スレッドを増やす
+ *   方法はMARGIN以上速い場合にのみ選ぶ(他の処理に回せるCPUを僅かな差の
+ *   ために使わない)。
+ */
+#define MEASURE_NS      (30 * 1000000)
+#define MIN_REPEAT      3
+#define MAX_REPEAT      64
+#define MARGIN          0.05
+
+#define WISDOM_HEADER   "# wavspa fft wisdom"
+
+#if defined(USE_CDFT_PTHREADS) || defined(USE_CDFT_WINTHREADS)
+#define USE_CDFT_THREADS
+#endif /* defined(USE_CDFT_PTHREADS) || defined(USE_CDFT_WINTHREADS) */
+
+/*
+ * fftsg.cの既定値 (extconf.rbで指定した値が優先される)
+ */
+#ifndef CDFT_THREADS_BEGIN_N
+#define CDFT_THREADS_BEGIN_N   8192
+#endif /* !defined(CDFT_THREADS_BEGIN_N) */
+#ifndef CDFT_4THREADS_BEGIN_N
+#define CDFT_4THREADS_BEGIN_N  65536
+#endif /* !defined(CDFT_4THREADS_BEGIN_N) */
+
+extern void rdft(int, int, double *, int *, double *);
+
+#ifdef USE_CDFT_THREADS
+extern __thread int cdft_threads_begin_n;
+extern __thread int cdft_4threads_begin_n;
+#endif /* defined(USE_CDFT_THREADS) */
+
+/*
+ * 実行方法毎の分割の閾値 (2スレッド, 4スレッド)
+ *   512はfftsg.cが許す最小値
+ */
+static const int thresholds[FFTPLAN_NUM][2] = {
+  {CDFT_THREADS_BEGIN_N, CDFT_4THREADS_BEGIN_N},  // FFTPLAN_ESTIMATE
+  {INT_MAX, INT_MAX},                             // FFTPLAN_SINGLE
+  {512, INT_MAX},                                 // FFTPLAN_THREAD2
+  {512, 512},                                     // FFTPLAN_THREAD4
+};
+
+static const char* plan_names[] = {
+  "estimate",             // FFTPLAN_ESTIMATE
+  "single",               // FFTPLAN_SINGLE
+  "thread2",              // FFTPLAN_THREAD2
+  "thread4",              // FFTPLAN_THREAD4
+};
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int cpus;          // as "number of online CPUs"
+static int mode;          // as "plan forced by WAVSPA_FFT_PLAN (-1: measure)"
+static char* path;        // as "wisdom file (NULL: not persisted)"
+
+static fftplan_wisdom_t wisdom[FFTPLAN_MAX_WISDOM];
+static int nwisdom;
+
+static int
+ncpu(void)
+{
+  long ret;
+
+  ret = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return (ret > 0)? (int)ret: 1;
+}
+
+static char*
+default_path(void)
+{
+  char* ret;
+  char* dir;
+  const char* sub;
+
+  dir = getenv("WAVSPA_FFT_WISDOM");
+  if (dir != NULL) return (*dir != '\0')? strdup(dir): NULL;
+
+  dir = getenv("XDG_CACHE_HOME");
+  sub = "wavspa/fft-wisdom";
+
+  if (dir == NULL || *dir == '\0') {
+    dir = getenv("HOME");
+    sub = ".cache/wavspa/fft-wisdom";
+  }
+
+  if (dir == NULL || *dir == '\0') return NULL;
+
+  ret = NALLOC(char, strlen(dir) + strlen(sub) + 2);
+  if (ret != NULL) sprintf(ret, "%s/%s", dir, sub);
+
+  return ret;
+}
+
+/*
+ * 以下のwisdom[]の操作はmutexを取った状態で呼ぶこと
+ */
+static fftplan_wisdom_t*
+find(int n)
+{
+  int i;
+
+  for (i = 0; i < nwisdom; i++) {
+    if (wisdom[i].n == n) return wisdom + i;
+  }
+
+  return NULL;
+}
+
+/*
+ * nの昇順を保って登録する (同じサイズは上書き)
+ */
+static void
+store(fftplan_wisdom_t* ent)
+{
+  fftplan_wisdom_t* dst;
+  int i;
+
+  dst = find(ent->n);
+
+  if (dst == NULL) {
+    if (nwisdom >= (int)N(wisdom)) return;
+
+    for (i = nwisdom; i > 0 && wisdom[i - 1].n > ent->n; i--) {
+      wisdom[i] = wisdom[i - 1];
+    }
+
+    dst = wisdom + i;
+    nwisdom++;
+  }
+
+  *dst = *ent;
+}
+
+/*
+ * CPU数が保存時と異なる場合は別の環境の結果とみなして読み込まない
+ *   overwriteが偽の場合は、既に登録されているサイズの結果を残す
+ */
+static int
+load(const char* path, int overwrite)
+{
+  int ret;
+  FILE* fp;
+  char line[256];
+  char name[16];
+  fftplan_wisdom_t ent;
+  int ncpus;
+  int plan;
+
+  ret = 0;
+  fp  = fopen(path, "r");
+  if (fp == NULL) ret = ERR;
+
+  while (!ret && fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#') continue;
+
+    if (sscanf(line, "cpus %d", &ncpus) == 1) {
+      if (ncpus != cpus) break;
+      continue;
+    }
+
+    memset(&ent, 0, sizeof(ent));
+
+    if (sscanf(line, "%d %15s %" SCNu64 " %" SCNu64 " %" SCNu64,
+               &ent.n, name, ent.ns + FFTPLAN_SINGLE,
+               ent.ns + FFTPLAN_THREAD2, ent.ns + FFTPLAN_THREAD4) != 5) {
+      continue;
+    }
+
+    plan = fftplan_parse(name);
+    if (ent.n < 16 || !IS_POW2(ent.n) || plan < 0) continue;
+
+    ent.plan = plan;
+    if (overwrite || find(ent.n) == NULL) store(&ent);
+  }
+
+  if (fp != NULL) fclose(fp);
+
+  return ret;
+}
+
+static int
+mkdirs(const char* path)
+{
+  int ret;
+  char* dir;
+  char* p;
+
+  ret = 0;
+  dir = strdup(path);
+  if (dir == NULL) ret = ERR;
+
+  /*
+   * 親ディレクトリを上から順に作る
+   */
+  if (!ret) {
+    for (p = strchr(dir + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+      *p = '\0';
+      if (mkdir(dir, 0755) < 0 && errno != EEXIST) ret = ERR;
+      *p = '/';
+
+      if (ret) break;
+    }
+  }
+
+  free(dir);
+
+  return ret;
+}
+
+/*
+ * 一時ファイルに書き出してから置き換える
+ *   (同時に実行している他のプロセスが書きかけのファイルを読まないように)
+ *   書き出す前にファイルを読み直し、他のプロセスが後から保存したサイズ
+ *   の結果を取り込んでおく(このプロセスで計測した結果を優先する)
+ */
+static int
+save(const char* path)
+{
+  int ret;
+  char* tmp;
+  FILE* fp;
+  int i;
+
+  ret = 0;
+  tmp = NULL;
+  fp  = NULL;
+
+  load(path, 0);
+
+  do {
+    if (mkdirs(path)) {
+      ret = ERR;
+      break;
+    }
+
+    tmp = NALLOC(char, strlen(path) + 32);
+    if (tmp == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    sprintf(tmp, "%s.%ld", path, (long)getpid());
+
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    fprintf(fp, "%s\n", WISDOM_HEADER);
+    fprintf(fp, "# size plan single(ns) thread2(ns) thread4(ns)\n");
+    fprintf(fp, "cpus %d\n", cpus);
+
+    for (i = 0; i < nwisdom; i++) {
+      fprintf(fp, "%d %s %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+              wisdom[i].n, plan_names[wisdom[i].plan],
+              wisdom[i].ns[FFTPLAN_SINGLE], wisdom[i].ns[FFTPLAN_THREAD2],
+              wisdom[i].ns[FFTPLAN_THREAD4]);
+    }
+
+    if (fclose(fp)) {
+      fp  = NULL;
+      ret = ERR;
+      break;
+    }
+
+    fp = NULL;
+
+    if (rename(tmp, path)) {
+      ret = ERR;
+      break;
+    }
+  } while(0);
+
+  if (fp != NULL) fclose(fp);
+  if (ret && tmp != NULL) unlink(tmp);
+
+  free(tmp);
+
+  return ret;
+}
+
+static void
+setup(void)
+{
+  char* s;
+
+  cpus = ncpu();
+  mode = -1;
+
+  /*
+   * 不明な値は計測(とwisdomファイルへの書き込み)に回さず、ビルド時の
+   * 閾値に従う
+   */
+  s = getenv("WAVSPA_FFT_PLAN");
+  if (s != NULL && *s != '\0' && strcasecmp(s, "measure") != 0) {
+    mode = fftplan_parse(s);
+
+    if (mode < 0) {
+      fprintf(stderr,
+              "wavspa: unknown WAVSPA_FFT_PLAN \"%s\", using \"estimate\"\n", s);
+      mode = FFTPLAN_ESTIMATE;
+    }
+  }
+
+  path = default_path();
+  if (path != NULL) load(path, !0);
+}
+
+/*
+ * 計測の対象とする実行方法
+ *   スレッドを使う方法は、1CPUの環境や分割されないサイズでは計測しない
+ */
+static int
+measurable(int n, int plan)
+{
+  if (plan == FFTPLAN_SINGLE) return !0;
+  if (plan == FFTPLAN_ESTIMATE) return 0;
+
+  return (cpus > 1 && fftplan_threads(n, plan) > 1);
+}
+
+/*
+ * 入力は変換毎に同じ値に戻す (rdft()はin-placeで値が発散していくため)
+ */
+static int
+measure(int n, fftplan_wisdom_t* dst)
+{
+  int ret;
+  double* a;
+  double* a0;
+  int* ip;
+  double* w;
+  int nplan;
+  int plan;
+  int i;
+  uint64_t t0;
+  uint64_t t;
+  uint64_t best;
+  uint64_t limit;
+
+  ret = 0;
+  a   = NULL;
+  a0  = NULL;
+  ip  = NULL;
+  w   = NULL;
+
+  do {
+    a  = NALLOC(double, n);
+    a0 = NALLOC(double, n);
+    ip = NALLOC(int, 2 + (int)sqrt(n / 2));
+    w  = NALLOC(double, n / 2);
+
+    if (a == NULL || a0 == NULL || ip == NULL || w == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    for (i = 0; i < n; i++) {
+      a0[i] = (double)((i * 7919) % 1024) / 512.0 - 1.0;
+    }
+
+    memcpy(a, a0, sizeof(double) * n);
+
+    ip[0] = 0;
+    rdft(n, 1, a, ip, w);
+
+    memset(dst, 0, sizeof(*dst));
+    dst->n    = n;
+    dst->plan = FFTPLAN_SINGLE;
+
+    nplan = 0;
+
+    for (plan = FFTPLAN_SINGLE; plan < FFTPLAN_NUM; plan++) {
+      if (measurable(n, plan)) nplan++;
+    }
+
+    limit = MEASURE_NS / nplan;
+
+    for (plan = FFTPLAN_SINGLE; plan < FFTPLAN_NUM; plan++) {
+      if (!measurable(n, plan)) continue;
+
+      best = UINT64_MAX;
+      t0   = now_ns();
+
+      /*
+       * 1回目はキャッシュとスレッド生成の慣らしとして捨てる
+       */
+      for (i = 0; i <= MAX_REPEAT; i++) {
+        memcpy(a, a0, sizeof(double) * n);
+
+        t = now_ns();
+        fftplan_rdft(n, plan, a, ip, w);
+        t = now_ns() - t;
+
+        if (i > 0 && t < best) best = t;
+        if (i >= MIN_REPEAT && now_ns() - t0 >= limit) break;
+      }
+
+      dst->ns[plan] = MAX(best, 1);
+    }
+
+    for (plan = FFTPLAN_THREAD2; plan < FFTPLAN_NUM; plan++) {
+      if (dst->ns[plan] == 0) continue;
+
+      if (dst->ns[plan] < dst->ns[dst->plan] * (1.0 - MARGIN)) {
+        dst->plan = plan;
+      }
+    }
+  } while(0);
+
+  free(a);
+  free(a0);
+  free(ip);
+  free(w);
+
+  return ret;
+}
+
+const char*
+fftplan_name(int plan)
+{
+  return (plan >= 0 && plan < FFTPLAN_NUM)? plan_names[plan]: NULL;
+}
+
+int
+fftplan_parse(const char* str)
+{
+  int i;
+
+  for (i = 0; i < FFTPLAN_NUM; i++) {
+    if (strcasecmp(str, plan_names[i]) == 0) return i;
+  }
+
+  return -1;
+}
+
+int
+fftplan_threads(int n, int plan)
+{
+  int ret;
+
+  ret = 1;
+
+#ifdef USE_CDFT_THREADS
+  if (plan < 0 || plan >= FFTPLAN_NUM) plan = FFTPLAN_ESTIMATE;
+
+  /*
+   * fftsg.cのcftfsub()/cftrec4_th()と同じ条件で求める
+   */
+  if (n > thresholds[plan][0]) {
+    ret = (n > thresholds[plan][1])? 4: 2;
+  }
+#else /* defined(USE_CDFT_THREADS) */
+  (void)n;
+  (void)plan;
+#endif /* defined(USE_CDFT_THREADS) */
+
+  return ret;
+}
+
+/*
+ * 閾値は呼び出したスレッドにのみ影響し、戻る前に元に戻す
+ *   (rdft()を直接呼ぶ側はビルド時の閾値のまま動く)
+ */
+void
+fftplan_rdft(int n, int plan, double* a, int* ip, double* w)
+{
+#ifdef USE_CDFT_THREADS
+  int t2;
+  int t4;
+
+  if (plan < 0 || plan >= FFTPLAN_NUM) plan = FFTPLAN_ESTIMATE;
+
+  t2 = cdft_threads_begin_n;
+  t4 = cdft_4threads_begin_n;
+
+  cdft_threads_begin_n  = thresholds[plan][0];
+  cdft_4threads_begin_n = thresholds[plan][1];
+
+  rdft(n, 1, a, ip, w);
+
+  cdft_threads_begin_n  = t2;
+  cdft_4threads_begin_n = t4;
+#else /* defined(USE_CDFT_THREADS) */
+  (void)plan;
+
+  rdft(n, 1, a, ip, w);
+#endif /* defined(USE_CDFT_THREADS) */
+}
+
+/*
+ * サイズnに使う実行方法
+ *   未計測のサイズはここで計測し、結果をwisdomファイルに保存する。
+ *   スレッドを使えないサイズやビルド、1CPUの環境では計測せずに
+ *   FFTPLAN_SINGLEを返す。
+ *
+ *   計測中はmutexを取らない(他のサイズの参照を待たせないため)。同じ
+ *   サイズを複数のスレッドが同時に計測した場合は先に登録された結果を使う。
+ */
+int
+fftplan_lookup(int n, int* dst)
+{
+  int ret;
+  fftplan_wisdom_t* ent;
+  fftplan_wisdom_t tmp;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  pthread_once(&once, setup);
+
+  /*
+   * argument check
+   */
+  if (n < 16 || !IS_POW2(n)) ret = ERR;
+  if (dst == NULL) ret = ERR;
+
+  /*
+   * decide plan
+   */
+  if (!ret) {
+    if (mode >= 0) {
+      *dst = mode;
+
+    } else if (!measurable(n, FFTPLAN_THREAD2) &&
+               !measurable(n, FFTPLAN_THREAD4)) {
+      *dst = FFTPLAN_SINGLE;
+
+    } else {
+      pthread_mutex_lock(&mutex);
+      ent = find(n);
+      if (ent != NULL) tmp = *ent;
+      pthread_mutex_unlock(&mutex);
+
+      if (ent == NULL) {
+        if (measure(n, &tmp)) {
+          tmp.plan = FFTPLAN_ESTIMATE;
+
+        } else {
+          pthread_mutex_lock(&mutex);
+
+          ent = find(n);
+          if (ent != NULL) {
+            tmp = *ent;
+          } else {
+            store(&tmp);
+            if (path != NULL) save(path);
+          }
+
+          pthread_mutex_unlock(&mutex);
+        }
+      }
+
+      *dst = tmp.plan;
+    }
+  }
+
+  return ret;
+}
+
+/*
+ * 登録済みかどうかに関わらず計測し直す
+ */
+int
+fftplan_measure(int n, fftplan_wisdom_t* dst)
+{
+  int ret;
+  fftplan_wisdom_t ent;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  pthread_once(&once, setup);
+
+  /*
+   * argument check
+   */
+  if (n < 16 || !IS_POW2(n)) ret = ERR;
+
+  /*
+   * do measure
+   */
+  if (!ret) {
+    ret = measure(n, &ent);
+  }
+
+  if (!ret) {
+    pthread_mutex_lock(&mutex);
+
+    store(&ent);
+    if (path != NULL) save(path);
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  if (!ret && dst != NULL) *dst = ent;
+
+  return ret;
+}
+
+const char*
+fftplan_wisdom_path(void)
+{
+  pthread_once(&once, setup);
+
+  return path;
+}
+
+int
+fftplan_wisdom_load(const char* _path)
+{
+  int ret;
+
+  pthread_once(&once, setup);
+
+  if (_path == NULL) _path = path;
+
+  if (_path == NULL) {
+    ret = ERR;
+
+  } else {
+    pthread_mutex_lock(&mutex);
+    ret = load(_path, !0);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  return ret;
+}
+
+int
+fftplan_wisdom_save(const char* _path)
+{
+  int ret;
+
+  pthread_once(&once, setup);
+
+  if (_path == NULL) _path = path;
+
+  if (_path == NULL) {
+    ret = ERR;
+
+  } else {
+    pthread_mutex_lock(&mutex);
+    ret = save(_path);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  return ret;
+}
+
+int
+fftplan_wisdom_get(fftplan_wisdom_t* dst, int max, int* num)
+{
+  int ret;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  pthread_once(&once, setup);
+
+  /*
+   * argument check
+   */
+  if (dst == NULL && max > 0) ret = ERR;
+  if (num == NULL) ret = ERR;
+
+  /*
+   * copy entries
+   */
+  if (!ret) {
+    pthread_mutex_lock(&mutex);
+
+    for (i = 0; i < nwisdom && i < max; i++) {
+      dst[i] = wisdom[i];
+    }
+
+    *num = nwisdom;
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  return ret;
+}
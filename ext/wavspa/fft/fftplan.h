@@ -0,0 +1,63 @@
+﻿/*
+ * rdft() execution planner
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __FFTPLAN_H__
+#define __FFTPLAN_H__
+
+#include <stdint.h>
+
+/*
+ * rdft()の実行方法
+ *   FFTPLAN_ESTIMATEはビルド時の閾値(CDFT_THREADS_BEGIN_N,
+ *   CDFT_4THREADS_BEGIN_N)に従う。それ以外はサイズに関わらずスレッド数を
+ *   固定する(512点以下の変換はfftsg.cの制約により常に1スレッドで行う)。
+ */
+#define FFTPLAN_ESTIMATE          0
+#define FFTPLAN_SINGLE            1
+#define FFTPLAN_THREAD2           2
+#define FFTPLAN_THREAD4           3
+#define FFTPLAN_NUM               4
+
+#define FFTPLAN_MAX_WISDOM        32
+
+/*
+ * サイズ毎の計測結果 (nsは1回あたりの所要時間の最小値。計測していない
+ * 実行方法は0)
+ */
+typedef struct {
+  int n;
+  int plan;
+  uint64_t ns[FFTPLAN_NUM];
+} fftplan_wisdom_t;
+
+/*
+ * 環境変数
+ *   WAVSPA_FFT_PLAN    "measure"(既定), "estimate", "single", "thread2",
+ *                      "thread4"のいずれか。measureの場合は未計測のサイズ
+ *                      を初めて使う時に各実行方法を計測して最速のものを選ぶ
+ *                      (1CPUの環境では計測せずにsingleを使う)。不明な値
+ *                      は警告してestimateとして扱う
+ *   WAVSPA_FFT_WISDOM  計測結果の保存先。未設定の場合は
+ *                      $XDG_CACHE_HOME/wavspa/fft-wisdom
+ *                      (既定は~/.cache/wavspa/fft-wisdom)、空文字列の
+ *                      場合は保存しない
+ *
+ * 計測結果はプロセス内で共有し、スレッドセーフに参照・更新する。
+ */
+int fftplan_lookup(int n, int* dst);
+int fftplan_measure(int n, fftplan_wisdom_t* dst);
+int fftplan_threads(int n, int plan);
+void fftplan_rdft(int n, int plan, double* a, int* ip, double* w);
+
+const char* fftplan_name(int plan);
+int fftplan_parse(const char* str);
+
+const char* fftplan_wisdom_path(void);
+int fftplan_wisdom_load(const char* path);
+int fftplan_wisdom_save(const char* path);
+int fftplan_wisdom_get(fftplan_wisdom_t* dst, int max, int* num);
+
+#endif /* !defined(__FFTPLAN_H__) */
@@ -639,6 +639,7 @@ void dfst(int n, double *a, double *t, int *ip, double *w)
 
 
 #include <math.h>
+#include "trace.h"  /* wavspa: worker thread tracing (cftrec*_th) */
 
 void makewt(int nw, int *ip, double *w)
 {
@@ -797,6 +798,17 @@ void makect(int nc, int *ip, double *c)
 #endif /* USE_CDFT_WINTHREADS */
 
 
+#ifdef USE_CDFT_THREADS
+/*
+    wavspa: the split thresholds are read from these per-thread
+    variables so that the caller can choose a plan (single, 2 or 4
+    threads) for each call. The macros above are the initial values.
+*/
+__thread int cdft_threads_begin_n = CDFT_THREADS_BEGIN_N;
+__thread int cdft_4threads_begin_n = CDFT_4THREADS_BEGIN_N;
+#endif /* USE_CDFT_THREADS */
+
+
 void cftfsub(int n, double *a, int *ip, int nw, double *w)
 {
     void bitrv2(int n, int *ip, double *a);
@@ -818,7 +830,7 @@ void cftfsub(int n, double *a, int *ip, int nw, double *w)
         if (n > 32) {
             cftf1st(n, a, &w[nw - (n >> 2)]);
 #ifdef USE_CDFT_THREADS
-            if (n > CDFT_THREADS_BEGIN_N) {
+            if (n > cdft_threads_begin_n) {
                 cftrec4_th(n, a, nw, w);
             } else 
 #endif /* USE_CDFT_THREADS */
@@ -866,7 +878,7 @@ void cftbsub(int n, double *a, int *ip, int nw, double *w)
         if (n > 32) {
             cftb1st(n, a, &w[nw - (n >> 2)]);
 #ifdef USE_CDFT_THREADS
-            if (n > CDFT_THREADS_BEGIN_N) {
+            if (n > cdft_threads_begin_n) {
                 cftrec4_th(n, a, nw, w);
             } else 
 #endif /* USE_CDFT_THREADS */
@@ -2215,7 +2227,7 @@ void cftrec4_th(int n, double *a, int nw, double *w)
     nthread = 2;
     idiv4 = 0;
     m = n >> 1;
-    if (n > CDFT_4THREADS_BEGIN_N) {
+    if (n > cdft_4threads_begin_n) {
         nthread = 4;
         idiv4 = 1;
         m >>= 1;
@@ -2251,6 +2263,7 @@ void *cftrec1_th(void *p)
     a = ((cdft_arg_t *) p)->a;
     nw = ((cdft_arg_t *) p)->nw;
     w = ((cdft_arg_t *) p)->w;
+    TRACE_BEGIN("cftrec1", "fft", "n", n);
     m = n0;
     while (m > 512) {
         m >>= 2;
@@ -2263,6 +2276,7 @@ void *cftrec1_th(void *p)
         isplt = cfttree(m, j, k, a, nw, w);
         cftleaf(m, isplt, &a[j - m], nw, w);
     }
+    TRACE_END();
     return (void *) 0;
 }
 
@@ -2280,6 +2294,7 @@ void *cftrec2_th(void *p)
     a = ((cdft_arg_t *) p)->a;
     nw = ((cdft_arg_t *) p)->nw;
     w = ((cdft_arg_t *) p)->w;
+    TRACE_BEGIN("cftrec2", "fft", "n", n);
     k = 1;
     m = n0;
     while (m > 512) {
@@ -2294,6 +2309,7 @@ void *cftrec2_th(void *p)
         isplt = cfttree(m, j, k, a, nw, w);
         cftleaf(m, isplt, &a[j - m], nw, w);
     }
+    TRACE_END();
     return (void *) 0;
 }
 #endif /* USE_CDFT_THREADS */
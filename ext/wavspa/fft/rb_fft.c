@@ -5,10 +5,16 @@
  */
 
 #include "ruby.h"
+#include "ruby/thread.h"
 #include "fft.h"
+#include "fb.h"
+#include "rb_wavmap.h"
+#include "smpl.h"
+#include "rb_column.h"
 
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
 
 #define N(x)                        (sizeof((x))/sizeof(*(x)))
 #define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
@@ -16,13 +22,18 @@
 #define RB_FFT(p)                   ((rb_fft_t*)(p))
 #define EQ_STR(val,str)             (rb_to_id(val) == rb_intern(str))
 
+static const char* plan_names[] = {
+  "ESTIMATE",             // FFTPLAN_ESTIMATE
+  "SINGLE",               // FFTPLAN_SINGLE
+  "THREAD2",              // FFTPLAN_THREAD2
+  "THREAD4",              // FFTPLAN_THREAD4
+};
+
 typedef struct {
   fft_t* fft;
+  int busy;         // GVLを解放してfftを操作している間は真
 } rb_fft_t;
 
-static VALUE wavspa_module;
-static VALUE fft_klass;
-
 static void
 rb_fft_free(void* ptr)
 {
@@ -37,9 +48,147 @@ rb_fft_alloc(VALUE self)
 
   ptr = xmalloc(sizeof(rb_fft_t));
 
-  ptr->fft = NULL;
+  ptr->fft  = NULL;
+  ptr->busy = 0;
+
+  return Data_Wrap_Struct(self, 0, rb_fft_free, ptr);
+}
+
+/*
+ * GVLを解放している間に他のスレッドから同じオブジェクトを操作されると
+ * fftの内部バッファが壊れるので、その場合は例外にする
+ */
+static rb_fft_t*
+get_fft(VALUE self)
+{
+  rb_fft_t* ret;
+
+  Data_Get_Struct(self, rb_fft_t, ret);
+
+  if (ret->busy) {
+    RUNTIME_ERROR("FFT object is busy");
+  }
+
+  return ret;
+}
+
+typedef struct {
+  int err;
+  rb_fft_t* ptr;
+  int (*func)(fft_t*, void*);
+  void* arg;
+} call_arg_t;
+
+static void*
+_call(void* data)
+{
+  call_arg_t* arg;
+
+  arg = (call_arg_t*)data;
+
+  arg->err = arg->func(arg->ptr->fft, arg->arg);
+
+  return NULL;
+}
+
+static int
+call_without_gvl(rb_fft_t* ptr, int (*func)(fft_t*, void*), void* _arg)
+{
+  call_arg_t arg;
+
+  arg.ptr  = ptr;
+  arg.func = func;
+  arg.arg  = _arg;
+
+  ptr->busy = !0;
+  rb_thread_call_without_gvl(_call, &arg, RUBY_UBF_PROCESS, NULL);
+  ptr->busy = 0;
+
+  return arg.err;
+}
+
+typedef struct {
+  void* src;
+  int n;
+  int nch;
+  int ch;
+} shift_in_arg_t;
+
+static int
+_shift_in(fft_t* fft, void* data)
+{
+  shift_in_arg_t* arg;
+
+  arg = (shift_in_arg_t*)data;
 
-  return Data_Make_Struct(fft_klass, rb_fft_t, 0, rb_fft_free, ptr);
+  return fft_shift_in_channel(fft, arg->src, arg->n, arg->nch, arg->ch);
+}
+
+static int
+_transform(fft_t* fft, void* data)
+{
+  return fft_transform(fft);
+}
+
+typedef struct {
+  int err;
+  rb_fft_t* ptr;
+  int (*func)(fft_t*, double*);
+  double* dst;
+  int type;
+} calc_arg_t;
+
+static int
+_calc(fft_t* fft, void* data)
+{
+  calc_arg_t* arg;
+  int err;
+
+  arg = (calc_arg_t*)data;
+  err = arg->func(fft, arg->dst);
+
+  if (!err) {
+    column_pack(arg->dst, arg->type, fft->width);
+  }
+
+  return err;
+}
+
+static VALUE
+_calc_locked(VALUE data)
+{
+  calc_arg_t* arg;
+
+  arg      = (calc_arg_t*)data;
+  arg->err = call_without_gvl(arg->ptr, _calc, arg);
+
+  return Qnil;
+}
+
+typedef struct {
+  uint8_t* dst;
+  double scale;
+  double bias;
+} plot_arg_t;
+
+static int
+_plot_power(fft_t* fft, void* data)
+{
+  plot_arg_t* arg;
+
+  arg = (plot_arg_t*)data;
+
+  return fft_plot_power(fft, arg->dst, arg->scale, arg->bias);
+}
+
+static int
+_plot_amplitude(fft_t* fft, void* data)
+{
+  plot_arg_t* arg;
+
+  arg = (plot_arg_t*)data;
+
+  return fft_plot_amplitude(fft, arg->dst, arg->scale, arg->bias);
 }
 
 static VALUE
@@ -57,7 +206,7 @@ rb_fft_initialize(VALUE self, VALUE fmt, VALUE capa)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * create fft context
@@ -71,33 +220,94 @@ rb_fft_initialize(VALUE self, VALUE fmt, VALUE capa)
 }
 
 static VALUE
-rb_fft_shift_in(VALUE self, VALUE data)
+rb_fft_shift_in(int argc, VALUE* argv, VALUE self)
 {
   rb_fft_t* ptr;
   int err;
-  void* src;
-  int n;
+  VALUE data;
+  VALUE pos;
+  VALUE len;
+  VALUE ch;
+  wavmap_t* wav;
+  size_t _pos;
+  size_t _len;
+  shift_in_arg_t arg;
 
   /*
-   * check argument
+   * strip object
    */
-  Check_Type(data, T_STRING);
+  ptr = get_fft(self);
 
   /*
-   * strip object
+   * parse argument
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  rb_scan_args(argc, argv, "13", &data, &pos, &len, &ch);
+
+  if (argc == 1) {
+    Check_Type(data, T_STRING);
+
+    /*
+     * GVL解放中に呼び出し元で書き換えられても影響を受けないよう、
+     * 凍結した複製(バッファは共有)から読む
+     */
+    data    = rb_str_new_frozen(data);
+    arg.src = RSTRING_PTR(data);
+    arg.n   = RSTRING_LEN(data) / SMPL_SIZE(ptr->fft->fmt);
+    arg.nch = 1;
+    arg.ch  = 0;
+
+  } else {
+    /*
+     * マップ済みのWAVファイルから直接取り込む
+     *   (posとlenはサンプルブロック単位、ファイル末尾で切り詰める)
+     */
+    if (argc < 3) {
+      rb_error_arity(argc, 3, 4);
+    }
+
+    wav     = wavmap_get_struct(data);
+    _pos    = NUM2SIZET(pos);
+    _len    = NUM2SIZET(len);
+    arg.ch  = wavmap_get_channel(wav, ch);
+    arg.nch = wav->channel_num;
+
+    if (wav->sample_size != SMPL_SIZE(ptr->fft->fmt) * 8) {
+      ARGUMENT_ERROR("sample format is not match");
+    }
+
+    if (_pos > wav->frames) {
+      ARGUMENT_ERROR("invalid position");
+    }
+
+    if (_len > wav->frames - _pos) {
+      _len = wav->frames - _pos;
+    }
+
+    if (_len > INT_MAX) {
+      ARGUMENT_ERROR("too long");
+    }
+
+    arg.src = wav->data + (_pos * wav->block_size);
+    arg.n   = (int)_len;
+  }
 
   /*
    * call fft library
+   *   (GVL解放中にWavMapをcloseされないようにしておく)
    */
+  if (argc == 1) {
+    err = call_without_gvl(ptr, _shift_in, &arg);
+
+  } else {
+    wavmap_hold(data);
+    err = call_without_gvl(ptr, _shift_in, &arg);
+    wavmap_unhold(data);
+  }
 
-  src = RSTRING_PTR(data);
-  n   = RSTRING_LEN(data) / (ptr->fft->fmt & 0x000f);
+  RB_GC_GUARD(data);
 
-  err = fft_shift_in(ptr->fft, src, n);
   if (err) {
-    RUNTIME_ERROR( "fft_shift_in() failed. [err = %d]\n", err);
+    RUNTIME_ERROR( "fft_shift_in_channel() failed. [err = %d]\n", err);
   }
 
   return self;
@@ -112,7 +322,7 @@ rb_fft_reset(VALUE self)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * call fft library
@@ -135,12 +345,12 @@ rb_fft_transform(VALUE self)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * call transform function
    */
-  err = fft_transform(ptr->fft);
+  err = call_without_gvl(ptr, _transform, NULL);
   if (err) {
     RUNTIME_ERROR( "fft_transform() failed. [err = %d]\n", err);
   }
@@ -149,9 +359,9 @@ rb_fft_transform(VALUE self)
 }
 
 static VALUE
-rb_fft_enqueue(VALUE self, VALUE data)
+rb_fft_enqueue(int argc, VALUE* argv, VALUE self)
 {
-  rb_fft_shift_in(self, data);
+  rb_fft_shift_in(argc, argv, self);
   rb_fft_transform(self);
 
   return self;
@@ -195,7 +405,7 @@ rb_fft_set_window(VALUE self, VALUE _type)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * call set window
@@ -213,7 +423,7 @@ rb_fft_get_width(VALUE self)
 {
   rb_fft_t* ptr;
 
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   return INT2FIX(ptr->fft->width);
 }
@@ -232,7 +442,7 @@ rb_fft_set_width(VALUE self, VALUE width)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * call set window
@@ -251,7 +461,7 @@ rb_fft_get_scale_mode(VALUE self)
   VALUE ret;
   rb_fft_t* ptr;
 
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   switch (ptr->fft->mode) {
   case FFT_LOGSCALE_MODE:
@@ -292,7 +502,7 @@ rb_fft_set_scale_mode(VALUE self, VALUE _mode)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * call set scale mode function
@@ -325,7 +535,7 @@ rb_fft_set_frequency(VALUE self, VALUE freq)
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
    * call set fequency
@@ -341,101 +551,394 @@ rb_fft_set_frequency(VALUE self, VALUE freq)
   return freq;
 }
 
-
 static VALUE
-rb_fft_power(VALUE self)
+calc(VALUE self, int argc, VALUE* argv, int (*func)(fft_t*, double*))
 {
   rb_fft_t* ptr;
   VALUE ret;
-  int err;
-  int i;
-  double* dat;
+  VALUE into;
+  calc_arg_t arg;
 
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
+
+  /*
+   * parse argument
+   */
+  column_parse_args(argc, argv, &into, &arg.type);
 
   /*
    * alloc return object
+   *   (intoが指定されている場合はそのバッファに書き込む)
    */
-  ret = rb_str_buf_new(sizeof(double) * ptr->fft->width);
-  rb_str_set_len(ret, sizeof(double) * ptr->fft->width);
+  ret = column_buffer(into, ptr->fft->width);
 
   /*
-   * call transform function
+   * call calc function
    */
-  dat = RSTRING_PTR(ret);
-  err = fft_calc_power(ptr->fft, dat);
-  if (err) {
-    RUNTIME_ERROR( "fft_calc_power() failed. [err = %d]\n", err);
+  arg.ptr  = ptr;
+  arg.func = func;
+  arg.dst  = column_ptr(ret);
+
+  column_call_locked(ret, _calc_locked, (VALUE)&arg);
+  if (arg.err) {
+    RUNTIME_ERROR( "fft_calc_*() failed. [err = %d]\n", arg.err);
   }
 
+  column_set_len(ret, arg.type, ptr->fft->width);
+
   return ret;
 }
 
 static VALUE
-rb_fft_amplitude(VALUE self)
+rb_fft_power(int argc, VALUE* argv, VALUE self)
+{
+  return calc(self, argc, argv, fft_calc_power);
+}
+
+static VALUE
+rb_fft_amplitude(int argc, VALUE* argv, VALUE self)
+{
+  return calc(self, argc, argv, fft_calc_amplitude);
+}
+
+static VALUE
+rb_fft_absolute(int argc, VALUE* argv, VALUE self)
+{
+  return calc(self, argc, argv, fft_calc_absolute);
+}
+
+static rb_fb_t*
+get_plot_target(rb_fft_t* ptr, int argc, VALUE* argv, int* col, int* band)
+{
+  rb_fb_t* ret;
+  VALUE fb;
+  VALUE _col;
+  VALUE _band;
+
+  /*
+   * check argument
+   */
+  rb_scan_args(argc, argv, "21", &fb, &_col, &_band);
+
+  Check_Type(_col, T_FIXNUM);
+  if (_band != Qnil) Check_Type(_band, T_FIXNUM);
+
+  ret   = fb_get_struct(fb);
+  *col  = FIX2INT(_col);
+  *band = (_band != Qnil)? FIX2INT(_band): 0;
+
+  if (*col < 0 || *col >= ret->width) {
+    ARGUMENT_ERROR("invalid column number");
+  }
+
+  if (*band < 0 || *band >= ret->bands) {
+    ARGUMENT_ERROR("invalid band number");
+  }
+
+  if (ret->height != ptr->fft->width) {
+    ARGUMENT_ERROR("frame buffer height is not match");
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_fft_plot_power(int argc, VALUE* argv, VALUE self)
 {
   rb_fft_t* ptr;
-  VALUE ret;
+  rb_fb_t* dst;
+  int col;
+  int band;
+  plot_arg_t arg;
   int err;
 
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
+
+  dst = get_plot_target(ptr, argc, argv, &col, &band);
 
   /*
-   * alloc return object
+   * call plot function
    */
-  ret = rb_str_buf_new(sizeof(double) * ptr->fft->width);
-  rb_str_set_len(ret, sizeof(double) * ptr->fft->width);
+  arg.dst   = fb_qbuf(dst, band);
+  arg.scale = dst->pscale;
+  arg.bias  = 0.5;
+
+  err = call_without_gvl(ptr, _plot_power, &arg);
+  if (err) {
+    RUNTIME_ERROR( "fft_plot_power() failed. [err = %d]\n", err);
+  }
+
+  fb_put_column(dst, col, band);
+
+  return self;
+}
+
+static VALUE
+rb_fft_plot_amplitude(int argc, VALUE* argv, VALUE self)
+{
+  rb_fft_t* ptr;
+  rb_fb_t* dst;
+  int col;
+  int band;
+  plot_arg_t arg;
+  int err;
 
   /*
-   * call inverse function
+   * strip object
    */
-  err = fft_calc_amplitude(ptr->fft, (double*)RSTRING_PTR(ret));
+  ptr = get_fft(self);
+
+  dst = get_plot_target(ptr, argc, argv, &col, &band);
+
+  /*
+   * call plot function
+   */
+  arg.dst   = fb_qbuf(dst, band);
+  arg.scale = dst->ascale;
+  arg.bias  = -dst->floor * dst->ascale;
+
+  err = call_without_gvl(ptr, _plot_amplitude, &arg);
   if (err) {
-    RUNTIME_ERROR( "fft_calc_amplitude() failed. [err = %d]\n", err);
+    RUNTIME_ERROR( "fft_plot_amplitude() failed. [err = %d]\n", err);
   }
 
-  return ret;
+  fb_put_column(dst, col, band);
+
+  return self;
 }
 
 static VALUE
-rb_fft_absolute(VALUE self)
+rb_fft_get_plan(VALUE self)
 {
   rb_fft_t* ptr;
-  VALUE ret;
+  int plan;
   int err;
 
   /*
    * strip object
    */
-  Data_Get_Struct(self, rb_fft_t, ptr);
+  ptr = get_fft(self);
 
   /*
-   * alloc return object
+   * call fft library
+   */
+  err = fft_get_plan(ptr->fft, &plan);
+  if (err) {
+    RUNTIME_ERROR( "fft_get_plan() failed. [err = %d]\n", err);
+  }
+
+  return ID2SYM(rb_intern(plan_names[plan]));
+}
+
+static VALUE
+rb_fft_set_plan(VALUE self, VALUE _plan)
+{
+  rb_fft_t* ptr;
+  int plan;
+  int err;
+
+  /*
+   * check argument
+   */
+  if (TYPE(_plan) != T_STRING && TYPE(_plan) != T_SYMBOL) {
+    ARGUMENT_ERROR( "Plan is unsupported data");
+  }
+
+  plan = fftplan_parse(rb_id2name(rb_to_id(_plan)));
+  if (plan < 0) {
+    ARGUMENT_ERROR( "Unknown plan");
+  }
+
+  /*
+   * strip object
+   */
+  ptr = get_fft(self);
+
+  /*
+   * call fft library
+   */
+  err = fft_set_plan(ptr->fft, plan);
+  if (err) {
+    RUNTIME_ERROR( "fft_set_plan() failed. [err = %d]\n", err);
+  }
+
+  return _plan;
+}
+
+/*
+ * 計測結果 (計測していない実行方法の所要時間はnil)
+ */
+static VALUE
+wisdom_hash(fftplan_wisdom_t* ent)
+{
+  VALUE ret;
+  VALUE ns;
+  int i;
+
+  ret = rb_hash_new();
+  ns  = rb_hash_new();
+
+  for (i = FFTPLAN_SINGLE; i < FFTPLAN_NUM; i++) {
+    rb_hash_aset(ns, ID2SYM(rb_intern(plan_names[i])),
+                 (ent->ns[i] > 0)? ULL2NUM(ent->ns[i]): Qnil);
+  }
+
+  rb_hash_aset(ret, ID2SYM(rb_intern("size")), INT2FIX(ent->n));
+  rb_hash_aset(ret, ID2SYM(rb_intern("plan")),
+               ID2SYM(rb_intern(plan_names[ent->plan])));
+  rb_hash_aset(ret, ID2SYM(rb_intern("ns")), ns);
+
+  return ret;
+}
+
+typedef struct {
+  int err;
+  int n;
+  fftplan_wisdom_t ent;
+} measure_arg_t;
+
+static void*
+_measure(void* data)
+{
+  measure_arg_t* arg;
+
+  arg = (measure_arg_t*)data;
+
+  arg->err = fftplan_measure(arg->n, &arg->ent);
+
+  return NULL;
+}
+
+/*
+ * 指定サイズのrdft()の実行方法を計測し直す (結果はwisdomファイルに保存
+ * され、以降に生成するFFTオブジェクトに反映される)
+ */
+static VALUE
+rb_fft_measure_plan(VALUE self, VALUE size)
+{
+  measure_arg_t arg;
+
+  arg.n = NUM2INT(size);
+
+  rb_thread_call_without_gvl(_measure, &arg, RUBY_UBF_PROCESS, NULL);
+
+  if (arg.err) {
+    ARGUMENT_ERROR( "fftplan_measure() failed. [err = %d]\n", arg.err);
+  }
+
+  return wisdom_hash(&arg.ent);
+}
+
+static VALUE
+rb_fft_wisdom(VALUE self)
+{
+  VALUE ret;
+  fftplan_wisdom_t ent[FFTPLAN_MAX_WISDOM];
+  int num;
+  int err;
+  int i;
+
+  err = fftplan_wisdom_get(ent, N(ent), &num);
+  if (err) {
+    RUNTIME_ERROR( "fftplan_wisdom_get() failed. [err = %d]\n", err);
+  }
+
+  ret = rb_ary_new();
+
+  for (i = 0; i < num && i < (int)N(ent); i++) {
+    rb_ary_push(ret, wisdom_hash(ent + i));
+  }
+
+  return ret;
+}
+
+/*
+ * 実行統計
+ *   transform_ns/reduce_nsはfft_transform()とfft_calc_*()/fft_plot_*()の
+ *   所要時間の合計(ナノ秒)
+ */
+static VALUE
+rb_fft_stats(VALUE self)
+{
+  VALUE ret;
+  rb_fft_t* ptr;
+  fft_stats_t st;
+  int err;
+
+  /*
+   * strip object
    */
-  ret = rb_str_buf_new(sizeof(double) * ptr->fft->width);
-  rb_str_set_len(ret, sizeof(double) * ptr->fft->width);
+  ptr = get_fft(self);
 
   /*
-   * call inverse function
+   * call fft library
    */
-  err = fft_calc_absolute(ptr->fft, (double*)RSTRING_PTR(ret));
+  err = fft_get_stats(ptr->fft, &st);
   if (err) {
-    RUNTIME_ERROR( "fft_calc_absolute() failed. [err = %d]\n", err);
+    RUNTIME_ERROR( "fft_get_stats() failed. [err = %d]\n", err);
   }
 
+  /*
+   * create return object
+   */
+  ret = rb_hash_new();
+
+  rb_hash_aset(ret, ID2SYM(rb_intern("frames")), ULL2NUM(st.frames));
+  rb_hash_aset(ret, ID2SYM(rb_intern("samples")), ULL2NUM(st.samples));
+  rb_hash_aset(ret, ID2SYM(rb_intern("transform_ns")),
+               ULL2NUM(st.transform_ns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("reduce_ns")), ULL2NUM(st.reduce_ns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("allocations")), ULL2NUM(st.allocs));
+  rb_hash_aset(ret, ID2SYM(rb_intern("table_bytes")),
+               SIZET2NUM(st.table_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("buffer_bytes")),
+               SIZET2NUM(st.buffer_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("threads")), INT2FIX(st.threads));
+
   return ret;
 }
 
+static VALUE
+rb_fft_reset_stats(VALUE self)
+{
+  rb_fft_t* ptr;
+  int err;
+
+  /*
+   * strip object
+   */
+  ptr = get_fft(self);
+
+  /*
+   * call fft library
+   */
+  err = fft_reset_stats(ptr->fft);
+  if (err) {
+    RUNTIME_ERROR( "fft_reset_stats() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
 
 void
 Init_fft()
 {
+  VALUE wavspa_module;
+  VALUE fft_klass;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  /*
+   * 状態は全てrb_fft_t側に持つので複数のRactorから利用できる
+   */
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
   wavspa_module = rb_define_module("WavSpectrumAnalyzer");
   fft_klass     = rb_define_class_under(wavspa_module, "FFT", rb_cObject);
 
@@ -449,13 +952,23 @@ Init_fft()
   rb_define_method(fft_klass, "scale_mode", rb_fft_get_scale_mode, 0);
   rb_define_method(fft_klass, "scale_mode=", rb_fft_set_scale_mode, 1);
   rb_define_method(fft_klass, "frequency=", rb_fft_set_frequency, 1);
+  rb_define_method(fft_klass, "plan", rb_fft_get_plan, 0);
+  rb_define_method(fft_klass, "plan=", rb_fft_set_plan, 1);
 
-  rb_define_method(fft_klass, "shift_in", rb_fft_shift_in, 1);
+  rb_define_method(fft_klass, "shift_in", rb_fft_shift_in, -1);
   rb_define_method(fft_klass, "reset", rb_fft_reset, 0);
   rb_define_method(fft_klass, "transform", rb_fft_transform, 0);
-  rb_define_method(fft_klass, "enqueue", rb_fft_enqueue, 1);
-  rb_define_method(fft_klass, "<<", rb_fft_enqueue, 1);
-  rb_define_method(fft_klass, "power", rb_fft_power, 0);
-  rb_define_method(fft_klass, "amplitude", rb_fft_amplitude, 0);
-  rb_define_method(fft_klass, "absolute", rb_fft_absolute, 0);
+  rb_define_method(fft_klass, "enqueue", rb_fft_enqueue, -1);
+  rb_define_method(fft_klass, "<<", rb_fft_enqueue, -1);
+  rb_define_method(fft_klass, "power", rb_fft_power, -1);
+  rb_define_method(fft_klass, "amplitude", rb_fft_amplitude, -1);
+  rb_define_method(fft_klass, "absolute", rb_fft_absolute, -1);
+  rb_define_method(fft_klass, "plot_power", rb_fft_plot_power, -1);
+  rb_define_method(fft_klass, "plot_amplitude", rb_fft_plot_amplitude, -1);
+
+  rb_define_method(fft_klass, "stats", rb_fft_stats, 0);
+  rb_define_method(fft_klass, "reset_stats", rb_fft_reset_stats, 0);
+
+  rb_define_singleton_method(fft_klass, "measure_plan", rb_fft_measure_plan, 1);
+  rb_define_singleton_method(fft_klass, "wisdom", rb_fft_wisdom, 0);
 }
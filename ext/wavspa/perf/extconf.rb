@@ -0,0 +1,4 @@
+require 'mkmf'
+
+# perf_event_open(2)はLinuxでのみ使用する (他の環境ではカウンタ無しとなる)
+create_makefile( "wavspa/perf")
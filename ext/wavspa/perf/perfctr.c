@@ -0,0 +1,217 @@
+﻿/*
+ * Hardware performance counter library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif /* defined(__linux__) */
+
+#include "perfctr.h"
+
+#define N(x)                    (sizeof(x)/sizeof(*x))
+
+#define ERR                     __LINE__
+
+static const char* names[] = {
+  "cycles",               // PERFCTR_CYCLES
+  "instructions",         // PERFCTR_INSTRUCTIONS
+  "l1d_misses",           // PERFCTR_L1D_MISSES
+  "llc_misses",           // PERFCTR_LLC_MISSES
+  "branch_misses",        // PERFCTR_BRANCH_MISSES
+};
+
+#ifdef __linux__
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} events[] = {
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int
+open_event(int id)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+
+  attr.size           = sizeof(attr);
+  attr.type           = events[id].type;
+  attr.config         = events[id].config;
+  attr.disabled       = 1;
+  attr.inherit        = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif /* defined(__linux__) */
+
+int
+perfctr_open(perfctr_t* pc)
+{
+  int ret;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    /*
+     * argument check
+     */
+    if (pc == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * open counters
+     *   (カーネルやハイパーバイザが対応していないカウンタは使用不可
+     *    として扱い、エラーにはしない)
+     */
+    pc->navail = 0;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+#ifdef __linux__
+      pc->fd[i] = open_event(i);
+#else /* defined(__linux__) */
+      pc->fd[i] = -1;
+#endif /* defined(__linux__) */
+
+      if (pc->fd[i] >= 0) pc->navail++;
+    }
+  } while (0);
+
+  return ret;
+}
+
+int
+perfctr_start(perfctr_t* pc)
+{
+  int ret;
+  int i;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (pc == NULL) ret = ERR;
+
+  /*
+   * reset and enable counters
+   */
+  if (!ret) {
+#ifdef __linux__
+    for (i = 0; i < PERFCTR_NUM; i++) {
+      if (pc->fd[i] < 0) continue;
+
+      ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else /* defined(__linux__) */
+    (void)i;
+#endif /* defined(__linux__) */
+  }
+
+  return ret;
+}
+
+/*
+ * カウンタを止めて値を読み出す
+ *   (他のイベントと多重化されていた場合は計数できた時間の比率で補正する)
+ */
+int
+perfctr_stop(perfctr_t* pc, uint64_t* dst)
+{
+  int ret;
+  int i;
+  uint64_t val[3];    // as {value, time enabled, time running}
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    /*
+     * argument check
+     */
+    if (pc == NULL || dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * read counters
+     */
+    for (i = 0; i < PERFCTR_NUM; i++) {
+      dst[i] = PERFCTR_NONE;
+
+#ifdef __linux__
+      if (pc->fd[i] < 0) continue;
+
+      ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+      if (read(pc->fd[i], val, sizeof(val)) != sizeof(val)) continue;
+      if (val[2] == 0) continue;
+
+      if (val[2] < val[1]) {
+        dst[i] = (uint64_t)((double)val[0] * ((double)val[1] / val[2]));
+      } else {
+        dst[i] = val[0];
+      }
+#else /* defined(__linux__) */
+      (void)val;
+#endif /* defined(__linux__) */
+    }
+  } while (0);
+
+  return ret;
+}
+
+void
+perfctr_close(perfctr_t* pc)
+{
+  int i;
+
+  if (pc != NULL) {
+    for (i = 0; i < PERFCTR_NUM; i++) {
+      if (pc->fd[i] >= 0) close(pc->fd[i]);
+      pc->fd[i] = -1;
+    }
+
+    pc->navail = 0;
+  }
+}
+
+const char*
+perfctr_name(int id)
+{
+  return (id >= 0 && id < (int)N(names))? names[id]: NULL;
+}
@@ -0,0 +1,42 @@
+﻿/*
+ * Hardware performance counter library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __PERFCTR_H__
+#define __PERFCTR_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PERFCTR_CYCLES            0
+#define PERFCTR_INSTRUCTIONS      1
+#define PERFCTR_L1D_MISSES        2
+#define PERFCTR_LLC_MISSES        3
+#define PERFCTR_BRANCH_MISSES     4
+#define PERFCTR_NUM               5
+
+#define PERFCTR_NONE              UINT64_MAX
+
+/*
+ * Linuxのperf_event_open(2)によるカウンタ
+ *   (開けなかったカウンタはfdが-1となり、値はPERFCTR_NONEを返す。
+ *    Linux以外では全てのカウンタが使用不可となる)
+ *
+ * カウントはユーザ空間のみ。perfctr_open()以降に生成されたスレッドも
+ * 計数に含まれるが、それ以前から存在するスレッド(OpenMPのスレッド
+ * プールなど)は含まれない。
+ */
+typedef struct {
+  int fd[PERFCTR_NUM];
+  int navail;         // as "number of available counters"
+} perfctr_t;
+
+int perfctr_open(perfctr_t* pc);
+int perfctr_start(perfctr_t* pc);
+int perfctr_stop(perfctr_t* pc, uint64_t* dst);
+void perfctr_close(perfctr_t* pc);
+const char* perfctr_name(int id);
+
+#endif /* !defined(__PERFCTR_H__) */
@@ -0,0 +1,174 @@
+﻿/*
+ * Hardware performance counter interface for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "ruby.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "perfctr.h"
+
+#define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
+
+static void
+rb_perfctr_free(void* _ptr)
+{
+  perfctr_t* ptr;
+
+  ptr = (perfctr_t*)_ptr;
+
+  perfctr_close(ptr);
+  free(ptr);
+}
+
+static size_t
+rb_perfctr_size(const void* _ptr)
+{
+  return sizeof(perfctr_t);
+}
+
+static const struct rb_data_type_struct perfctr_data_type = {
+  .wrap_struct_name = "perf counter for wavspa",
+  .function = {
+    .dfree = rb_perfctr_free,
+    .dsize = rb_perfctr_size,
+  },
+};
+
+static VALUE
+rb_perfctr_alloc(VALUE self)
+{
+  perfctr_t* ptr;
+  int i;
+
+  ptr = ALLOC(perfctr_t);
+
+  for (i = 0; i < PERFCTR_NUM; i++) ptr->fd[i] = -1;
+  ptr->navail = 0;
+
+  return TypedData_Wrap_Struct(self, &perfctr_data_type, ptr);
+}
+
+static perfctr_t*
+get_perfctr(VALUE self)
+{
+  perfctr_t* ret;
+
+  TypedData_Get_Struct(self, perfctr_t, &perfctr_data_type, ret);
+
+  return ret;
+}
+
+static VALUE
+rb_perfctr_initialize(VALUE self)
+{
+  int err;
+
+  err = perfctr_open(get_perfctr(self));
+  if (err) {
+    RUNTIME_ERROR("perfctr_open() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
+
+/*
+ * 使用可能なカウンタ名の配列 (空ならカウンタは使えない)
+ */
+static VALUE
+rb_perfctr_events(VALUE self)
+{
+  VALUE ret;
+  perfctr_t* ptr;
+  int i;
+
+  ptr = get_perfctr(self);
+  ret = rb_ary_new();
+
+  for (i = 0; i < PERFCTR_NUM; i++) {
+    if (ptr->fd[i] >= 0) {
+      rb_ary_push(ret, ID2SYM(rb_intern(perfctr_name(i))));
+    }
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_perfctr_is_available(VALUE self)
+{
+  return (get_perfctr(self)->navail > 0)? Qtrue: Qfalse;
+}
+
+static VALUE
+rb_perfctr_start(VALUE self)
+{
+  int err;
+
+  err = perfctr_start(get_perfctr(self));
+  if (err) {
+    RUNTIME_ERROR("perfctr_start() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
+
+/*
+ * 計数を止めて {:cycles => n, ...} を返す (使えないカウンタはnil)
+ */
+static VALUE
+rb_perfctr_stop(VALUE self)
+{
+  VALUE ret;
+  uint64_t val[PERFCTR_NUM];
+  int err;
+  int i;
+
+  err = perfctr_stop(get_perfctr(self), val);
+  if (err) {
+    RUNTIME_ERROR("perfctr_stop() failed. [err = %d]\n", err);
+  }
+
+  ret = rb_hash_new();
+
+  for (i = 0; i < PERFCTR_NUM; i++) {
+    rb_hash_aset(ret, ID2SYM(rb_intern(perfctr_name(i))),
+                 (val[i] != PERFCTR_NONE)? ULL2NUM(val[i]): Qnil);
+  }
+
+  return ret;
+}
+
+static VALUE
+rb_perfctr_close(VALUE self)
+{
+  perfctr_close(get_perfctr(self));
+
+  return Qnil;
+}
+
+void
+Init_perf(void)
+{
+  VALUE wavspa_module;
+  VALUE perfctr_klass;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
+  wavspa_module = rb_define_module("WavSpectrumAnalyzer");
+  perfctr_klass = rb_define_class_under(wavspa_module,
+                                        "PerfCounter", rb_cObject);
+
+  rb_define_alloc_func(perfctr_klass, rb_perfctr_alloc);
+  rb_define_method(perfctr_klass, "initialize", rb_perfctr_initialize, 0);
+  rb_define_method(perfctr_klass, "events", rb_perfctr_events, 0);
+  rb_define_method(perfctr_klass, "available?", rb_perfctr_is_available, 0);
+  rb_define_method(perfctr_klass, "start", rb_perfctr_start, 0);
+  rb_define_method(perfctr_klass, "stop", rb_perfctr_stop, 0);
+  rb_define_method(perfctr_klass, "close", rb_perfctr_close, 0);
+}
@@ -0,0 +1,46 @@
+require 'mkmf'
+require 'optparse'
+
+omp_enable = true
+omp_name   = "gomp"
+
+OptionParser.new { |opt|
+  opt.on("--[no-]openmp") { |flag|
+    omp_enable = flag
+  }
+
+  opt.on("--omp-name=NAME", String) { |name|
+    omp_name = name
+  }
+
+  opt.parse!(ARGV)
+}
+
+if not have_header("zlib.h") or not have_library("z", "deflate")
+  abort("zlib is not found.")
+end
+
+# FFT(../fft)の設定と揃える (閾値は実行方法の計測をしない場合の既定値)
+$CFLAGS << " -DUSE_CDFT_PTHREADS -DCDFT_THREADS_BEGIN_N=512 -DCDFT_4THREADS_BEGIN_N=1024"
+
+if omp_enable
+  $CFLAGS << " -fopenmp"
+  have_library(omp_name)
+end
+
+have_library("pthread")
+have_library("m")
+
+# WAVSPA_TRACE環境変数によるトレース記録(../common/trace.c)を組み込む
+$CFLAGS << " -DWAVSPA_TRACE"
+
+# 解析・描画・出力の各ライブラリのCソースをRubyを介さずに直接リンクする
+%w[fft wavelet wavmap cache fb common].each { |dir|
+  $INCFLAGS << " -I$(srcdir)/../#{dir}"
+  $VPATH << "$(srcdir)/../#{dir}"
+}
+
+$srcs = Dir.glob("#{$srcdir}/*.c").map {|f| File.basename(f)}
+$srcs += %w[fft.c fftsg.c fftplan.c walet.c wavmap.c spc.c fbdraw.c pngenc.c smpl.c trace.c]
+
+create_makefile( "wavspa/render")
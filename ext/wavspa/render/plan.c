@@ -0,0 +1,572 @@
+﻿/*
+ * Cost model and time budget planner
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+/*
+ * 変換の処理時間を実行前に予測し、時間の予算に収まる構成を選ぶ。
+ *
+ * Waveletの1カラムの処理時間は窓幅の合計(ws[i] = wk0 * fq_s / ft[i]
+ * の総和)に比例するので、1サンプル分の積算(exp/cos/sin)の時間を小さな
+ * 構成で計測し、それに窓幅の合計を掛けて求める。FFTの処理時間はサイズ
+ * とスレッドの分割で決まり式では表しにくいため、候補のサイズ毎に実際に
+ * 数回変換して計測する。計測自体は数ミリ秒程度だが、rdft()の実行方法が
+ * 未計測のサイズはfft_new()でその計測(fftplan.h)も行うので、wisdom
+ * ファイルが無い初回はサイズ毎に更に時間が掛かる。
+ *
+ * 候補は、指定された構成と同じカラム数・出力幅・周波数範囲で、解析器
+ * (FFT/Wavelet)、FFTのサイズと窓関数、Waveletのσとガボール閾値を変えた
+ * もの。分解能は最低周波数での窓の等価雑音帯域幅で比べる。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "plan.h"
+#include "fft.h"
+#include "walet.h"
+#include "clock.h"
+
+#define N(x)                    (sizeof(x)/sizeof(*x))
+#define MIN(m,n)                (((m) < (n))? (m): (n))
+
+#define ERR                     __LINE__
+
+#define MIN_FFT_SIZE            512
+#define MAX_FFT_SIZE            262144
+#define FFT_REPEAT              5
+#define TAP_REPEAT              3
+#define TOLERANCE               1.0001
+
+#define DEFAULT_WINDOW          FFT_WINDOW_BLACKMAN   // as fft_new()
+
+/*
+ * 窓関数の等価雑音帯域幅 (ビン単位)
+ */
+static const double enbw[] = {
+  1.00,                   // FFT_WINDOW_RECTANGULAR
+  1.36,                   // FFT_WINDOW_HAMMING
+  1.50,                   // FFT_WINDOW_HANN
+  1.73,                   // FFT_WINDOW_BLACKMAN
+  1.98,                   // FFT_WINDOW_BLACKMAN_NUTTALL
+  3.77,                   // FFT_WINDOW_FLAT_TOP
+};
+
+static const char* window_names[] = {
+  "rectangular",          // FFT_WINDOW_RECTANGULAR
+  "hamming",              // FFT_WINDOW_HAMMING
+  "hann",                 // FFT_WINDOW_HANN
+  "blackman",             // FFT_WINDOW_BLACKMAN
+  "blackman-nuttall",     // FFT_WINDOW_BLACKMAN_NUTTALL
+  "flat-top",             // FFT_WINDOW_FLAT_TOP
+};
+
+/*
+ * FFTに切り替える場合に試す窓関数
+ */
+static const int fft_windows[] = {
+  FFT_WINDOW_HANN,
+  FFT_WINDOW_BLACKMAN,
+  FFT_WINDOW_FLAT_TOP,
+};
+
+/*
+ * ガボール閾値を緩める場合の値 (窓が短くなる代わりに精度が下がる)
+ */
+static const double thresholds[] = {0.02, 0.05, 0.1};
+
+static int
+wavelet_new(render_param_t* prm, double fq_s, walet_t** dst)
+{
+  int ret;
+  walet_t* wl;
+
+  ret = 0;
+  wl  = NULL;
+
+  do {
+    if (walet_new(&wl)) {
+      ret = ERR;
+      break;
+    }
+
+    if (walet_set_frequency(wl, fq_s)) {
+      ret = ERR;
+      break;
+    }
+
+    if (prm->sigma > 0 && walet_set_sigma(wl, prm->sigma)) {
+      ret = ERR;
+      break;
+    }
+
+    if (prm->threshold > 0 && walet_set_gabor_threshold(wl, prm->threshold)) {
+      ret = ERR;
+      break;
+    }
+
+    if (walet_set_range(wl, prm->fq_l, prm->fq_h)) {
+      ret = ERR;
+      break;
+    }
+
+    if (walet_set_scale_mode(wl, (prm->scale == RENDER_LOGSCALE_MODE)?
+                                 WALET_LOGSCALE_MODE: WALET_LINEARSCALE_MODE)) {
+      ret = ERR;
+      break;
+    }
+
+    if (walet_set_output_width(wl, prm->width)) {
+      ret = ERR;
+      break;
+    }
+
+    *dst = wl;
+  } while (0);
+
+  if (ret && wl != NULL) walet_destroy(wl);
+
+  return ret;
+}
+
+/*
+ * Waveletの窓1サンプル分の積算時間の計測
+ *   (σ=24、2k-8kHz、32本の構成で、入力の端にかからない位置を変換する)
+ */
+static int
+calibrate_tap(double* dst)
+{
+  int ret;
+  render_param_t prm;
+  walet_t* wl;
+  double* buf;
+  size_t wmax;
+  size_t taps;
+  uint64_t t0;
+  uint64_t t;
+  uint64_t best;
+  int i;
+
+  ret  = 0;
+  wl   = NULL;
+  buf  = NULL;
+  best = UINT64_MAX;
+
+  memset(&prm, 0, sizeof(prm));
+
+  prm.sigma = 24.0;
+  prm.fq_l  = 2000.0;
+  prm.fq_h  = 8000.0;
+  prm.scale = RENDER_LINEARSCALE_MODE;
+  prm.width = 32;
+
+  do {
+    ret = wavelet_new(&prm, 44100.0, &wl);
+    if (ret) break;
+
+    walet_get_max_window(wl, &wmax);
+    walet_get_taps(wl, &taps);
+
+    buf = (double*)calloc((wmax * 2) + 1, sizeof(double));
+    if (buf == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (walet_put_in(wl, "dbl", buf, (wmax * 2) + 1)) {
+      ret = ERR;
+      break;
+    }
+
+    for (i = 0; i < TAP_REPEAT; i++) {
+      t0 = now_ns();
+
+      if (walet_transform(wl, wmax)) {
+        ret = ERR;
+        break;
+      }
+
+      t = now_ns() - t0;
+      if (t < best) best = t;
+    }
+
+    if (ret) break;
+
+    *dst = (double)best / taps;
+  } while (0);
+
+  if (buf != NULL) free(buf);
+  if (wl != NULL) walet_destroy(wl);
+
+  return ret;
+}
+
+static int
+eval_wavelet(plan_t* plan, plan_entry_t* ent, wavmap_t* wav)
+{
+  int ret;
+  walet_t* wl;
+  size_t wmax;
+  size_t taps;
+
+  ret = wavelet_new(&ent->prm, wav->sample_rate, &wl);
+
+  if (!ret) {
+    walet_get_max_window(wl, &wmax);
+    walet_get_taps(wl, &taps);
+
+    ent->resolution = ent->prm.fq_l / (2.0 * sqrt(M_PI) * wl->sigma);
+    ent->window     = (double)(wmax * 2) / wav->sample_rate;
+    ent->col_ns     = taps * plan->tap_ns;
+
+    snprintf(ent->mode, sizeof(ent->mode),
+             "wavelet sigma=%.4g threshold=%.4g", wl->sigma, wl->gth);
+
+    walet_destroy(wl);
+  }
+
+  return ret;
+}
+
+/*
+ * FFTは1カラム分(取り込み・変換・プロット)を実際に数回実行して計測する
+ */
+static int
+eval_fft(plan_entry_t* ent, wavmap_t* wav, size_t usize)
+{
+  int ret;
+  render_param_t* prm;
+  fft_t* fft;
+  uint8_t* buf;
+  uint8_t* qbuf;
+  size_t n;
+  uint64_t t0;
+  uint64_t t;
+  uint64_t best;
+  int win;
+  int i;
+
+  ret  = 0;
+  prm  = &ent->prm;
+  fft  = NULL;
+  buf  = NULL;
+  qbuf = NULL;
+  best = UINT64_MAX;
+  win  = (prm->window >= 0)? prm->window: DEFAULT_WINDOW;
+  n    = MIN(usize, (size_t)prm->fft_size);
+
+  do {
+    if (fft_new(wav->fmt, prm->fft_size, &fft)) {
+      ret = ERR;
+      break;
+    }
+
+    if (fft_set_window(fft, win) ||
+        fft_set_width(fft, prm->width) ||
+        fft_set_scale_mode(fft, (prm->scale == RENDER_LOGSCALE_MODE)?
+                                FFT_LOGSCALE_MODE: FFT_LINEARSCALE_MODE) ||
+        fft_set_frequency(fft, wav->sample_rate, prm->fq_l, prm->fq_h)) {
+      ret = ERR;
+      break;
+    }
+
+    buf  = (uint8_t*)calloc(n, wav->block_size);
+    qbuf = (uint8_t*)malloc(prm->width);
+    if (buf == NULL || qbuf == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    for (i = 0; i < FFT_REPEAT; i++) {
+      t0 = now_ns();
+
+      if (fft_shift_in_channel(fft, buf, (int)n, wav->channel_num, 0) ||
+          fft_transform(fft) ||
+          fft_plot_power(fft, qbuf, 1.0, 0.0)) {
+        ret = ERR;
+        break;
+      }
+
+      t = now_ns() - t0;
+      if (t < best) best = t;
+    }
+
+    if (ret) break;
+
+    ent->resolution = (enbw[win] * wav->sample_rate) / prm->fft_size;
+    ent->window     = (double)prm->fft_size / wav->sample_rate;
+    ent->col_ns     = (double)best;
+
+    snprintf(ent->mode, sizeof(ent->mode),
+             "fft %s %d", window_names[win], prm->fft_size);
+  } while (0);
+
+  if (qbuf != NULL) free(qbuf);
+  if (buf != NULL) free(buf);
+  if (fft != NULL) fft_destroy(fft);
+
+  return ret;
+}
+
+static int
+eval_entry(plan_t* plan, plan_entry_t* ent, wavmap_t* wav)
+{
+  int ret;
+  size_t usize;
+  int nch;
+  int par;
+
+  usize = render_unit_size(&ent->prm, wav);
+  nch   = (ent->prm.nch > 0)? ent->prm.nch: wav->channel_num;
+
+  if (ent->prm.analyzer == RENDER_ANALYZER_FFT) {
+    ret = eval_fft(ent, wav, usize);
+    par = MIN(nch, plan->ncpu);
+
+  } else {
+    ret = eval_wavelet(plan, ent, wav);
+    par = 1;    // 1カラムの変換自体がOpenMPで並列化されている
+  }
+
+  if (!ret) {
+    ent->sec = ((wav->frames / usize) * ent->col_ns *
+                ((nch + par - 1) / par)) / 1e9;
+  }
+
+  return ret;
+}
+
+/*
+ * 候補の追加 (指定された構成と同じものは追加しない)
+ */
+static int
+add_entry(plan_t* plan, render_param_t* prm, wavmap_t* wav)
+{
+  int ret;
+  plan_entry_t* ent;
+
+  ret = 0;
+
+  do {
+    if (plan->nent >= PLAN_MAX_ENTRIES) break;
+
+    ent = plan->ent + plan->nent;
+
+    memset(ent, 0, sizeof(*ent));
+    ent->prm = *prm;
+
+    ret = eval_entry(plan, ent, wav);
+    if (ret) break;
+
+    if (plan->nent > 0 && strcmp(ent->mode, plan->ent[0].mode) == 0) break;
+
+    ent->meets = (ent->resolution <= plan->ent[0].resolution * TOLERANCE);
+    plan->nent++;
+  } while (0);
+
+  return ret;
+}
+
+/*
+ * 要求された分解能を満たす最小のFFTサイズ (無い場合は0)
+ */
+static int
+fft_size_for(double res, double fq_s, int win)
+{
+  int ret;
+
+  for (ret = MIN_FFT_SIZE; ret <= MAX_FFT_SIZE; ret *= 2) {
+    if ((enbw[win] * fq_s) / ret <= res * TOLERANCE) return ret;
+  }
+
+  return 0;
+}
+
+static int
+add_fft_entries(plan_t* plan, render_param_t* prm, wavmap_t* wav)
+{
+  int ret;
+  render_param_t tmp;
+  size_t i;
+
+  ret = 0;
+  tmp = *prm;
+
+  tmp.analyzer = RENDER_ANALYZER_FFT;
+
+  if (prm->analyzer == RENDER_ANALYZER_WAVELET) {
+    // カラム数が変わらない場合のみ (FFTのunit_timeはセンチ秒単位)
+    tmp.unit_time = prm->unit_time / 10;
+
+    if (prm->unit_time % 10 != 0 ||
+        render_unit_size(&tmp, wav) != render_unit_size(prm, wav)) {
+      return 0;
+    }
+  }
+
+  for (i = 0; i < N(fft_windows); i++) {
+    tmp.window   = fft_windows[i];
+    tmp.fft_size = fft_size_for(plan->ent[0].resolution,
+                                wav->sample_rate, tmp.window);
+    if (tmp.fft_size == 0) continue;
+
+    ret = add_entry(plan, &tmp, wav);
+    if (ret) break;
+  }
+
+  return ret;
+}
+
+static int
+add_wavelet_entries(plan_t* plan, render_param_t* prm, wavmap_t* wav)
+{
+  int ret;
+  render_param_t tmp;
+  double th;
+  size_t i;
+
+  ret = 0;
+  tmp = *prm;
+
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    /*
+     * 同じ分解能になるσのWavelet (ウェーブレットのunit_timeはミリ秒単位)
+     */
+    tmp.analyzer  = RENDER_ANALYZER_WAVELET;
+    tmp.unit_time = prm->unit_time * 10;
+    tmp.sigma     = prm->fq_l / (2.0 * sqrt(M_PI) * plan->ent[0].resolution);
+    tmp.threshold = 0.0;
+
+    if (render_unit_size(&tmp, wav) != render_unit_size(prm, wav)) return 0;
+
+    ret = add_entry(plan, &tmp, wav);
+
+  } else {
+    /*
+     * ガボール閾値を緩めたもの
+     */
+    th = (prm->threshold > 0)? prm->threshold: 0.0;
+
+    for (i = 0; i < N(thresholds); i++) {
+      if (thresholds[i] <= th) continue;
+
+      tmp.threshold = thresholds[i];
+
+      ret = add_entry(plan, &tmp, wav);
+      if (ret) break;
+    }
+  }
+
+  return ret;
+}
+
+int
+plan_build(render_param_t* prm, wavmap_t* wav, double budget, plan_t* plan)
+{
+  int ret;
+  int i;
+  plan_entry_t* ent;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    /*
+     * argument check
+     */
+    if (prm == NULL || wav == NULL || plan == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (prm->width < 1 || prm->unit_time < 1 ||
+        render_unit_size(prm, wav) == 0) {
+      ret = ERR;
+      break;
+    }
+
+    memset(plan, 0, sizeof(*plan));
+
+    plan->budget = budget;
+    plan->ncpu   = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    plan->chosen = -1;
+
+    if (plan->ncpu < 1) plan->ncpu = 1;
+
+    ret = calibrate_tap(&plan->tap_ns);
+    if (ret) break;
+
+    /*
+     * 候補の列挙と評価 (先頭は指定された構成)
+     */
+    ret = add_entry(plan, prm, wav);
+    if (ret) break;
+
+    plan->ent[0].meets = !0;
+
+    ret = add_wavelet_entries(plan, prm, wav);
+    if (ret) break;
+
+    ret = add_fft_entries(plan, prm, wav);
+    if (ret) break;
+
+    /*
+     * 選択
+     */
+    if (budget <= 0.0 || plan->ent[0].sec <= budget) {
+      plan->chosen = 0;
+      break;
+    }
+
+    for (i = 1; i < plan->nent; i++) {
+      ent = plan->ent + i;
+      if (!ent->meets || ent->sec > budget) continue;
+
+      if (plan->chosen < 0 || ent->sec < plan->ent[plan->chosen].sec) {
+        plan->chosen = i;
+      }
+    }
+  } while (0);
+
+  return ret;
+}
+
+/*
+ * 候補の一覧 (wavfft/wavletの-vの出力と同じ体裁)
+ *   "*"は指定された構成、">"は選んだ構成、"-"は分解能を満たさないもの
+ */
+void
+plan_print(FILE* fp, plan_t* plan)
+{
+  int i;
+  plan_entry_t* ent;
+
+  fprintf(fp, "- PLAN\n");
+  if (plan->budget > 0.0) {
+    fprintf(fp, "    time budget: %.1f s\n", plan->budget);
+  }
+  fprintf(fp, "    wavelet tap: %.2f ns\n", plan->tap_ns);
+  fprintf(fp, "\n");
+
+  fprintf(fp, "       %-36s %12s %10s %12s\n",
+          "candidate", "resolution", "window", "predicted");
+
+  for (i = 0; i < plan->nent; i++) {
+    ent = plan->ent + i;
+
+    fprintf(fp, "    %c%c %-36s %9.2f Hz %8.3f s %10.2f s\n",
+            (i == plan->chosen)? '>': ' ',
+            (i == 0)? '*': (ent->meets)? ' ': '-',
+            ent->mode, ent->resolution, ent->window, ent->sec);
+  }
+
+  fprintf(fp, "\n");
+}
@@ -0,0 +1,51 @@
+﻿/*
+ * Cost model and time budget planner
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __PLAN_H__
+#define __PLAN_H__
+
+#include <stdio.h>
+
+#include "render.h"
+#include "wavmap.h"
+
+#define PLAN_MAX_ENTRIES          16
+
+/*
+ * 候補となる構成と、その処理時間の予測
+ *   resolutionは最低周波数での周波数分解能(窓の等価雑音帯域幅, Hz)、
+ *   windowは同じく最低周波数での窓の長さ(秒)。
+ */
+typedef struct {
+  render_param_t prm;
+  char mode[48];          // as "description of the candidate"
+  double resolution;
+  double window;
+  double col_ns;          // as "predicted time per column and channel"
+  double sec;             // as "predicted transform time of whole input"
+  int meets;              // as "meets the requested resolution"
+} plan_entry_t;
+
+/*
+ * plan_build()の結果
+ *   ent[0]は指定されたパラメータそのもの。budgetに収まる場合はそれを、
+ *   収まらない場合は分解能を満たす候補のうち最も速いものを選ぶ。
+ *   どれも収まらない場合はchosenが-1になる。
+ */
+typedef struct {
+  double budget;          // as "time budget in seconds" (0 for unlimited)
+  double tap_ns;          // as "wavelet: time per window tap"
+  int ncpu;
+
+  int nent;
+  plan_entry_t ent[PLAN_MAX_ENTRIES];
+  int chosen;
+} plan_t;
+
+int plan_build(render_param_t* prm, wavmap_t* wav, double budget, plan_t* plan);
+void plan_print(FILE* fp, plan_t* plan);
+
+#endif /* !defined(__PLAN_H__) */
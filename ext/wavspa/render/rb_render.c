@@ -0,0 +1,794 @@
+﻿/*
+ * Native rendering pipeline interface for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "ruby.h"
+#include "ruby/thread.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "render.h"
+#include "plan.h"
+#include "rb_wavmap.h"
+#include "fft.h"
+#include "spc.h"
+#include "fbdraw.h"
+
+#define N(x)                        (sizeof((x))/sizeof(*(x)))
+#define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
+#define ARGUMENT_ERROR(...)         rb_raise(rb_eArgError, __VA_ARGS__)
+#define EQ_STR(val,str)             (rb_to_id(val) == rb_intern(str))
+
+static const char* opts_keys[] = {
+  "analyzer",             // {Symbol} :FFT or :WAVELET
+  "transform_mode",       // {Symbol}
+  "unit_time",            // {Integer}
+  "fft_size",             // {Integer}
+  "window_function",      // {Symbol|String}
+  "sigma",                // {Float}
+  "threshold",            // {Float}
+  "output_width",         // {Integer}
+  "range",                // {Array} [lo, hi]
+  "scale_mode",           // {Symbol}
+  "ceil",                 // {Float}
+  "floor",                // {Float}
+  "luminance",            // {Float}
+  "col_step",             // {Integer}
+  "colormap",             // {Symbol}
+  "basis_freq",           // {Float}
+  "grid_step",            // {Float}
+  "draw_freq_line",       // {Boolean}
+  "draw_time_line",       // {Boolean}
+  "fb_mmap",              // {Boolean|String}
+  "cache_file",           // {String}
+  "cache_type",           // {Symbol}
+  "channels",             // {nil|:ALL|:MIX|Array}
+  "separate_channels",    // {Boolean}
+  "png_threads",          // {Integer}
+  "png_level",            // {Integer}
+  "profile",              // {Boolean}
+  "max_memory",           // {Integer} as "bytes" (nil or 0 for unlimited)
+};
+
+static ID opts_ids[N(opts_keys)];
+
+static const char* window_names[] = {
+  "RECTANGULAR",          // FFT_WINDOW_RECTANGULAR
+  "HAMMING",              // FFT_WINDOW_HAMMING
+  "HANN",                 // FFT_WINDOW_HANN
+  "BLACKMAN",             // FFT_WINDOW_BLACKMAN
+  "BLACKMAN_NUTTALL",     // FFT_WINDOW_BLACKMAN_NUTTALL
+  "FLAT_TOP",             // FFT_WINDOW_FLAT_TOP
+};
+
+static int
+parse_window(VALUE val)
+{
+  int ret;
+
+  if (EQ_STR(val, "RECTANGULAR")) {
+    ret = FFT_WINDOW_RECTANGULAR;
+
+  } else if (EQ_STR(val, "HAMMING")) {
+    ret = FFT_WINDOW_HAMMING;
+
+  } else if (EQ_STR(val, "HANN")) {
+    ret = FFT_WINDOW_HANN;
+
+  } else if (EQ_STR(val, "BLACKMAN")) {
+    ret = FFT_WINDOW_BLACKMAN;
+
+  } else if (EQ_STR(val, "BLACKMAN_NUTTALL")) {
+    ret = FFT_WINDOW_BLACKMAN_NUTTALL;
+
+  } else if (EQ_STR(val, "FLAT_TOP")) {
+    ret = FFT_WINDOW_FLAT_TOP;
+
+  } else {
+    ARGUMENT_ERROR("unknown window function");
+  }
+
+  return ret;
+}
+
+static int
+parse_colormap(VALUE val)
+{
+  int ret;
+
+  if (EQ_STR(val, "GREEN")) {
+    ret = CMAP_GREEN;
+
+  } else if (EQ_STR(val, "GRAYSCALE") || EQ_STR(val, "GRAY")) {
+    ret = CMAP_GRAYSCALE;
+
+  } else if (EQ_STR(val, "VIRIDIS")) {
+    ret = CMAP_VIRIDIS;
+
+  } else if (EQ_STR(val, "MAGMA")) {
+    ret = CMAP_MAGMA;
+
+  } else {
+    ARGUMENT_ERROR("unknown colormap");
+  }
+
+  return ret;
+}
+
+static void
+parse_channels(render_param_t* prm, VALUE val, wavmap_t* wav)
+{
+  int i;
+  int ch;
+
+  if (val == Qnil || (SYMBOL_P(val) && EQ_STR(val, "ALL"))) {
+    if (wav->channel_num > RENDER_MAX_CHANNELS) {
+      ARGUMENT_ERROR("too many channels");
+    }
+
+    prm->nch = 0;
+
+  } else if (SYMBOL_P(val) && EQ_STR(val, "MIX")) {
+    prm->nch   = 1;
+    prm->ch[0] = WAVMAP_DOWNMIX;
+
+  } else {
+    Check_Type(val, T_ARRAY);
+
+    if (RARRAY_LEN(val) < 1 || RARRAY_LEN(val) > RENDER_MAX_CHANNELS) {
+      ARGUMENT_ERROR("invalid channel list");
+    }
+
+    for (i = 0; i < RARRAY_LEN(val); i++) {
+      ch = NUM2INT(RARRAY_AREF(val, i));
+      if (ch < 0 || ch >= wav->channel_num) {
+        ARGUMENT_ERROR("channel %d is not exist.", ch);
+      }
+
+      prm->ch[i] = ch;
+    }
+
+    prm->nch = i;
+  }
+}
+
+/*
+ * wavfft/wavletのパラメータハッシュをrender_param_tに展開する
+ *   (省略時の値はCLIと同じ)
+ *
+ * パス文字列はGVL解放中に書き換えられないよう凍結した複製を参照する。
+ * 複製はholdに格納するので、呼び出し元で保持しておくこと。
+ * :profileが真の場合はprofに計測結果を格納させる。
+ */
+static void
+parse_params(render_param_t* prm,
+             VALUE params, wavmap_t* wav, VALUE* hold, render_profile_t* prof)
+{
+  VALUE opts[N(opts_ids)];
+  int log;
+
+  memset(prm, 0, sizeof(*prm));
+
+  prm->analyzer    = 0;
+  prm->mode        = RENDER_MODE_POWER;
+  prm->scale       = RENDER_LOGSCALE_MODE;
+  prm->window      = -1;
+  prm->ceil        = -10.0;
+  prm->floor       = -90.0;
+  prm->lumi        = 3.5;
+  prm->step        = 1;
+  prm->cmap        = CMAP_GREEN;
+  prm->basis       = 440.0;
+  prm->grid        = 0.0;
+  prm->freq_line   = !0;
+  prm->time_line   = !0;
+  prm->cache_type  = SPC_TYPE_FLOAT32;
+  prm->png_threads = 0;
+  prm->png_level   = 6;
+
+  /*
+   * rb_get_kwargs()は取り出したキーをハッシュから削除するので
+   * 呼び出し元のハッシュ(プリセットの表など)は複製してから渡す
+   */
+  Check_Type(params, T_HASH);
+  rb_get_kwargs(rb_hash_dup(params), opts_ids, 0, N(opts_ids), opts);
+
+  // :analyzer
+  if (opts[0] != Qundef) {
+    if (EQ_STR(opts[0], "FFT")) {
+      prm->analyzer = RENDER_ANALYZER_FFT;
+
+    } else if (EQ_STR(opts[0], "WAVELET")) {
+      prm->analyzer = RENDER_ANALYZER_WAVELET;
+
+    } else {
+      ARGUMENT_ERROR("unknown analyzer");
+    }
+
+  } else if (opts[3] != Qundef) {
+    prm->analyzer = RENDER_ANALYZER_FFT;
+
+  } else if (opts[5] != Qundef) {
+    prm->analyzer = RENDER_ANALYZER_WAVELET;
+
+  } else {
+    ARGUMENT_ERROR("analyzer is not specified");
+  }
+
+  // :transform_mode
+  if (opts[1] != Qundef) {
+    if (EQ_STR(opts[1], "POWER")) {
+      prm->mode = RENDER_MODE_POWER;
+
+    } else if (EQ_STR(opts[1], "AMPLITUDE")) {
+      prm->mode = RENDER_MODE_AMPLITUDE;
+
+    } else {
+      ARGUMENT_ERROR("unknown transform mode");
+    }
+  }
+
+  // :unit_time
+  if (opts[2] == Qundef) ARGUMENT_ERROR("unit_time is not specified");
+  prm->unit_time = NUM2INT(opts[2]);
+  if (prm->unit_time < 1) ARGUMENT_ERROR("invalid unit time");
+
+  // :fft_size
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    if (opts[3] == Qundef) ARGUMENT_ERROR("fft_size is not specified");
+    prm->fft_size = NUM2INT(opts[3]);
+  }
+
+  // :window_function
+  if (opts[4] != Qundef && opts[4] != Qnil) prm->window = parse_window(opts[4]);
+
+  // :sigma
+  if (opts[5] != Qundef && opts[5] != Qnil) prm->sigma = NUM2DBL(opts[5]);
+
+  // :threshold
+  if (opts[6] != Qundef && opts[6] != Qnil) prm->threshold = NUM2DBL(opts[6]);
+
+  // :output_width
+  if (opts[7] == Qundef) ARGUMENT_ERROR("output_width is not specified");
+  prm->width = NUM2INT(opts[7]);
+  if (prm->width < 1) ARGUMENT_ERROR("invalid output width");
+
+  // :range
+  if (opts[8] == Qundef) ARGUMENT_ERROR("range is not specified");
+  Check_Type(opts[8], T_ARRAY);
+  if (RARRAY_LEN(opts[8]) != 2) {
+    ARGUMENT_ERROR("range shall be 2 entries contain.");
+  }
+
+  prm->fq_l = NUM2DBL(RARRAY_AREF(opts[8], 0));
+  prm->fq_h = NUM2DBL(RARRAY_AREF(opts[8], 1));
+  if (prm->fq_l <= 0.0 || prm->fq_h <= prm->fq_l) {
+    ARGUMENT_ERROR("invalid frequency range");
+  }
+
+  // :scale_mode
+  if (opts[9] != Qundef) {
+    if (EQ_STR(opts[9], "LOGSCALE") || EQ_STR(opts[9], "LOG")) {
+      prm->scale = RENDER_LOGSCALE_MODE;
+
+    } else if (EQ_STR(opts[9], "LINEARSCALE") || EQ_STR(opts[9], "LINEAR")) {
+      prm->scale = RENDER_LINEARSCALE_MODE;
+
+    } else {
+      ARGUMENT_ERROR("unknown scale mode");
+    }
+  }
+
+  log = (prm->scale == RENDER_LOGSCALE_MODE);
+
+  // :ceil
+  if (opts[10] != Qundef && opts[10] != Qnil) prm->ceil = NUM2DBL(opts[10]);
+
+  // :floor
+  if (opts[11] != Qundef && opts[11] != Qnil) prm->floor = NUM2DBL(opts[11]);
+
+  // :luminance
+  if (opts[12] != Qundef && opts[12] != Qnil) prm->lumi = NUM2DBL(opts[12]);
+
+  // :col_step
+  if (opts[13] != Qundef && opts[13] != Qnil) {
+    prm->step = NUM2INT(opts[13]);
+    if (prm->step < 1) ARGUMENT_ERROR("invalid column step");
+  }
+
+  // :colormap
+  if (opts[14] != Qundef && opts[14] != Qnil) {
+    prm->cmap = parse_colormap(opts[14]);
+  }
+
+  // :basis_freq
+  if (opts[15] != Qundef && opts[15] != Qnil) prm->basis = NUM2DBL(opts[15]);
+
+  // :grid_step
+  if (opts[16] != Qundef && opts[16] != Qnil) {
+    prm->grid = NUM2DBL(opts[16]);
+  } else {
+    prm->grid = (log)? 2.0: 2000.0;
+  }
+
+  if ((log && (prm->basis <= 1.0 || prm->grid <= 1.0)) ||
+      (!log && (prm->basis <= 0.0 || prm->grid <= 0.0))) {
+    ARGUMENT_ERROR("illeagal frequency grid.");
+  }
+
+  // :draw_freq_line
+  if (opts[17] != Qundef) prm->freq_line = RTEST(opts[17]);
+
+  // :draw_time_line
+  if (opts[18] != Qundef) prm->time_line = RTEST(opts[18]);
+
+  // :fb_mmap
+  if (opts[19] != Qundef && RTEST(opts[19])) {
+    prm->fb_mmap = !0;
+
+    if (opts[19] != Qtrue) {
+      ExportStringValue(opts[19]);
+      hold[0] = rb_str_new_frozen(opts[19]);
+      prm->fb_mmap_path = StringValueCStr(hold[0]);
+    }
+  }
+
+  // :cache_file
+  if (opts[20] != Qundef && opts[20] != Qnil) {
+    ExportStringValue(opts[20]);
+    hold[1] = rb_str_new_frozen(opts[20]);
+    prm->cache_path = StringValueCStr(hold[1]);
+  }
+
+  // :cache_type
+  if (opts[21] != Qundef && opts[21] != Qnil) {
+    if (EQ_STR(opts[21], "FLOAT32")) {
+      prm->cache_type = SPC_TYPE_FLOAT32;
+
+    } else if (EQ_STR(opts[21], "FLOAT16")) {
+      prm->cache_type = SPC_TYPE_FLOAT16;
+
+    } else {
+      ARGUMENT_ERROR("unsupported cache type");
+    }
+  }
+
+  // :channels
+  parse_channels(prm, (opts[22] != Qundef)? opts[22]: Qnil, wav);
+
+  // :separate_channels
+  if (opts[23] != Qundef) prm->separate = RTEST(opts[23]);
+
+  // :png_threads
+  if (opts[24] != Qundef && opts[24] != Qnil) {
+    prm->png_threads = NUM2INT(opts[24]);
+  }
+
+  // :png_level
+  if (opts[25] != Qundef && opts[25] != Qnil) {
+    prm->png_level = NUM2INT(opts[25]);
+  }
+
+  // :profile
+  if (opts[26] != Qundef && RTEST(opts[26])) prm->profile = prof;
+
+  // :max_memory
+  if (opts[27] != Qundef && opts[27] != Qnil) {
+    if (NUM2LL(opts[27]) < 0) ARGUMENT_ERROR("invalid memory budget");
+    prm->max_memory = NUM2SIZET(opts[27]);
+  }
+}
+
+/*
+ * Cの表示関数の出力を文字列で受け取る
+ *   (CLIの-vや--profileの表示はlibwavspaのwavspaと同じ関数で作る)
+ */
+static FILE*
+report_open(char** buf, size_t* len)
+{
+  FILE* ret;
+
+  *buf = NULL;
+  *len = 0;
+
+  ret = open_memstream(buf, len);
+  if (ret == NULL) rb_sys_fail("open_memstream()");
+
+  return ret;
+}
+
+static VALUE
+report_close(FILE* fp, char** buf, size_t* len)
+{
+  VALUE ret;
+
+  fclose(fp);
+
+  ret = rb_str_new(*buf, *len);
+  free(*buf);
+
+  return ret;
+}
+
+static VALUE
+profile_hash(render_profile_t* prof)
+{
+  VALUE ret;
+  VALUE stages;
+  VALUE stg;
+  FILE* fp;
+  char* buf;
+  size_t len;
+  int i;
+
+  stages = rb_hash_new();
+
+  for (i = 0; i < RENDER_STAGE_NUM; i++) {
+    stg = rb_hash_new();
+    rb_hash_aset(stg, ID2SYM(rb_intern("sec")),
+                 DBL2NUM(prof->stage[i].ns / 1e9));
+    rb_hash_aset(stg, ID2SYM(rb_intern("calls")),
+                 ULL2NUM(prof->stage[i].count));
+    rb_hash_aset(stg, ID2SYM(rb_intern("bytes")),
+                 ULL2NUM(prof->stage[i].bytes));
+
+    rb_hash_aset(stages, ID2SYM(rb_intern(render_stage_name(i))), stg);
+  }
+
+  ret = rb_hash_new();
+  rb_hash_aset(ret, ID2SYM(rb_intern("wall_sec")), DBL2NUM(prof->wall_ns / 1e9));
+  rb_hash_aset(ret, ID2SYM(rb_intern("cpu_sec")), DBL2NUM(prof->cpu_ns / 1e9));
+  rb_hash_aset(ret, ID2SYM(rb_intern("samples")), ULL2NUM(prof->samples));
+  rb_hash_aset(ret, ID2SYM(rb_intern("columns")), ULL2NUM(prof->columns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("input_bytes")), ULL2NUM(prof->in_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("output_bytes")),
+               ULL2NUM(prof->out_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("peak_rss_kib")), LONG2NUM(prof->peak_rss));
+  rb_hash_aset(ret, ID2SYM(rb_intern("stages")), stages);
+
+  fp = report_open(&buf, &len);
+  render_profile_print(fp, prof);
+  rb_hash_aset(ret, ID2SYM(rb_intern("report")), report_close(fp, &buf, &len));
+
+  fp = report_open(&buf, &len);
+  render_profile_print_json(fp, prof);
+  rb_hash_aset(ret, ID2SYM(rb_intern("json")), report_close(fp, &buf, &len));
+
+  return ret;
+}
+
+static VALUE
+estimate_hash(render_estimate_t* est)
+{
+  VALUE ret;
+
+  ret = rb_hash_new();
+  rb_hash_aset(ret, ID2SYM(rb_intern("samples")), SIZET2NUM(est->samples));
+  rb_hash_aset(ret, ID2SYM(rb_intern("analyzer")), SIZET2NUM(est->analyzer));
+  rb_hash_aset(ret, ID2SYM(rb_intern("cache")), SIZET2NUM(est->cache));
+  rb_hash_aset(ret, ID2SYM(rb_intern("pixels")), SIZET2NUM(est->canvas));
+  rb_hash_aset(ret, ID2SYM(rb_intern("png")), SIZET2NUM(est->png));
+  rb_hash_aset(ret, ID2SYM(rb_intern("input")), SIZET2NUM(est->input));
+  rb_hash_aset(ret, ID2SYM(rb_intern("total")), SIZET2NUM(est->total));
+  rb_hash_aset(ret, ID2SYM(rb_intern("fb_mmap")), (est->fb_mmap)? Qtrue: Qfalse);
+  rb_hash_aset(ret, ID2SYM(rb_intern("chunk")),
+               (est->chunk > 0)? SIZET2NUM(est->chunk): Qnil);
+  rb_hash_aset(ret, ID2SYM(rb_intern("png_threads")),
+               INT2FIX(est->png_threads));
+
+  return ret;
+}
+
+static VALUE
+open_input(VALUE input)
+{
+  VALUE ret;
+
+  if (RB_TYPE_P(input, T_STRING)) {
+    rb_require("wavspa/wavmap");
+    ret = rb_class_new_instance(1, &input,
+                      rb_path2class("WavSpectrumAnalyzer::WavMap"));
+  } else {
+    ret = input;
+  }
+
+  return ret;
+}
+
+/*
+ * メモリ使用量の見積もり
+ *   予算(:max_memory)に収まる構成を探し、その構成と見積もりをHashで返す。
+ *   収まらない場合も例外とはせず、:fitを偽として返す。
+ */
+static VALUE
+rb_estimate(VALUE self, VALUE input, VALUE params)
+{
+  VALUE ret;
+  VALUE wav_obj;
+  VALUE hold[2];
+  wavmap_t* wav;
+  render_param_t prm;
+  render_estimate_t est;
+  int err;
+  FILE* fp;
+  char* buf;
+  size_t len;
+
+  wav_obj = open_input(input);
+  wav     = wavmap_get_struct(wav_obj);
+  hold[0] = Qnil;
+  hold[1] = Qnil;
+
+  parse_params(&prm, params, wav, hold, NULL);
+
+  err = render_estimate(&prm, wav, &est);
+
+  RB_GC_GUARD(hold[0]);
+  RB_GC_GUARD(hold[1]);
+
+  if (input != wav_obj) {
+    rb_funcall(wav_obj, rb_intern("close"), 0);
+  }
+
+  if (err && err != RENDER_OVER_BUDGET) {
+    RUNTIME_ERROR("render_estimate() failed. [err = %d]\n", err);
+  }
+
+  ret = estimate_hash(&est);
+  rb_hash_aset(ret, ID2SYM(rb_intern("budget")),
+               (prm.max_memory > 0)? SIZET2NUM(prm.max_memory): Qnil);
+  rb_hash_aset(ret, ID2SYM(rb_intern("fit")), (err)? Qfalse: Qtrue);
+
+  fp = report_open(&buf, &len);
+  render_estimate_print(fp, &prm, &est);
+  rb_hash_aset(ret, ID2SYM(rb_intern("report")), report_close(fp, &buf, &len));
+
+  return ret;
+}
+
+/*
+ * 候補の構成のうち、パラメータハッシュにマージすれば切り替えられる項目
+ * と予測値
+ */
+static VALUE
+plan_entry_hash(plan_entry_t* ent)
+{
+  VALUE ret;
+  render_param_t* prm;
+
+  ret = rb_hash_new();
+  prm = &ent->prm;
+
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    rb_hash_aset(ret, ID2SYM(rb_intern("analyzer")), ID2SYM(rb_intern("FFT")));
+    rb_hash_aset(ret, ID2SYM(rb_intern("fft_size")), INT2FIX(prm->fft_size));
+    if (prm->window >= 0) {
+      rb_hash_aset(ret, ID2SYM(rb_intern("window_function")),
+                   ID2SYM(rb_intern(window_names[prm->window])));
+    }
+
+  } else {
+    rb_hash_aset(ret, ID2SYM(rb_intern("analyzer")),
+                 ID2SYM(rb_intern("WAVELET")));
+    if (prm->sigma > 0) {
+      rb_hash_aset(ret, ID2SYM(rb_intern("sigma")), DBL2NUM(prm->sigma));
+    }
+    if (prm->threshold > 0) {
+      rb_hash_aset(ret, ID2SYM(rb_intern("threshold")),
+                   DBL2NUM(prm->threshold));
+    }
+  }
+
+  rb_hash_aset(ret, ID2SYM(rb_intern("unit_time")), INT2FIX(prm->unit_time));
+  rb_hash_aset(ret, ID2SYM(rb_intern("mode")), rb_str_new_cstr(ent->mode));
+  rb_hash_aset(ret, ID2SYM(rb_intern("resolution")),
+               DBL2NUM(ent->resolution));
+  rb_hash_aset(ret, ID2SYM(rb_intern("window_sec")), DBL2NUM(ent->window));
+  rb_hash_aset(ret, ID2SYM(rb_intern("predicted_sec")), DBL2NUM(ent->sec));
+  rb_hash_aset(ret, ID2SYM(rb_intern("meets")), (ent->meets)? Qtrue: Qfalse);
+
+  return ret;
+}
+
+/*
+ * 処理時間の予測と、予算(秒, nilは無制限)に収まる構成の選択
+ *   候補の先頭は指定された構成。:chosenは選んだ候補の添字で、収まる
+ *   ものが無い場合はnil。
+ */
+static VALUE
+rb_plan(VALUE self, VALUE input, VALUE params, VALUE budget)
+{
+  VALUE ret;
+  VALUE wav_obj;
+  VALUE hold[2];
+  VALUE ents;
+  wavmap_t* wav;
+  render_param_t prm;
+  plan_t plan;
+  int err;
+  int i;
+  FILE* fp;
+  char* buf;
+  size_t len;
+
+  wav_obj = open_input(input);
+  wav     = wavmap_get_struct(wav_obj);
+  hold[0] = Qnil;
+  hold[1] = Qnil;
+
+  parse_params(&prm, params, wav, hold, NULL);
+
+  err = plan_build(&prm, wav, (budget != Qnil)? NUM2DBL(budget): 0.0, &plan);
+
+  RB_GC_GUARD(hold[0]);
+  RB_GC_GUARD(hold[1]);
+
+  if (input != wav_obj) {
+    rb_funcall(wav_obj, rb_intern("close"), 0);
+  }
+
+  if (err) RUNTIME_ERROR("plan_build() failed. [err = %d]\n", err);
+
+  ents = rb_ary_new_capa(plan.nent);
+  for (i = 0; i < plan.nent; i++) {
+    rb_ary_push(ents, plan_entry_hash(plan.ent + i));
+  }
+
+  ret = rb_hash_new();
+  rb_hash_aset(ret, ID2SYM(rb_intern("tap_ns")), DBL2NUM(plan.tap_ns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("candidates")), ents);
+  rb_hash_aset(ret, ID2SYM(rb_intern("chosen")),
+               (plan.chosen >= 0)? INT2FIX(plan.chosen): Qnil);
+
+  fp = report_open(&buf, &len);
+  plan_print(fp, &plan);
+  rb_hash_aset(ret, ID2SYM(rb_intern("report")), report_close(fp, &buf, &len));
+
+  return ret;
+}
+
+typedef struct {
+  render_param_t* prm;
+  wavmap_t* wav;
+  char* output;
+  render_result_t* res;
+  int err;
+} render_arg_t;
+
+static void*
+_render(void* data)
+{
+  render_arg_t* arg;
+
+  arg = (render_arg_t*)data;
+
+  arg->err = render_run(arg->prm, arg->wav, arg->output, arg->res);
+
+  return NULL;
+}
+
+/*
+ * 割り込み(Ctrl-CやThread#kill)を受けたらカラム単位で処理を打ち切る
+ */
+static void
+_render_ubf(void* data)
+{
+  *(volatile int*)data = !0;
+}
+
+static VALUE
+rb_render(VALUE self, VALUE input, VALUE output, VALUE params)
+{
+  VALUE ret;
+  VALUE wav_obj;
+  VALUE outs;
+  VALUE hold[2];
+  wavmap_t* wav;
+  render_param_t prm;
+  render_result_t res;
+  render_profile_t prof;
+  render_arg_t arg;
+  volatile int cancel;
+  int i;
+
+  /*
+   * check argument
+   *   (入力はWAVファイルのパス、またはオープン済みのWavMap。パスの場合も
+   *    WavMapとして開くので、例外で抜けた場合の後始末はGCに任せられる)
+   */
+  ExportStringValue(output);
+  output = rb_str_new_frozen(output);
+
+  wav_obj = open_input(input);
+  wav     = wavmap_get_struct(wav_obj);
+  hold[0] = Qnil;
+  hold[1] = Qnil;
+
+  parse_params(&prm, params, wav, hold, &prof);
+
+  /*
+   * call pipeline
+   */
+  cancel     = 0;
+  prm.cancel = &cancel;
+
+  arg.prm    = &prm;
+  arg.wav    = wav;
+  arg.output = StringValueCStr(output);
+  arg.res    = &res;
+
+  wavmap_hold(wav_obj);
+  rb_thread_call_without_gvl(_render, &arg, _render_ubf, (void*)&cancel);
+  wavmap_unhold(wav_obj);
+
+  RB_GC_GUARD(output);
+  RB_GC_GUARD(hold[0]);
+  RB_GC_GUARD(hold[1]);
+
+  if (input != wav_obj) {
+    rb_funcall(wav_obj, rb_intern("close"), 0);
+  }
+
+  if (arg.err == RENDER_CANCELED) {
+    /*
+     * 保留中の割り込みを処理する (通常はここで例外となる)
+     */
+    rb_thread_check_ints();
+    RUNTIME_ERROR("render canceled");
+  }
+
+  if (arg.err == RENDER_OVER_BUDGET) {
+    RUNTIME_ERROR("estimated memory usage exceeds max_memory");
+  }
+
+  if (arg.err) {
+    RUNTIME_ERROR("render_run() failed. [err = %d]\n", arg.err);
+  }
+
+  /*
+   * create return parameter
+   */
+  outs = rb_ary_new_capa(res.nout);
+  for (i = 0; i < res.nout; i++) {
+    rb_ary_push(outs, rb_str_new_cstr(res.out[i]));
+  }
+
+  render_result_free(&res);
+
+  ret = rb_hash_new();
+  rb_hash_aset(ret, ID2SYM(rb_intern("columns")), SIZET2NUM(res.columns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("width")), INT2FIX(res.width));
+  rb_hash_aset(ret, ID2SYM(rb_intern("height")), INT2FIX(res.height));
+  rb_hash_aset(ret, ID2SYM(rb_intern("outputs")), outs);
+  rb_hash_aset(ret, ID2SYM(rb_intern("memory")), estimate_hash(&res.memory));
+
+  if (prm.profile != NULL) {
+    rb_hash_aset(ret, ID2SYM(rb_intern("profile")), profile_hash(&prof));
+  }
+
+  return ret;
+}
+
+void
+Init_render(void)
+{
+  VALUE wavspa_module;
+  int i;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
+  wavspa_module = rb_define_module("WavSpectrumAnalyzer");
+
+  rb_define_module_function(wavspa_module, "render", rb_render, 3);
+  rb_define_module_function(wavspa_module, "estimate", rb_estimate, 2);
+  rb_define_module_function(wavspa_module, "plan", rb_plan, 3);
+
+  for (i = 0; i < (int)N(opts_keys); i++) {
+    opts_ids[i] = rb_intern_const(opts_keys[i]);
+  }
+}
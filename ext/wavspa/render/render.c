@@ -0,0 +1,1430 @@
+﻿/*
+ * Native rendering pipeline
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "render.h"
+#include "fft.h"
+#include "walet.h"
+#include "spc.h"
+#include "fbdraw.h"
+#include "pngenc.h"
+#include "trace.h"
+#include "clock.h"
+
+#define ALLOC(t)                ((t*)malloc(sizeof(t)))
+#define NALLOC(t,n)             ((t*)malloc(sizeof(t) * (n)))
+#define MAX(m,n)                (((m) > (n))? (m): (n))
+#define MIN(m,n)                (((m) < (n))? (m): (n))
+
+#define ERR                     __LINE__
+
+#define MARGIN_X                50
+#define MARGIN_Y                30
+
+#define PAGE_STEP               4096
+
+/*
+ * rb_fb.cのフレームバッファからRubyへの依存を除いたもの
+ */
+typedef struct {
+  int width;          // as "number of columns"
+  int height;         // as "height of one band"
+  int bands;
+  int step;
+  int margin_x;
+  int margin_y;
+
+  int stride;
+  size_t size;
+
+  uint8_t* qbuf;      // as "quantized column" (per band)
+  uint8_t* pix;
+  void* map;
+} canvas_t;
+
+/*
+ * プロファイル/トレース用の区間計測 (enableが偽の時は何もしない)
+ */
+typedef struct {
+  int enable;
+  uint64_t lap;
+  int64_t col;        // as "current column" (-1 for none)
+  render_stage_t stage[RENDER_STAGE_NUM];
+} stopwatch_t;
+
+typedef struct {
+  render_param_t* prm;
+  wavmap_t* wav;
+  int ch;
+
+  canvas_t* cv;
+  int band;
+  const uint8_t* lut;
+  double scale;
+  double bias;
+
+  spc_writer_t* cache;
+  size_t usize;       // as "input samples per column"
+  size_t nblk;        // as "number of columns"
+  size_t chunk;       // as "columns per wavelet import" (0 for whole input)
+
+  stopwatch_t sw;
+
+  pthread_t thread;
+  int err;
+} job_t;
+
+static const char* stage_names[] = {
+  "setup",                // RENDER_STAGE_SETUP
+  "read",                 // RENDER_STAGE_READ
+  "import",               // RENDER_STAGE_IMPORT
+  "transform",            // RENDER_STAGE_TRANSFORM
+  "reduce",               // RENDER_STAGE_REDUCE
+  "cache",                // RENDER_STAGE_CACHE
+  "draw",                 // RENDER_STAGE_DRAW
+  "png",                  // RENDER_STAGE_PNG
+};
+
+static void
+sw_start(stopwatch_t* sw)
+{
+  if (sw->enable) sw->lap = clock_ns(CLOCK_MONOTONIC);
+}
+
+/*
+ * 前回の計測点からの経過時間をstageに加算し、計測点を現在時刻に進める
+ * (トレースが有効ならその区間をイベントとしても記録する)
+ */
+static void
+sw_lap(stopwatch_t* sw, int stage, size_t bytes)
+{
+  uint64_t now;
+
+  if (sw->enable) {
+    now = clock_ns(CLOCK_MONOTONIC);
+
+    sw->stage[stage].ns    += now - sw->lap;
+    sw->stage[stage].count += 1;
+    sw->stage[stage].bytes += bytes;
+
+    TRACE_COMPLETE(stage_names[stage], "stage", sw->lap, now,
+                   (sw->col >= 0)? "col": NULL, sw->col);
+
+    sw->lap = now;
+  }
+}
+
+/*
+ * WAVデータはmmapなので、計測時は変換より先にページインさせて
+ * 読み込みの時間を分けて取る
+ */
+static void
+touch_pages(const uint8_t* p, size_t n)
+{
+  volatile uint8_t sink;
+  size_t i;
+
+  for (i = 0; i < n; i += PAGE_STEP) sink = p[i];
+  if (n > 0) sink = p[n - 1];
+
+  (void)sink;
+}
+
+/*
+ * "foo.png" -> "foo-ch0.png" (ダウンミックスは "foo-chmix.png")
+ */
+static char*
+channel_path(char* path, int ch)
+{
+  char* ret;
+  char* base;
+  char* ext;
+  char tag[16];
+  size_t n;
+
+  base = strrchr(path, '/');
+  base = (base != NULL)? base + 1: path;
+  ext  = strrchr(base, '.');
+  if (ext == NULL || ext == base) ext = path + strlen(path);
+
+  if (ch < 0) {
+    snprintf(tag, sizeof(tag), "-chmix");
+  } else {
+    snprintf(tag, sizeof(tag), "-ch%d", ch);
+  }
+
+  n   = strlen(path) + strlen(tag) + 1;
+  ret = NALLOC(char, n);
+
+  if (ret != NULL) {
+    snprintf(ret, n, "%.*s%s%s", (int)(ext - path), path, tag, ext);
+  }
+
+  return ret;
+}
+
+static int
+canvas_map(canvas_t* cv, char* path)
+{
+  int ret;
+  int fd;
+  char tmpl[1024];
+  const char* dir;
+  void* map;
+
+  ret = 0;
+
+  do {
+    if (path == NULL) {
+      dir = getenv("TMPDIR");
+      if (dir == NULL) dir = "/tmp";
+
+      snprintf(tmpl, sizeof(tmpl), "%s/wavspa-fb-XXXXXX", dir);
+
+      fd = mkstemp(tmpl);
+      if (fd >= 0) unlink(tmpl);
+
+    } else {
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (fd < 0) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * 疎なファイルのままだとディスクが溢れた時点で描画中にSIGBUSとなる
+     * ので、先に全領域を確保しておく
+     */
+    if (posix_fallocate(fd, 0, cv->size)) {
+      close(fd);
+      ret = ERR;
+      break;
+    }
+
+    map = mmap(NULL, cv->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+      ret = ERR;
+      break;
+    }
+
+    cv->map = map;
+    cv->pix = (uint8_t*)map;
+  } while (0);
+
+  return ret;
+}
+
+/*
+ * 画像の寸法の決定 (render_estimate()からは確保せずに寸法だけを求める)
+ */
+static void
+canvas_layout(canvas_t* cv, render_param_t* prm, size_t cols, int bands)
+{
+  cv->width    = (int)cols;
+  cv->height   = prm->width;
+  cv->bands    = bands;
+  cv->step     = prm->step;
+  cv->margin_x = (prm->freq_line)? MARGIN_X: 0;
+  cv->margin_y = (prm->time_line)? MARGIN_Y: 0;
+
+  cv->stride   = (cv->margin_x + (cv->width * cv->step)) * 3;
+  cv->size     = (size_t)cv->stride *
+                         ((cv->height * cv->bands) + cv->margin_y);
+}
+
+static int
+canvas_init(canvas_t* cv, render_param_t* prm,
+            size_t cols, int bands, int map, char* mmap_path)
+{
+  int ret;
+
+  ret = 0;
+
+  do {
+    if (cols < 1 || cols > INT32_MAX) {
+      ret = ERR;
+      break;
+    }
+
+    canvas_layout(cv, prm, cols, bands);
+
+    cv->qbuf = NALLOC(uint8_t, cv->height * cv->bands);
+    if (cv->qbuf == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (map) {
+      ret = canvas_map(cv, mmap_path);
+
+    } else {
+      cv->pix = (uint8_t*)calloc(cv->size, 1);
+      if (cv->pix == NULL) ret = ERR;
+    }
+  } while (0);
+
+  return ret;
+}
+
+static void
+canvas_release(canvas_t* cv)
+{
+  if (cv->qbuf != NULL) free(cv->qbuf);
+
+  if (cv->map != NULL) {
+    munmap(cv->map, cv->size);
+
+  } else if (cv->pix != NULL) {
+    free(cv->pix);
+  }
+}
+
+static void
+canvas_put_column(canvas_t* cv, const uint8_t* lut, size_t col, int band)
+{
+  uint8_t* qbuf;
+
+  qbuf = cv->qbuf + ((size_t)band * cv->height);
+
+  fbdraw_put_column(cv->pix + ((cv->margin_x + (col * cv->step)) * 3) +
+                              ((size_t)band * cv->height * cv->stride),
+                    cv->stride, cv->height, cv->step, lut, qbuf);
+}
+
+static void
+canvas_put_string(canvas_t* cv, int row, int col,
+                  const char* str, uint8_t r, uint8_t g, uint8_t b)
+{
+  fbdraw_put_string(cv->pix, cv->stride,
+                    cv->width + cv->margin_x,
+                    (cv->height * cv->bands) + cv->margin_y,
+                    row, col, str, strlen(str), r, g, b);
+}
+
+/*
+ * 周波数軸の目盛り (lib/wavspa/common.rbのdraw_freq_lineと同じ位置に引く)
+ */
+static double
+freq_pos(render_param_t* prm, double r)
+{
+  double scale;
+  double base;
+
+  if (prm->scale == RENDER_LOGSCALE_MODE) {
+    base  = log(pow(prm->fq_h / prm->fq_l, 1.0 / prm->width));
+    scale = 1.0 - ((log(r / prm->fq_l) / base) / prm->width);
+
+  } else {
+    scale = 1.0 - ((r - prm->fq_l) / (prm->fq_h - prm->fq_l));
+  }
+
+  return round(scale * prm->width);
+}
+
+static void
+put_hline(canvas_t* cv, int row, double frq)
+{
+  char label[32];
+
+  snprintf(label, sizeof(label), "%dHz", (int)frq);
+
+  fbdraw_hline(cv->pix, cv->stride, cv->margin_x + (cv->width * cv->step), row);
+  canvas_put_string(cv, row - 11, 4, label, 0xff, 0x00, 0x00);
+}
+
+static void
+draw_freq_line(canvas_t* cv, render_param_t* prm)
+{
+  int band;
+  int ofs;
+  int log;
+  double frq;
+  double pos;
+
+  log = (prm->scale == RENDER_LOGSCALE_MODE);
+
+  for (band = 0; band < cv->bands; band++) {
+    ofs = band * prm->width;
+
+    /*
+     * 低周波方向
+     */
+    frq = (log)? (prm->basis / prm->grid): (prm->basis - prm->grid);
+    while (1) {
+      pos = freq_pos(prm, frq);
+      if (!(pos < prm->width)) break;
+
+      if (pos >= 0) put_hline(cv, ofs + (int)pos, frq);
+      frq = (log)? (frq / prm->grid): (frq - prm->grid);
+    }
+
+    /*
+     * 高周波方向
+     */
+    frq = prm->basis;
+    while (1) {
+      pos = freq_pos(prm, frq);
+      if (!(pos > 0)) break;
+
+      if (pos < prm->width) put_hline(cv, ofs + (int)pos, frq);
+      frq = (log)? (frq * prm->grid): (frq + prm->grid);
+    }
+  }
+}
+
+static void
+put_vline(canvas_t* cv, size_t col, int tm)
+{
+  char label[32];
+
+  if (tm < 60) {
+    snprintf(label, sizeof(label), "%d\"", tm);
+  } else {
+    snprintf(label, sizeof(label), "%d'%02d\"", tm / 60, tm % 60);
+  }
+
+  fbdraw_vline(cv->pix, cv->stride,
+               cv->margin_y + (cv->height * cv->bands),
+               cv->margin_x + (col * cv->step));
+
+  canvas_put_string(cv,
+                    (cv->height * cv->bands) + 14,
+                    cv->margin_x + (col * cv->step) + 4,
+                    label, 0x80, 0x80, 0xff);
+}
+
+static void
+draw_time_line(canvas_t* cv, size_t nblk, size_t rate, size_t usize)
+{
+  size_t col;
+  size_t tc;
+  int tm;
+
+  tc = 0;
+  tm = 0;
+
+  put_vline(cv, 0, tm);
+
+  for (col = 0; col < nblk; col++) {
+    tc += usize;
+    if (tc >= rate) {
+      tm += 1;
+      tc %= rate;
+      if (!(tm % 10)) put_vline(cv, col, tm);
+    }
+  }
+}
+
+/*
+ * 解析器の差異を吸収する薄いラッパ
+ */
+typedef struct {
+  fft_t* fft;
+  walet_t* wl;
+
+  size_t base;        // as "first frame of imported samples" (wavelet)
+  size_t end;         // as "end of columns covered by the import" (wavelet)
+} analyzer_t;
+
+/*
+ * 解析器の生成とパラメータの設定 (Waveletのサンプルの取り込みは
+ * analyzer_import()で行う)
+ */
+static int
+analyzer_setup(analyzer_t* an, render_param_t* prm, wavmap_t* wav)
+{
+  int ret;
+
+  ret = 0;
+
+  an->fft  = NULL;
+  an->wl   = NULL;
+  an->base = 0;
+  an->end  = 0;
+
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    do {
+      if (fft_new(wav->fmt, prm->fft_size, &an->fft)) {
+        ret = ERR;
+        break;
+      }
+
+      if (prm->window >= 0 && fft_set_window(an->fft, prm->window)) {
+        ret = ERR;
+        break;
+      }
+
+      if (fft_set_width(an->fft, prm->width)) {
+        ret = ERR;
+        break;
+      }
+
+      if (fft_set_scale_mode(an->fft, (prm->scale == RENDER_LOGSCALE_MODE)?
+                               FFT_LOGSCALE_MODE: FFT_LINEARSCALE_MODE)) {
+        ret = ERR;
+        break;
+      }
+
+      if (fft_set_frequency(an->fft, wav->sample_rate, prm->fq_l, prm->fq_h)) {
+        ret = ERR;
+        break;
+      }
+    } while (0);
+
+  } else {
+    do {
+      if (walet_new(&an->wl)) {
+        ret = ERR;
+        break;
+      }
+
+      if (walet_set_frequency(an->wl, wav->sample_rate)) {
+        ret = ERR;
+        break;
+      }
+
+      if (prm->sigma > 0 && walet_set_sigma(an->wl, prm->sigma)) {
+        ret = ERR;
+        break;
+      }
+
+      if (prm->threshold > 0 &&
+          walet_set_gabor_threshold(an->wl, prm->threshold)) {
+        ret = ERR;
+        break;
+      }
+
+      if (walet_set_range(an->wl, prm->fq_l, prm->fq_h)) {
+        ret = ERR;
+        break;
+      }
+
+      if (walet_set_scale_mode(an->wl,
+                               (prm->scale == RENDER_LOGSCALE_MODE)?
+                               WALET_LOGSCALE_MODE: WALET_LINEARSCALE_MODE)) {
+        ret = ERR;
+        break;
+      }
+
+      if (walet_set_output_width(an->wl, prm->width)) {
+        ret = ERR;
+        break;
+      }
+    } while (0);
+  }
+
+  return ret;
+}
+
+static int
+analyzer_init(analyzer_t* an, job_t* job)
+{
+  int ret;
+
+  ret = analyzer_setup(an, job->prm, job->wav);
+  if (!ret) sw_lap(&job->sw, RENDER_STAGE_SETUP, 0);
+
+  return ret;
+}
+
+/*
+ * colから始まるjob->chunkカラム分のサンプルをWaveletに取り込む
+ *   (chunkが0の場合は入力全体)。各カラムの変換はpos±最大窓幅の範囲を
+ *   参照するので、前後にその幅を重ねて取り込めば、全体を取り込んだ
+ *   場合と同じ結果になる。
+ */
+static int
+analyzer_import(analyzer_t* an, job_t* job, size_t col)
+{
+  int ret;
+  wavmap_t* wav;
+  size_t wmax;
+  size_t head;
+  size_t tail;
+  size_t n;
+
+  ret = 0;
+  wav = job->wav;
+
+  do {
+    if (job->chunk == 0) {
+      head    = 0;
+      tail    = wav->frames;
+      an->end = job->nblk;
+
+    } else {
+      if (walet_get_max_window(an->wl, &wmax)) {
+        ret = ERR;
+        break;
+      }
+
+      an->end = MIN(col + job->chunk, job->nblk);
+
+      head    = col * job->usize;
+      head    = (head > wmax)? head - wmax: 0;
+      tail    = MIN(((an->end - 1) * job->usize) + wmax + 1, wav->frames);
+    }
+
+    n = (tail - head) * wav->block_size;
+
+    if (job->sw.enable) {
+      touch_pages(wav->data + (head * wav->block_size), n);
+      sw_lap(&job->sw, RENDER_STAGE_READ, n);
+    }
+
+    if (walet_put_in_channel(an->wl, wav->fmt,
+                             wav->data + (head * wav->block_size),
+                             tail - head, wav->channel_num, job->ch)) {
+      ret = ERR;
+      break;
+    }
+
+    an->base = head;
+
+    sw_lap(&job->sw, RENDER_STAGE_IMPORT, n);
+  } while (0);
+
+  return ret;
+}
+
+static void
+analyzer_release(analyzer_t* an)
+{
+  if (an->fft != NULL) fft_destroy(an->fft);
+  if (an->wl != NULL) walet_destroy(an->wl);
+}
+
+static int
+analyzer_feed(analyzer_t* an, job_t* job, size_t col)
+{
+  int ret;
+  wavmap_t* wav;
+  uint8_t* src;
+  size_t pos;
+  size_t n;
+
+  wav = job->wav;
+  pos = col * job->usize;
+
+  if (an->fft != NULL) {
+    n   = job->usize;
+    if (n > wav->frames - pos) n = wav->frames - pos;
+    src = wav->data + (pos * wav->block_size);
+
+    if (job->sw.enable) {
+      touch_pages(src, n * wav->block_size);
+      sw_lap(&job->sw, RENDER_STAGE_READ, n * wav->block_size);
+    }
+
+    ret = fft_shift_in_channel(an->fft, src,
+                               (int)n, wav->channel_num, job->ch);
+    sw_lap(&job->sw, RENDER_STAGE_IMPORT, n * wav->block_size);
+
+    if (!ret) ret = fft_transform(an->fft);
+
+  } else {
+    ret = (col < an->end)? 0: analyzer_import(an, job, col);
+    if (!ret) ret = walet_transform(an->wl, pos - an->base);
+  }
+
+  sw_lap(&job->sw, RENDER_STAGE_TRANSFORM, 0);
+
+  return ret;
+}
+
+static int
+analyzer_plot(analyzer_t* an, int mode, uint8_t* dst, double scale, double bias)
+{
+  int ret;
+
+  if (an->fft != NULL) {
+    ret = (mode == RENDER_MODE_POWER)?
+                    fft_plot_power(an->fft, dst, scale, bias):
+                    fft_plot_amplitude(an->fft, dst, scale, bias);
+
+  } else {
+    ret = (mode == RENDER_MODE_POWER)?
+                    walet_plot_power(an->wl, dst, scale, bias):
+                    walet_plot_amplitude(an->wl, dst, scale, bias);
+  }
+
+  return ret;
+}
+
+static int
+analyzer_calc(analyzer_t* an, int mode, double* dst)
+{
+  int ret;
+
+  if (an->fft != NULL) {
+    ret = (mode == RENDER_MODE_POWER)?
+                    fft_calc_power(an->fft, dst):
+                    fft_calc_amplitude(an->fft, dst);
+
+  } else {
+    ret = (mode == RENDER_MODE_POWER)?
+                    walet_calc_power(an->wl, dst):
+                    walet_calc_amplitude(an->wl, dst);
+  }
+
+  return ret;
+}
+
+/*
+ * 1チャネル分の変換と描画 (チャネル毎のスレッドで実行する)
+ */
+static void*
+job_main(void* data)
+{
+  job_t* job;
+  render_param_t* prm;
+  analyzer_t an;
+  uint8_t* qbuf;
+  double* buf;
+  size_t col;
+  size_t csize;
+
+  job = (job_t*)data;
+  prm = job->prm;
+  buf = NULL;
+
+  qbuf  = job->cv->qbuf + ((size_t)job->band * job->cv->height);
+  csize = (size_t)prm->width *
+                  ((prm->cache_type == SPC_TYPE_FLOAT16)? 2: sizeof(float));
+
+  TRACE_BEGIN("channel", "render", "ch", job->ch);
+
+  job->sw.col = -1;
+  sw_start(&job->sw);
+  job->err = analyzer_init(&an, job);
+
+  do {
+    if (job->err) break;
+
+    if (job->cache != NULL) {
+      buf = NALLOC(double, prm->width);
+      if (buf == NULL) {
+        job->err = ERR;
+        break;
+      }
+    }
+
+    for (col = 0; col < job->nblk; col++) {
+      if (prm->cancel != NULL && *prm->cancel) {
+        job->err = RENDER_CANCELED;
+        break;
+      }
+
+      job->sw.col = col;
+
+      job->err = analyzer_feed(&an, job, col);
+      if (job->err) break;
+
+      if (job->cache == NULL) {
+        job->err = analyzer_plot(&an, prm->mode, qbuf, job->scale, job->bias);
+        if (job->err) break;
+
+        sw_lap(&job->sw, RENDER_STAGE_REDUCE, 0);
+
+      } else {
+        job->err = analyzer_calc(&an, prm->mode, buf);
+        if (job->err) break;
+
+        fbdraw_quantize(qbuf, (uint8_t*)buf,
+                        prm->width, job->scale, job->bias);
+        sw_lap(&job->sw, RENDER_STAGE_REDUCE, 0);
+
+        job->err = spc_writer_put(job->cache, buf);
+        if (job->err) break;
+
+        sw_lap(&job->sw, RENDER_STAGE_CACHE, csize);
+      }
+
+      canvas_put_column(job->cv, job->lut, col, job->band);
+      sw_lap(&job->sw, RENDER_STAGE_DRAW,
+             (size_t)job->cv->height * job->cv->step * 3);
+    }
+  } while (0);
+
+  if (buf != NULL) free(buf);
+  analyzer_release(&an);
+
+  TRACE_END();
+
+  return NULL;
+}
+
+/*
+ * 対象チャネルの決定
+ */
+static int
+select_channels(render_param_t* prm, wavmap_t* wav, int* chs, int* nch)
+{
+  int ret;
+  int i;
+
+  ret = 0;
+
+  if (prm->nch == 0) {
+    if (wav->channel_num > RENDER_MAX_CHANNELS) {
+      ret = ERR;
+
+    } else {
+      for (i = 0; i < wav->channel_num; i++) chs[i] = i;
+      *nch = wav->channel_num;
+    }
+
+  } else {
+    for (i = 0; i < prm->nch; i++) {
+      if (prm->ch[i] >= wav->channel_num) ret = ERR;
+      chs[i] = prm->ch[i];
+    }
+
+    *nch = prm->nch;
+  }
+
+  return ret;
+}
+
+/*
+ * 1カラムあたりの入力サンプル数
+ *   (unit_timeの単位は解析器によって異なる: wavfft/wavletと同じ)
+ */
+size_t
+render_unit_size(render_param_t* prm, wavmap_t* wav)
+{
+  size_t ret;
+
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    ret = (size_t)(wav->sample_rate / 100) * prm->unit_time;
+  } else {
+    ret = ((size_t)wav->sample_rate * prm->unit_time) / 1000;
+  }
+
+  return ret;
+}
+
+/*
+ * 画素、解析器の作業領域、PNGエンコーダの作業領域の順に確保されるので、
+ * ピークは画素に解析器とPNGエンコーダの大きい方を加えた値になる
+ */
+static void
+sum_estimate(render_estimate_t* est)
+{
+  size_t work;
+
+  work       = est->samples + est->analyzer + est->cache;
+  est->total = ((est->fb_mmap)? 0: est->canvas) + MAX(work, est->png);
+}
+
+static int
+fit_estimate(render_param_t* prm, render_estimate_t* est)
+{
+  sum_estimate(est);
+
+  return (prm->max_memory == 0 || est->total <= prm->max_memory);
+}
+
+int
+render_estimate(render_param_t* prm, wavmap_t* wav, render_estimate_t* est)
+{
+  int ret;
+  int chs[RENDER_MAX_CHANNELS];
+  int nch;
+  int ncv;
+  size_t usize;
+  size_t nblk;
+  size_t wmax;
+  size_t used;
+  size_t span;
+  size_t chunk;
+  analyzer_t an;
+  fft_stats_t fst;
+  walet_stats_t wst;
+  canvas_t cv;
+
+  /*
+   * initialize
+   */
+  ret  = 0;
+  wmax = 0;
+
+  memset(&an, 0, sizeof(an));
+
+  do {
+    /*
+     * argument check
+     */
+    if (prm == NULL || wav == NULL || est == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (prm->width < 1 || prm->step < 1 || prm->unit_time < 1) {
+      ret = ERR;
+      break;
+    }
+
+    ret = select_channels(prm, wav, chs, &nch);
+    if (ret) break;
+
+    usize = render_unit_size(prm, wav);
+    if (usize == 0) {
+      ret = ERR;
+      break;
+    }
+
+    nblk = wav->frames / usize;
+
+    memset(est, 0, sizeof(*est));
+
+    /*
+     * 解析器 (実際に設定して表の大きさを問い合わせる)
+     */
+    ret = analyzer_setup(&an, prm, wav);
+    if (ret) break;
+
+    if (an.fft != NULL) {
+      fft_get_stats(an.fft, &fst);
+      est->analyzer = (fst.table_bytes + fst.buffer_bytes) * nch;
+
+    } else {
+      walet_get_stats(an.wl, &wst);
+      walet_get_max_window(an.wl, &wmax);
+      est->analyzer = wst.table_bytes * nch;
+      est->samples  = wav->frames * sizeof(double) * nch;
+    }
+
+    // 量子化済みカラム
+    est->analyzer += (size_t)prm->width * nch;
+
+    if (prm->cache_path != NULL) {
+      est->cache = (((size_t)prm->width * (sizeof(double) + sizeof(float))) +
+                    BUFSIZ) * nch;
+    }
+
+    /*
+     * 画素とPNGエンコーダ (チャネル毎に別画像の場合、画素は全チャネル分
+     * を同時に確保し、エンコードは1枚ずつ行う)
+     */
+    ncv = (prm->separate && nch > 1)? nch: 1;
+    canvas_layout(&cv, prm, nblk, (ncv > 1)? 1: nch);
+
+    est->canvas      = cv.size * ncv;
+    est->input       = wav->frames * wav->block_size;
+    est->fb_mmap     = prm->fb_mmap;
+    est->png_threads = prm->png_threads;
+    est->png         = pngenc_estimate(cv.margin_x + (cv.width * cv.step),
+                                       (cv.height * cv.bands) + cv.margin_y,
+                                       est->png_threads);
+
+    if (fit_estimate(prm, est)) break;
+
+    /*
+     * 予算を超える場合は (1) 画素を一時ファイルにマップする
+     */
+    if (!est->fb_mmap) {
+      est->fb_mmap = !0;
+      if (fit_estimate(prm, est)) break;
+    }
+
+    /*
+     * (2) Waveletの入力をカラム単位に分割して取り込む
+     *     (1回の取り込みはchunkカラム分と前後の最大窓幅)
+     */
+    used = est->analyzer + est->cache;
+
+    if (an.wl != NULL && prm->max_memory > used) {
+      span = (prm->max_memory - used) / (sizeof(double) * nch);
+
+      if (span > (wmax * 2) + 1) {
+        chunk = ((span - (wmax * 2) - 1) / usize) + 1;
+
+        if (chunk < nblk) {
+          est->chunk   = chunk;
+          est->samples = MIN(((chunk - 1) * usize) + (wmax * 2) + 1,
+                             wav->frames) * sizeof(double) * nch;
+        }
+      }
+
+      if (fit_estimate(prm, est)) break;
+    }
+
+    /*
+     * (3) PNGエンコードを1スレッドで行う (同時に保持するバンドが1つになる)
+     */
+    if (est->png_threads != 1) {
+      est->png_threads = 1;
+      est->png         = pngenc_estimate(cv.margin_x + (cv.width * cv.step),
+                                         (cv.height * cv.bands) + cv.margin_y,
+                                         1);
+      if (fit_estimate(prm, est)) break;
+    }
+
+    ret = RENDER_OVER_BUDGET;
+  } while (0);
+
+  analyzer_release(&an);
+
+  return ret;
+}
+
+static double
+mib(size_t n)
+{
+  return n / (1024.0 * 1024.0);
+}
+
+/*
+ * 見積もりの表示 (wavfft/wavletの-vの出力と同じ体裁)
+ */
+void
+render_estimate_print(FILE* fp, render_param_t* prm, render_estimate_t* est)
+{
+  fprintf(fp, "- MEMORY\n");
+  fprintf(fp, "    samples:     %.1f MiB", mib(est->samples));
+  if (est->chunk > 0) {
+    fprintf(fp, " (%zu columns per import)", est->chunk);
+  }
+  fprintf(fp, "\n");
+  fprintf(fp, "    analyzer:    %.1f MiB\n", mib(est->analyzer));
+  if (est->cache > 0) {
+    fprintf(fp, "    cache:       %.1f MiB\n", mib(est->cache));
+  }
+  fprintf(fp, "    pixels:      %.1f MiB%s\n",
+          mib(est->canvas), (est->fb_mmap)? " (mapped to file)": "");
+  fprintf(fp, "    PNG encoder: %.1f MiB", mib(est->png));
+  if (est->png_threads > 0) {
+    fprintf(fp, " (%d threads)", est->png_threads);
+  }
+  fprintf(fp, "\n");
+  fprintf(fp, "    input:       %.1f MiB (mapped)\n", mib(est->input));
+  fprintf(fp, "    total:       %.1f MiB", mib(est->total));
+  if (prm->max_memory > 0) {
+    fprintf(fp, " (budget %.1f MiB)", mib(prm->max_memory));
+  }
+  fprintf(fp, "\n");
+  fprintf(fp, "\n");
+}
+
+void
+render_result_free(render_result_t* res)
+{
+  int i;
+
+  for (i = 0; i < res->nout; i++) {
+    free(res->out[i]);
+    res->out[i] = NULL;
+  }
+
+  res->nout = 0;
+}
+
+const char*
+render_stage_name(int stage)
+{
+  return (stage >= 0 && stage < RENDER_STAGE_NUM)? stage_names[stage]: NULL;
+}
+
+static double
+per_sec(double val, uint64_t ns)
+{
+  return (ns > 0)? (val * 1e9) / ns: 0.0;
+}
+
+/*
+ * プロファイルの要約 (wavfft/wavletの-vの出力と同じ体裁)
+ */
+void
+render_profile_print(FILE* fp, render_profile_t* prof)
+{
+  int i;
+  render_stage_t* stg;
+
+  fprintf(fp, "- PROFILE\n");
+  fprintf(fp, "    wall time:   %.3f s\n", prof->wall_ns / 1e9);
+  fprintf(fp, "    CPU time:    %.3f s (%.0f%%)\n",
+          prof->cpu_ns / 1e9, per_sec(prof->cpu_ns, prof->wall_ns) / 1e7);
+  fprintf(fp, "    samples:     %" PRIu64 " (%.0f samples/s)\n",
+          prof->samples, per_sec(prof->samples, prof->wall_ns));
+  fprintf(fp, "    columns:     %" PRIu64 " (%.1f columns/s)\n",
+          prof->columns, per_sec(prof->columns, prof->wall_ns));
+  fprintf(fp, "    input:       %.2f MB (%.2f MB/s)\n",
+          prof->in_bytes / 1e6, per_sec(prof->in_bytes, prof->wall_ns) / 1e6);
+  fprintf(fp, "    output:      %.2f MB\n", prof->out_bytes / 1e6);
+  fprintf(fp, "    peak RSS:    %.1f MiB\n", prof->peak_rss / 1024.0);
+  fprintf(fp, "\n");
+
+  fprintf(fp, "    %-10s %12s %7s %10s %10s\n",
+          "stage", "time(ms)", "ratio", "calls", "MB/s");
+
+  for (i = 0; i < RENDER_STAGE_NUM; i++) {
+    stg = prof->stage + i;
+    if (stg->count == 0) continue;
+
+    fprintf(fp, "    %-10s %12.3f %6.1f%% %10" PRIu64,
+            stage_names[i], stg->ns / 1e6,
+            per_sec(stg->ns, prof->wall_ns) / 1e7, stg->count);
+
+    if (stg->bytes > 0) {
+      fprintf(fp, " %10.2f\n", per_sec(stg->bytes, stg->ns) / 1e6);
+    } else {
+      fprintf(fp, " %10s\n", "-");
+    }
+  }
+
+  fprintf(fp, "\n");
+}
+
+void
+render_profile_print_json(FILE* fp, render_profile_t* prof)
+{
+  int i;
+  render_stage_t* stg;
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"wall_sec\": %.9f,\n", prof->wall_ns / 1e9);
+  fprintf(fp, "  \"cpu_sec\": %.9f,\n", prof->cpu_ns / 1e9);
+  fprintf(fp, "  \"samples\": %" PRIu64 ",\n", prof->samples);
+  fprintf(fp, "  \"columns\": %" PRIu64 ",\n", prof->columns);
+  fprintf(fp, "  \"input_bytes\": %" PRIu64 ",\n", prof->in_bytes);
+  fprintf(fp, "  \"output_bytes\": %" PRIu64 ",\n", prof->out_bytes);
+  fprintf(fp, "  \"peak_rss_kib\": %ld,\n", prof->peak_rss);
+  fprintf(fp, "  \"samples_per_sec\": %.3f,\n",
+          per_sec(prof->samples, prof->wall_ns));
+  fprintf(fp, "  \"columns_per_sec\": %.3f,\n",
+          per_sec(prof->columns, prof->wall_ns));
+  fprintf(fp, "  \"input_mb_per_sec\": %.3f,\n",
+          per_sec(prof->in_bytes, prof->wall_ns) / 1e6);
+  fprintf(fp, "  \"stages\": {\n");
+
+  for (i = 0; i < RENDER_STAGE_NUM; i++) {
+    stg = prof->stage + i;
+
+    fprintf(fp, "    \"%s\": {\"sec\": %.9f, \"calls\": %" PRIu64
+                ", \"bytes\": %" PRIu64 "}%s\n",
+            stage_names[i], stg->ns / 1e9, stg->count, stg->bytes,
+            (i < RENDER_STAGE_NUM - 1)? ",": "");
+  }
+
+  fprintf(fp, "  }\n");
+  fprintf(fp, "}\n");
+}
+
+int
+render_run(render_param_t* prm,
+           wavmap_t* wav, char* output, render_result_t* res)
+{
+  int ret;
+  int chs[RENDER_MAX_CHANNELS];
+  int nch;
+  int ncv;
+  int multi;
+  canvas_t cv[RENDER_MAX_CHANNELS];
+  job_t job[RENDER_MAX_CHANNELS];
+  spc_header_t hdr;
+  uint8_t lut[LUT_SIZE * 3];
+  size_t usize;
+  size_t nblk;
+  char* path;
+  int started;
+  int err;
+  int i;
+  int j;
+  stopwatch_t sw;
+  uint64_t t0;
+  uint64_t c0;
+  struct stat st;
+  struct rusage ru;
+  render_profile_t* prof;
+  render_estimate_t est;
+
+  /*
+   * initialize
+   */
+  ret     = 0;
+  ncv     = 0;
+  started = 0;
+  t0      = 0;
+  c0      = 0;
+
+  memset(cv, 0, sizeof(cv));
+  memset(job, 0, sizeof(job));
+  memset(res, 0, sizeof(*res));
+  memset(&sw, 0, sizeof(sw));
+
+  sw.enable = ((prm != NULL && prm->profile != NULL) || TRACE_ENABLED());
+  sw.col    = -1;
+
+  TRACE_BEGIN("render", "render", NULL, 0);
+
+  if (sw.enable) {
+    t0 = clock_ns(CLOCK_MONOTONIC);
+    c0 = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+  }
+
+  do {
+    /*
+     * argument check
+     */
+    if (prm == NULL || wav == NULL || output == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * メモリ使用量の見積もり
+     *   (予算に収まらない場合は何も確保せずにRENDER_OVER_BUDGETを返す)
+     */
+    ret = render_estimate(prm, wav, &est);
+    if (ret) break;
+
+    ret = select_channels(prm, wav, chs, &nch);
+    if (ret) break;
+
+    multi = (nch > 1);
+    usize = render_unit_size(prm, wav);
+    nblk  = wav->frames / usize;
+
+    fbdraw_make_lut(lut, prm->cmap);
+
+    /*
+     * 出力先の準備
+     *   (チャネル毎に別画像とするか、縦に積み重ねた1枚の画像とするか)
+     */
+    if (prm->separate && multi) {
+      for (i = 0; i < nch; i++) {
+        path = (prm->fb_mmap_path != NULL)?
+                          channel_path(prm->fb_mmap_path, chs[i]): NULL;
+
+        if (prm->fb_mmap_path != NULL && path == NULL) {
+          ret = ERR;
+          break;
+        }
+
+        ret = canvas_init(cv + i, prm, nblk, 1, est.fb_mmap, path);
+        ncv++;
+
+        if (path != NULL) free(path);
+        if (ret) break;
+
+        res->out[i] = channel_path(output, chs[i]);
+        if (res->out[i] == NULL) {
+          ret = ERR;
+          break;
+        }
+
+        res->nout++;
+      }
+
+    } else {
+      ret = canvas_init(cv, prm, nblk, nch, est.fb_mmap, prm->fb_mmap_path);
+      ncv++;
+
+      if (ret) break;
+
+      res->out[0] = strdup(output);
+      if (res->out[0] == NULL) {
+        ret = ERR;
+        break;
+      }
+
+      res->nout++;
+    }
+
+    if (ret) break;
+
+    for (i = 0; i < nch; i++) {
+      job[i].prm   = prm;
+      job[i].wav   = wav;
+      job[i].ch    = chs[i];
+      job[i].cv    = (ncv > 1)? cv + i: cv;
+      job[i].band  = (ncv > 1)? 0: i;
+      job[i].lut   = lut;
+      job[i].usize = usize;
+      job[i].nblk  = nblk;
+      job[i].chunk = est.chunk;
+
+      job[i].sw.enable = sw.enable;
+
+      if (prm->mode == RENDER_MODE_POWER) {
+        job[i].scale = 1024 * prm->lumi;
+        job[i].bias  = 0.5;
+
+      } else {
+        job[i].scale = 255.0 / (prm->ceil - prm->floor);
+        job[i].bias  = -prm->floor * job[i].scale;
+      }
+    }
+
+    /*
+     * キャッシュファイルの作成
+     */
+    if (prm->cache_path != NULL) {
+      memset(&hdr, 0, sizeof(hdr));
+
+      hdr.type   = prm->cache_type;
+      hdr.mode   = (prm->mode == RENDER_MODE_POWER)?
+                                 SPC_MODE_POWER: SPC_MODE_AMPLITUDE;
+      hdr.height = prm->width;
+      hdr.scale  = (prm->scale == RENDER_LOGSCALE_MODE)?
+                                 SPC_LOGSCALE_MODE: SPC_LINEARSCALE_MODE;
+      hdr.unit   = usize;
+      hdr.fq_s   = wav->sample_rate;
+      hdr.fq_l   = prm->fq_l;
+      hdr.fq_h   = prm->fq_h;
+
+      for (i = 0; i < nch; i++) {
+        path = (multi)? channel_path(prm->cache_path, chs[i]): prm->cache_path;
+        if (path == NULL) {
+          ret = ERR;
+          break;
+        }
+
+        ret = spc_writer_new(path, &hdr, &job[i].cache);
+        if (multi) free(path);
+        if (ret) break;
+      }
+
+      if (ret) break;
+    }
+
+    /*
+     * 変換 (チャネル毎に並行して行う)
+     */
+    if (nch == 1) {
+      job_main(job);
+
+    } else {
+      for (i = 0; i < nch; i++) {
+        if (pthread_create(&job[i].thread, NULL, job_main, job + i)) {
+          ret = ERR;
+          break;
+        }
+
+        started++;
+      }
+
+      for (i = 0; i < started; i++) {
+        pthread_join(job[i].thread, NULL);
+      }
+
+      if (ret) break;
+    }
+
+    for (i = 0; i < nch; i++) {
+      if (job[i].err) {
+        ret = job[i].err;
+        break;
+      }
+    }
+
+    if (ret) break;
+
+    for (i = 0; i < nch; i++) {
+      if (job[i].cache != NULL) {
+        err = spc_writer_close(job[i].cache);
+        if (err && !ret) ret = err;
+      }
+    }
+
+    if (ret) break;
+
+    /*
+     * 目盛りを描いてPNGに書き出す
+     */
+    for (i = 0; i < ncv; i++) {
+      sw_start(&sw);
+
+      if (prm->freq_line) draw_freq_line(cv + i, prm);
+      if (prm->time_line) draw_time_line(cv + i, nblk, wav->sample_rate, usize);
+
+      sw_lap(&sw, RENDER_STAGE_DRAW, 0);
+
+      ret = pngenc_write(res->out[i],
+                         cv[i].pix,
+                         cv[i].margin_x + (cv[i].width * cv[i].step),
+                         (cv[i].height * cv[i].bands) + cv[i].margin_y,
+                         cv[i].stride,
+                         est.png_threads,
+                         prm->png_level);
+      if (ret) break;
+
+      if (sw.enable) {
+        sw_lap(&sw, RENDER_STAGE_PNG,
+               (stat(res->out[i], &st) == 0)? (size_t)st.st_size: 0);
+      }
+    }
+
+    if (ret) break;
+
+    /*
+     * set return parameter
+     */
+    res->columns = nblk;
+    res->memory  = est;
+    res->width   = cv[0].margin_x + (cv[0].width * cv[0].step);
+    res->height  = (cv[0].height * cv[0].bands) + cv[0].margin_y;
+
+    if (prm->profile != NULL) {
+      prof = prm->profile;
+      memset(prof, 0, sizeof(*prof));
+
+      for (i = 0; i < nch; i++) {
+        for (j = 0; j < RENDER_STAGE_NUM; j++) {
+          sw.stage[j].ns    += job[i].sw.stage[j].ns;
+          sw.stage[j].count += job[i].sw.stage[j].count;
+          sw.stage[j].bytes += job[i].sw.stage[j].bytes;
+        }
+      }
+
+      memcpy(prof->stage, sw.stage, sizeof(prof->stage));
+
+      prof->wall_ns   = clock_ns(CLOCK_MONOTONIC) - t0;
+      prof->cpu_ns    = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - c0;
+      prof->samples   = (uint64_t)wav->frames * nch;
+      prof->columns   = (uint64_t)nblk * nch;
+      prof->in_bytes  = (uint64_t)wav->frames * wav->block_size;
+      prof->out_bytes = sw.stage[RENDER_STAGE_PNG].bytes;
+      prof->peak_rss  = (getrusage(RUSAGE_SELF, &ru) == 0)? ru.ru_maxrss: 0;
+    }
+  } while (0);
+
+  /*
+   * post process
+   */
+  for (i = 0; i < RENDER_MAX_CHANNELS; i++) {
+    if (job[i].cache != NULL) spc_writer_destroy(job[i].cache);
+  }
+
+  for (i = 0; i < ncv; i++) {
+    canvas_release(cv + i);
+  }
+
+  if (ret) render_result_free(res);
+
+  TRACE_END();
+
+  return ret;
+}
@@ -0,0 +1,160 @@
+﻿/*
+ * Native rendering pipeline
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "wavmap.h"
+
+#define RENDER_ANALYZER_FFT       1
+#define RENDER_ANALYZER_WAVELET   2
+
+#define RENDER_MODE_POWER         1
+#define RENDER_MODE_AMPLITUDE     2
+
+#define RENDER_LINEARSCALE_MODE   1
+#define RENDER_LOGSCALE_MODE      2
+
+#define RENDER_MAX_CHANNELS       32
+
+#define RENDER_CANCELED           (-1)
+#define RENDER_OVER_BUDGET        (-2)
+
+/*
+ * プロファイルの計測区間
+ */
+#define RENDER_STAGE_SETUP        0   // 解析器の初期化
+#define RENDER_STAGE_READ         1   // WAVデータの読み込み (ページイン)
+#define RENDER_STAGE_IMPORT       2   // サンプルの取り込み (実数化)
+#define RENDER_STAGE_TRANSFORM    3   // FFT/ウェーブレット変換
+#define RENDER_STAGE_REDUCE       4   // パワー/振幅への変換と量子化
+#define RENDER_STAGE_CACHE        5   // キャッシュファイルへの書き込み
+#define RENDER_STAGE_DRAW         6   // カラムと目盛りの描画
+#define RENDER_STAGE_PNG          7   // PNGエンコード
+#define RENDER_STAGE_NUM          8
+
+typedef struct {
+  uint64_t ns;        // as "elapsed time" (sum of all channels)
+  uint64_t count;     // as "number of calls"
+  uint64_t bytes;     // as "processed bytes"
+} render_stage_t;
+
+/*
+ * render_run()の計測結果
+ *   (各区間の時間はチャネル毎のスレッドの合計なので、複数チャネルでは
+ *    wall_nsを超えることがある)
+ */
+typedef struct {
+  uint64_t wall_ns;
+  uint64_t cpu_ns;    // as "process CPU time"
+  uint64_t samples;   // as "input samples" (frames x channels)
+  uint64_t columns;   // as "columns of all channels"
+  uint64_t in_bytes;  // as "input bytes"
+  uint64_t out_bytes; // as "PNG file size"
+  long peak_rss;      // as "peak RSS in KiB"
+  render_stage_t stage[RENDER_STAGE_NUM];
+} render_profile_t;
+
+/*
+ * wavfft/wavlet のパラメータハッシュに相当する設定
+ *   (未設定を表す値の項目はライブラリの既定値を使用する)
+ */
+typedef struct {
+  int analyzer;       // as RENDER_ANALYZER_*
+  int mode;           // as RENDER_MODE_*
+  int scale;          // as RENDER_*SCALE_MODE
+  int unit_time;      // FFTはセンチ秒, Waveletはミリ秒単位
+
+  int fft_size;
+  int window;         // as FFT_WINDOW_* (-1 for default)
+
+  double sigma;       // (0 for default)
+  double threshold;   // (0 for default)
+
+  int width;          // as "output width" (height of each band)
+  double fq_l;
+  double fq_h;
+
+  double ceil;
+  double floor;
+  double lumi;
+  int step;
+  int cmap;           // as CMAP_*
+
+  double basis;       // as "basis frequency of grid"
+  double grid;        // as "grid step"
+  int freq_line;
+  int time_line;
+
+  int fb_mmap;        // as "map pixel store to file"
+  char* fb_mmap_path; // (NULL for unlinked temporary file)
+
+  char* cache_path;   // (NULL for no cache)
+  int cache_type;     // as SPC_TYPE_*
+
+  int nch;            // as "number of selected channels" (0 for all)
+  int ch[RENDER_MAX_CHANNELS];
+  int separate;
+
+  int png_threads;
+  int png_level;
+
+  size_t max_memory;  // as "memory budget in bytes" (0 for unlimited)
+
+  volatile int* cancel;
+  render_profile_t* profile;  // (NULL for no profiling)
+} render_param_t;
+
+/*
+ * render_estimate()によるメモリ使用量の見積もり (バイト数)
+ *   max_memoryを超える場合は、画素を一時ファイルにマップする、Wavelet
+ *   の入力をカラム単位に分割して取り込む、PNGエンコードのスレッド数を
+ *   減らす、の順に切り替えて収まる構成を探す。選んだ構成は後半の項目に
+ *   格納され、render_run()はそれに従って実行する。
+ */
+typedef struct {
+  size_t samples;     // as "imported samples" (wavelet, all channels)
+  size_t analyzer;    // as "analyzer tables and work buffers"
+  size_t cache;       // as "cache writer buffers"
+  size_t canvas;      // as "pixel store" (not counted in total if mapped)
+  size_t png;         // as "PNG encoder buffers"
+  size_t input;       // as "mapped WAV data" (not counted in total)
+  size_t total;       // as "peak of anonymous memory"
+
+  int fb_mmap;        // as "pixel store is mapped to file"
+  size_t chunk;       // as "columns per wavelet import" (0 for whole input)
+  int png_threads;
+} render_estimate_t;
+
+/*
+ * 実行結果 (出力ファイル名は render_result_free() で解放する)
+ */
+typedef struct {
+  size_t columns;
+  int width;          // as "image width in pixels"
+  int height;         // as "image height in pixels"
+  int nout;
+  char* out[RENDER_MAX_CHANNELS];
+  render_estimate_t memory;   // as "applied memory plan"
+} render_result_t;
+
+size_t render_unit_size(render_param_t* prm, wavmap_t* wav);
+int render_estimate(render_param_t* prm,
+                    wavmap_t* wav, render_estimate_t* est);
+int render_run(render_param_t* prm,
+               wavmap_t* wav, char* output, render_result_t* res);
+void render_result_free(render_result_t* res);
+
+const char* render_stage_name(int stage);
+void render_profile_print(FILE* fp, render_profile_t* prof);
+void render_profile_print_json(FILE* fp, render_profile_t* prof);
+void render_estimate_print(FILE* fp,
+                           render_param_t* prm, render_estimate_t* est);
+
+#endif /* !defined(__RENDER_H__) */
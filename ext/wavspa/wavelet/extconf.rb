@@ -44,4 +44,10 @@ end
 
 have_library("m")
 
+$INCFLAGS << " -I$(srcdir)/../fb -I$(srcdir)/../wavmap -I$(srcdir)/../common"
+
+# 共通のサンプル取り込み処理(../common/smpl.c)も合わせてビルドする
+$VPATH << "$(srcdir)/../common"
+$srcs = Dir.glob("#{$srcdir}/*.c").map {|f| File.basename(f)} << "smpl.c"
+
 create_makefile( "wavspa/wavelet")
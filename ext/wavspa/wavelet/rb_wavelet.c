@@ -10,6 +10,10 @@
 #include "ruby.h"
 #include "ruby/thread.h"
 #include "walet.h"
+#include "fb.h"
+#include "rb_wavmap.h"
+#include "smpl.h"
+#include "rb_column.h"
 
 #define N(x)                        (sizeof((x))/sizeof(*(x)))
 #define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
@@ -21,9 +25,6 @@ typedef struct {
   walet_t* wl;
 } rb_wavelet_t;
 
-static VALUE wavspa_module;
-static VALUE wavelet_klass;
-
 static const char* wavelet_opts_keys[] = {
   "sigma",            // {float}
   "gabor_threshold",  // {float}
@@ -58,7 +59,7 @@ rb_wavelet_alloc(VALUE self)
   ptr = ALLOC(rb_wavelet_t);
   memset(ptr, 0, sizeof(*ptr));
 
-  return Data_Wrap_Struct(wavelet_klass, 0, rb_wavelet_free, ptr);
+  return Data_Wrap_Struct(self, 0, rb_wavelet_free, ptr);
 }
 
 static void
@@ -434,7 +435,6 @@ rb_wavelet_get_output_width(VALUE self)
   return ret;
 }
 
-
 static VALUE
 rb_wavelet_set_output_width(VALUE self, VALUE width)
 {
@@ -488,19 +488,18 @@ copy_rb_string(char* dst, VALUE _src, int lim)
 }
 
 static VALUE
-rb_wavelet_put_in(VALUE self, VALUE _fmt, VALUE _smpl)
+rb_wavelet_put_in(int argc, VALUE* argv, VALUE self)
 {
   rb_wavelet_t* ptr;
   int err;
+  VALUE _fmt;
+  VALUE _smpl;
+  wavmap_t* wav;
   void* smpl;
   char fmt[8];
-  int n;
-
-  /*
-   * check argument
-   */
-  Check_Type(_fmt, T_STRING);
-  Check_Type(_smpl, T_STRING);
+  size_t n;
+  int nch;
+  int ch;
 
   /*
    * stript object
@@ -508,42 +507,62 @@ rb_wavelet_put_in(VALUE self, VALUE _fmt, VALUE _smpl)
   Data_Get_Struct(self, rb_wavelet_t, ptr);
 
   /*
-   * unpack argument
+   * parse argument
    */
-  smpl = RSTRING_PTR(_smpl);
-  n    = RSTRING_LEN(_smpl);
-
-  err  = copy_rb_string(fmt, _fmt, N(fmt));
-  if (err) {
-    ARGUMENT_ERROR("Illeagal format string.\n");
-  }
+  rb_scan_args(argc, argv, "11", &_fmt, &_smpl);
 
-  /*
-   * eval format
-   */
-  if (strcasecmp("u8", fmt) == 0) {
-    /* Nothing */
+  if (!RB_TYPE_P(_fmt, T_STRING)) {
+    /*
+     * マップ済みのWAVファイルから直接取り込む
+     *   (put_in(wav) または put_in(wav, channel))
+     */
+    wav  = wavmap_get_struct(_fmt);
+    ch   = wavmap_get_channel(wav, _smpl);
+    nch  = wav->channel_num;
 
-  } else if(strcasecmp("u16be", fmt) == 0 ||
-            strcasecmp("u16le", fmt) == 0 ||
-            strcasecmp("s16be", fmt) == 0 ||
-            strcasecmp("s16le", fmt) == 0 ) {
-    n /= 2;
+    smpl = wav->data;
+    n    = wav->frames;
 
-  } else if(strcasecmp("u24be", fmt) == 0 ||
-            strcasecmp("u24le", fmt) == 0) {
-    n /= 3;
+    strcpy(fmt, wav->fmt);
 
   } else {
-    ARGUMENT_ERROR("Illeagal format string.\n");
+    Check_Type(_fmt, T_STRING);
+    Check_Type(_smpl, T_STRING);
+
+    nch  = 1;
+    ch   = 0;
+
+    /*
+     * unpack argument
+     */
+    smpl = RSTRING_PTR(_smpl);
+    n    = RSTRING_LEN(_smpl);
+
+    err  = copy_rb_string(fmt, _fmt, N(fmt));
+    if (err) {
+      ARGUMENT_ERROR("Illeagal format string.\n");
+    }
+
+    /*
+     * eval format
+     */
+    if (strcasecmp("dbl", fmt) == 0) {
+      n /= sizeof(double);
+
+    } else if (smpl_parse_format(fmt)) {
+      n /= SMPL_SIZE(smpl_parse_format(fmt));
+
+    } else {
+      ARGUMENT_ERROR("Illeagal format string.\n");
+    }
   }
 
   /*
    * call base library
    */
-  err = walet_put_in(ptr->wl, fmt, smpl, n);
+  err = walet_put_in_channel(ptr->wl, fmt, smpl, n, nch, ch);
   if (err) {
-    RUNTIME_ERROR("walet_put_in() failed [err=%d]\n", err);
+    RUNTIME_ERROR("walet_put_in_channel() failed [err=%d]\n", err);
   }
 
   return self;
@@ -552,7 +571,7 @@ rb_wavelet_put_in(VALUE self, VALUE _fmt, VALUE _smpl)
 typedef struct {
   int err;
   walet_t* ptr;
-  int pos;
+  size_t pos;
 } transform_arg_t;
 
 static void*
@@ -568,7 +587,7 @@ _transform(void* data)
 }
 
 static int
-transform(walet_t* ptr, int pos)
+transform(walet_t* ptr, size_t pos)
 {
   transform_arg_t arg;
 
@@ -594,7 +613,7 @@ rb_wavelet_transform(VALUE self, VALUE pos)
   /*
    * call base library
    */
-  err = transform(ptr->wl, NUM2INT(pos));
+  err = transform(ptr->wl, NUM2SIZET(pos));
   if (err) {
     RUNTIME_ERROR("walet_transform() failed [err=%d]\n", err);
   }
@@ -605,99 +624,170 @@ rb_wavelet_transform(VALUE self, VALUE pos)
 typedef struct {
   int err;
   walet_t* ptr;
+  int (*func)(walet_t*, double*);
   double* dst;
-} calc_power_arg_t;
+  int type;
+} calc_arg_t;
 
 static void*
-_calc_power(void* data)
+_calc(void* data)
 {
-  calc_power_arg_t* arg;
+  calc_arg_t* arg;
 
-  arg = (calc_power_arg_t*)data;
+  arg = (calc_arg_t*)data;
 
-  arg->err = walet_calc_power(arg->ptr, arg->dst);
+  arg->err = arg->func(arg->ptr, arg->dst);
+
+  if (!arg->err) {
+    column_pack(arg->dst, arg->type, arg->ptr->width);
+  }
 
   return NULL;
 }
 
-static int
-calc_power(walet_t* ptr, double* dst)
+static VALUE
+_calc_locked(VALUE data)
 {
-  calc_power_arg_t arg;
-
-  arg.ptr = ptr;
-  arg.dst = dst;
+  rb_thread_call_without_gvl(_calc, (void*)data, RUBY_UBF_PROCESS, NULL);
 
-  rb_thread_call_without_gvl(_calc_power, &arg, RUBY_UBF_PROCESS, NULL);
-
-  return arg.err;
+  return Qnil;
 }
 
 static VALUE
-rb_wavelet_power(VALUE self)
+calc(VALUE self, int argc, VALUE* argv, int (*func)(walet_t*, double*))
 {
   rb_wavelet_t* ptr;
   VALUE ret;
-  int err;
+  VALUE into;
+  calc_arg_t arg;
 
   /*
    * strip object
    */
   Data_Get_Struct(self, rb_wavelet_t, ptr);
 
+  /*
+   * parse argument
+   */
+  column_parse_args(argc, argv, &into, &arg.type);
+
   /*
    * create return buffer
+   *   (intoが指定されている場合はそのバッファに書き込む)
    */
-  ret = rb_str_buf_new(sizeof(double) * ptr->wl->width);
-  rb_str_set_len(ret, sizeof(double) * ptr->wl->width);
+  ret = column_buffer(into, ptr->wl->width);
 
   /*
    * call base library
    */
-  err = calc_power(ptr->wl, (double*)RSTRING_PTR(ret));
-  if (err) {
-    RUNTIME_ERROR("walet_calc_power() failed [err=%d]\n", err);
+  arg.ptr  = ptr->wl;
+  arg.func = func;
+  arg.dst  = column_ptr(ret);
+
+  column_call_locked(ret, _calc_locked, (VALUE)&arg);
+
+  if (arg.err) {
+    RUNTIME_ERROR("walet_calc_*() failed [err=%d]\n", arg.err);
   }
 
+  column_set_len(ret, arg.type, ptr->wl->width);
+
   return ret;
 }
 
+static VALUE
+rb_wavelet_power(int argc, VALUE* argv, VALUE self)
+{
+  return calc(self, argc, argv, walet_calc_power);
+}
+
+static VALUE
+rb_wavelet_amplitude(int argc, VALUE* argv, VALUE self)
+{
+  return calc(self, argc, argv, walet_calc_amplitude);
+}
+
 typedef struct {
   int err;
   walet_t* ptr;
-  double* dst;
-} calc_amplitude_arg_t;
+  int (*func)(walet_t*, uint8_t*, double, double);
+  uint8_t* dst;
+  double scale;
+  double bias;
+} plot_arg_t;
 
 static void*
-_calc_amplitude(void* data)
+_plot(void* data)
 {
-  calc_amplitude_arg_t* arg;
+  plot_arg_t* arg;
 
-  arg = (calc_amplitude_arg_t*)data;
+  arg = (plot_arg_t*)data;
 
-  arg->err = walet_calc_amplitude(arg->ptr, arg->dst);
+  arg->err = arg->func(arg->ptr, arg->dst, arg->scale, arg->bias);
 
   return NULL;
 }
 
 static int
-calc_amplitude(walet_t* ptr, double* dst)
+plot(walet_t* ptr,
+     int (*func)(walet_t*, uint8_t*, double, double),
+     uint8_t* dst, double scale, double bias)
 {
-  calc_amplitude_arg_t arg;
+  plot_arg_t arg;
 
-  arg.ptr = ptr;
-  arg.dst = dst;
+  arg.ptr   = ptr;
+  arg.func  = func;
+  arg.dst   = dst;
+  arg.scale = scale;
+  arg.bias  = bias;
 
-  rb_thread_call_without_gvl(_calc_amplitude, &arg, RUBY_UBF_PROCESS, NULL);
+  rb_thread_call_without_gvl(_plot, &arg, RUBY_UBF_PROCESS, NULL);
 
   return arg.err;
 }
 
+static rb_fb_t*
+get_plot_target(rb_wavelet_t* ptr, int argc, VALUE* argv, int* col, int* band)
+{
+  rb_fb_t* ret;
+  VALUE fb;
+  VALUE _col;
+  VALUE _band;
+
+  /*
+   * check argument
+   */
+  rb_scan_args(argc, argv, "21", &fb, &_col, &_band);
+
+  Check_Type(_col, T_FIXNUM);
+  if (_band != Qnil) Check_Type(_band, T_FIXNUM);
+
+  ret   = fb_get_struct(fb);
+  *col  = FIX2INT(_col);
+  *band = (_band != Qnil)? FIX2INT(_band): 0;
+
+  if (*col < 0 || *col >= ret->width) {
+    ARGUMENT_ERROR("invalid column number");
+  }
+
+  if (*band < 0 || *band >= ret->bands) {
+    ARGUMENT_ERROR("invalid band number");
+  }
+
+  if (ret->height != ptr->wl->width) {
+    ARGUMENT_ERROR("frame buffer height is not match");
+  }
+
+  return ret;
+}
+
 static VALUE
-rb_wavelet_amplitude(VALUE self)
+rb_wavelet_plot_power(int argc, VALUE* argv, VALUE self)
 {
   rb_wavelet_t* ptr;
-  VALUE ret;
+  rb_fb_t* dst;
+  int col;
+  int band;
   int err;
 
   /*
@@ -705,30 +795,136 @@ rb_wavelet_amplitude(VALUE self)
    */
   Data_Get_Struct(self, rb_wavelet_t, ptr);
 
+  dst = get_plot_target(ptr, argc, argv, &col, &band);
+
   /*
-   * create return buffer
+   * call base library
    */
-  ret = rb_str_buf_new(sizeof(double) * ptr->wl->width);
-  rb_str_set_len(ret, sizeof(double) * ptr->wl->width);
+  err = plot(ptr->wl,
+             walet_plot_power, fb_qbuf(dst, band), dst->pscale, 0.5);
+  if (err) {
+    RUNTIME_ERROR("walet_plot_power() failed [err=%d]\n", err);
+  }
+
+  fb_put_column(dst, col, band);
+
+  return self;
+}
+
+static VALUE
+rb_wavelet_plot_amplitude(int argc, VALUE* argv, VALUE self)
+{
+  rb_wavelet_t* ptr;
+  rb_fb_t* dst;
+  int col;
+  int band;
+  int err;
+
+  /*
+   * strip object
+   */
+  Data_Get_Struct(self, rb_wavelet_t, ptr);
+
+  dst = get_plot_target(ptr, argc, argv, &col, &band);
 
   /*
    * call base library
    */
-  err = calc_amplitude(ptr->wl, (double*)RSTRING_PTR(ret));
+  err = plot(ptr->wl,
+             walet_plot_amplitude,
+             fb_qbuf(dst, band),
+             dst->ascale, -dst->floor * dst->ascale);
+  if (err) {
+    RUNTIME_ERROR("walet_plot_amplitude() failed [err=%d]\n", err);
+  }
+
+  fb_put_column(dst, col, band);
+
+  return self;
+}
+
+/*
+ * 実行統計 (FFT#statsと同じ形式)
+ */
+static VALUE
+rb_wavelet_stats(VALUE self)
+{
+  VALUE ret;
+  rb_wavelet_t* ptr;
+  walet_stats_t st;
+  int err;
+
+  /*
+   * strip object
+   */
+  Data_Get_Struct(self, rb_wavelet_t, ptr);
+
+  /*
+   * call wavelet library
+   */
+  err = walet_get_stats(ptr->wl, &st);
   if (err) {
-    RUNTIME_ERROR("walet_calc_amplitude() failed [err=%d]\n", err);
+    RUNTIME_ERROR("walet_get_stats() failed. [err=%d]", err);
   }
 
+  /*
+   * create return object
+   */
+  ret = rb_hash_new();
+
+  rb_hash_aset(ret, ID2SYM(rb_intern("frames")), ULL2NUM(st.frames));
+  rb_hash_aset(ret, ID2SYM(rb_intern("samples")), ULL2NUM(st.samples));
+  rb_hash_aset(ret, ID2SYM(rb_intern("transform_ns")),
+               ULL2NUM(st.transform_ns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("reduce_ns")), ULL2NUM(st.reduce_ns));
+  rb_hash_aset(ret, ID2SYM(rb_intern("allocations")), ULL2NUM(st.allocs));
+  rb_hash_aset(ret, ID2SYM(rb_intern("table_bytes")),
+               SIZET2NUM(st.table_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("buffer_bytes")),
+               SIZET2NUM(st.buffer_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("threads")), INT2FIX(st.threads));
+
   return ret;
 }
 
+static VALUE
+rb_wavelet_reset_stats(VALUE self)
+{
+  rb_wavelet_t* ptr;
+  int err;
+
+  /*
+   * strip object
+   */
+  Data_Get_Struct(self, rb_wavelet_t, ptr);
+
+  /*
+   * call wavelet library
+   */
+  err = walet_reset_stats(ptr->wl);
+  if (err) {
+    RUNTIME_ERROR("walet_reset_stats() failed. [err=%d]", err);
+  }
+
+  return self;
+}
+
 void
 Init_wavelet()
 {
+  VALUE wavspa_module;
+  VALUE wavelet_klass;
   int i;
 
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  /*
+   * wavelet_opts_idsは初期化時に一度だけ設定する読み出し専用の表
+   */
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
   wavspa_module = rb_define_module("WavSpectrumAnalyzer");
-	wavelet_klass = rb_define_class_under(wavspa_module, "Wavelet", rb_cObject);
+  wavelet_klass = rb_define_class_under(wavspa_module, "Wavelet", rb_cObject);
 
   rb_define_alloc_func(wavelet_klass, rb_wavelet_alloc);
 
@@ -748,10 +944,16 @@ Init_wavelet()
   rb_define_method(wavelet_klass, "width", rb_wavelet_get_output_width, 0);
   rb_define_method(wavelet_klass, "width=", rb_wavelet_set_output_width, 1);
 
-  rb_define_method(wavelet_klass, "put_in", rb_wavelet_put_in, 2);
+  rb_define_method(wavelet_klass, "put_in", rb_wavelet_put_in, -1);
   rb_define_method(wavelet_klass, "transform", rb_wavelet_transform, 1);
-  rb_define_method(wavelet_klass, "power", rb_wavelet_power, 0);
-  rb_define_method(wavelet_klass, "amplitude", rb_wavelet_amplitude, 0);
+  rb_define_method(wavelet_klass, "power", rb_wavelet_power, -1);
+  rb_define_method(wavelet_klass, "amplitude", rb_wavelet_amplitude, -1);
+  rb_define_method(wavelet_klass, "plot_power", rb_wavelet_plot_power, -1);
+  rb_define_method(wavelet_klass, "plot_amplitude",
+                                  rb_wavelet_plot_amplitude, -1);
+
+  rb_define_method(wavelet_klass, "stats", rb_wavelet_stats, 0);
+  rb_define_method(wavelet_klass, "reset_stats", rb_wavelet_reset_stats, 0);
 	
   for (i = 0; i < (int)N(wavelet_opts_keys); i++) {
     wavelet_opts_ids[i] = rb_intern(wavelet_opts_keys[i]);
@@ -13,8 +13,16 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include "walet.h"
+#include "smpl.h"
+#include "trace.h"
+#include "clock.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* defined(_OPENMP) */
 
 #define N(x)                    (sizeof(x)/sizeof(*x))
 #define IS_POW2(n)              (!((n) & ((n) - 1)))
@@ -65,6 +73,16 @@ calc_step(int mode, double low, double high, int width, double* tbl)
   return ret;
 }
 
+static inline uint8_t
+quantize(double x, double scale, double bias)
+{
+  x = (x * scale) + bias;
+  x = (x > 0.0)? x: 0.0;
+  x = (x < 255.0)? x: 255.0;
+
+  return (uint8_t)x;
+}
+
 static void
 reset_window_size_table(walet_t* ptr)
 {
@@ -149,6 +167,10 @@ walet_new(walet_t** _obj)
     obj->wt    = wt;
     obj->ft    = ft;
 
+    memset(&obj->stats, 0, sizeof(obj->stats));
+    obj->stats.allocs  = 4;   // obj, ws, wt, ft
+    obj->stats.threads = 1;
+
     /*
      * put return parameter
      */
@@ -435,6 +457,7 @@ walet_set_output_width(walet_t* ptr, int width)
     ptr->ft    = ft;
     ptr->step  = step;
 
+    ptr->stats.allocs += 3;
     ptr->flags |= F_DIRTY;
   } while (0);
 
@@ -449,118 +472,29 @@ walet_set_output_width(walet_t* ptr, int width)
   return ret;
 }
 
-static void
-import_u8(double* dst, uint8_t* src, int n)
-{
-  int i;
-
-  for (i = 0; i < n; i++) {
-    dst[i] = ((double)src[i] - 128.0) / 128.0;
-  }
-}
-
-static void
-import_u16le(double* dst, uint8_t* src, int n)
-{
-  int i;
-  uint16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((uint16_t)src[0] << 0) & 0x00ff)|
-              (((uint16_t)src[1] << 8) & 0xff00));
-    
-    dst[i] = ((double)smpl - 32768.0) / 32768.0;
-  }
-}
-
-static void
-import_u16be(double* dst, uint8_t* src, int n)
-{
-  int i;
-  uint16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((uint16_t)src[1] << 0) & 0x00ff)|
-              (((uint16_t)src[0] << 8) & 0xff00));
-
-    dst[i] = ((double)smpl - 32768.0) / 32768.0;
-  }
-}
-
-static void
-import_s16le(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((int16_t)src[0] << 0) & 0x00ff)|
-              (((int16_t)src[1] << 8) & 0xff00));
-    
-    dst[i] = (double)smpl  / 32768.0;
-  }
-}
-
-static void
-import_s16be(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int16_t smpl;
-
-  for (i = 0; i < n; i++, src += 2) {
-    smpl   = ((((int16_t)src[1] << 0) & 0x00ff)|
-              (((int16_t)src[0] << 8) & 0xff00));
-    
-    dst[i] = (double)smpl  / 32768.0;
-  }
-}
-
-static void
-import_s24le(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int32_t smpl;
-
-  for (i = 0; i < n; i++, src += 3) {
-    smpl   = ((((int32_t)src[0] <<  8) & 0x0000ff00)|
-              (((int32_t)src[1] << 16) & 0x00ff0000)|
-              (((int32_t)src[2] << 24) & 0xff000000));
-    
-    dst[i] = (double)smpl  / 2147483648.0;
-  }
-}
-
-static void
-import_s24be(double* dst, uint8_t* src, int n)
-{
-  int i;
-  int32_t smpl;
-
-  for (i = 0; i < n; i++, src += 3) {
-    smpl   = ((((int32_t)src[2] <<  8) & 0x0000ff00)|
-              (((int32_t)src[1] << 16) & 0x00ff0000)|
-              (((int32_t)src[0] << 24) & 0xff000000));
-    
-    dst[i] = (double)smpl  / 2147483648.0;
-  }
-}
-
-static void
-import_double(double* dst, double* src, int n)
+int
+walet_put_in(walet_t* ptr, const char* fmt, void* data, size_t n)
 {
-  memcpy(dst, src, sizeof(double) * n);
+  return walet_put_in_channel(ptr, fmt, data, n, 1, 0);
 }
 
+/*
+ * インタリーブされたnchチャネルのブロック列からch番目のチャネルを取り込む
+ * (chにSMPL_DOWNMIXを指定した場合は全チャネルの平均を取り込む)
+ */
 int
-walet_put_in(walet_t* ptr, char* fmt, void* data, size_t n)
+walet_put_in_channel(walet_t* ptr,
+                     const char* fmt, void* data, size_t n, int nch, int ch)
 {
   int ret;
+  int code;
   double* smpl;
 
   /*
    * initialize
    */
   ret  = 0;
+  code = 0;
   smpl = NULL;
 
 
@@ -583,6 +517,26 @@ walet_put_in(walet_t* ptr, char* fmt, void* data, size_t n)
       break;
     }
 
+    if (nch < 1 || ch >= nch || (ch < 0 && ch != SMPL_DOWNMIX)) {
+      ret = ERR;
+      break;
+    }
+
+    // "dbl"はホスト順のdouble列をそのまま取り込む(単一チャネルのみ)
+    if (strcasecmp("dbl", fmt) == 0) {
+      if (nch != 1) {
+        ret = ERR;
+        break;
+      }
+
+    } else {
+      code = smpl_parse_format(fmt);
+      if (!code) {
+        ret = ERR;
+        break;
+      }
+    }
+
     /*
      * alloc sample buffer
      */
@@ -595,40 +549,23 @@ walet_put_in(walet_t* ptr, char* fmt, void* data, size_t n)
     /*
      * import samples
      */
-    if (strcasecmp("u8", fmt) == 0) {
-      import_u8(smpl, data, n);
-
-    } else if (strcasecmp("u16be", fmt) == 0) {
-      import_u16be(smpl, data, n);
-
-    } else if (strcasecmp("u16le", fmt) == 0) {
-      import_u16le(smpl, data, n);
-
-    } else if (strcasecmp("s16be", fmt) == 0) {
-      import_s16be(smpl, data, n);
-
-    } else if (strcasecmp("s16le", fmt) == 0) {
-      import_s16le(smpl, data, n);
-
-    } else if (strcasecmp("s24be", fmt) == 0) {
-      import_s24be(smpl, data, n);
-
-    } else if (strcasecmp("s24le", fmt) == 0) {
-      import_s24le(smpl, data, n);
-
-    } else if (strcasecmp("dbl", fmt) == 0) {
-      import_double(smpl, data, n);
-
+    if (code) {
+      smpl_import_channel(code, smpl, data, n, nch, ch);
     } else {
-      ret = ERR;
-      break;
+      memcpy(smpl, data, sizeof(double) * n);
     }
 
     /*
      * put parameter
+     *   (分割して取り込む場合に備えて前回のバッファは解放する)
      */
+    if (ptr->smpl != NULL) free(ptr->smpl);
+
     ptr->smpl = smpl;
     ptr->n    = n;
+
+    ptr->stats.samples += n;
+    ptr->stats.allocs++;
   } while (0);
 
   /*
@@ -642,10 +579,11 @@ walet_put_in(walet_t* ptr, char* fmt, void* data, size_t n)
 }
 
 int
-walet_transform(walet_t* ptr, int pos)
+walet_transform(walet_t* ptr, size_t pos)
 {
   int ret;
   int dx;
+  size_t rem;
 
   int i;
   int j;
@@ -658,11 +596,13 @@ walet_transform(walet_t* ptr, int pos)
   double re;
   double im;
   double* wt;
+  uint64_t t0;
 
   /*
    * initialize
    */
   ret = 0;
+  t0  = now_ns();
 
   do {
     /*
@@ -673,7 +613,7 @@ walet_transform(walet_t* ptr, int pos)
       break;
     }
 
-    if (pos < 0 || pos >= ptr->n) {
+    if (pos >= ptr->n) {
       ret = ERR;
       break;
     }
@@ -693,22 +633,40 @@ walet_transform(walet_t* ptr, int pos)
     for (i = 0, wt = ptr->wt; i < ptr->width; i++, wt += 2) {
       dx = ptr->ws[i];
 
-      st = (dx < pos)? -dx : -pos;
-      ed = (dx < (ptr->n - pos))? dx: (ptr->n - (pos + 1));
+      rem = ptr->n - pos;
+
+      /*
+       * 窓幅はint、サンプル位置はsize_tなので比較は符号なしで行う
+       */
+      st = ((size_t)dx < pos)? -dx : -(int)pos;
+      ed = ((size_t)dx < rem)? dx: (int)(rem - 1);
 
       re = 0.0;
       im = 0.0;
 
+      /*
+       * トレース時にワーカ毎の負荷の偏りが見えるよう、並列区間の中で
+       * 各スレッドの担当分を記録する (nowaitでも並列区間の終端で同期する)
+       */
 #ifdef _OPENMP
-#pragma omp parallel for private(t,gss,omt) reduction(+:re,im)
+#pragma omp parallel private(t,gss,omt)
 #endif /* defined(_OPENMP) */
-      for (j = st; j <= ed; j++) {
-        t   = ((double)j / ptr->fq_s) * ptr->ft[i];
-        gss = ptr->wk1 * exp(-t * (t / ptr->wk2)) * (ptr->smpl[pos + j]);
-        omt = M_PI2 * t;
+      {
+        TRACE_BEGIN("gabor", "wavelet", "bin", i);
 
-        re += cos(omt) * gss;
-        im += sin(omt) * gss;
+#ifdef _OPENMP
+#pragma omp for reduction(+:re,im) nowait
+#endif /* defined(_OPENMP) */
+        for (j = st; j <= ed; j++) {
+          t   = ((double)j / ptr->fq_s) * ptr->ft[i];
+          gss = ptr->wk1 * exp(-t * (t / ptr->wk2)) * (ptr->smpl + pos)[j];
+          omt = M_PI2 * t;
+
+          re += cos(omt) * gss;
+          im += sin(omt) * gss;
+        }
+
+        TRACE_END();
       }
 
 
@@ -718,6 +676,101 @@ walet_transform(walet_t* ptr, int pos)
 
   } while (0);
 
+  if (!ret) {
+    ptr->stats.frames++;
+    ptr->stats.transform_ns += now_ns() - t0;
+#ifdef _OPENMP
+    ptr->stats.threads = omp_get_max_threads();
+#else /* defined(_OPENMP) */
+    ptr->stats.threads = 1;
+#endif /* defined(_OPENMP) */
+  }
+
+  return ret;
+}
+
+/*
+ * 最も長い窓の片側の幅 (最低周波数の窓、サンプル数)
+ *   walet_transform(pos)はpos±この幅のサンプルを参照するので、入力を
+ *   分割して取り込む際の重なりの大きさとして使用する。
+ */
+int
+walet_get_max_window(walet_t* ptr, size_t* dst)
+{
+  int ret;
+  int i;
+  int max;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+  if (dst == NULL) ret = ERR;
+
+  /*
+   * eval window size table
+   */
+  if (!ret) {
+    if (ptr->flags & F_DIRTY) {
+      reset_window_size_table(ptr);
+
+      ptr->flags &= ~F_DIRTY;
+    }
+
+    for (i = 0, max = 0; i < ptr->width; i++) {
+      if (ptr->ws[i] > max) max = ptr->ws[i];
+    }
+
+    *dst = max;
+  }
+
+  return ret;
+}
+
+/*
+ * 1回のwalet_transform()で積算するサンプル数の合計
+ *   (窓が入力の端にかからない場合。処理時間の見積もりに使用する)
+ */
+int
+walet_get_taps(walet_t* ptr, size_t* dst)
+{
+  int ret;
+  int i;
+  size_t n;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+  if (dst == NULL) ret = ERR;
+
+  /*
+   * eval window size table
+   */
+  if (!ret) {
+    if (ptr->flags & F_DIRTY) {
+      reset_window_size_table(ptr);
+
+      ptr->flags &= ~F_DIRTY;
+    }
+
+    for (i = 0, n = 0; i < ptr->width; i++) {
+      n += ((size_t)ptr->ws[i] * 2) + 1;
+    }
+
+    *dst = n;
+  }
+
   return ret;
 }
 
@@ -727,11 +780,13 @@ walet_calc_power(walet_t* ptr, double* dst)
   int ret;
   int i;
   double* wt;
+  uint64_t t0;
 
   /*
    * initialize
    */
   ret = 0;
+  t0  = now_ns();
 
   do {
     /*
@@ -763,6 +818,8 @@ walet_calc_power(walet_t* ptr, double* dst)
     }
   } while (0);
 
+  if (!ret) ptr->stats.reduce_ns += now_ns() - t0;
+
   return ret;
 }
 
@@ -773,11 +830,13 @@ walet_calc_amplitude(walet_t* ptr, double* dst)
   int i;
   double* wt;
   double base;
+  uint64_t t0;
 
   /*
    * initialize
    */
   ret = 0;
+  t0  = now_ns();
 
   do {
     /*
@@ -806,6 +865,103 @@ walet_calc_amplitude(walet_t* ptr, double* dst)
     }
   } while (0);
 
+  if (!ret) ptr->stats.reduce_ns += now_ns() - t0;
+
+  return ret;
+}
+
+/*
+ * 以下の二つはwalet_calc_power()/walet_calc_amplitude()と同じ値を求め、
+ * doubleの配列を経由せずに直接 (x * scale) + bias で量子化した
+ * 8bitの値(フレームバッファのLUTインデックス)を書き出す。
+ */
+int
+walet_plot_power(walet_t* ptr, uint8_t* dst, double scale, double bias)
+{
+  int ret;
+  int i;
+  double* wt;
+  uint64_t t0;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  t0  = now_ns();
+
+  do {
+    /*
+     * argument check
+     */
+    if (ptr == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * put power 
+     */
+    for (i = 0; i < ptr->width; i++) {
+      wt     = ptr->wt + (i * 2);
+      dst[i] = quantize((sqrt((wt[0] * wt[0]) + (wt[1] * wt[1])) /
+                                                  ptr->ft[i]) * 256,
+                        scale, bias);
+    }
+  } while (0);
+
+  if (!ret) ptr->stats.reduce_ns += now_ns() - t0;
+
+  return ret;
+}
+
+int
+walet_plot_amplitude(walet_t* ptr, uint8_t* dst, double scale, double bias)
+{
+  int ret;
+  int i;
+  double* wt;
+  double base;
+  uint64_t t0;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  t0  = now_ns();
+
+  do {
+    /*
+     * argument check
+     */
+    if (ptr == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    if (dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * put amplitude 
+     */
+    for (i = 0; i < ptr->width; i++) {
+      wt     = ptr->wt + (i * 2);
+      base   = ptr->ws[i] * 2;
+      dst[i] = quantize(20.0 *
+                        log10(sqrt(((wt[0] * wt[0]) + (wt[1] * wt[1])) / base)),
+                        scale, bias);
+    }
+  } while (0);
+
+  if (!ret) ptr->stats.reduce_ns += now_ns() - t0;
+
   return ret;
 }
 
@@ -837,3 +993,62 @@ walet_destroy(walet_t* ptr)
 
   return ret;
 }
+
+int
+walet_get_stats(walet_t* ptr, walet_stats_t* dst)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+  if (dst == NULL) ret = ERR;
+
+  /*
+   * copy counters and eval current configuration
+   */
+  if (!ret) {
+    *dst = ptr->stats;
+
+    dst->table_bytes  = (sizeof(int) + (sizeof(double) * 3)) * ptr->width;
+    dst->buffer_bytes = (ptr->smpl != NULL)? sizeof(double) * ptr->n: 0;
+  }
+
+  return ret;
+}
+
+int
+walet_reset_stats(walet_t* ptr)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+
+  /*
+   * clear counters
+   *   (threadsはカウンタではないので残す)
+   */
+  if (!ret) {
+    ptr->stats.frames       = 0;
+    ptr->stats.samples      = 0;
+    ptr->stats.transform_ns = 0;
+    ptr->stats.reduce_ns    = 0;
+    ptr->stats.allocs       = 0;
+  }
+
+  return ret;
+}
@@ -18,6 +18,22 @@
 #define WALET_LINEARSCALE_MODE    1
 #define WALET_LOGSCALE_MODE       2
 
+/*
+ * 実行統計 (walet_get_stats()で取得、walet_reset_stats()で0に戻す)
+ *   fft_stats_tと同じく、カウンタはオブジェクト毎に非アトミックに更新する。
+ *   threadsは直近のwalet_transform()で使用したOpenMPのスレッド数。
+ */
+typedef struct {
+  uint64_t frames;        // as "number of walet_transform() calls"
+  uint64_t samples;       // as "number of imported samples"
+  uint64_t transform_ns;
+  uint64_t reduce_ns;     // as "time spent in walet_calc_*()/walet_plot_*()"
+  uint64_t allocs;        // as "number of memory allocations"
+  size_t table_bytes;     // 窓幅・周波数表と変換結果
+  size_t buffer_bytes;    // 取り込んだサンプル
+  int threads;
+} walet_stats_t;
+
 typedef struct __walet__ {
   int flags;
 
@@ -38,10 +54,12 @@ typedef struct __walet__ {
   double step;
 
   double* smpl;   // as "sample data"
-  int n;          // as "number of sample size"
+  size_t n;       // as "number of sample size"
 
   double* wt;
   double* ft;     // as "frequency table"
+
+  walet_stats_t stats;
 } walet_t;
 
 int walet_new(walet_t** ptr);
@@ -54,9 +72,18 @@ int walet_set_range(walet_t* ptr, double low, double high);
 int walet_set_scale_mode(walet_t* ptr, int mode);
 int walet_set_output_width(walet_t* ptr, int width);
 
-int walet_put_in(walet_t* ptr, char* fmt, void* data, size_t size);
-int walet_transform(walet_t* ptr, int pos);
+int walet_put_in(walet_t* ptr, const char* fmt, void* data, size_t size);
+int walet_put_in_channel(walet_t* ptr,
+                         const char* fmt, void* data, size_t size, int nch, int ch);
+int walet_transform(walet_t* ptr, size_t pos);
+int walet_get_max_window(walet_t* ptr, size_t* dst);
+int walet_get_taps(walet_t* ptr, size_t* dst);
 int walet_calc_power(walet_t* ptr, double* dst);
 int walet_calc_amplitude(walet_t* ptr, double* dst);
+int walet_plot_power(walet_t* ptr, uint8_t* dst, double scale, double bias);
+int walet_plot_amplitude(walet_t* ptr, uint8_t* dst, double scale, double bias);
+
+int walet_get_stats(walet_t* ptr, walet_stats_t* dst);
+int walet_reset_stats(walet_t* ptr);
 
 #endif /* !defined(__WALET_H__) */
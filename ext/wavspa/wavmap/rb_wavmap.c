@@ -0,0 +1,233 @@
+﻿/*
+ * Memory mapped WAV file interface for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "ruby.h"
+#include "rb_wavmap.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RUNTIME_ERROR(...)          rb_raise(rb_eRuntimeError, __VA_ARGS__)
+#define ARGUMENT_ERROR(...)         rb_raise(rb_eArgError, __VA_ARGS__)
+
+static void
+rb_wavmap_free(void* _ptr)
+{
+  rb_wavmap_t* ptr;
+
+  ptr = (rb_wavmap_t*)_ptr;
+
+  if (ptr->wav != NULL) wavmap_close(ptr->wav);
+
+  free(ptr);
+}
+
+static size_t
+rb_wavmap_size(const void* _ptr)
+{
+  /*
+   * マップした領域はページキャッシュ上にあるので計上しない
+   */
+  return sizeof(rb_wavmap_t) + sizeof(wavmap_t);
+}
+
+static const struct rb_data_type_struct wavmap_data_type = {
+  .wrap_struct_name = WAVMAP_DATA_TYPE_NAME,
+  .function = {
+    .dfree = rb_wavmap_free,
+    .dsize = rb_wavmap_size,
+  },
+};
+
+static VALUE
+rb_wavmap_alloc(VALUE self)
+{
+  rb_wavmap_t* ptr;
+
+  ptr = ALLOC(rb_wavmap_t);
+  memset(ptr, 0, sizeof(*ptr));
+
+  return TypedData_Wrap_Struct(self, &wavmap_data_type, ptr);
+}
+
+static VALUE
+rb_wavmap_initialize(VALUE self, VALUE path)
+{
+  rb_wavmap_t* ptr;
+  int err;
+
+  /*
+   * extract context data
+   */
+  TypedData_Get_Struct(self, rb_wavmap_t, &wavmap_data_type, ptr);
+
+  if (ptr->wav != NULL) {
+    RUNTIME_ERROR("already initialized");
+  }
+
+  /*
+   * check argument
+   */
+  ExportStringValue(path);
+
+  /*
+   * map and parse file
+   */
+  err = wavmap_open(StringValueCStr(path), &ptr->wav);
+  if (err) {
+    RUNTIME_ERROR("wavmap_open() failed. [err = %d]\n", err);
+  }
+
+  return self;
+}
+
+static VALUE
+rb_wavmap_data_size(VALUE self)
+{
+  return SIZET2NUM(wavmap_get_struct(self)->data_size);
+}
+
+static VALUE
+rb_wavmap_frames(VALUE self)
+{
+  return SIZET2NUM(wavmap_get_struct(self)->frames);
+}
+
+static VALUE
+rb_wavmap_format_id(VALUE self)
+{
+  return INT2FIX(wavmap_get_struct(self)->format_id);
+}
+
+static VALUE
+rb_wavmap_channel_num(VALUE self)
+{
+  return INT2FIX(wavmap_get_struct(self)->channel_num);
+}
+
+static VALUE
+rb_wavmap_sample_rate(VALUE self)
+{
+  return INT2NUM(wavmap_get_struct(self)->sample_rate);
+}
+
+static VALUE
+rb_wavmap_channel_mask(VALUE self)
+{
+  return UINT2NUM(wavmap_get_struct(self)->channel_mask);
+}
+
+static VALUE
+rb_wavmap_is_rf64(VALUE self)
+{
+  return (wavmap_get_struct(self)->rf64)? Qtrue: Qfalse;
+}
+
+static VALUE
+rb_wavmap_bytes_per_sec(VALUE self)
+{
+  return INT2NUM(wavmap_get_struct(self)->bytes_per_sec);
+}
+
+static VALUE
+rb_wavmap_block_size(VALUE self)
+{
+  return INT2FIX(wavmap_get_struct(self)->block_size);
+}
+
+static VALUE
+rb_wavmap_sample_size(VALUE self)
+{
+  return INT2FIX(wavmap_get_struct(self)->sample_size);
+}
+
+static VALUE
+rb_wavmap_format(VALUE self)
+{
+  return rb_str_new_cstr(wavmap_get_struct(self)->fmt);
+}
+
+static VALUE
+rb_wavmap_read(VALUE self, VALUE pos, VALUE n)
+{
+  wavmap_t* wav;
+  size_t _pos;
+  size_t _n;
+
+  /*
+   * extract context data
+   */
+  wav = wavmap_get_struct(self);
+
+  /*
+   * check argument
+   */
+  _pos = NUM2SIZET(pos);
+  _n   = NUM2SIZET(n);
+
+  if (_pos > wav->frames) {
+    ARGUMENT_ERROR("invalid position");
+  }
+
+  if (_n > wav->frames - _pos) {
+    _n = wav->frames - _pos;
+  }
+
+  /*
+   * copy out samples
+   */
+  return rb_str_new((char*)wav->data + (_pos * wav->block_size),
+                    _n * wav->block_size);
+}
+
+static VALUE
+rb_wavmap_close(VALUE self)
+{
+  rb_wavmap_t* ptr;
+
+  TypedData_Get_Struct(self, rb_wavmap_t, &wavmap_data_type, ptr);
+
+  if (ptr->busy) {
+    RUNTIME_ERROR("WavMap is busy");
+  }
+
+  if (ptr->wav != NULL) {
+    wavmap_close(ptr->wav);
+    ptr->wav = NULL;
+  }
+
+  return Qnil;
+}
+
+void
+Init_wavmap(void)
+{
+  VALUE wavspa_module;
+  VALUE wavmap_klass;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(true);
+#endif /* defined(HAVE_RB_EXT_RACTOR_SAFE) */
+
+  wavspa_module = rb_define_module("WavSpectrumAnalyzer");
+  wavmap_klass  = rb_define_class_under(wavspa_module, "WavMap", rb_cObject);
+
+  rb_define_alloc_func(wavmap_klass, rb_wavmap_alloc);
+  rb_define_method(wavmap_klass, "initialize", rb_wavmap_initialize, 1);
+  rb_define_method(wavmap_klass, "data_size", rb_wavmap_data_size, 0);
+  rb_define_method(wavmap_klass, "frames", rb_wavmap_frames, 0);
+  rb_define_method(wavmap_klass, "format_id", rb_wavmap_format_id, 0);
+  rb_define_method(wavmap_klass, "channel_num", rb_wavmap_channel_num, 0);
+  rb_define_method(wavmap_klass, "channel_mask", rb_wavmap_channel_mask, 0);
+  rb_define_method(wavmap_klass, "rf64?", rb_wavmap_is_rf64, 0);
+  rb_define_method(wavmap_klass, "sample_rate", rb_wavmap_sample_rate, 0);
+  rb_define_method(wavmap_klass, "bytes_per_sec", rb_wavmap_bytes_per_sec, 0);
+  rb_define_method(wavmap_klass, "block_size", rb_wavmap_block_size, 0);
+  rb_define_method(wavmap_klass, "sample_size", rb_wavmap_sample_size, 0);
+  rb_define_method(wavmap_klass, "format", rb_wavmap_format, 0);
+  rb_define_method(wavmap_klass, "read", rb_wavmap_read, 2);
+  rb_define_method(wavmap_klass, "close", rb_wavmap_close, 0);
+}
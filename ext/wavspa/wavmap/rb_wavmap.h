@@ -0,0 +1,103 @@
+﻿/*
+ * Memory mapped WAV file interface for Ruby
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __RB_WAVMAP_H__
+#define __RB_WAVMAP_H__
+
+#include <string.h>
+
+#include "ruby.h"
+#include "wavmap.h"
+
+#define WAVMAP_DATA_TYPE_NAME   "Memory mapped WAV file for spectrum analyzer"
+
+#define WAVMAP_DOWNMIX          (-1)    // smpl.hのSMPL_DOWNMIXと同じ値
+
+typedef struct {
+  wavmap_t* wav;
+  int busy;         // GVL解放中に参照している数(参照中はcloseさせない)
+} rb_wavmap_t;
+
+/*
+ * 他の拡張ライブラリ(FFT/Wavelet)からマップ済みのサンプルデータを
+ * 直接参照するためのインタフェース。fb.hと同様にデータ型は名前で照合
+ * する。
+ */
+static inline rb_wavmap_t*
+wavmap_get_data(VALUE obj)
+{
+  rb_wavmap_t* ret;
+
+  if (!RB_TYPE_P(obj, T_DATA) || !RTYPEDDATA_P(obj) ||
+      strcmp(RTYPEDDATA_TYPE(obj)->wrap_struct_name, WAVMAP_DATA_TYPE_NAME)) {
+    rb_raise(rb_eTypeError, "not a WavMap object");
+  }
+
+  ret = (rb_wavmap_t*)RTYPEDDATA_DATA(obj);
+  if (ret->wav == NULL) {
+    rb_raise(rb_eRuntimeError, "WavMap is not opened");
+  }
+
+  return ret;
+}
+
+static inline wavmap_t*
+wavmap_get_struct(VALUE obj)
+{
+  return wavmap_get_data(obj)->wav;
+}
+
+/*
+ * GVLを解放してマップ領域を読む間、他のスレッドからcloseされない
+ * ようにする(カウンタの操作はGVLを保持した状態で行うこと)
+ */
+static inline void
+wavmap_hold(VALUE obj)
+{
+  wavmap_get_data(obj)->busy++;
+}
+
+static inline void
+wavmap_unhold(VALUE obj)
+{
+  ((rb_wavmap_t*)RTYPEDDATA_DATA(obj))->busy--;
+}
+
+/*
+ * チャネル指定(Integer または :MIX)を評価する
+ *   省略時はモノラルの場合のみ0チャネル目とみなす
+ */
+static inline int
+wavmap_get_channel(wavmap_t* wav, VALUE ch)
+{
+  int ret;
+
+  if (ch == Qnil) {
+    if (wav->channel_num != 1) {
+      rb_raise(rb_eArgError, "channel is not specified");
+    }
+
+    ret = 0;
+
+  } else if (SYMBOL_P(ch)) {
+    if (rb_to_id(ch) != rb_intern("MIX")) {
+      rb_raise(rb_eArgError, "unknown channel specifier");
+    }
+
+    ret = WAVMAP_DOWNMIX;
+
+  } else {
+    ret = NUM2INT(ch);
+
+    if (ret < 0 || ret >= wav->channel_num) {
+      rb_raise(rb_eArgError, "invalid channel number");
+    }
+  }
+
+  return ret;
+}
+
+#endif /* !defined(__RB_WAVMAP_H__) */
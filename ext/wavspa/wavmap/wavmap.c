@@ -0,0 +1,387 @@
+﻿/*
+ * Memory mapped WAV file reader
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "wavmap.h"
+
+#define ALLOC(t)                ((t*)malloc(sizeof(t)))
+
+#define ERR                     __LINE__
+
+#define CHUNK_HEADER_SIZE       8
+#define FMT_CHUNK_MIN_SIZE      16
+#define FMT_EXTENSIBLE_SIZE     40
+#define DS64_CHUNK_MIN_SIZE     28
+
+#define SIZE_PLACEHOLDER        0xffffffff
+
+/*
+ * KSDATAFORMAT_SUBTYPE_* の共通部分(先頭2バイトがフォーマットID)
+ */
+static const uint8_t subformat_guid_tail[14] = {
+  0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71,
+};
+
+static uint16_t
+get_u16(uint8_t* p)
+{
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t
+get_u32(uint8_t* p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t
+get_u64(uint8_t* p)
+{
+  return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+/*
+ * fmtチャンクの内容を取り込む
+ */
+static int
+parse_fmt(wavmap_t* ptr, uint8_t* p, size_t size)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  do {
+    if (size < FMT_CHUNK_MIN_SIZE) {
+      ret = ERR;
+      break;
+    }
+
+    ptr->format_id     = get_u16(p + 0);
+    ptr->channel_num   = get_u16(p + 2);
+    ptr->sample_rate   = get_u32(p + 4);
+    ptr->bytes_per_sec = get_u32(p + 8);
+    ptr->block_size    = get_u16(p + 12);
+    ptr->sample_size   = get_u16(p + 14);
+
+    /*
+     * WAVE_FORMAT_EXTENSIBLEの場合はSubFormatの値を実際のフォーマット
+     * として扱う(sample_sizeはコンテナのビット数のまま)
+     */
+    if (ptr->format_id == WAVMAP_FORMAT_EXTENSIBLE) {
+      if (size < FMT_EXTENSIBLE_SIZE ||
+          memcmp(p + 26, subformat_guid_tail, sizeof(subformat_guid_tail))) {
+        ret = ERR;
+        break;
+      }
+
+      ptr->format_id    = get_u16(p + 24);
+      ptr->channel_mask = get_u32(p + 20);
+    }
+
+    if (ptr->channel_num <= 0 || ptr->sample_rate <= 0) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * 8bitのPCMは符号なし、それ以外は符号付きリトルエンディアン
+     */
+    switch (ptr->format_id) {
+    case WAVMAP_FORMAT_PCM:
+      switch (ptr->sample_size) {
+      case 8:
+        strcpy(ptr->fmt, "u8");
+        break;
+
+      case 16:
+        strcpy(ptr->fmt, "s16le");
+        break;
+
+      case 24:
+        strcpy(ptr->fmt, "s24le");
+        break;
+
+      case 32:
+        strcpy(ptr->fmt, "s32le");
+        break;
+
+      default:
+        ret = ERR;
+        break;
+      }
+      break;
+
+    case WAVMAP_FORMAT_IEEE_FLOAT:
+      switch (ptr->sample_size) {
+      case 32:
+        strcpy(ptr->fmt, "f32le");
+        break;
+
+      case 64:
+        strcpy(ptr->fmt, "f64le");
+        break;
+
+      default:
+        ret = ERR;
+        break;
+      }
+      break;
+
+    default:
+      ret = ERR;
+      break;
+    }
+    if (ret) break;
+
+    if (ptr->block_size != (ptr->sample_size / 8) * ptr->channel_num) {
+      ret = ERR;
+      break;
+    }
+  } while (0);
+
+  return ret;
+}
+
+/*
+ * RIFFチャンクを走査してfmt/dataチャンクを探す
+ *   RF64/BW64の場合は先頭のds64チャンクから64bitのサイズを取り出し、
+ *   dataチャンクのサイズ欄が0xffffffffの時にそちらを用いる。
+ */
+static int
+parse_riff(wavmap_t* ptr)
+{
+  int ret;
+  uint8_t* head;
+  uint8_t* tail;
+  uint8_t* p;
+  uint64_t size;
+  uint64_t ds64;
+  int rf64;
+  int fmt;
+
+  /*
+   * initialize
+   */
+  ret  = 0;
+  head = (uint8_t*)ptr->map;
+  tail = head + ptr->size;
+  ds64 = 0;
+  rf64 = 0;
+  fmt  = 0;
+
+  do {
+    if (ptr->size < 12 || memcmp(head + 8, "WAVE", 4)) {
+      ret = ERR;
+      break;
+    }
+
+    if (!memcmp(head, "RF64", 4) || !memcmp(head, "BW64", 4)) {
+      rf64 = !0;
+
+    } else if (memcmp(head, "RIFF", 4)) {
+      ret = ERR;
+      break;
+    }
+
+    p = head + 12;
+
+    if (rf64) {
+      if ((size_t)(tail - p) < CHUNK_HEADER_SIZE + DS64_CHUNK_MIN_SIZE ||
+          memcmp(p, "ds64", 4)) {
+        ret = ERR;
+        break;
+      }
+
+      ds64 = get_u64(p + CHUNK_HEADER_SIZE + 8);
+    }
+
+    while (1) {
+      if ((size_t)(tail - p) < CHUNK_HEADER_SIZE) {
+        ret = ERR;
+        break;
+      }
+
+      size = get_u32(p + 4);
+
+      if (!memcmp(p, "fmt ", 4)) {
+        if (size > (size_t)(tail - p) - CHUNK_HEADER_SIZE) {
+          ret = ERR;
+          break;
+        }
+
+        ret = parse_fmt(ptr, p + CHUNK_HEADER_SIZE, size);
+        if (ret) break;
+
+        fmt = !0;
+
+      } else if (!memcmp(p, "data", 4)) {
+        if (!fmt) {
+          ret = ERR;
+          break;
+        }
+
+        if (rf64 && size == SIZE_PLACEHOLDER) {
+          size = ds64;
+        }
+
+        /*
+         * 録音途中で切れたファイル等に配慮し、ヘッダ上のサイズが
+         * 実ファイルを超える場合はファイル末尾までを有効とする
+         */
+        if (size > (size_t)(tail - p) - CHUNK_HEADER_SIZE) {
+          size = (tail - p) - CHUNK_HEADER_SIZE;
+        }
+
+        ptr->data      = p + CHUNK_HEADER_SIZE;
+        ptr->data_size = size;
+        ptr->frames    = size / ptr->block_size;
+        ptr->rf64      = rf64;
+        break;
+      }
+
+      // チャンクは2バイト境界にパディングされる
+      size += (size & 1);
+
+      if (size > (size_t)(tail - p) - CHUNK_HEADER_SIZE) {
+        ret = ERR;
+        break;
+      }
+
+      p += CHUNK_HEADER_SIZE + size;
+    }
+  } while (0);
+
+  return ret;
+}
+
+int
+wavmap_open(char* path, wavmap_t** _obj)
+{
+  int ret;
+  wavmap_t* obj;
+  int fd;
+  struct stat st;
+  void* map;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+  obj = NULL;
+  fd  = -1;
+  map = MAP_FAILED;
+
+  do {
+    /*
+     * argument check
+     */
+    if (path == NULL || _obj == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    /*
+     * alloc object
+     */
+    obj = ALLOC(wavmap_t);
+    if (obj == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    memset(obj, 0, sizeof(*obj));
+
+    /*
+     * map file
+     */
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      ret = ERR;
+      break;
+    }
+
+    if (fstat(fd, &st) || st.st_size == 0 ||
+        (uint64_t)st.st_size > SIZE_MAX) {
+      ret = ERR;
+      break;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      ret = ERR;
+      break;
+    }
+
+    obj->map  = map;
+    obj->size = st.st_size;
+
+    /*
+     * parse header
+     */
+    ret = parse_riff(obj);
+    if (ret) break;
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    /*
+     * set return parameter
+     */
+    *_obj = obj;
+  } while (0);
+
+  /*
+   * post process
+   */
+  if (fd >= 0) close(fd);
+
+  if (ret) {
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+    if (obj != NULL) free(obj);
+  }
+
+  return ret;
+}
+
+int
+wavmap_close(wavmap_t* ptr)
+{
+  int ret;
+
+  /*
+   * initialize
+   */
+  ret = 0;
+
+  /*
+   * argument check
+   */
+  if (ptr == NULL) ret = ERR;
+
+  /*
+   * release object
+   */
+  if (!ret) {
+    munmap(ptr->map, ptr->size);
+    free(ptr);
+  }
+
+  return ret;
+}
@@ -0,0 +1,40 @@
+﻿/*
+ * Memory mapped WAV file reader
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __WAVMAP_H__
+#define __WAVMAP_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define WAVMAP_FORMAT_PCM         0x0001
+#define WAVMAP_FORMAT_IEEE_FLOAT  0x0003
+#define WAVMAP_FORMAT_EXTENSIBLE  0xfffe
+
+typedef struct {
+  void* map;
+  size_t size;
+
+  int format_id;      // (SubFormat for WAVE_FORMAT_EXTENSIBLE)
+  int channel_num;
+  uint32_t channel_mask;
+  int sample_rate;
+  int bytes_per_sec;
+  int block_size;
+  int sample_size;    // as "bits per sample"
+
+  uint8_t* data;      // as "head of data chunk"
+  size_t data_size;
+  size_t frames;      // as "number of sample blocks"
+  int rf64;           // as "RF64/BW64 file"
+
+  char fmt[8];        // as "sample format string (ex. 's16le')"
+} wavmap_t;
+
+int wavmap_open(char* path, wavmap_t** obj);
+int wavmap_close(wavmap_t* ptr);
+
+#endif /* !defined(__WAVMAP_H__) */
@@ -25,27 +25,34 @@ module WavSpectrumAnalyzer
 
     def draw_freq_line(fb)
       #
-      # 低周波方向
+      # 複数チャネルを積み重ねている場合はバンド毎に描く
       #
-      frq = down_step(@basis_freq)
-      loop {
-        pos  = fpos(frq)
-        break if pos >= @output_width
-
-        fb.hline(pos, "#{frq.to_i}Hz") if pos >= 0
-        frq = down_step(frq)
-      }
-     
-      #
-      # 高周波方向
-      #
-      frq = @basis_freq;
-      loop {
-        pos = fpos(frq)
-        break if pos <= 0 
-
-        fb.hline(pos, "#{frq.to_i}Hz") if pos < @output_width
-        frq = up_step(frq)
+      fb.bands.times { |band|
+        ofs = band * @output_width
+
+        #
+        # 低周波方向
+        #
+        frq = down_step(@basis_freq)
+        loop {
+          pos  = fpos(frq)
+          break if pos >= @output_width
+
+          fb.hline(ofs + pos, "#{frq.to_i}Hz") if pos >= 0
+          frq = down_step(frq)
+        }
+       
+        #
+        # 高周波方向
+        #
+        frq = @basis_freq;
+        loop {
+          pos = fpos(frq)
+          break if pos <= 0 
+
+          fb.hline(ofs + pos, "#{frq.to_i}Hz") if pos < @output_width
+          frq = up_step(frq)
+        }
       }
     end
 
@@ -62,23 +69,105 @@ module WavSpectrumAnalyzer
       return ret
     end
 
-    def draw_time_line(fb, wav, usize)
+    def draw_time_line(fb, n, rate, usize)
       tc = 0
       tm = 0
-      n  = (wav.data_size / (wav.sample_size / 8)) / usize
 
       fb.vline(0, time_str(tm))
 
       n.times { |col|
         tc += usize;
-        if tc >= wav.sample_rate
+        if tc >= rate
           tm += 1
-          tc %= wav.sample_rate
+          tc %= rate
           fb.vline(col, time_str(tm)) if (tm % 10).zero?
         end
       }
     end
 
+    #
+    # 解析対象のチャネルのリスト (整数のチャネル番号 または :MIX)
+    #
+    def select_channels(wav)
+      case @channels
+      when nil, :ALL
+        ret = (0...wav.channel_num).to_a
+
+      when :MIX
+        ret = [:MIX]
+
+      else
+        @channels.each { |ch|
+          error("channel #{ch} is not exist.") if ch >= wav.channel_num
+        }
+
+        ret = @channels
+      end
+
+      return ret
+    end
+
+    #
+    # --max-memoryの値 ("512M"や"2G"など。接尾辞は1024の累乗)
+    #
+    def parse_size(str)
+      if not /\A(\d+(?:\.\d+)?)\s*([KMG]?)(?:i?B)?\z/i =~ str
+        raise ArgumentError, "invalid memory size #{str}"
+      end
+
+      exp = {"" => 0, "K" => 1, "M" => 2, "G" => 3}[$2.upcase]
+
+      return ($1.to_f * (1024 ** exp)).to_i
+    end
+    module_function :parse_size
+
+    #
+    # 変換の前にメモリ使用量を見積もる (-vの場合は見積もりを表示し、
+    # --max-memoryに収まらない場合はここで打ち切る)
+    #
+    def check_memory(wav, opts)
+      mem = WavSpectrumAnalyzer.estimate(wav, opts)
+
+      STDERR.print(mem[:report]) if $verbose
+
+      if not mem[:fit]
+        error("estimated memory usage (%.1f MiB) exceeds --max-memory." %
+              (mem[:total] / (1024.0 * 1024.0)))
+      end
+
+      return mem
+    end
+
+    #
+    # --time-budgetの処理
+    #   指定された構成の予測時間が予算を超える場合は、分解能を満たす
+    #   候補のうち最も速いものに切り替えたパラメータを返す
+    #
+    def apply_plan(wav, opts, budget)
+      plan = WavSpectrumAnalyzer.plan(wav, opts, budget)
+      ents = plan[:candidates]
+
+      STDERR.print(plan[:report]) if $verbose
+
+      if not plan[:chosen]
+        error("no configuration fits --time-budget " \
+              "(%.1f s predicted for the requested one)." %
+              ents[0][:predicted_sec])
+      end
+
+      ent = ents[plan[:chosen]]
+      return opts.merge(ent.slice(:analyzer, :fft_size, :window_function,
+                                  :sigma, :threshold, :unit_time))
+    end
+
+    #
+    # --profileの計測結果の出力
+    #   (要約は標準エラー出力へ。表示とJSONはlibwavspaのwavspaと同じ)
+    #
+    def report_profile(prof, path)
+      STDERR.print(prof[:report])
+      File.write(path, prof[:json]) if path.kind_of?(String)
+    end
   end
 end
 
@@ -7,11 +7,8 @@
 #   Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
 #
 
-require 'wav'
-require 'png'
-
-require 'wavspa/wavelet'
-require 'wavspa/fb'
+require 'wavspa/wavmap'
+require 'wavspa/render'
 
 module WavSpectrumAnalyzer
   module WaveLetApp
@@ -23,56 +20,22 @@ module WavSpectrumAnalyzer
         @unit_time      = param[:unit_time]
         @sigma          = param[:sigma]
         @threshold      = param[:threshold]
-        @output_width   = param[:output_width]
-                       
-        @freq_range     = param[:range]
+        @lo_freq        = param[:range][0]
+        @hi_freq        = param[:range][1]
         @ceil           = param[:ceil]
         @floor          = param[:floor]
-        @luminance      = param[:luminance]
-        @col_step       = param[:col_step]
-                       
+        @colormap       = param[:colormap] || :GREEN
+        @channels       = param[:channels]
+        @separate       = param[:separate_channels]
         @scale_mode     = param[:scale_mode]
-        @logscale       = (param[:scale_mode] == :LOGSCALE)
-        @basis_freq     = param[:basis_freq] || 440.0 
-        @grid_step      = param[:grid_step] || ((@logscale)? 2.0: 2000.0)
-                       
-        @lo_freq        = @freq_range[0]
-        @hi_freq        = @freq_range[1]
-        @freq_width     = (@hi_freq - @lo_freq)
-                       
-        @log_step       = (@hi_freq / @lo_freq) ** (1.0 / @output_width)
-        @log_base       = Math.log(@log_step)
       end
       private :load_param
 
       def main(input, param, output)
         load_param(param)
 
-        wav = WavFile.open(input)
-        wl  = Wavelet.new
-
-        wl.frequency       = wav.sample_rate
-        wl.sigma           = @sigma
-        wl.gabor_threshold = @threshold
-        wl.range           = (@lo_freq .. @hi_freq)
-        wl.scale_mode      = @scale_mode
-        wl.width           = @output_width
-
-
-        wl.put_in("s%dle" % wav.sample_size, wav.read)
-
-        row   = 0
-        usize = (wav.sample_rate * @unit_time) / 1000
-        nblk  = (wav.data_size / wav.block_size) / usize
-
-        fb    = FrameBuffer.new(nblk,
-                                @output_width,
-                                :column_step => @col_step,
-                                :margin_x => ($draw_freq_line)? 50:0,
-                                :margin_y => ($draw_time_line)? 30:0,
-                                :ceil => @ceil,
-                                :floor => @floor,
-                                :luminance => @luminance)
+        wav = WavMap.new(input)
+        chs = select_channels(wav)
 
         if $verbose
           STDERR.print <<~EOT
@@ -89,47 +52,44 @@ module WavSpectrumAnalyzer
                 gabor threshold: #{@threshold}
                 unit time:       #{@unit_time} ms
 
+          EOT
+        end
+
+        #
+        # 変換から描画・PNG出力までをネイティブで実行する
+        #
+        opts = param.merge(:analyzer       => :WAVELET,
+                           :draw_freq_line => $draw_freq_line,
+                           :draw_time_line => $draw_time_line,
+                           :profile        => !!$profile)
+        opts = apply_plan(wav, opts, $time_budget) if $time_budget
+        check_memory(wav, opts)
+        ret  = WavSpectrumAnalyzer.render(wav, output, opts)
+
+        if $verbose
+          STDERR.print <<~EOT
             - OUTPUT
-                width:           #{fb.width}px
-                height:          #{fb.height}px
+                width:           #{ret[:width]}px
+                height:          #{ret[:height]}px
                 freq range:      #{@lo_freq} - #{@hi_freq}Hz
                 scale mode:      #{@scale_mode}
                 plot mode :      #{@transform_mode}
                 ceil:            #{@ceil}
                 floor:           #{@floor}
+                colormap:        #{@colormap}
+                channels:        #{chs.join(",")} #{(ret[:outputs].size > 1)? "(separate)": ""}
 
           EOT
-        end
 
-        if wav.channel_num >= 2
-          error("error: multi chanel data is not supported " \
-                "(support only monoral data).")
-        end
-       
-        until row >= nblk
-          STDERR.printf("\rtransform #{row + 1}/#{nblk}", row) if $verbose
-          wl.transform(row * usize)
-
-          if @transform_mode == :POWER
-            fb.draw_power(row, wl.power)
-          else
-            fb.draw_amplitude(row, wl.amplitude)
-          end
-
-          row += 1
+          ret[:outputs].each { |out| STDERR.printf("write to #{out} ... done\n") }
         end
 
-        STDERR.printf(" ... done\n") if $verbose
-
-        STDERR.printf("write to #{output} ... ") if $verbose
-
-        draw_freq_line(fb) if $draw_freq_line
-        draw_time_line(fb, wav, usize) if $draw_time_line
+        report_profile(ret[:profile], $profile) if $profile
 
-        png = PNG.encode(fb.width, fb.height, fb.to_s, :pixel_format => :RGB)
-        IO.binwrite(output, png)
+        wav.close
 
-        STDERR.printf("done\n") if $verbose
+      rescue ArgumentError => e
+        error(e.message)
       end
     end
   end
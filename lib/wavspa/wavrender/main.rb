@@ -0,0 +1,113 @@
+#! /usr/bin/env ruby
+# coding: utf-8
+
+#
+# Spectrum analyzer for WAV file
+#
+#   Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+#
+
+require 'wavspa/fb'
+require 'wavspa/cache'
+
+module WavSpectrumAnalyzer
+  module RenderApp
+    extend WavSpectrumAnalyzer::Common
+
+    class << self
+      def load_param(param, cache)
+        @transform_mode = cache.plot_mode
+        @output_width   = cache.height
+
+        @freq_range     = cache.range
+        @ceil           = param[:ceil]
+        @floor          = param[:floor]
+        @luminance      = param[:luminance]
+        @col_step       = param[:col_step]
+        @colormap       = param[:colormap] || :GREEN
+        @fb_mmap        = param[:fb_mmap]
+
+        @scale_mode     = cache.scale_mode
+        @logscale       = (cache.scale_mode == :LOGSCALE)
+        @basis_freq     = param[:basis_freq] || 440.0 
+        @grid_step      = param[:grid_step] || ((@logscale)? 2.0: 2000.0)
+
+        @lo_freq        = @freq_range[0]
+        @hi_freq        = @freq_range[1]
+        @freq_width     = (@hi_freq - @lo_freq)
+
+        @log_step       = (@hi_freq / @lo_freq) ** (1.0 / @output_width)
+        @log_base       = Math.log(@log_step)
+      end
+      private :load_param
+
+      def main(input, param, output)
+        cache = CacheReader.new(input)
+
+        load_param(param, cache)
+
+        nblk  = cache.columns
+        usize = cache.unit_size
+        rate  = cache.sample_rate.to_i
+
+        fb    = FrameBuffer.new(nblk,
+                                @output_width,
+                                :column_step => @col_step,
+                                :margin_x => ($draw_freq_line)? 50:0,
+                                :margin_y => ($draw_time_line)? 30:0,
+                                :ceil => @ceil,
+                                :floor => @floor,
+                                :luminance => @luminance,
+                                :colormap => @colormap,
+                                :mmap => @fb_mmap)
+
+        if $verbose
+          STDERR.print <<~EOT
+            - input data
+              #{input}
+                columns:     #{nblk}
+                sample type: #{cache.sample_type}
+                sample rate: #{rate} Hz
+                unit size:   #{usize} samples
+
+            - OUTPUT
+                width:       #{fb.width}px
+                height:      #{fb.height}px
+                freq range:  #{@lo_freq} - #{@hi_freq}Hz
+                scale mode:  #{@scale_mode}
+                plot mode :  #{@transform_mode}
+                ceil:        #{@ceil}
+                floor:       #{@floor}
+                colormap:    #{@colormap}
+
+          EOT
+        end
+
+        STDERR.printf("render #{nblk} columns") if $verbose
+
+        dat = String.new
+
+        nblk.times { |col|
+          if @transform_mode == :POWER
+            fb.draw_power(col, cache.read(col, dat))
+          else
+            fb.draw_amplitude(col, cache.read(col, dat))
+          end
+        }
+
+        cache.close
+
+        STDERR.printf(" ... done\n") if $verbose
+
+        STDERR.printf("write to #{output} ... ") if $verbose
+
+        draw_freq_line(fb) if $draw_freq_line
+        draw_time_line(fb, nblk, rate, usize) if $draw_time_line
+
+        fb.write_png(output)
+
+        STDERR.printf("done\n") if $verbose
+      end
+    end
+  end
+end
@@ -0,0 +1,21 @@
+#! /usr/bin/env ruby
+# coding: utf-8
+
+#
+# Spectrum analyzer for WAV file
+#
+#   Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+#
+
+module WavSpectrumAnalyzer
+  module RenderApp
+    PRESET_TABLE = {
+      "default" => {
+        :ceil            => -10.0,
+        :floor           => -90.0,
+        :luminance       => 3.5,
+        :col_step        => 1,
+      },
+    }
+  end
+end
@@ -0,0 +1,849 @@
+﻿/*
+ * Spectrum analyzer for WAV file (native CLI)
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <libgen.h>
+
+#include "wavspa.h"
+
+#define N(x)                        (sizeof((x))/sizeof(*(x)))
+
+/*
+ * lib/wavspa/{wavfft,wavlet}/preset.rbと同じ内容
+ */
+typedef struct {
+  const char* name;
+  int unit_time;
+  int fft_size;
+  double sigma;
+  double threshold;
+  int width;
+  double fq_l;
+  double fq_h;
+} preset_t;
+
+static const preset_t fft_presets[] = {
+  {"default",   10,  16384, 0.0, 0.0, 240, 200.0,  8000.0},
+  {"32k",        5,  32768, 0.0, 0.0, 360, 200.0, 16000.0},
+  {"cd",         5,  32768, 0.0, 0.0, 480,  50.0, 22000.0},
+  {"highreso",   5, 131072, 0.0, 0.0, 640, 200.0, 32000.0},
+};
+
+static const preset_t wavelet_presets[] = {
+  {"default",  100,      0, 24.0, 0.01, 240, 200.0,  8000.0},
+  {"cd",        50,      0, 24.0, 0.01, 480,  50.0, 22050.0},
+};
+
+static const char* window_names[] = {
+  "RECTANGULAR",          // FFT_WINDOW_RECTANGULAR
+  "HAMMING",              // FFT_WINDOW_HAMMING
+  "HANN",                 // FFT_WINDOW_HANN
+  "BLACKMAN",             // FFT_WINDOW_BLACKMAN
+  "BLACKMAN_NUTTALL",     // FFT_WINDOW_BLACKMAN_NUTTALL
+  "FLAT_TOP",             // FFT_WINDOW_FLAT_TOP
+};
+
+static const char* colormap_names[] = {
+  "GREEN",                // CMAP_GREEN
+  "GRAYSCALE",            // CMAP_GRAYSCALE
+  "VIRIDIS",              // CMAP_VIRIDIS
+  "MAGMA",                // CMAP_MAGMA
+};
+
+enum {
+  OPT_FLOOR_GAIN = 0x100,
+  OPT_CEIL_GAIN,
+  OPT_LUMINANCE,
+  OPT_COLORMAP,
+  OPT_SAVE_CACHE,
+  OPT_CACHE_TYPE,
+  OPT_SHOW_PARAMS,
+  OPT_MMAP_FB,
+  OPT_CHANNEL,
+  OPT_SEPARATE,
+  OPT_VERSION,
+  OPT_PROFILE,
+  OPT_MAX_MEMORY,
+  OPT_TIME_BUDGET,
+};
+
+static const struct option fft_opts[] = {
+  {"output",             required_argument, NULL, 'o'},
+  {"preset",             required_argument, NULL, 'p'},
+  {"amplitude-mode",     no_argument,       NULL, 'a'},
+  {"fft-size",           required_argument, NULL, 'f'},
+  {"unit-time",          required_argument, NULL, 'u'},
+  {"output-width",       required_argument, NULL, 'W'},
+  {"window-function",    required_argument, NULL, 'w'},
+  {"frequency-range",    required_argument, NULL, 'r'},
+  {"floor-gain",         required_argument, NULL, OPT_FLOOR_GAIN},
+  {"ceil-gain",          required_argument, NULL, OPT_CEIL_GAIN},
+  {"luminance",          required_argument, NULL, OPT_LUMINANCE},
+  {"colormap",           required_argument, NULL, OPT_COLORMAP},
+  {"frequency-grid",     required_argument, NULL, 'g'},
+  {"scale-mode",         required_argument, NULL, 'm'},
+  {"col-steps",          required_argument, NULL, 'c'},
+  {"save-cache",         required_argument, NULL, OPT_SAVE_CACHE},
+  {"cache-type",         required_argument, NULL, OPT_CACHE_TYPE},
+  {"show-params",        no_argument,       NULL, OPT_SHOW_PARAMS},
+  {"mmap-fb",            optional_argument, NULL, OPT_MMAP_FB},
+  {"max-memory",         required_argument, NULL, OPT_MAX_MEMORY},
+  {"time-budget",        required_argument, NULL, OPT_TIME_BUDGET},
+  {"channel",            required_argument, NULL, OPT_CHANNEL},
+  {"separate-channels",  no_argument,       NULL, OPT_SEPARATE},
+  {"no-draw-freq-line",  no_argument,       NULL, 'F'},
+  {"no-draw-time-line",  no_argument,       NULL, 'T'},
+  {"verbose",            no_argument,       NULL, 'v'},
+  {"profile",            optional_argument, NULL, OPT_PROFILE},
+  {"version",            no_argument,       NULL, OPT_VERSION},
+  {"help",               no_argument,       NULL, 'h'},
+  {NULL,                 0,                 NULL, 0},
+};
+
+static const struct option wavelet_opts[] = {
+  {"output",             required_argument, NULL, 'o'},
+  {"preset",             required_argument, NULL, 'p'},
+  {"amplitude-mode",     no_argument,       NULL, 'a'},
+  {"sigma",              required_argument, NULL, 's'},
+  {"gabor-threshold",    required_argument, NULL, 't'},
+  {"unit-time",          required_argument, NULL, 'u'},
+  {"output-width",       required_argument, NULL, 'W'},
+  {"frequency-range",    required_argument, NULL, 'r'},
+  {"floor-gain",         required_argument, NULL, OPT_FLOOR_GAIN},
+  {"ceil-gain",          required_argument, NULL, OPT_CEIL_GAIN},
+  {"luminance",          required_argument, NULL, OPT_LUMINANCE},
+  {"colormap",           required_argument, NULL, OPT_COLORMAP},
+  {"frequency-grid",     required_argument, NULL, 'g'},
+  {"scale-mode",         required_argument, NULL, 'm'},
+  {"col-steps",          required_argument, NULL, 'c'},
+  {"save-cache",         required_argument, NULL, OPT_SAVE_CACHE},
+  {"cache-type",         required_argument, NULL, OPT_CACHE_TYPE},
+  {"show-params",        no_argument,       NULL, OPT_SHOW_PARAMS},
+  {"mmap-fb",            optional_argument, NULL, OPT_MMAP_FB},
+  {"max-memory",         required_argument, NULL, OPT_MAX_MEMORY},
+  {"time-budget",        required_argument, NULL, OPT_TIME_BUDGET},
+  {"channel",            required_argument, NULL, OPT_CHANNEL},
+  {"separate-channels",  no_argument,       NULL, OPT_SEPARATE},
+  {"no-draw-freq-line",  no_argument,       NULL, 'F'},
+  {"no-draw-time-line",  no_argument,       NULL, 'T'},
+  {"verbose",            no_argument,       NULL, 'v'},
+  {"profile",            optional_argument, NULL, OPT_PROFILE},
+  {"version",            no_argument,       NULL, OPT_VERSION},
+  {"help",               no_argument,       NULL, 'h'},
+  {NULL,                 0,                 NULL, 0},
+};
+
+static void
+error(const char* fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  fprintf(stderr, "error: ");
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+
+  exit(1);
+}
+
+static int
+lookup(const char* str, const char** tbl, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (strcasecmp(str, tbl[i]) == 0) return i;
+  }
+
+  return -1;
+}
+
+static void
+parse_pair(const char* str, double* a, double* b, const char* what)
+{
+  char* p;
+
+  *a = strtod(str, &p);
+  if (p == str || *p != ',') error("invalid %s.", what);
+
+  str = p + 1;
+  *b  = strtod(str, &p);
+  if (p == str || *p != '\0') error("invalid %s.", what);
+}
+
+static int
+parse_int(const char* str, const char* what)
+{
+  char* p;
+  long ret;
+
+  ret = strtol(str, &p, 10);
+  if (p == str || *p != '\0') error("invalid %s.", what);
+
+  return (int)ret;
+}
+
+static double
+parse_double(const char* str, const char* what)
+{
+  char* p;
+  double ret;
+
+  ret = strtod(str, &p);
+  if (p == str || *p != '\0') error("invalid %s.", what);
+
+  return ret;
+}
+
+/*
+ * "512M"や"2G"などのバイト数 (接尾辞は1024の累乗)
+ */
+static size_t
+parse_size(const char* str, const char* what)
+{
+  char* p;
+  double ret;
+
+  ret = strtod(str, &p);
+  if (p == str || ret <= 0.0) error("invalid %s.", what);
+
+  switch (*p) {
+  case 'k': case 'K': ret *= 1024.0; p++; break;
+  case 'm': case 'M': ret *= 1024.0 * 1024.0; p++; break;
+  case 'g': case 'G': ret *= 1024.0 * 1024.0 * 1024.0; p++; break;
+  }
+
+  if (*p == 'i' || *p == 'I') p++;
+  if (*p == 'b' || *p == 'B') p++;
+  if (*p != '\0') error("invalid %s.", what);
+
+  return (size_t)ret;
+}
+
+static void
+parse_channels(render_param_t* prm, const char* str)
+{
+  const char* p;
+  char* e;
+  long ch;
+  int i;
+
+  if (strcasecmp(str, "all") == 0) {
+    prm->nch = 0;
+
+  } else if (strcasecmp(str, "mix") == 0) {
+    prm->nch   = 1;
+    prm->ch[0] = SMPL_DOWNMIX;
+
+  } else {
+    prm->nch = 0;
+    p        = str;
+
+    while (1) {
+      ch = strtol(p, &e, 10);
+      if (e == p || ch < 0 || (*e != ',' && *e != '\0')) {
+        error("invalid channel list.");
+      }
+
+      for (i = 0; i < prm->nch; i++) {
+        if (prm->ch[i] == ch) break;
+      }
+
+      if (i == prm->nch) {
+        if (prm->nch >= RENDER_MAX_CHANNELS) error("invalid channel list.");
+        prm->ch[prm->nch++] = (int)ch;
+      }
+
+      if (*e == '\0') break;
+      p = e + 1;
+    }
+  }
+}
+
+static void
+apply_preset(render_param_t* prm, const preset_t* ps)
+{
+  prm->unit_time = ps->unit_time;
+  prm->fft_size  = ps->fft_size;
+  prm->window    = FFT_WINDOW_FLAT_TOP;
+  prm->sigma     = ps->sigma;
+  prm->threshold = ps->threshold;
+  prm->width     = ps->width;
+  prm->fq_l      = ps->fq_l;
+  prm->fq_h      = ps->fq_h;
+  prm->scale     = RENDER_LOGSCALE_MODE;
+  prm->mode      = RENDER_MODE_POWER;
+  prm->ceil      = -10.0;
+  prm->floor     = -90.0;
+  prm->lumi      = 3.5;
+  prm->step      = 1;
+}
+
+static void
+show_params(render_param_t* prm)
+{
+  char range[64];
+
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    printf("FFT size        %20d entries\n", prm->fft_size);
+    printf("unit time       %20d msec\n", prm->unit_time);
+    printf("window function %20s\n", window_names[prm->window]);
+
+  } else {
+    printf("sigma           %20f\n", prm->sigma);
+    printf("unit time       %20d msec\n", prm->unit_time);
+  }
+
+  printf("scale mode      %20s\n",
+         (prm->scale == RENDER_LOGSCALE_MODE)? "LOGSCALE": "LINEARSCALE");
+  snprintf(range, sizeof(range), "%.0f - %.0f", prm->fq_l, prm->fq_h);
+  printf("frequency range %20s Hz\n", range);
+  printf("column steps    %20d pixels\n", prm->step);
+}
+
+static void
+usage(FILE* fp, const char* prog, int analyzer)
+{
+  fprintf(fp, "Usage: %s [options] WAV-FILE\n", prog);
+  fprintf(fp, "    -o, --output=FILE\n");
+  fprintf(fp, "    -p, --preset=NAME\n");
+  fprintf(fp, "    -a, --amplitude-mode\n");
+
+  if (analyzer == RENDER_ANALYZER_FFT) {
+    fprintf(fp, "    -f, --fft-size=SIZE\n");
+    fprintf(fp, "    -u, --unit-time=MSEC\n");
+    fprintf(fp, "    -W, --output-width=SIZE\n");
+    fprintf(fp, "    -w, --window-function=FUNCTION\n");
+
+  } else {
+    fprintf(fp, "    -s, --sigma=NUMBER\n");
+    fprintf(fp, "    -t, --gabor-threshold=NUMBER\n");
+    fprintf(fp, "    -u, --unit-time=CENTISECOND\n");
+    fprintf(fp, "    -W, --output-width=SIZE\n");
+  }
+
+  fprintf(fp, "    -r, --frequency-range=LO,HI\n");
+  fprintf(fp, "        --floor-gain=DB\n");
+  fprintf(fp, "        --ceil-gain=DB\n");
+  fprintf(fp, "        --luminance=NUM\n");
+  fprintf(fp, "        --colormap=NAME\n");
+  fprintf(fp, "    -g, --frequency-grid=BASIS,STEP\n");
+  fprintf(fp, "    -m, --scale-mode=MODE\n");
+  fprintf(fp, "    -c, --col-steps=SIZE\n");
+  fprintf(fp, "        --save-cache=FILE\n");
+  fprintf(fp, "        --cache-type=TYPE\n");
+  fprintf(fp, "        --show-params\n");
+  fprintf(fp, "        --mmap-fb[=FILE]\n");
+  fprintf(fp, "        --max-memory=SIZE\n");
+  fprintf(fp, "        --time-budget=SEC\n");
+  fprintf(fp, "        --channel=LIST\n");
+  fprintf(fp, "        --separate-channels\n");
+  fprintf(fp, "    -F, --no-draw-freq-line\n");
+  fprintf(fp, "    -T, --no-draw-time-line\n");
+  fprintf(fp, "    -v, --verbose\n");
+  fprintf(fp, "        --profile[=JSON-FILE]\n");
+}
+
+static void
+print_input(const char* path, wavmap_t* wav)
+{
+  fprintf(stderr, "- input data\n");
+  fprintf(stderr, "  %s\n", path);
+  fprintf(stderr, "    data size:   %zu\n", wav->data_size);
+  fprintf(stderr, "    channel num: %d\n", wav->channel_num);
+  fprintf(stderr, "    sample rate: %d Hz\n", wav->sample_rate);
+  fprintf(stderr, "    sample size: %d bits\n", wav->sample_size);
+  fprintf(stderr, "    data rate:   %d bytes/sec\n", wav->bytes_per_sec);
+  fprintf(stderr, "\n");
+}
+
+static void
+print_output(render_param_t* prm, render_result_t* res)
+{
+  int i;
+
+  if (prm->analyzer == RENDER_ANALYZER_FFT) {
+    fprintf(stderr, "- FFT parameter\n");
+    fprintf(stderr, "    FFT size:    %d samples\n", prm->fft_size);
+    fprintf(stderr, "    unit time:   %d cs\n", prm->unit_time);
+    fprintf(stderr, "    window func: %s\n", window_names[prm->window]);
+
+  } else {
+    fprintf(stderr, "- WAVELET parameter\n");
+    fprintf(stderr, "    sigma:           %g\n", prm->sigma);
+    fprintf(stderr, "    gabor threshold: %g\n", prm->threshold);
+    fprintf(stderr, "    unit time:       %d ms\n", prm->unit_time);
+  }
+
+  fprintf(stderr, "\n");
+  fprintf(stderr, "- OUTPUT\n");
+  fprintf(stderr, "    width:       %dpx\n", res->width);
+  fprintf(stderr, "    height:      %dpx\n", res->height);
+  fprintf(stderr, "    freq range:  %g - %gHz\n", prm->fq_l, prm->fq_h);
+  fprintf(stderr, "    scale mode:  %s\n",
+          (prm->scale == RENDER_LOGSCALE_MODE)? "LOGSCALE": "LINEARSCALE");
+  fprintf(stderr, "    plot mode :  %s\n",
+          (prm->mode == RENDER_MODE_POWER)? "POWER": "AMPLITUDE");
+  fprintf(stderr, "    ceil:        %g\n", prm->ceil);
+  fprintf(stderr, "    floor:       %g\n", prm->floor);
+  fprintf(stderr, "    colormap:    %s\n", colormap_names[prm->cmap]);
+  fprintf(stderr, "    columns:     %zu\n", res->columns);
+  fprintf(stderr, "\n");
+
+  for (i = 0; i < res->nout; i++) {
+    fprintf(stderr, "write to %s ... done\n", res->out[i]);
+  }
+}
+
+static void
+print_ns(uint64_t ns)
+{
+  if (ns > 0) {
+    printf(" %12.1f", (double)ns / 1000.0);
+  } else {
+    printf(" %12s", "-");
+  }
+}
+
+/*
+ * rdft()の実行方法をサイズ毎に計測し直し、wisdomファイルに保存する
+ *   (サイズを省略した場合はプリセットで使うサイズを対象にする)
+ */
+static int
+fft_plan(int argc, char* argv[])
+{
+  fftplan_wisdom_t ent;
+  const char* path;
+  int n;
+  int i;
+  int j;
+
+  if (argc > 1 && (strcmp(argv[1], "-h") == 0 ||
+                   strcmp(argv[1], "--help") == 0)) {
+    printf("Usage: wavspa fft-plan [SIZE...]\n");
+    return 0;
+  }
+
+  printf("%10s %-8s %12s %12s %12s\n",
+         "size", "plan", "single(us)", "thread2(us)", "thread4(us)");
+
+  for (i = 0; i < ((argc > 1)? argc - 1: (int)N(fft_presets)); i++) {
+    if (argc > 1) {
+      n = parse_int(argv[i + 1], "FFT size");
+
+    } else {
+      n = fft_presets[i].fft_size;
+
+      for (j = 0; j < i; j++) {
+        if (fft_presets[j].fft_size == n) break;
+      }
+
+      if (j < i) continue;
+    }
+
+    if (fftplan_measure(n, &ent)) error("invalid FFT size %d.", n);
+
+    printf("%10d %-8s", ent.n, fftplan_name(ent.plan));
+    print_ns(ent.ns[FFTPLAN_SINGLE]);
+    print_ns(ent.ns[FFTPLAN_THREAD2]);
+    print_ns(ent.ns[FFTPLAN_THREAD4]);
+    printf("\n");
+  }
+
+  path = fftplan_wisdom_path();
+  if (path != NULL) {
+    printf("\nsaved to %s\n", path);
+  } else {
+    printf("\nnot saved (WAVSPA_FFT_WISDOM is empty)\n");
+  }
+
+  return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+  render_param_t prm;
+  render_result_t res;
+  render_profile_t prof;
+  render_estimate_t est;
+  plan_t plan;
+  double budget;
+  const preset_t* presets;
+  int npreset;
+  const struct option* opts;
+  const char* optstr;
+  const char* prog;
+  char* output;
+  char* input;
+  char* base;
+  char* ext;
+  int verbose;
+  char* prof_path;
+  FILE* fp;
+  int show;
+  int analyzer;
+  int c;
+  int i;
+  int err;
+  wavmap_t* wav;
+
+  /*
+   * 解析器の選択
+   *   (wavfft/wavletという名前で起動した場合はサブコマンドを省略できる)
+   */
+  prog = basename(argv[0]);
+
+  if (strcmp(prog, "wavfft") == 0) {
+    analyzer = RENDER_ANALYZER_FFT;
+
+  } else if (strcmp(prog, "wavlet") == 0) {
+    analyzer = RENDER_ANALYZER_WAVELET;
+
+  } else if (argc > 1 && strcmp(argv[1], "fft") == 0) {
+    analyzer = RENDER_ANALYZER_FFT;
+    argv++; argc--;
+
+  } else if (argc > 1 &&
+             (strcmp(argv[1], "wavelet") == 0 || strcmp(argv[1], "wavlet") == 0)) {
+    analyzer = RENDER_ANALYZER_WAVELET;
+    argv++; argc--;
+
+  } else if (argc > 1 && strcmp(argv[1], "fft-plan") == 0) {
+    return fft_plan(argc - 1, argv + 1);
+
+  } else if (argc > 1 && strcmp(argv[1], "--version") == 0) {
+    printf("wavspa %s\n", wavspa_version());
+    return 0;
+
+  } else {
+    fprintf(stderr, "Usage: %s {fft|wavelet} [options] WAV-FILE\n", prog);
+    fprintf(stderr, "       %s fft-plan [SIZE...]\n", prog);
+    return 1;
+  }
+
+  if (analyzer == RENDER_ANALYZER_FFT) {
+    presets = fft_presets;
+    npreset = N(fft_presets);
+    opts    = fft_opts;
+    optstr  = "o:p:af:u:W:w:r:g:m:c:FTvh";
+
+  } else {
+    presets = wavelet_presets;
+    npreset = N(wavelet_presets);
+    opts    = wavelet_opts;
+    optstr  = "o:p:as:t:u:W:r:g:m:c:FTvh";
+  }
+
+  /*
+   * デフォルトパラメータのセット
+   */
+  memset(&prm, 0, sizeof(prm));
+
+  apply_preset(&prm, presets);
+
+  prm.analyzer    = analyzer;
+  prm.cmap        = CMAP_GREEN;
+  prm.basis       = 440.0;
+  prm.grid        = 0.0;
+  prm.freq_line   = !0;
+  prm.time_line   = !0;
+  prm.cache_type  = SPC_TYPE_FLOAT32;
+  prm.png_threads = 0;
+  prm.png_level   = 6;
+
+  output    = NULL;
+  verbose   = 0;
+  prof_path = NULL;
+  show      = 0;
+  budget    = 0.0;
+
+  /*
+   * コマンドラインオプションのパース
+   */
+  while ((c = getopt_long(argc, argv, optstr, opts, NULL)) != -1) {
+    switch (c) {
+    case 'o':
+      output = optarg;
+      break;
+
+    case 'p':
+      if (strcasecmp(optarg, "help") == 0) {
+        for (i = 0; i < npreset; i++) printf("    %s\n", presets[i].name);
+        return 0;
+      }
+
+      for (i = 0; i < npreset; i++) {
+        if (strcasecmp(optarg, presets[i].name) == 0) break;
+      }
+
+      if (i == npreset) error("unknown preset name.");
+      apply_preset(&prm, presets + i);
+      break;
+
+    case 'a':
+      prm.mode = RENDER_MODE_AMPLITUDE;
+      break;
+
+    case 'f':
+      prm.fft_size = parse_int(optarg, "fft size");
+      break;
+
+    case 's':
+      prm.sigma = parse_double(optarg, "sigma");
+      break;
+
+    case 't':
+      prm.threshold = parse_double(optarg, "gabor threshold");
+      break;
+
+    case 'u':
+      prm.unit_time = parse_int(optarg, "unit time");
+      if (analyzer == RENDER_ANALYZER_WAVELET) prm.unit_time *= 10;
+      break;
+
+    case 'W':
+      prm.width = parse_int(optarg, "output width");
+      break;
+
+    case 'w':
+      if (strcasecmp(optarg, "help") == 0) {
+        for (i = 0; i < (int)N(window_names); i++) {
+          printf("    %s\n", window_names[i]);
+        }
+        return 0;
+      }
+
+      prm.window = lookup(optarg, window_names, N(window_names));
+      if (prm.window < 0) error("unknown windows function.");
+      break;
+
+    case 'r':
+      parse_pair(optarg, &prm.fq_l, &prm.fq_h, "frequency range");
+      break;
+
+    case OPT_FLOOR_GAIN:
+      prm.floor = parse_double(optarg, "floor gain");
+      break;
+
+    case OPT_CEIL_GAIN:
+      prm.ceil = parse_double(optarg, "ceil gain");
+      break;
+
+    case OPT_LUMINANCE:
+      prm.lumi = parse_double(optarg, "luminance");
+      break;
+
+    case OPT_COLORMAP:
+      prm.cmap = lookup(optarg, colormap_names, N(colormap_names));
+      if (prm.cmap < 0) error("unknown colormap.");
+      break;
+
+    case 'g':
+      parse_pair(optarg, &prm.basis, &prm.grid, "frequency grid");
+      break;
+
+    case 'm':
+      if (strcasecmp(optarg, "LOGSCALE") == 0) {
+        prm.scale = RENDER_LOGSCALE_MODE;
+
+      } else if (strcasecmp(optarg, "LINEARSCALE") == 0) {
+        prm.scale = RENDER_LINEARSCALE_MODE;
+
+      } else {
+        error("unknown scale mode.");
+      }
+      break;
+
+    case 'c':
+      prm.step = parse_int(optarg, "column steps");
+      if (prm.step < 1) error("invalid column steps.");
+      break;
+
+    case OPT_SAVE_CACHE:
+      prm.cache_path = optarg;
+      break;
+
+    case OPT_CACHE_TYPE:
+      if (strcasecmp(optarg, "FLOAT32") == 0) {
+        prm.cache_type = SPC_TYPE_FLOAT32;
+
+      } else if (strcasecmp(optarg, "FLOAT16") == 0) {
+        prm.cache_type = SPC_TYPE_FLOAT16;
+
+      } else {
+        error("unknown cache type.");
+      }
+      break;
+
+    case OPT_SHOW_PARAMS:
+      show = !0;
+      break;
+
+    case OPT_MMAP_FB:
+      prm.fb_mmap      = !0;
+      prm.fb_mmap_path = optarg;
+      break;
+
+    case OPT_MAX_MEMORY:
+      prm.max_memory = parse_size(optarg, "memory size");
+      break;
+
+    case OPT_TIME_BUDGET:
+      budget = parse_double(optarg, "time budget");
+      if (budget <= 0.0) error("invalid time budget.");
+      break;
+
+    case OPT_CHANNEL:
+      parse_channels(&prm, optarg);
+      break;
+
+    case OPT_SEPARATE:
+      prm.separate = !0;
+      break;
+
+    case 'F':
+      prm.freq_line = 0;
+      break;
+
+    case 'T':
+      prm.time_line = 0;
+      break;
+
+    case 'v':
+      verbose = !0;
+      break;
+
+    case OPT_PROFILE:
+      prm.profile = &prof;
+      prof_path   = optarg;
+      break;
+
+    case OPT_VERSION:
+      printf("wavspa %s\n", wavspa_version());
+      return 0;
+
+    case 'h':
+      usage(stdout, prog, analyzer);
+      return 0;
+
+    default:
+      usage(stderr, prog, analyzer);
+      return 1;
+    }
+  }
+
+  if (show) {
+    show_params(&prm);
+    return 0;
+  }
+
+  if (prm.grid == 0.0) {
+    prm.grid = (prm.scale == RENDER_LOGSCALE_MODE)? 2.0: 2000.0;
+  }
+
+  if (prm.scale == RENDER_LOGSCALE_MODE) {
+    if (prm.basis <= 1.0 || prm.grid <= 1.0) error("illeagal frequency grid.");
+  } else {
+    if (prm.basis <= 0.0 || prm.grid <= 0.0) error("illeagal frequency grid.");
+  }
+
+  if (prm.fq_l <= 0.0 || prm.fq_h <= prm.fq_l) {
+    error("invalid frequency range.");
+  }
+
+  if (optind >= argc) error("target file not specified.");
+  input = argv[optind];
+
+  /*
+   * 出力ファイル名の省略時は入力ファイル名の拡張子を差し替える
+   */
+  if (output == NULL) {
+    base   = basename(strdup(input));
+    ext    = strrchr(base, '.');
+    if (ext != NULL && strcmp(ext, ".wav") == 0) *ext = '\0';
+
+    output = malloc(strlen(base) + 5);
+    if (output == NULL) error("out of memory.");
+    sprintf(output, "%s.png", base);
+  }
+
+  /*
+   * 実行
+   */
+  err = wavmap_open(input, &wav);
+  if (err) error("wavmap_open() failed. [err = %d]", err);
+
+  for (i = 0; i < prm.nch; i++) {
+    if (prm.ch[i] >= wav->channel_num) {
+      error("channel %d is not exist.", prm.ch[i]);
+    }
+  }
+
+  if (verbose) print_input(input, wav);
+
+  /*
+   * 処理時間の予測 (予算に収まらない場合は分解能を満たす最も速い構成に
+   * 切り替える)
+   */
+  if (budget > 0.0) {
+    err = plan_build(&prm, wav, budget, &plan);
+    if (err) error("plan_build() failed. [err = %d]", err);
+
+    if (verbose) plan_print(stderr, &plan);
+
+    if (plan.chosen < 0) {
+      error("no configuration fits --time-budget (%.1f s predicted for "
+            "the requested one).", plan.ent[0].sec);
+    }
+
+    prm = plan.ent[plan.chosen].prm;
+  }
+
+  /*
+   * メモリ使用量の見積もり (予算を超える場合は変換の前に打ち切る)
+   */
+  err = render_estimate(&prm, wav, &est);
+  if (verbose && (!err || err == RENDER_OVER_BUDGET)) {
+    render_estimate_print(stderr, &prm, &est);
+  }
+
+  if (err == RENDER_OVER_BUDGET) {
+    error("estimated memory usage (%.1f MiB) exceeds --max-memory.",
+          est.total / (1024.0 * 1024.0));
+  }
+
+  if (err) error("render_estimate() failed. [err = %d]", err);
+
+  err = render_run(&prm, wav, output, &res);
+  if (err) error("render_run() failed. [err = %d]", err);
+
+  if (verbose) print_output(&prm, &res);
+
+  if (prm.profile != NULL) {
+    render_profile_print(stderr, &prof);
+
+    if (prof_path != NULL) {
+      fp = fopen(prof_path, "w");
+      if (fp == NULL) error("can't open %s.", prof_path);
+
+      render_profile_print_json(fp, &prof);
+      fclose(fp);
+    }
+  }
+
+  render_result_free(&res);
+  wavmap_close(wav);
+
+  return 0;
+}
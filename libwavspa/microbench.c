@@ -0,0 +1,885 @@
+﻿/*
+ * Microbenchmark for the native kernels
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "wavspa.h"
+#include "perfctr.h"
+#include "clock.h"
+
+#define N(x)                        (sizeof((x))/sizeof(*(x)))
+#define NALLOC(t,n)                 ((t*)calloc((n), sizeof(t)))
+
+#define ERR                         __LINE__
+
+#define MAX_SIZES                   4
+#define MAX_FILTERS                 16
+
+#define DEFAULT_WARMUP              3
+#define DEFAULT_REPEAT              20
+
+/*
+ * コールドキャッシュ計測時に各反復の前に書き換えるバッファのサイズ
+ *   (LLCより十分大きいこと)
+ */
+#define FLUSH_SIZE                  (64 * 1024 * 1024)
+
+#define MODE_HOT                    0x01
+#define MODE_COLD                   0x02
+
+extern void rdft(int, int, double *, int *, double *);
+
+/*
+ * カーネル毎の作業領域
+ */
+typedef struct {
+  int size;
+  size_t elems;       // as "number of elements per run"
+
+  int fmt;
+  uint8_t* src;
+  double* dst;
+
+  double* a;
+  double* a0;         // as "rdft() input (restored before each run)"
+  int* ip;
+  double* w;
+
+  fft_t* fft;
+  walet_t* wl;
+  size_t pos;
+
+  uint8_t* pix;
+  int pw;
+  int ph;
+  char str[64];
+} bench_t;
+
+typedef struct {
+  const char* name;
+  const char* unit;
+  int sizes[MAX_SIZES];   // 0で終端
+  const char* size_unit;
+
+  int (*setup)(bench_t* b);
+  void (*prepare)(bench_t* b);      // 計測対象外 (NULL可)
+  int (*run)(bench_t* b);
+} kernel_t;
+
+typedef struct {
+  double median;
+  double p95;
+  double min;
+  double mean;
+  uint64_t ctr[PERFCTR_NUM];
+} result_t;
+
+static int warmup    = DEFAULT_WARMUP;
+static int repeat    = DEFAULT_REPEAT;
+static int modes     = MODE_HOT | MODE_COLD;
+static char* json_path = NULL;
+
+static const char* kernel_filter[MAX_FILTERS];
+static int nkernel_filter = 0;
+static int size_filter[MAX_FILTERS];
+static int nsize_filter = 0;
+
+static uint8_t* flush_buf = NULL;
+static perfctr_t perf;
+
+static void
+error(const char* fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  fprintf(stderr, "error: ");
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+
+  exit(1);
+}
+
+/*
+ * 再現性のためrand()は使わずに固定シードのxorshiftで入力を作る
+ */
+static uint32_t
+xorshift(uint32_t* s)
+{
+  uint32_t x;
+
+  x   = *s;
+  x  ^= x << 13;
+  x  ^= x >> 17;
+  x  ^= x << 5;
+  *s  = x;
+
+  return x;
+}
+
+static void
+fill_random(uint8_t* p, size_t n)
+{
+  uint32_t s;
+  size_t i;
+
+  s = 0x2545f491;
+
+  for (i = 0; i < n; i++) {
+    p[i] = (uint8_t)(xorshift(&s) >> 24);
+  }
+}
+
+static void
+fill_noise(double* p, size_t n)
+{
+  uint32_t s;
+  size_t i;
+
+  s = 0x9e3779b9;
+
+  for (i = 0; i < n; i++) {
+    p[i] = ((double)xorshift(&s) / 2147483648.0) - 1.0;
+  }
+}
+
+static void
+flush_cache()
+{
+  size_t i;
+  volatile uint8_t* p;
+
+  p = flush_buf;
+
+  for (i = 0; i < FLUSH_SIZE; i += 64) {
+    p[i]++;
+  }
+}
+
+static void
+bench_release(bench_t* b)
+{
+  if (b->src != NULL) free(b->src);
+  if (b->dst != NULL) free(b->dst);
+  if (b->a != NULL) free(b->a);
+  if (b->a0 != NULL) free(b->a0);
+  if (b->ip != NULL) free(b->ip);
+  if (b->w != NULL) free(b->w);
+  if (b->fft != NULL) fft_destroy(b->fft);
+  if (b->wl != NULL) walet_destroy(b->wl);
+  if (b->pix != NULL) free(b->pix);
+}
+
+/*
+ * import_s16le / import_s24le (size: サンプル数)
+ */
+static int
+setup_import(bench_t* b, char* fmt)
+{
+  b->fmt   = smpl_parse_format(fmt);
+  b->elems = b->size;
+  b->src   = NALLOC(uint8_t, (size_t)b->size * SMPL_SIZE(b->fmt));
+  b->dst   = NALLOC(double, b->size);
+
+  if (b->src == NULL || b->dst == NULL) return ERR;
+
+  fill_random(b->src, (size_t)b->size * SMPL_SIZE(b->fmt));
+
+  return 0;
+}
+
+static int
+setup_import_s16le(bench_t* b)
+{
+  return setup_import(b, "s16le");
+}
+
+static int
+setup_import_s24le(bench_t* b)
+{
+  return setup_import(b, "s24le");
+}
+
+static int
+run_import(bench_t* b)
+{
+  smpl_import(b->fmt, b->dst, b->src, b->size);
+
+  return 0;
+}
+
+/*
+ * rdft (size: FFTサイズ)
+ *   rdft()はin-placeで値が発散していくので、毎回同じ入力に戻す
+ */
+static int
+setup_rdft(bench_t* b)
+{
+  b->elems = b->size;
+  b->a     = NALLOC(double, b->size);
+  b->a0    = NALLOC(double, b->size);
+  b->ip    = NALLOC(int, 2 + (int)sqrt(b->size / 2));
+  b->w     = NALLOC(double, b->size / 2);
+
+  if (b->a == NULL || b->a0 == NULL || b->ip == NULL || b->w == NULL) {
+    return ERR;
+  }
+
+  fill_noise(b->a0, b->size);
+
+  b->ip[0] = 0;
+  rdft(b->size, 1, b->a, b->ip, b->w);
+
+  return 0;
+}
+
+static void
+prepare_rdft(bench_t* b)
+{
+  memcpy(b->a, b->a0, sizeof(double) * b->size);
+}
+
+static int
+run_rdft(bench_t* b)
+{
+  rdft(b->size, 1, b->a, b->ip, b->w);
+
+  return 0;
+}
+
+/*
+ * window / fft_transform / log_mapping (size: FFTサイズ)
+ *   出力幅はプリセット(lib/wavspa/wavfft/preset.rb)に合わせる
+ */
+static int
+preset_width(int size)
+{
+  int ret;
+
+  switch (size) {
+  case 16384:
+    ret = 240;
+    break;
+
+  case 32768:
+    ret = 480;
+    break;
+
+  default:
+    ret = 640;
+    break;
+  }
+
+  return ret;
+}
+
+static int
+setup_fft(bench_t* b)
+{
+  int ret;
+  uint8_t* pcm;
+
+  ret = 0;
+  pcm = NULL;
+
+  do {
+    if (fft_new("s16le", b->size, &b->fft)) {
+      ret = ERR;
+      break;
+    }
+
+    fft_set_window(b->fft, FFT_WINDOW_FLAT_TOP);
+    fft_set_scale_mode(b->fft, FFT_LOGSCALE_MODE);
+    fft_set_frequency(b->fft, 44100.0, 200.0, 8000.0);
+    fft_set_width(b->fft, preset_width(b->size));
+
+    pcm = NALLOC(uint8_t, (size_t)b->size * 2);
+    if (pcm == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    fill_random(pcm, (size_t)b->size * 2);
+
+    if (fft_shift_in(b->fft, pcm, b->size)) {
+      ret = ERR;
+      break;
+    }
+
+    b->dst = NALLOC(double, b->fft->width);
+    if (b->dst == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    fft_transform(b->fft);
+    b->elems = b->size;
+  } while (0);
+
+  if (pcm != NULL) free(pcm);
+
+  return ret;
+}
+
+/*
+ * 窓関数の乗算はfft_transform()の中にあるので、同じループを
+ * fft_tの作業領域に対して実行する
+ */
+static int
+run_window(bench_t* b)
+{
+  fft_t* fft;
+  int i;
+
+  fft = b->fft;
+
+  for (i = 0; i < fft->capa; i++) {
+    fft->a[i] = fft->data[i] * fft->wtbl[i];
+  }
+
+  return 0;
+}
+
+static int
+run_fft_transform(bench_t* b)
+{
+  return fft_transform(b->fft);
+}
+
+static int
+setup_log_mapping(bench_t* b)
+{
+  int ret;
+
+  ret = setup_fft(b);
+  if (!ret) b->elems = b->fft->width;
+
+  return ret;
+}
+
+static int
+run_log_mapping(bench_t* b)
+{
+  return fft_calc_power(b->fft, b->dst);
+}
+
+/*
+ * gabor (size: サンプリング周波数)
+ *   4秒分のノイズの中央で1カラム分(240 bins)を変換する
+ */
+static int
+setup_gabor(bench_t* b)
+{
+  size_t n;
+  uint8_t* pcm;
+  int ret;
+
+  ret = 0;
+  pcm = NULL;
+  n   = (size_t)b->size * 4;
+
+  do {
+    if (walet_new(&b->wl)) {
+      ret = ERR;
+      break;
+    }
+
+    walet_set_frequency(b->wl, b->size);
+    walet_set_sigma(b->wl, 24.0);
+    walet_set_gabor_threshold(b->wl, 0.01);
+    walet_set_range(b->wl, 200.0, 8000.0);
+    walet_set_scale_mode(b->wl, WALET_LOGSCALE_MODE);
+    walet_set_output_width(b->wl, 240);
+
+    pcm = NALLOC(uint8_t, n * 2);
+    if (pcm == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    fill_random(pcm, n * 2);
+
+    if (walet_put_in(b->wl, "s16le", pcm, n)) {
+      ret = ERR;
+      break;
+    }
+
+    b->pos   = n / 2;
+    b->elems = 240;
+  } while (0);
+
+  if (pcm != NULL) free(pcm);
+
+  return ret;
+}
+
+static int
+run_gabor(bench_t* b)
+{
+  return walet_transform(b->wl, b->pos);
+}
+
+/*
+ * put_string (size: 文字数)
+ */
+static int
+setup_put_string(bench_t* b)
+{
+  int i;
+
+  b->pw    = 640;
+  b->ph    = 480;
+  b->elems = b->size;
+  b->pix   = NALLOC(uint8_t, (size_t)b->pw * b->ph * 3);
+
+  if (b->pix == NULL || b->size >= (int)sizeof(b->str)) return ERR;
+
+  for (i = 0; i < b->size; i++) {
+    b->str[i] = "0123456789 kHz:-"[i % 16];
+  }
+
+  return 0;
+}
+
+static int
+run_put_string(bench_t* b)
+{
+  fbdraw_put_string(b->pix, b->pw * 3, b->pw, b->ph, 100, 8,
+                    b->str, b->size, 255, 255, 255);
+
+  return 0;
+}
+
+static const kernel_t kernels[] = {
+  {"import_s16le", "sample", {4096, 65536, 1048576}, "samples",
+   setup_import_s16le, NULL, run_import},
+  {"import_s24le", "sample", {4096, 65536, 1048576}, "samples",
+   setup_import_s24le, NULL, run_import},
+  {"rdft", "point", {16384, 32768, 131072}, "points",
+   setup_rdft, prepare_rdft, run_rdft},
+  {"window", "point", {16384, 32768, 131072}, "points",
+   setup_fft, NULL, run_window},
+  {"fft_transform", "point", {16384, 32768, 131072}, "points",
+   setup_fft, NULL, run_fft_transform},
+  {"log_mapping", "bin", {16384, 32768, 131072}, "points",
+   setup_log_mapping, NULL, run_log_mapping},
+  {"gabor", "bin", {44100, 96000}, "Hz",
+   setup_gabor, NULL, run_gabor},
+  {"put_string", "char", {8, 32}, "chars",
+   setup_put_string, NULL, run_put_string},
+};
+
+static int
+cmp_double(const void* a, const void* b)
+{
+  double x;
+  double y;
+
+  x = *(const double*)a;
+  y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+static int
+selected(const kernel_t* k, int size)
+{
+  int i;
+  int ret;
+
+  ret = !nkernel_filter;
+  for (i = 0; i < nkernel_filter; i++) {
+    if (!strcmp(kernel_filter[i], k->name)) ret = !0;
+  }
+
+  if (ret && nsize_filter) {
+    ret = 0;
+    for (i = 0; i < nsize_filter; i++) {
+      if (size_filter[i] == size) ret = !0;
+    }
+  }
+
+  return ret;
+}
+
+/*
+ * 1ケースの計測
+ *   ウォームアップ後にrepeat回計測し、各回の所要時間から統計値を求める
+ */
+static int
+measure(const kernel_t* k, bench_t* b, int mode, result_t* res)
+{
+  int ret;
+  int i;
+  int j;
+  double* t;
+  double sum;
+  uint64_t t0;
+  uint64_t ctr[PERFCTR_NUM];
+
+  ret = 0;
+  t   = NALLOC(double, repeat);
+  sum = 0.0;
+
+  for (j = 0; j < PERFCTR_NUM; j++) {
+    res->ctr[j] = (perf.navail)? 0: PERFCTR_NONE;
+  }
+
+  do {
+    if (t == NULL) {
+      ret = ERR;
+      break;
+    }
+
+    for (i = 0; i < warmup; i++) {
+      if (k->prepare) k->prepare(b);
+      if (k->run(b)) {
+        ret = ERR;
+        break;
+      }
+    }
+    if (ret) break;
+
+    for (i = 0; i < repeat; i++) {
+      if (k->prepare) k->prepare(b);
+      if (mode == MODE_COLD) flush_cache();
+
+      if (perf.navail) perfctr_start(&perf);
+      t0 = now_ns();
+
+      if (k->run(b)) {
+        ret = ERR;
+        break;
+      }
+
+      t[i] = (double)(now_ns() - t0);
+      sum += t[i];
+
+      if (perf.navail) {
+        perfctr_stop(&perf, ctr);
+        for (j = 0; j < PERFCTR_NUM; j++) {
+          if (ctr[j] == PERFCTR_NONE) {
+            res->ctr[j] = PERFCTR_NONE;
+          } else if (res->ctr[j] != PERFCTR_NONE) {
+            res->ctr[j] += ctr[j];
+          }
+        }
+      }
+    }
+    if (ret) break;
+
+    qsort(t, repeat, sizeof(*t), cmp_double);
+
+    res->min    = t[0];
+    res->mean   = sum / repeat;
+    res->median = (repeat & 1)?
+                  t[repeat / 2]: (t[repeat / 2 - 1] + t[repeat / 2]) / 2.0;
+    res->p95    = t[(int)ceil(repeat * 0.95) - 1];
+  } while (0);
+
+  if (t != NULL) free(t);
+
+  return ret;
+}
+
+static double
+ipc(result_t* res)
+{
+  uint64_t cyc;
+  uint64_t ins;
+
+  cyc = res->ctr[PERFCTR_CYCLES];
+  ins = res->ctr[PERFCTR_INSTRUCTIONS];
+
+  if (cyc == PERFCTR_NONE || ins == PERFCTR_NONE || cyc == 0) return NAN;
+
+  return (double)ins / cyc;
+}
+
+static void
+print_header()
+{
+  printf("%-14s %9s %-4s %12s %12s %12s %10s %6s\n",
+         "kernel", "size", "mode", "median(us)", "p95(us)", "min(us)",
+         "ns/elem", "IPC");
+}
+
+static void
+print_result(const kernel_t* k, bench_t* b, int mode, result_t* res)
+{
+  double v;
+
+  printf("%-14s %9d %-4s %12.2f %12.2f %12.2f %10.3f",
+         k->name, b->size, (mode == MODE_HOT)? "hot": "cold",
+         res->median / 1000.0, res->p95 / 1000.0, res->min / 1000.0,
+         res->median / b->elems);
+
+  v = ipc(res);
+  if (isnan(v)) {
+    printf(" %6s\n", "-");
+  } else {
+    printf(" %6.2f\n", v);
+  }
+
+  fflush(stdout);
+}
+
+static void
+write_json_result(FILE* fp, const kernel_t* k, bench_t* b, int mode,
+                  result_t* res, int first)
+{
+  int i;
+  int n;
+
+  fprintf(fp, "%s\n    {\"kernel\": \"%s\", \"size\": %d, \"mode\": \"%s\", "
+              "\"unit\": \"%s\", \"elements\": %zu,\n",
+          (first)? "": ",", k->name, b->size,
+          (mode == MODE_HOT)? "hot": "cold", k->unit, b->elems);
+
+  fprintf(fp, "     \"median_ns\": %.1f, \"p95_ns\": %.1f, \"min_ns\": %.1f, "
+              "\"mean_ns\": %.1f, \"ns_per_%s\": %.4f",
+          res->median, res->p95, res->min, res->mean, k->unit,
+          res->median / b->elems);
+
+  if (perf.navail) {
+    fprintf(fp, ",\n     \"counters\": {");
+
+    for (i = 0, n = 0; i < PERFCTR_NUM; i++) {
+      if (res->ctr[i] == PERFCTR_NONE) continue;
+
+      fprintf(fp, "%s\"%s\": %.1f", (n++)? ", ": "", perfctr_name(i),
+              (double)res->ctr[i] / repeat);
+    }
+
+    if (!isnan(ipc(res))) {
+      fprintf(fp, "%s\"ipc\": %.3f", (n)? ", ": "", ipc(res));
+    }
+
+    fprintf(fp, "}");
+  }
+
+  fprintf(fp, "}");
+}
+
+static void
+list_kernels()
+{
+  int i;
+  int j;
+
+  for (i = 0; i < (int)N(kernels); i++) {
+    printf("%-14s ", kernels[i].name);
+
+    for (j = 0; j < MAX_SIZES && kernels[i].sizes[j]; j++) {
+      printf("%s%d", (j)? ",": "", kernels[i].sizes[j]);
+    }
+
+    printf(" %s (per %s)\n", kernels[i].size_unit, kernels[i].unit);
+  }
+}
+
+static void
+usage(FILE* fp, const char* prog)
+{
+  fprintf(fp, "Usage: %s [options]\n", prog);
+  fprintf(fp, "    -k, --kernel=NAME         (repeatable)\n");
+  fprintf(fp, "    -s, --size=SIZE           (repeatable)\n");
+  fprintf(fp, "    -n, --repeat=COUNT        (default %d)\n",
+          DEFAULT_REPEAT);
+  fprintf(fp, "    -w, --warmup=COUNT        (default %d)\n",
+          DEFAULT_WARMUP);
+  fprintf(fp, "        --hot\n");
+  fprintf(fp, "        --cold\n");
+  fprintf(fp, "    -j, --json=FILE\n");
+  fprintf(fp, "    -l, --list\n");
+  fprintf(fp, "    -h, --help\n");
+}
+
+enum {
+  OPT_HOT = 0x100,
+  OPT_COLD,
+};
+
+static const struct option opts[] = {
+  {"kernel",     required_argument, NULL, 'k'},
+  {"size",       required_argument, NULL, 's'},
+  {"repeat",     required_argument, NULL, 'n'},
+  {"warmup",     required_argument, NULL, 'w'},
+  {"hot",        no_argument,       NULL, OPT_HOT},
+  {"cold",       no_argument,       NULL, OPT_COLD},
+  {"json",       required_argument, NULL, 'j'},
+  {"list",       no_argument,       NULL, 'l'},
+  {"help",       no_argument,       NULL, 'h'},
+  {NULL,         0,                 NULL, 0},
+};
+
+static int
+parse_int(const char* str, const char* what, int min)
+{
+  char* p;
+  long ret;
+
+  ret = strtol(str, &p, 10);
+  if (p == str || *p != '\0' || ret < min) error("invalid %s.", what);
+
+  return (int)ret;
+}
+
+static void
+parse_args(int argc, char* argv[])
+{
+  int c;
+  int i;
+  int mask;
+
+  mask = 0;
+
+  while ((c = getopt_long(argc, argv, "k:s:n:w:j:lh", opts, NULL)) != -1) {
+    switch (c) {
+    case 'k':
+      for (i = 0; i < (int)N(kernels); i++) {
+        if (!strcmp(optarg, kernels[i].name)) break;
+      }
+
+      if (i == N(kernels)) error("unknown kernel \"%s\".", optarg);
+      if (nkernel_filter >= MAX_FILTERS) error("too many kernels.");
+
+      kernel_filter[nkernel_filter++] = optarg;
+      break;
+
+    case 's':
+      if (nsize_filter >= MAX_FILTERS) error("too many sizes.");
+      size_filter[nsize_filter++] = parse_int(optarg, "size", 1);
+      break;
+
+    case 'n':
+      repeat = parse_int(optarg, "repeat count", 1);
+      break;
+
+    case 'w':
+      warmup = parse_int(optarg, "warm-up count", 0);
+      break;
+
+    case OPT_HOT:
+      mask |= MODE_HOT;
+      break;
+
+    case OPT_COLD:
+      mask |= MODE_COLD;
+      break;
+
+    case 'j':
+      json_path = optarg;
+      break;
+
+    case 'l':
+      list_kernels();
+      exit(0);
+
+    case 'h':
+      usage(stdout, argv[0]);
+      exit(0);
+
+    default:
+      usage(stderr, argv[0]);
+      exit(1);
+    }
+  }
+
+  if (optind < argc) {
+    usage(stderr, argv[0]);
+    exit(1);
+  }
+
+  if (mask) modes = mask;
+}
+
+int
+main(int argc, char* argv[])
+{
+  int i;
+  int j;
+  int m;
+  int n;
+  const kernel_t* k;
+  bench_t b;
+  result_t res;
+  FILE* fp;
+
+  parse_args(argc, argv);
+
+  fp = NULL;
+  n  = 0;
+
+  if (modes & MODE_COLD) {
+    flush_buf = NALLOC(uint8_t, FLUSH_SIZE);
+    if (flush_buf == NULL) error("memory allocation failed.");
+  }
+
+  if (perfctr_open(&perf) || perf.navail == 0) {
+    fprintf(stderr, "warning: hardware performance counters are "
+                    "unavailable; IPC is not reported.\n");
+  }
+
+  if (json_path != NULL) {
+    fp = fopen(json_path, "w");
+    if (fp == NULL) error("can't open %s.", json_path);
+
+    fprintf(fp, "{\n  \"version\": \"%s\",\n  \"warmup\": %d,\n"
+                "  \"repeat\": %d,\n  \"results\": [",
+            wavspa_version(), warmup, repeat);
+  }
+
+  print_header();
+
+  for (i = 0; i < (int)N(kernels); i++) {
+    k = kernels + i;
+
+    for (j = 0; j < MAX_SIZES && k->sizes[j]; j++) {
+      if (!selected(k, k->sizes[j])) continue;
+
+      memset(&b, 0, sizeof(b));
+      b.size = k->sizes[j];
+
+      if (k->setup(&b)) {
+        bench_release(&b);
+        error("setup failed (%s, %d).", k->name, b.size);
+      }
+
+      for (m = MODE_HOT; m <= MODE_COLD; m <<= 1) {
+        if (!(modes & m)) continue;
+
+        if (measure(k, &b, m, &res)) {
+          bench_release(&b);
+          error("%s failed (size %d).", k->name, b.size);
+        }
+
+        print_result(k, &b, m, &res);
+        if (fp != NULL) write_json_result(fp, k, &b, m, &res, !n++);
+      }
+
+      bench_release(&b);
+    }
+  }
+
+  if (fp != NULL) {
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+  }
+
+  perfctr_close(&perf);
+  if (flush_buf != NULL) free(flush_buf);
+
+  return 0;
+}
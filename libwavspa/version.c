@@ -0,0 +1,13 @@
+﻿/*
+ * WAV file spectrum analyzer library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#include "wavspa.h"
+
+const char*
+wavspa_version(void)
+{
+  return WAVSPA_VERSION;
+}
@@ -0,0 +1,35 @@
+﻿/*
+ * WAV file spectrum analyzer library
+ *
+ *  Copyright (C) 2019 Hiroshi Kuwagata <kgt9221@gmail.com>
+ */
+
+#ifndef __WAVSPA_H__
+#define __WAVSPA_H__
+
+/*
+ * 各コンポーネントのヘッダをまとめて読み込む
+ *   (インストール時は同じディレクトリに配置される)
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+#include "smpl.h"
+#include "wavmap.h"
+#include "fftplan.h"
+#include "fft.h"
+#include "walet.h"
+#include "spc.h"
+#include "fbdraw.h"
+#include "pngenc.h"
+#include "render.h"
+#include "plan.h"
+
+const char* wavspa_version(void);
+
+#ifdef __cplusplus
+}
+#endif /* defined(__cplusplus) */
+
+#endif /* !defined(__WAVSPA_H__) */